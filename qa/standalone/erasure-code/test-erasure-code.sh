@@ -326,6 +326,125 @@ function TEST_chunk_mapping() {
     ceph osd erasure-code-profile rm remap-profile
 }
 
+#
+# Write 4KB pieces of the same object concurrently and check the
+# result. The pieces land in different stripes, so each one is a
+# candidate for a parity delta while the next ones are queued behind
+# it.
+#
+function ec_overwrite_back_to_back() {
+    local dir=$1
+    local poolname=$2
+    local objname=$3
+    local count=$4
+
+    dd if=/dev/zero of=$dir/EXPECTED bs=4096 count=$((count * 4)) 2>/dev/null
+    for i in $(seq 0 $((count - 1))) ; do
+        printf "%4096s" $objname.$i > $dir/PIECE.$i
+        dd if=$dir/PIECE.$i of=$dir/EXPECTED bs=4096 seek=$((i * 4)) \
+            conv=notrunc 2>/dev/null
+    done
+    local pids=""
+    for i in $(seq 0 $((count - 1))) ; do
+        rados --pool $poolname put $objname $dir/PIECE.$i \
+            --offset $((i * 4 * 4096)) &
+        pids+=" $!"
+    done
+    local ret=0
+    for pid in $pids ; do
+        wait $pid || ret=1
+    done
+    test $ret = 0 || return 1
+
+    rados --pool $poolname get $objname $dir/COPY || return 1
+    cmp $dir/EXPECTED $dir/COPY || return 1
+    rm -f $dir/PIECE.* $dir/EXPECTED $dir/COPY
+}
+
+#
+# Create a pool on which a 4KB overwrite is a parity delta (k=4, m=2,
+# one touched chunk) and an object of count stripes in it.
+#
+function create_parity_delta_pool() {
+    local dir=$1
+    local poolname=$2
+    local objname=$3
+    local count=$4
+
+    ceph osd erasure-code-profile set deltaprofile \
+        k=4 m=2 crush-failure-domain=osd || return 1
+    create_pool $poolname 1 1 erasure deltaprofile || return 1
+    ceph osd pool set $poolname allow_ec_overwrites true || return 1
+    wait_for_clean || return 1
+
+    # lay out the object first, the writes are overwrites
+    dd if=/dev/zero of=$dir/ZERO bs=4096 count=$((count * 4)) 2>/dev/null
+    rados --pool $poolname put $objname $dir/ZERO || return 1
+    rm $dir/ZERO
+}
+
+#
+# Return how often the primary of the object logged the pattern.
+#
+function count_primary_log() {
+    local dir=$1
+    local poolname=$2
+    local objname=$3
+    local pattern=$4
+
+    local primary=$(get_primary $poolname $objname)
+    CEPH_ARGS='' ceph --admin-daemon $(get_asok_path osd.$primary) \
+        log flush > /dev/null || return 1
+    grep -c "$pattern" $dir/osd.$primary.log
+}
+
+function TEST_ec_parity_delta_back_to_back() {
+    local dir=$1
+    local poolname=deltapool
+    local count=32
+
+    create_parity_delta_pool $dir $poolname OBJ $count || return 1
+    ceph tell 'osd.*' config set osd_ec_parity_delta_writes true || return 1
+    local before=$(count_primary_log $dir $poolname OBJ \
+        "try_start_parity_delta_read: .*OBJ.* reading shards")
+    ec_overwrite_back_to_back $dir $poolname OBJ $count || return 1
+    local after=$(count_primary_log $dir $poolname OBJ \
+        "try_start_parity_delta_read: .*OBJ.* reading shards")
+    # at least the first write was applied as a parity delta
+    test $after -gt $before || return 1
+
+    ceph tell 'osd.*' config set osd_ec_parity_delta_writes false || return 1
+    delete_pool $poolname
+    ceph osd erasure-code-profile rm deltaprofile
+}
+
+function TEST_ec_parity_delta_read_error() {
+    local dir=$1
+    local poolname=deltapool
+    local count=8
+
+    create_parity_delta_pool $dir $poolname OBJ $count || return 1
+    ceph tell 'osd.*' config set osd_ec_parity_delta_writes true || return 1
+
+    # the writes touch the first data chunk of their stripe, fail the
+    # reads of that shard: the delta reads fall back to stripe reads
+    # while the next writes are queued behind them
+    local -a osds=($(get_osds $poolname OBJ))
+    local type=$(cat $dir/${osds[0]}/type)
+    inject_eio ec data $poolname OBJ $dir 0 || return 1
+    local before=$(count_primary_log $dir $poolname OBJ \
+        "handle_parity_delta_read: .*OBJ.* falling back to rmw")
+    ec_overwrite_back_to_back $dir $poolname OBJ $count || return 1
+    local after=$(count_primary_log $dir $poolname OBJ \
+        "handle_parity_delta_read: .*OBJ.* falling back to rmw")
+    test $after -gt $before || return 1
+
+    set_config osd ${osds[0]} ${type}_debug_inject_read_err false || return 1
+    ceph tell 'osd.*' config set osd_ec_parity_delta_writes false || return 1
+    delete_pool $poolname
+    ceph osd erasure-code-profile rm deltaprofile
+}
+
 main test-erasure-code "$@"
 
 # Local Variables:
@@ -188,6 +188,11 @@ public:
     CephContext* cct, const std::string& path, aio_callback_t cb, void *cbpriv, aio_callback_t d_cb, void *d_cbpriv);
   virtual bool supported_bdev_label() { return true; }
   virtual bool is_rotational() { return rotational; }
+  /// true if bl (or part of it) still sits in a buffer the device reads
+  /// into without copying and wants back; copy it before keeping it around
+  virtual bool is_io_buffer(const ceph::buffer::list& bl) const {
+    return false;
+  }
 
   // HM-SMR-specific calls
   virtual bool is_smr() const { return false; }
@@ -103,6 +103,20 @@ struct io_queue_t {
   virtual int submit_batch(aio_iter begin, aio_iter end, uint16_t aios_size,
 			   void *priv, int *retries) = 0;
   virtual int get_next_completed(int timeout_ms, aio_t **paio, int max) = 0;
+
+  /// get a buffer the queue can do I/O on without per-I/O page pinning,
+  /// or an empty ptr if the queue has none (to spare).  These are a
+  /// scarce resource and must not be held past the I/O.
+  virtual ceph::buffer::ptr get_io_buffer(unsigned len) {
+    return {};
+  }
+  virtual bool has_io_buffers() const {
+    return false;
+  }
+  /// true if any part of bl is backed by a buffer from get_io_buffer()
+  virtual bool is_io_buffer(const ceph::buffer::list& bl) const {
+    return false;
+  }
 };
 
 struct aio_queue_t final : public io_queue_t {
@@ -32,6 +32,7 @@
 #endif
 #include "common/debug.h"
 #include "common/numa.h"
+#include "common/perf_counters.h"
 
 #include "global/global_context.h"
 #include "io_uring.h"
@@ -73,7 +74,13 @@ KernelDevice::KernelDevice(CephContext* cct, aio_callback_t cb, void *cbpriv, ai
   if (use_ioring && ioring_queue_t::supported()) {
     bool use_ioring_hipri = cct->_conf.get_val<bool>("bdev_ioring_hipri");
     bool use_ioring_sqthread_poll = cct->_conf.get_val<bool>("bdev_ioring_sqthread_poll");
-    io_queue = std::make_unique<ioring_queue_t>(iodepth, use_ioring_hipri, use_ioring_sqthread_poll);
+    auto fixed_buffers = cct->_conf.get_val<uint64_t>("bdev_ioring_fixed_buffers");
+    auto fixed_buffer_size = p2roundup<uint64_t>(
+      cct->_conf.get_val<Option::size_t>("bdev_ioring_fixed_buffer_size"),
+      CEPH_PAGE_SIZE);
+    io_queue = std::make_unique<ioring_queue_t>(
+      iodepth, use_ioring_hipri, use_ioring_sqthread_poll,
+      fixed_buffers, fixed_buffer_size);
   } else {
     static bool once;
     if (use_ioring && !once) {
@@ -244,6 +251,23 @@ int KernelDevice::open(const string& p)
   }
   _discard_start();
 
+  if (io_queue->has_io_buffers()) {
+    // BlueFS and BlueStore may open the same path, so key the counters by
+    // device instance as well
+    static std::atomic<unsigned> instance_seq = {0};
+    PerfCountersBuilder b(cct, "bdev-" + std::string(basename(path.c_str())) +
+			  "-" + stringify(instance_seq++),
+			  l_blk_kernel_device_first, l_blk_kernel_device_last);
+    b.add_u64_counter(l_blk_kernel_device_ioring_fixed_read,
+		      "ioring_fixed_read",
+		      "Reads done into registered io_uring buffers");
+    b.add_u64_counter(l_blk_kernel_device_ioring_fixed_fallback,
+		      "ioring_fixed_fallback",
+		      "Reads that found no free registered io_uring buffer");
+    logger = b.create_perf_counters();
+    cct->get_perfcounters_collection()->add(logger);
+  }
+
   // round size down to an even block
   size &= ~(block_size - 1);
 
@@ -291,6 +315,12 @@ void KernelDevice::close()
   _aio_stop();
   _discard_stop();
 
+  if (logger) {
+    cct->get_perfcounters_collection()->remove(logger);
+    delete logger;
+    logger = nullptr;
+  }
+
   if (vdo_fd >= 0) {
     VOID_TEMP_FAILURE_RETRY(::close(vdo_fd));
     vdo_fd = -1;
@@ -609,7 +639,6 @@ void KernelDevice::_aio_thread()
                << " but returned: " << r << dendl;
           ceph_abort_msg("unexpected aio return value: does not match length");
         }
-
         dout(10) << __func__ << " finished aio " << aio[i] << " r " << r
                  << " ioc " << ioc
                  << " with " << (ioc->num_running.load() - 1)
@@ -1092,12 +1121,23 @@ int KernelDevice::aio_read(
     ioc->pending_aios.push_back(aio_t(ioc, fd_directs[WRITE_LIFE_NOT_SET]));
     ++ioc->num_pending;
     aio_t& aio = ioc->pending_aios.back();
-    bufferptr p = ceph::buffer::create_small_page_aligned(len);
-    aio.bl.append(std::move(p));
+    // read into a buffer pre-registered with io_uring if one is free.  It
+    // is handed to the caller as is and goes back to the pool once the
+    // last reference to it is dropped; see is_io_buffer().
+    bufferptr p;
+    if (io_queue->has_io_buffers()) {
+      p = io_queue->get_io_buffer(len);
+      logger->inc(p.have_raw() ? l_blk_kernel_device_ioring_fixed_read :
+		  l_blk_kernel_device_ioring_fixed_fallback);
+    }
+    if (!p.have_raw()) {
+      p = ceph::buffer::create_small_page_aligned(len);
+    }
+    aio.bl.append(p);
     aio.bl.prepare_iov(&aio.iov);
     aio.preadv(off, len);
     dout(30) << aio << dendl;
-    pbl->append(aio.bl);
+    pbl->append(std::move(p));
     dout(5) << __func__ << " 0x" << std::hex << off << "~" << len
 	    << std::dec << " aio " << &aio << dendl;
   } else
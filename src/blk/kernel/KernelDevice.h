@@ -27,6 +27,15 @@
 
 #define RW_IO_MAX (INT_MAX & CEPH_PAGE_MASK)
 
+enum {
+  l_blk_kernel_device_first = 1000,
+  l_blk_kernel_device_ioring_fixed_read,
+  l_blk_kernel_device_ioring_fixed_fallback,
+  l_blk_kernel_device_last,
+};
+
+class PerfCounters;
+
 
 class KernelDevice : public BlockDevice {
   std::vector<int> fd_directs, fd_buffereds;
@@ -46,6 +55,7 @@ class KernelDevice : public BlockDevice {
   ceph::mutex flush_mutex = ceph::make_mutex("KernelDevice::flush_mutex");
 
   std::unique_ptr<io_queue_t> io_queue;
+  PerfCounters *logger = nullptr;
   aio_callback_t discard_callback;
   void *discard_callback_priv;
   bool aio_stop;
@@ -131,6 +141,9 @@ public:
 	   bool buffered) override;
   int aio_read(uint64_t off, uint64_t len, ceph::buffer::list *pbl,
 	       IOContext *ioc) override;
+  bool is_io_buffer(const ceph::buffer::list& bl) const override {
+    return io_queue->is_io_buffer(bl);
+  }
   int read_random(uint64_t off, uint64_t len, char *buf, bool buffered) override;
 
   int write(uint64_t off, ceph::buffer::list& bl, bool buffered, int write_hint = WRITE_LIFE_NOT_SET) override;
@@ -7,6 +7,89 @@
 
 #include "liburing.h"
 #include <sys/epoll.h>
+#include <sys/mman.h>
+
+#include "common/ceph_mutex.h"
+#include "include/buffer_raw.h"
+#include "include/mempool.h"
+
+// A page aligned region carved into equal slots, each registered with the
+// ring by io_uring_register_buffers() so the kernel pins the pages once
+// rather than on every I/O.  Buffers handed out keep a reference to the
+// pool since I/O may still be in flight when the queue shuts down.  The
+// region is accounted to mempool bdev_ioring_buffers.
+struct ioring_buffer_pool {
+  char *base = nullptr;
+  size_t slot_size;
+  unsigned num_slots;
+  ceph::mutex lock = ceph::make_mutex("ioring_buffer_pool::lock");
+  std::vector<unsigned> free_slots;
+
+  ioring_buffer_pool(unsigned n, size_t size)
+    : slot_size(size), num_slots(n) {}
+  ~ioring_buffer_pool() {
+    if (base) {
+      munmap(base, slot_size * num_slots);
+      mempool::get_pool(mempool::mempool_bdev_ioring_buffers).adjust_count(
+	-1, -(ssize_t)(slot_size * num_slots));
+    }
+  }
+
+  int init() {
+    void *p = mmap(nullptr, slot_size * num_slots, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (p == MAP_FAILED) {
+      return -errno;
+    }
+    base = static_cast<char*>(p);
+    mempool::get_pool(mempool::mempool_bdev_ioring_buffers).adjust_count(
+      1, slot_size * num_slots);
+    free_slots.reserve(num_slots);
+    for (unsigned i = num_slots; i > 0; --i) {
+      free_slots.push_back(i - 1);
+    }
+    return 0;
+  }
+
+  /// the registered buffer index covering [p, p+len), if any
+  bool find_slot(const void *p, size_t len, unsigned *slot) const {
+    auto c = static_cast<const char*>(p);
+    if (c < base || c + len > base + slot_size * num_slots) {
+      return false;
+    }
+    *slot = (c - base) / slot_size;
+    return c + len <= base + (*slot + 1) * slot_size;
+  }
+
+  int get() {
+    std::lock_guard l(lock);
+    if (free_slots.empty()) {
+      return -1;
+    }
+    unsigned slot = free_slots.back();
+    free_slots.pop_back();
+    return slot;
+  }
+  void put(unsigned slot) {
+    std::lock_guard l(lock);
+    free_slots.push_back(slot);
+  }
+};
+
+class raw_ioring_fixed : public ceph::buffer::raw {
+  std::shared_ptr<ioring_buffer_pool> pool;
+  unsigned slot;
+public:
+  raw_ioring_fixed(std::shared_ptr<ioring_buffer_pool> p, unsigned s,
+		   unsigned l)
+    : raw(p->base + s * p->slot_size, l), pool(std::move(p)), slot(s) {}
+  ~raw_ioring_fixed() override {
+    pool->put(slot);
+  }
+  raw* clone_empty() override {
+    return ceph::buffer::create_page_aligned(len).release();
+  }
+};
 
 struct ioring_data {
   struct io_uring io_uring;
@@ -14,6 +97,7 @@ struct ioring_data {
   pthread_mutex_t sq_mutex;
   int epoll_fd = -1;
   std::map<int, int> fixed_fds_map;
+  std::shared_ptr<ioring_buffer_pool> buffer_pool;
 };
 
 static int ioring_get_cqe(struct ioring_data *d, unsigned int max,
@@ -54,7 +138,19 @@ static void init_sqe(struct ioring_data *d, struct io_uring_sqe *sqe,
 
   ceph_assert(fixed_fd != -1);
 
-  if (io->iocb.aio_lio_opcode == IO_CMD_PWRITEV)
+  unsigned slot;
+  if (d->buffer_pool && io->iov.size() == 1 &&
+      d->buffer_pool->find_slot(io->iov[0].iov_base, io->iov[0].iov_len,
+				&slot)) {
+    if (io->iocb.aio_lio_opcode == IO_CMD_PWRITEV)
+      io_uring_prep_write_fixed(sqe, fixed_fd, io->iov[0].iov_base,
+				io->iov[0].iov_len, io->offset, slot);
+    else if (io->iocb.aio_lio_opcode == IO_CMD_PREADV)
+      io_uring_prep_read_fixed(sqe, fixed_fd, io->iov[0].iov_base,
+			       io->iov[0].iov_len, io->offset, slot);
+    else
+      ceph_assert(0);
+  } else if (io->iocb.aio_lio_opcode == IO_CMD_PWRITEV)
     io_uring_prep_writev(sqe, fixed_fd, &io->iov[0],
 			 io->iov.size(), io->offset);
   else if (io->iocb.aio_lio_opcode == IO_CMD_PREADV)
@@ -103,11 +199,36 @@ static void build_fixed_fds_map(struct ioring_data *d,
   }
 }
 
-ioring_queue_t::ioring_queue_t(unsigned iodepth_, bool hipri_, bool sq_thread_) :
+static int register_buffer_pool(struct ioring_data *d, unsigned n,
+				size_t size)
+{
+  auto pool = std::make_shared<ioring_buffer_pool>(n, size);
+  int ret = pool->init();
+  if (ret < 0)
+    return ret;
+
+  std::vector<struct iovec> iovs(n);
+  for (unsigned i = 0; i < n; ++i) {
+    iovs[i].iov_base = pool->base + i * size;
+    iovs[i].iov_len = size;
+  }
+  ret = io_uring_register_buffers(&d->io_uring, iovs.data(), n);
+  if (ret < 0)
+    return ret;
+
+  d->buffer_pool = std::move(pool);
+  return 0;
+}
+
+ioring_queue_t::ioring_queue_t(unsigned iodepth_, bool hipri_, bool sq_thread_,
+			       unsigned fixed_buffers_,
+			       unsigned fixed_buffer_size_) :
   d(make_unique<ioring_data>()),
   iodepth(iodepth_),
   hipri(hipri_),
-  sq_thread(sq_thread_)
+  sq_thread(sq_thread_),
+  fixed_buffers(fixed_buffers_),
+  fixed_buffer_size(fixed_buffer_size_)
 {
 }
 
@@ -140,6 +261,14 @@ int ioring_queue_t::init(std::vector<int> &fds)
 
   build_fixed_fds_map(d.get(), fds);
 
+  if (fixed_buffers && fixed_buffer_size) {
+    // failing to pin (e.g. RLIMIT_MEMLOCK) is not fatal; we just fall
+    // back to regular buffers and IORING_OP_READV/WRITEV.
+    if (register_buffer_pool(d.get(), fixed_buffers, fixed_buffer_size) < 0) {
+      fixed_buffers = 0;
+    }
+  }
+
   d->epoll_fd = epoll_create1(0);
   if (d->epoll_fd < 0) {
     ret = -errno;
@@ -167,6 +296,9 @@ close_ring_fd:
 void ioring_queue_t::shutdown()
 {
   d->fixed_fds_map.clear();
+  // outstanding buffers keep the memory alive; the registration goes
+  // away with the ring.
+  d->buffer_pool.reset();
   close(d->epoll_fd);
   d->epoll_fd = -1;
   io_uring_queue_exit(&d->io_uring);
@@ -206,6 +338,35 @@ get_cqe:
   return events;
 }
 
+ceph::buffer::ptr ioring_queue_t::get_io_buffer(unsigned len)
+{
+  auto& pool = d->buffer_pool;
+  if (!pool || len > pool->slot_size) {
+    return {};
+  }
+  int slot = pool->get();
+  if (slot < 0) {
+    return {};
+  }
+  return ceph::buffer::ptr(ceph::unique_leakable_ptr<ceph::buffer::raw>(
+    new raw_ioring_fixed(pool, slot, len)));
+}
+
+bool ioring_queue_t::is_io_buffer(const ceph::buffer::list& bl) const
+{
+  auto& pool = d->buffer_pool;
+  if (!pool) {
+    return false;
+  }
+  unsigned slot;
+  for (auto& p : bl.buffers()) {
+    if (pool->find_slot(p.c_str(), p.length(), &slot)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 bool ioring_queue_t::supported()
 {
   struct io_uring ring;
@@ -221,7 +382,9 @@ bool ioring_queue_t::supported()
 
 struct ioring_data {};
 
-ioring_queue_t::ioring_queue_t(unsigned iodepth_, bool hipri_, bool sq_thread_)
+ioring_queue_t::ioring_queue_t(unsigned iodepth_, bool hipri_, bool sq_thread_,
+			       unsigned fixed_buffers_,
+			       unsigned fixed_buffer_size_)
 {
   ceph_assert(0);
 }
@@ -253,6 +416,16 @@ int ioring_queue_t::get_next_completed(int timeout_ms, aio_t **paio, int max)
   ceph_assert(0);
 }
 
+ceph::buffer::ptr ioring_queue_t::get_io_buffer(unsigned len)
+{
+  ceph_assert(0);
+}
+
+bool ioring_queue_t::is_io_buffer(const ceph::buffer::list& bl) const
+{
+  ceph_assert(0);
+}
+
 bool ioring_queue_t::supported()
 {
   return false;
@@ -15,6 +15,7 @@
 #include "WorkQueue.h"
 #include "include/compat.h"
 #include "common/errno.h"
+#include "common/numa.h"
 
 #define dout_subsys ceph_subsys_tp
 #undef dout_prefix
@@ -266,6 +267,15 @@ void ShardedThreadPool::shardedthreadpool_worker(uint32_t thread_index)
   ceph_assert(wq != NULL);
   ldout(cct,10) << "worker start" << dendl;
 
+  if (thread_index < thread_cpus.size() && !thread_cpus[thread_index].empty()) {
+    int r = set_cpu_affinity_this_thread(thread_cpus[thread_index]);
+    if (r < 0) {
+      lderr(cct) << "worker unable to set cpu affinity to "
+		 << thread_cpus[thread_index] << ": " << cpp_strerror(r)
+		 << dendl;
+    }
+  }
+
   std::stringstream ss;
   ss << name << " thread " << (void *)pthread_self();
   auto hb = cct->get_heartbeat_map()->add_worker(ss.str(), pthread_self());
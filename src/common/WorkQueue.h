@@ -640,6 +640,7 @@ private:
   };
 
   std::vector<WorkThreadSharded*> threads_shardedpool;
+  std::vector<std::set<int>> thread_cpus;
   void start_threads();
   void shardedthreadpool_worker(uint32_t thread_index);
   void set_wq(BaseShardedWQ* swq) {
@@ -654,6 +655,12 @@ public:
 
   ~ShardedThreadPool(){};
 
+  /// restrict thread i to the cpus in thread_cpus[i], must be called
+  /// before start()
+  void set_thread_cpus(std::vector<std::set<int>> cpus) {
+    thread_cpus = std::move(cpus);
+  }
+
   /// start thread pool thread
   void start();
   /// stop thread pool thread
@@ -188,6 +188,47 @@ int set_cpu_affinity_all_threads(size_t cpu_set_size, cpu_set_t *cpu_set)
   return 0;
 }
 
+int set_cpu_affinity_this_thread(int cpu)
+{
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(cpu, &cpu_set);
+  if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) < 0) {
+    return -errno;
+  }
+  return 0;
+}
+
+int set_cpu_affinity_this_thread(const std::set<int>& cpus)
+{
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (auto cpu : cpus) {
+    if (cpu >= 0 && cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &cpu_set);
+    }
+  }
+  if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) < 0) {
+    return -errno;
+  }
+  return 0;
+}
+
+int get_cpu_numa_node(int cpu)
+{
+  std::set<std::string> ls;
+  if (easy_readdir("/sys/devices/system/cpu/cpu"s + stringify(cpu), &ls) < 0) {
+    return -1;
+  }
+  for (auto& i : ls) {
+    if (i.compare(0, 4, "node") == 0 && i.size() > 4 &&
+	::isdigit(i[4])) {
+      return atoi(i.c_str() + 4);
+    }
+  }
+  return -1;
+}
+
 #else
 int parse_cpu_set_list(const char *s,
 		       size_t *cpu_set_size,
@@ -221,4 +262,19 @@ int set_cpu_affinity_all_threads(size_t cpu_set_size,
   return -ENOTSUP;
 }
 
+int set_cpu_affinity_this_thread(int cpu)
+{
+  return -ENOTSUP;
+}
+
+int set_cpu_affinity_this_thread(const std::set<int>& cpus)
+{
+  return -ENOTSUP;
+}
+
+int get_cpu_numa_node(int cpu)
+{
+  return -1;
+}
+
 #endif
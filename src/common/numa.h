@@ -22,3 +22,9 @@ int get_numa_node_cpu_set(int node,
 
 int set_cpu_affinity_all_threads(size_t cpu_set_size,
 				 cpu_set_t *cpu_set);
+
+int set_cpu_affinity_this_thread(int cpu);
+int set_cpu_affinity_this_thread(const std::set<int>& cpus);
+
+/// the numa node the cpu belongs to, -1 if unknown
+int get_cpu_numa_node(int cpu);
@@ -978,6 +978,47 @@ std::vector<Option> get_global_options() {
     .set_default(4_K)
     .set_description("Maximum amount of data to prefetch out of the socket receive buffer"),
 
+    Option("ms_tcp_zerocopy_min_size", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Send with MSG_ZEROCOPY when at least this many bytes are sent at once (0 disables)")
+    .set_long_description("Applies to the async+posix messenger on Linux. Data sent with MSG_ZEROCOPY is not copied into the socket buffers; the messenger keeps it referenced until the kernel reports the transmission completed. This saves CPU for large messages on fast networks, but costs more than a copy for small ones. Takes effect for new connections."),
+
+    Option("ms_tcp_busy_poll_us", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Set SO_BUSY_POLL on sockets to let the kernel poll the device queue for this many microseconds on receive (0 disables)")
+    .set_long_description("Linux only. Reduces receive latency at the cost of CPU, mostly useful together with ms_async_busy_poll_us. Setting values above the net.core.busy_read sysctl requires CAP_NET_ADMIN. Takes effect for new connections.")
+    .add_see_also("ms_async_busy_poll_us"),
+
+    Option("ms_osd_compress_mode", Option::TYPE_STR, Option::LEVEL_ADVANCED)
+    .set_default("none")
+    .set_enum_allowed({"none", "force"})
+    .set_description("Compression policy for msgr2 connections from or to OSDs")
+    .set_long_description("With 'force', frame segments of at least ms_osd_compress_min_size bytes are compressed if the peer supports on-wire compression too. Connections in secure mode are never compressed. Takes effect for new connections.")
+    .add_see_also({"ms_osd_compress_min_size", "ms_osd_compression_algorithm", "ms_osd_compress_crush_level"}),
+
+    Option("ms_osd_compress_min_size", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(1_K)
+    .set_description("Minimum size of a frame segment to be compressed on the wire")
+    .add_see_also("ms_osd_compress_mode"),
+
+    Option("ms_osd_compression_algorithm", Option::TYPE_STR, Option::LEVEL_ADVANCED)
+    .set_default("snappy")
+    .set_description("Compression algorithms for msgr2 connections, in order of preference")
+    .set_long_description("A space separated list, e.g. 'lz4 snappy'. The accepting side picks the first algorithm from the connecting side's list it can use as well. Only snappy, lz4 and zstd can be used on the wire, and not with QAT acceleration enabled.")
+    .add_see_also("ms_osd_compress_mode"),
+
+    Option("ms_osd_decompress_max_size", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(256_M)
+    .set_description("Largest frame segment a peer may send compressed")
+    .set_long_description("A compressed segment announces its original length, which is allocated before decompressing. Segments claiming more than this are rejected and the connection is reset.")
+    .add_see_also("ms_osd_compress_mode"),
+
+    Option("ms_osd_compress_crush_level", Option::TYPE_STR, Option::LEVEL_ADVANCED)
+    .set_default("")
+    .set_description("Only compress connections between daemons in different CRUSH buckets of this type")
+    .set_long_description("E.g. 'datacenter' limits on-wire compression to the traffic between datacenters. The crush_location of the two daemons is compared. If empty, all connections are compressed.")
+    .add_see_also({"ms_osd_compress_mode", "crush_location"}),
+
     Option("ms_initial_backoff", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
     .set_default(.2)
     .set_description("Initial backoff after a network error is detected (seconds)"),
@@ -1153,6 +1194,20 @@ std::vector<Option> get_global_options() {
     .set_description("Maximum threadpool size of AsyncMessenger")
     .add_see_also("ms_async_op_threads"),
 
+    Option("ms_async_affinity_cores", Option::TYPE_STR, Option::LEVEL_ADVANCED)
+    .set_default("")
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("CPUs to pin the AsyncMessenger worker threads to")
+    .set_long_description("A list of CPUs like '0-3,8'. Worker i is pinned to the i-th CPU of the list, wrapping around if there are more workers than CPUs. Empty for no pinning.")
+    .add_see_also({"ms_async_op_threads", "osd_op_shard_msgr_affinity"}),
+
+    Option("ms_async_busy_poll_us", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Maximum time in microseconds a messenger worker busy polls for events before it goes to sleep (0 disables)")
+    .set_long_description("Saves the wakeup latency for events arriving shortly after the previous ones at the cost of keeping the worker threads' cores busy. The time actually spent polling adapts to the load: it shrinks down to 1/16 of this value while polling finds nothing and grows back as soon as it does. See the msgr_busy_poll_time and msgr_idle_time perf counters.")
+    .add_see_also("ms_tcp_busy_poll_us"),
+
     Option("ms_async_rdma_device_name", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("")
     .set_description(""),
@@ -1410,6 +1465,20 @@ std::vector<Option> get_global_options() {
     .add_service("mon")
     .set_description("granularity of PG placement calculation background work"),
 
+    Option("mon_osd_mapping_incremental", Option::TYPE_BOOL, Option::LEVEL_DEV)
+    .set_default(false)
+    .add_service("mon")
+    .set_description("only recalculate placement of PGs a new osdmap may have moved")
+    .set_long_description("When the PG placement calculated for the previous osdmap epoch is complete, recalculate only the PGs that the incremental changes (pg_temp, upmap, osd state and weight, pool changes) may have remapped instead of every PG.  CRUSH map and max_osd changes always recalculate everything.")
+    .add_see_also("mon_osd_mapping_incremental_check"),
+
+    Option("mon_osd_mapping_incremental_check", Option::TYPE_BOOL, Option::LEVEL_DEV)
+    .set_default(false)
+    .add_service("mon")
+    .set_description("verify incremental PG placement against a full recalculation")
+    .set_long_description("After each incrementally updated PG mapping completes, recalculate every PG and abort if any up or acting set differs.  Slow, for testing only.")
+    .add_see_also("mon_osd_mapping_incremental"),
+
     Option("mon_clean_pg_upmaps_per_chunk", Option::TYPE_UINT, Option::LEVEL_DEV)
     .set_default(256)
     .add_service("mon")
@@ -2549,6 +2618,14 @@ std::vector<Option> get_global_options() {
     .set_description("Maximum number of PGs we can attempt to unmap or upmap "
                      "for a specific overfull or underfull osd per iteration "),
 
+    Option("osd_calc_pg_upmaps_max_time", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Maximum time in seconds to spend calculating PG upmaps "
+                     "in a single call, 0 for no limit")
+    .set_long_description("When the limit is hit the changes found so far "
+                          "are returned."),
+
     Option("osd_numa_prefer_iface", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(true)
     .set_flag(Option::FLAG_STARTUP)
@@ -2566,6 +2643,13 @@ std::vector<Option> get_global_options() {
     .set_description("set affinity to a numa node (-1 for none)")
     .add_see_also("osd_numa_auto_affinity"),
 
+    Option("osd_op_shard_msgr_affinity", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("keep the threads of op shard i on the numa node of messenger worker i")
+    .set_long_description("Requires ms_async_affinity_cores. Spreads the op threads over the numa nodes the messenger workers run on. Ops are not routed to the worker of their shard, a connection carries ops for every shard. Without numa information the op threads are restricted to ms_async_affinity_cores. See the op_queue_lat perf counter. osd_numa_node and osd_numa_auto_affinity are not applied when this is enabled.")
+    .add_see_also({"ms_async_affinity_cores", "osd_op_num_shards"}),
+
     Option("osd_smart_report_timeout", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
     .set_default(5)
     .set_description("Timeout (in seconds) for smarctl to run, default is set to 5"),
@@ -3152,6 +3236,18 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description(""),
 
+    Option("osd_ec_parity_delta_writes", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Apply small overwrites of EC objects as parity deltas")
+    .set_long_description("With plugins whose codes are linear, an overwrite touching few data chunks of a stripe only reads and rewrites those and the coding chunks instead of the whole stripe. Requires allow_ec_overwrites on the pool.")
+    .set_flag(Option::FLAG_RUNTIME),
+
+    Option("osd_ec_partial_reads", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Read only the needed part of the data chunks for small EC reads")
+    .set_long_description("A client read smaller than a stripe reads the bytes it covers from the data chunks holding them instead of whole stripes from k shards. If one of those shards is unavailable the minimal set of chunk aligned ranges needed to decode them is read instead. Only applies to pools with allow_ec_overwrites, other pools read whole chunks to check them against their hinfo crcs. Does not apply to fast_read pools.")
+    .set_flag(Option::FLAG_RUNTIME),
+
     // Only use clone_overlap for recovery if there are fewer than
     // osd_recover_clone_overlap_limit entries in the overlap set
     Option("osd_recover_clone_overlap_limit", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
@@ -3563,6 +3659,14 @@ std::vector<Option> get_global_options() {
     .add_see_also("osd_min_pg_log_entries")
     .add_see_also("osd_max_pg_log_entries"),
 
+    Option("osd_pg_log_memory_entries", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("number of recent PG log entries to keep in memory for PGs with nothing missing")
+    .set_long_description("Older entries are dropped from memory, leaving only what duplicate op detection needs, and are read back from disk when peering needs them. 0 keeps the whole log in memory.")
+    .add_service("osd")
+    .add_see_also("osd_min_pg_log_entries")
+    .add_see_also("osd_max_pg_log_entries"),
+
     Option("osd_object_clean_region_max_num_intervals", Option::TYPE_INT, Option::LEVEL_DEV)
     .set_default(10)
     .set_description("number of intervals in clean_offsets")
@@ -3895,6 +3999,19 @@ std::vector<Option> get_global_options() {
     .set_default(1048576)
     .set_description("The number of keys required to invoke DeleteRange when deleting muliple keys."),
 
+    Option("rocksdb_delete_range_compact_threshold", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(16384)
+    .set_description("Compact a key range once at least this many keys in it are deleted by a single transaction")
+    .set_long_description("Point deletes and DeleteRange both leave tombstones behind which every iterator through the range has to skip until they are compacted away. When a range removal (e.g. clearing the omap of a large object) deletes at least this many keys, or falls back to DeleteRange, the range is queued for compaction once the transaction is committed. 0 disables this.")
+    .add_see_also("rocksdb_delete_range_threshold")
+    .add_see_also("rocksdb_delete_range_compact_interval"),
+
+    Option("rocksdb_delete_range_compact_interval", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(10.0)
+    .set_description("Minimum seconds between rounds of compacting ranges left full of tombstones")
+    .set_long_description("Ranges queued by rocksdb_delete_range_compact_threshold are coalesced and compacted together, at most once per this interval, with non-exclusive manual compactions.")
+    .add_see_also("rocksdb_delete_range_compact_threshold"),
+
     Option("rocksdb_bloom_bits_per_key", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
     .set_default(20)
     .set_description("Number of bits per key to use for RocksDB's bloom filters.")
@@ -4664,6 +4781,13 @@ std::vector<Option> get_global_options() {
 			  "Recommended hash ranges: O(0-13) P(0-8) m(0-16). "
 			  "Sharding of S,T,C,M,B prefixes is inadvised"),
 
+    Option("bluestore_rocksdb_cf_access_hints", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(true)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Tune column families for how BlueStore accesses them")
+    .set_long_description("Onodes (O) get small blocks and bloom filters for point lookups, omap (M, P, m, p) gets large blocks for scans, keeping its bloom filters and the deferred write log (L) is compacted as write-once data. Only applies to prefixes which are column families; options given in bluestore_rocksdb_cfs take precedence.")
+    .add_see_also("bluestore_rocksdb_cfs"),
+
     Option("bluestore_fsck_on_mount", Option::TYPE_BOOL, Option::LEVEL_DEV)
     .set_default(false)
     .set_description("Run fsck at mount"),
@@ -4752,6 +4876,28 @@ std::vector<Option> get_global_options() {
     .set_description("Default bluestore_deferred_batch_ops for non-rotational (solid state) media")
     .add_see_also("bluestore_deferred_batch_ops"),
 
+    Option("bluestore_deferred_adaptive", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Adapt deferred write size threshold and batching to observed latencies")
+    .set_long_description("When enabled, bluestore periodically compares the latency of direct (non-deferred) writes to the main device with the kv commit latency. If direct writes are much slower than a kv commit, the deferred size threshold is raised and deferred writes are batched more; if they are faster, or deferred writes back up in the throttle, the threshold is lowered. The configured bluestore_prefer_deferred_size and bluestore_deferred_batch_ops are used as starting points.")
+    .add_see_also("bluestore_prefer_deferred_size")
+    .add_see_also("bluestore_deferred_batch_ops")
+    .add_see_also("bluestore_deferred_adaptive_interval")
+    .add_see_also("bluestore_deferred_adaptive_max_size"),
+
+    Option("bluestore_deferred_adaptive_interval", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(1.0)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Seconds between adjustments of the adaptive deferred write threshold")
+    .add_see_also("bluestore_deferred_adaptive"),
+
+    Option("bluestore_deferred_adaptive_max_size", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(512_K)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Upper bound for the adaptive deferred write size threshold")
+    .add_see_also("bluestore_deferred_adaptive"),
+
     Option("bluestore_nid_prealloc", Option::TYPE_INT, Option::LEVEL_DEV)
     .set_default(1024)
     .set_description("Number of unique object ids to preallocate at a time"),
@@ -4909,6 +5055,36 @@ std::vector<Option> get_global_options() {
     .set_default(64_M)
     .set_description("Maximum RAM hybrid allocator should use before enabling bitmap supplement"),
 
+    Option("bluestore_allocator_snapshot", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Save allocator state on clean umount and load it on mount")
+    .set_long_description("On clean umount free extents of the main device are "
+      "written to a checksummed BlueFS file which is used to initialize the "
+      "allocator on next mount instead of scanning the whole freelist. The "
+      "snapshot records a nonce stored in the DB as the last write before "
+      "umount and the resulting kv sequence number; it is only used if both "
+      "still match, and the nonce is removed before the first write after "
+      "mount. A missing, stale or damaged snapshot always falls back to the "
+      "freelist scan."),
+
+    Option("bluestore_allocator_magazine_size", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_min_max(0, 4096)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Number of min_alloc_size chunks cached per allocator magazine")
+    .set_long_description("When non-zero, small allocations and releases are served "
+      "from per-thread magazines of free min_alloc_size chunks layered over "
+      "bluestore_allocator, which are refilled from and drained to it in bulk. "
+      "0 disables the magazines.")
+    .add_see_also("bluestore_allocator_magazines"),
+
+    Option("bluestore_allocator_magazines", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Number of allocator magazines, 0 to use one per CPU")
+    .add_see_also("bluestore_allocator_magazine_size"),
+
     Option("bluestore_volume_selection_policy", Option::TYPE_STR, Option::LEVEL_DEV)
     .set_default("use_some_extra")
     .set_enum_allowed({ "rocksdb_original", "use_some_extra", "fit_to_fast" })
@@ -4940,6 +5116,26 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description("Enables Linux io_uring API Offload submission/completion to kernel thread"),
 
+    Option("bdev_ioring_fixed_buffers", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_min_max(0, 16384)
+    .set_description("Number of buffers to register with io_uring")
+    .set_long_description("When non-zero and io_uring is in use, this many "
+      "page aligned buffers of bdev_ioring_fixed_buffer_size bytes are pinned "
+      "and registered with the ring once, and aio reads that fit are issued "
+      "with IORING_OP_READ_FIXED into them, avoiding per-I/O page pinning. "
+      "The data is copied out on completion so a buffer is only held for "
+      "the duration of the I/O; reads fall back to regular buffers when "
+      "none is free (counted by the ioring_fixed_fallback perf counter). "
+      "The pinned memory is accounted to mempool bdev_ioring_buffers.")
+    .add_see_also("bdev_ioring")
+    .add_see_also("bdev_ioring_fixed_buffer_size"),
+
+    Option("bdev_ioring_fixed_buffer_size", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(64_K)
+    .set_description("Size of each buffer registered with io_uring")
+    .add_see_also("bdev_ioring_fixed_buffers"),
+
     Option("bluestore_kv_sync_util_logging_s", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
     .set_default(10.0)
     .set_flag(Option::FLAG_RUNTIME)
@@ -4947,6 +5143,16 @@ std::vector<Option> get_global_options() {
     .set_long_description("How often (in seconds) to print KV sync thread utilization, "
       "not logged when set to 0 or when utilization is 0%"),
 
+    Option("bluestore_kv_finalize_shards", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(1)
+    .set_min(1)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Number of kv_finalize threads")
+    .set_long_description("Committed transactions are handed to one of this many "
+      "finalize threads, chosen by OpSequencer, so ordering within a sequencer "
+      "is preserved while completions for different PGs are processed in "
+      "parallel. The default of 1 keeps the single bstore_kv_final thread."),
+
 
     // -----------------------------------------
     // kstore
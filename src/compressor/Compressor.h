@@ -95,6 +95,14 @@ public:
   // this is a bit weird but we need non-const iterator to be in
   // alignment with decode methods
   virtual int decompress(ceph::bufferlist::const_iterator &p, size_t compressed_len, ceph::bufferlist &out, boost::optional<int32_t> compressor_message) = 0;
+  // Decompress into out, which the caller allocated with the expected
+  // uncompressed length.  Fails with -EINVAL rather than producing more
+  // or less, so data from an untrusted peer can't make us allocate more
+  // than was announced up front.  -EOPNOTSUPP if the plugin can't bound
+  // its output.
+  virtual int decompress_into(const ceph::bufferlist &in, ceph::bufferptr &out) {
+    return -EOPNOTSUPP;
+  }
 
   static CompressorRef create(CephContext *cct, const std::string &type);
   static CompressorRef create(CephContext *cct, int alg);
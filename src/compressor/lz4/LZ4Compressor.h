@@ -143,6 +143,62 @@ class LZ4Compressor : public Compressor {
     dst.push_back(std::move(dstptr));
     return 0;
   }
+
+  int decompress_into(const ceph::buffer::list &src, ceph::buffer::ptr &dst) override {
+#ifdef HAVE_QATZIP
+    if (qat_enabled)
+      return -EOPNOTSUPP;
+#endif
+    using ceph::decode;
+    auto p = std::cbegin(src);
+    uint32_t count;
+    std::vector<std::pair<uint32_t, uint32_t> > compressed_pairs;
+    uint64_t total_origin = 0;
+    uint64_t total_compressed = 0;
+    try {
+      decode(count, p);
+      if (count > p.get_remaining() / (sizeof(uint32_t) * 2)) {
+	return -EINVAL;
+      }
+      compressed_pairs.resize(count);
+      for (unsigned i = 0; i < count; ++i) {
+	decode(compressed_pairs[i].first, p);
+	decode(compressed_pairs[i].second, p);
+	total_origin += compressed_pairs[i].first;
+	total_compressed += compressed_pairs[i].second;
+      }
+    } catch (ceph::buffer::error&) {
+      return -EINVAL;
+    }
+    if (total_origin != dst.length() ||
+	total_compressed != p.get_remaining()) {
+      return -EINVAL;
+    }
+
+    ceph::buffer::ptr cur_ptr = p.get_current_ptr();
+    ceph::buffer::ptr *ptr = &cur_ptr;
+    Tub<ceph::buffer::ptr> data_holder;
+    if (total_compressed != cur_ptr.length()) {
+      data_holder.construct(total_compressed);
+      p.copy_deep(total_compressed, *data_holder);
+      ptr = data_holder.get();
+    }
+
+    LZ4_streamDecode_t lz4_stream_decode;
+    LZ4_setStreamDecode(&lz4_stream_decode, nullptr, 0);
+    char *c_in = ptr->c_str();
+    char *c_out = dst.c_str();
+    for (unsigned i = 0; i < count; ++i) {
+      int r = LZ4_decompress_safe_continue(
+          &lz4_stream_decode, c_in, c_out, compressed_pairs[i].second, compressed_pairs[i].first);
+      if (r != (int)compressed_pairs[i].first) {
+	return -EINVAL;
+      }
+      c_in += compressed_pairs[i].second;
+      c_out += compressed_pairs[i].first;
+    }
+    return 0;
+  }
 };
 
 #endif
@@ -111,6 +111,24 @@ class SnappyCompressor : public Compressor {
     }
     return -2;
   }
+
+  int decompress_into(const ceph::bufferlist &src, ceph::bufferptr &dst) override {
+#ifdef HAVE_QATZIP
+    if (qat_enabled)
+      return -EOPNOTSUPP;
+#endif
+    snappy::uint32 res_len = 0;
+    BufferlistSource source_1(std::cbegin(src), src.length());
+    if (!snappy::GetUncompressedLength(&source_1, &res_len) ||
+	res_len != dst.length()) {
+      return -EINVAL;
+    }
+    BufferlistSource source_2(std::cbegin(src), src.length());
+    if (!snappy::RawUncompress(&source_2, dst.c_str())) {
+      return -EINVAL;
+    }
+    return 0;
+  }
 };
 
 #endif
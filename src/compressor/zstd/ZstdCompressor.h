@@ -100,6 +100,45 @@ class ZstdCompressor : public Compressor {
     dst.append(dstptr, 0, outbuf.pos);
     return 0;
   }
+
+  int decompress_into(const ceph::buffer::list &src, ceph::buffer::ptr &dst) override {
+    if (src.length() < 4) {
+      return -EINVAL;
+    }
+    auto p = std::cbegin(src);
+    uint32_t dst_len;
+    ceph::decode(dst_len, p);
+    if (dst_len != dst.length()) {
+      return -EINVAL;
+    }
+
+    ZSTD_outBuffer_s outbuf;
+    outbuf.dst = dst.c_str();
+    outbuf.size = dst.length();
+    outbuf.pos = 0;
+    ZSTD_DStream *s = ZSTD_createDStream();
+    ZSTD_initDStream(s);
+    int r = 0;
+    size_t compressed_len = src.length() - 4;
+    while (compressed_len > 0) {
+      ZSTD_inBuffer_s inbuf;
+      inbuf.pos = 0;
+      inbuf.size = p.get_ptr_and_advance(compressed_len,
+					 (const char**)&inbuf.src);
+      size_t ret = ZSTD_decompressStream(s, &outbuf, &inbuf);
+      // input left over once the output is full: longer than announced
+      if (ZSTD_isError(ret) || inbuf.pos != inbuf.size) {
+	r = -EINVAL;
+	break;
+      }
+      compressed_len -= inbuf.size;
+    }
+    ZSTD_freeDStream(s);
+    if (r == 0 && outbuf.pos != dst.length()) {
+      r = -EINVAL;
+    }
+    return r;
+  }
  private:
   CephContext *const cct;
 };
@@ -2,6 +2,7 @@
 // vim: ts=8 sw=2 smarttab
 
 #include <algorithm>
+#include <chrono>
 #include <cstdlib>
 #include <iostream>
 
@@ -805,3 +806,96 @@ int CrushTester::compare(CrushWrapper& crush2)
   }
   return ret;
 }
+
+int CrushTester::benchmark()
+{
+  if (min_rule < 0 || max_rule < 0) {
+    min_rule = 0;
+    max_rule = crush.get_max_rules() - 1;
+  }
+  if (min_x < 0 || max_x < 0) {
+    min_x = 0;
+    max_x = 1023;
+  }
+
+  // initial osd weights
+  vector<__u32> weight;
+  for (int o = 0; o < crush.get_max_devices(); o++) {
+    if (device_weight.count(o)) {
+      weight.push_back(device_weight[o]);
+    } else if (crush.check_item_present(o)) {
+      weight.push_back(0x10000);
+    } else {
+      weight.push_back(0);
+    }
+  }
+
+  // make adjustments
+  adjust_weights(weight);
+
+  vector<int> xs;
+  for (int x = min_x; x <= max_x; ++x) {
+    uint32_t real_x = x;
+    if (pool_id != -1) {
+      real_x = crush_hash32_2(CRUSH_HASH_RJENKINS1, x, (uint32_t)pool_id);
+    }
+    xs.push_back(real_x);
+  }
+
+  using clock = std::chrono::steady_clock;
+  auto per_sec = [&xs](clock::duration d) {
+    return xs.size() / std::max(std::chrono::duration<double>(d).count(), 1e-9);
+  };
+
+  int ret = 0;
+  for (int r = min_rule; r < crush.get_max_rules() && r <= max_rule; r++) {
+    if (!crush.rule_exists(r)) {
+      continue;
+    }
+    if (ruleset >= 0 &&
+	crush.get_rule_mask_ruleset(r) != ruleset) {
+      continue;
+    }
+    int minr = min_rep, maxr = max_rep;
+    if (min_rep < 0 || max_rep < 0) {
+      minr = crush.get_rule_mask_min_size(r);
+      maxr = crush.get_rule_mask_max_size(r);
+    }
+    for (int nr = minr; nr <= maxr; nr++) {
+      vector<vector<int>> single(xs.size());
+      auto start = clock::now();
+      for (unsigned i = 0; i < xs.size(); ++i) {
+	crush.do_rule(r, xs[i], single[i], nr, weight, 0);
+      }
+      auto single_time = clock::now() - start;
+
+      vector<int> out, out_size;
+      start = clock::now();
+      crush.do_rule_batch(r, xs, nr, weight, 0, &out, &out_size);
+      auto batch_time = clock::now() - start;
+
+      int bad = 0;
+      for (unsigned i = 0; i < xs.size(); ++i) {
+	auto p = out.begin() + i * nr;
+	if (single[i] != vector<int>(p, p + std::max(out_size[i], 0))) {
+	  ++bad;
+	}
+      }
+      if (bad) {
+	ret = -1;
+      }
+      cout << "rule " << r << " num_rep " << nr << " " << xs.size()
+	   << " mappings: " << (uint64_t)per_sec(single_time)
+	   << " mappings/sec one at a time, " << (uint64_t)per_sec(batch_time)
+	   << " mappings/sec batched";
+      if (bad) {
+	cout << ", " << bad << " mismatched";
+      }
+      cout << std::endl;
+    }
+  }
+  if (ret) {
+    cerr << "warning: batched mappings do NOT match" << std::endl;
+  }
+  return ret;
+}
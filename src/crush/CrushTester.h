@@ -361,6 +361,8 @@ public:
   int test_with_fork(int timeout);
 
   int compare(CrushWrapper& other);
+  /// time do_rule() against do_rule_batch(), checking they agree
+  int benchmark();
 };
 
 #endif
@@ -1596,6 +1596,30 @@ public:
       out[i] = rawout[i];
   }
 
+  /**
+   * map all of xs with the same rule
+   *
+   * The items of xs[i] end up in out[i * maxout, i * maxout + out_size[i]).
+   * Equivalent to calling do_rule() for each input, without setting up
+   * the workspace and looking up the choose_args for every single one.
+   */
+  template<typename WeightVector>
+  void do_rule_batch(int rule, const std::vector<int>& xs, int maxout,
+		     const WeightVector& weight,
+		     uint64_t choose_args_index,
+		     std::vector<int> *out,
+		     std::vector<int> *out_size) const {
+    std::vector<char> work(crush_work_size(crush, maxout));
+    crush_choose_arg_map arg_map = choose_args_get_with_fallback(
+      choose_args_index);
+    out->resize(xs.size() * maxout);
+    out_size->resize(xs.size());
+    crush_do_rule_batch(crush, rule, xs.data(), xs.size(),
+			out->data(), maxout, out_size->data(),
+			std::data(weight), std::size(weight),
+			work.data(), arg_map.args);
+  }
+
   int _choose_type_stack(
     CephContext *cct,
     const std::vector<std::pair<int,int>>& stack,
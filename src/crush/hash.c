@@ -120,6 +120,26 @@ __u32 crush_hash32_3(int type, __u32 a, __u32 b, __u32 c)
 	}
 }
 
+/*
+ * the loop has no dependencies between iterations and only does 32-bit
+ * integer arithmetic, which leaves it to the compiler to vectorize
+ */
+void crush_hash32_3_n(int type, __u32 a, const __s32 *b, __u32 c,
+		      __u32 *out, unsigned int n)
+{
+	unsigned int i;
+
+	switch (type) {
+	case CRUSH_HASH_RJENKINS1:
+		for (i = 0; i < n; i++)
+			out[i] = crush_hash32_rjenkins1_3(a, b[i], c);
+		break;
+	default:
+		for (i = 0; i < n; i++)
+			out[i] = 0;
+	}
+}
+
 __u32 crush_hash32_4(int type, __u32 a, __u32 b, __u32 c, __u32 d)
 {
 	switch (type) {
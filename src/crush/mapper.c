@@ -326,57 +326,70 @@ static inline __s32 *get_choose_arg_ids(const struct crush_bucket_straw2 *bucket
 }
 
 /*
- * Compute exponential random variable using inversion method.
- *
- * for reference, see the exponential distribution example at:  
- * https://en.wikipedia.org/wiki/Inverse_transform_sampling#Examples
+ * straw2 draws are computed a block of items at a time.  The hashes and
+ * logs of a block don't depend on each other and are left to the
+ * compiler to vectorize, only the division and the comparison with the
+ * highest draw so far are done one item after the other.
  */
-static inline __s64 generate_exponential_distribution(int type, int x, int y, int z, 
-                                                      int weight)
-{
-	unsigned int u = crush_hash32_3(type, x, y, z);
-	u &= 0xffff;
-
-	/*
-	 * for some reason slightly less than 0x10000 produces
-	 * a slightly more accurate distribution... probably a
-	 * rounding effect.
-	 *
-	 * the natural log lookup table maps [0,0xffff]
-	 * (corresponding to real numbers [1/0x10000, 1] to
-	 * [0, 0xffffffffffff] (corresponding to real numbers
-	 * [-11.090355,0]).
-	 */
-	__s64 ln = crush_ln(u) - 0x1000000000000ll;
-
-	/*
-	 * divide by 16.16 fixed-point weight.  note
-	 * that the ln value is negative, so a larger
-	 * weight means a larger (less negative) value
-	 * for draw.
-	 */
-	return div64_s64(ln, weight);
-}
+#define CRUSH_STRAW2_BLOCK 32
 
 static int bucket_straw2_choose(const struct crush_bucket_straw2 *bucket,
 				int x, int r, const struct crush_choose_arg *arg,
                                 int position)
 {
-	unsigned int i, high = 0;
+	unsigned int i, j, n, high = 0;
 	__s64 draw, high_draw = 0;
+	__u32 u[CRUSH_STRAW2_BLOCK];
+	__u64 ln[CRUSH_STRAW2_BLOCK];
         __u32 *weights = get_choose_arg_weights(bucket, arg, position);
         __s32 *ids = get_choose_arg_ids(bucket, arg);
-	for (i = 0; i < bucket->h.size; i++) {
-                dprintk("weight 0x%x item %d\n", weights[i], ids[i]);
-		if (weights[i]) {
-			draw = generate_exponential_distribution(bucket->h.hash, x, ids[i], r, weights[i]);
-		} else {
-			draw = S64_MIN;
-		}
+	for (i = 0; i < bucket->h.size; i += n) {
+		n = bucket->h.size - i;
+		if (n > CRUSH_STRAW2_BLOCK)
+			n = CRUSH_STRAW2_BLOCK;
+
+		/*
+		 * Compute exponential random variable using inversion
+		 * method.
+		 *
+		 * for reference, see the exponential distribution example at:
+		 * https://en.wikipedia.org/wiki/Inverse_transform_sampling#Examples
+		 */
+		crush_hash32_3_n(bucket->h.hash, x, ids + i, r, u, n);
+
+		/*
+		 * for some reason slightly less than 0x10000 produces
+		 * a slightly more accurate distribution... probably a
+		 * rounding effect.
+		 *
+		 * the natural log lookup table maps [0,0xffff]
+		 * (corresponding to real numbers [1/0x10000, 1] to
+		 * [0, 0xffffffffffff] (corresponding to real numbers
+		 * [-11.090355,0]).
+		 */
+		for (j = 0; j < n; j++)
+			ln[j] = crush_ln(u[j] & 0xffff);
+
+		for (j = 0; j < n; j++) {
+			dprintk("weight 0x%x item %d\n", weights[i + j],
+				ids[i + j]);
+			if (weights[i + j]) {
+				/*
+				 * divide by 16.16 fixed-point weight.  note
+				 * that the ln value is negative, so a larger
+				 * weight means a larger (less negative) value
+				 * for draw.
+				 */
+				draw = div64_s64((__s64)(ln[j] - 0x1000000000000ll),
+						 (int)weights[i + j]);
+			} else {
+				draw = S64_MIN;
+			}
 
-		if (i == 0 || draw > high_draw) {
-			high = i;
-			high_draw = draw;
+			if (i + j == 0 || draw > high_draw) {
+				high = i + j;
+				high_draw = draw;
+			}
 		}
 	}
 
@@ -1103,3 +1116,35 @@ int crush_do_rule(const struct crush_map *map,
 
 	return result_len;
 }
+
+/**
+ * crush_do_rule_batch - calculate the mappings of many inputs
+ * @map: the crush_map
+ * @ruleno: the rule id
+ * @x: hash inputs
+ * @n: number of inputs
+ * @result: result_max items for each input
+ * @result_max: maximum result size of a single input
+ * @result_len: result size of each input
+ * @weight: weight vector (for map leaves)
+ * @weight_max: size of weight vector
+ * @cwin: workspace, initialized here
+ *
+ * The bucket permutations cached in the workspace are keyed by the
+ * input, so a single workspace serves all of them.
+ */
+void crush_do_rule_batch(const struct crush_map *map,
+			 int ruleno, const int *x, int n,
+			 int *result, int result_max, int *result_len,
+			 const __u32 *weight, int weight_max,
+			 void *cwin, const struct crush_choose_arg *choose_args)
+{
+	int i;
+
+	crush_init_workspace(map, cwin);
+	for (i = 0; i < n; i++)
+		result_len[i] = crush_do_rule(map, ruleno, x[i],
+					      result + i * result_max,
+					      result_max, weight, weight_max,
+					      cwin, choose_args);
+}
@@ -78,6 +78,33 @@ extern int crush_do_rule(const struct crush_map *map,
 			 const __u32 *weights, int weight_max,
 			 void *cwin, const struct crush_choose_arg *choose_args);
 
+/** @ingroup API
+ *
+ * Map each of the __n__ inputs in __x__ with crush_do_rule(). The
+ * items for __x[i]__ are stored in __result[i * result_max]__ and
+ * their number in __result_len[i]__. The workspace is initialized
+ * once for the whole batch instead of once per input.
+ *
+ * @param map the crush_map
+ * @param ruleno a positive integer < __CRUSH_MAX_RULES__
+ * @param x the values to map
+ * @param n the size of the __x__ and __result_len__ arrays
+ * @param result an array of items of size __n__ * __result_max__
+ * @param result_max the maximum number of items for a single input
+ * @param result_len the number of items found for each input
+ * @param weights an array of weights of size __weight_max__
+ * @param weight_max the size of the __weights__ array
+ * @param cwin a workspace of crush_work_size(__map__, __result_max__)
+ * @param choose_args weights and ids for each known bucket
+ */
+extern void crush_do_rule_batch(const struct crush_map *map,
+				int ruleno,
+				const int *x, int n,
+				int *result, int result_max, int *result_len,
+				const __u32 *weights, int weight_max,
+				void *cwin,
+				const struct crush_choose_arg *choose_args);
+
 /* Returns the exact amount of workspace that will need to be used
    for a given combination of crush_map and result_max. The caller can
    then allocate this much on its own, either on the stack, in a
@@ -60,6 +60,10 @@ namespace ceph {
       return 1;
     }
 
+    uint64_t get_supported_optimizations() const override {
+      return 0;
+    }
+
     virtual int _minimum_to_decode(const std::set<int> &want_to_read,
 				   const std::set<int> &available_chunks,
 				   std::set<int> *minimum);
@@ -459,6 +459,21 @@ namespace ceph {
      */
     virtual int decode_concat(const std::map<int, bufferlist> &chunks,
 			      bufferlist *decoded) = 0;
+
+    enum {
+      /* the code is linear over XOR: encoding the XOR of two stripes
+       * yields the XOR of their coding chunks. A partial overwrite can
+       * update the coding chunks from the changed data chunks alone. */
+      FLAG_EC_PLUGIN_PARITY_DELTA_OPTIMIZATION = 1 << 0,
+    };
+
+    /**
+     * Return the FLAG_EC_PLUGIN_* optimizations the implementation
+     * supports.
+     *
+     * @return a bitmask of FLAG_EC_PLUGIN_*
+     */
+    virtual uint64_t get_supported_optimizations() const = 0;
   };
 
   typedef std::shared_ptr<ErasureCodeInterface> ErasureCodeInterfaceRef;
@@ -71,6 +71,13 @@ public:
     return k;
   }
 
+  uint64_t
+  get_supported_optimizations() const override
+  {
+    // vandermonde and cauchy matrices are both linear codes
+    return FLAG_EC_PLUGIN_PARITY_DELTA_OPTIMIZATION;
+  }
+
   unsigned int get_chunk_size(unsigned int object_size) const override;
 
   int encode_chunks(const std::set<int> &want_to_encode,
@@ -54,6 +54,11 @@ public:
     return k;
   }
 
+  uint64_t get_supported_optimizations() const override {
+    // all the techniques are linear codes over GF(2^w)
+    return FLAG_EC_PLUGIN_PARITY_DELTA_OPTIMIZATION;
+  }
+
   unsigned int get_chunk_size(unsigned int object_size) const override;
 
   int encode_chunks(const std::set<int> &want_to_encode,
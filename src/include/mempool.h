@@ -147,6 +147,7 @@ namespace mempool {
 // define memory pools
 
 #define DEFINE_MEMORY_POOLS_HELPER(f) \
+  f(bdev_ioring_buffers)	      \
   f(bloom_filter)		      \
   f(bluestore_alloc)		      \
   f(bluestore_cache_data)	      \
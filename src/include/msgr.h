@@ -51,8 +51,13 @@
 	(((x) & (CEPH_MSGR2_FEATUREMASK_##name)) == (CEPH_MSGR2_FEATUREMASK_##name))
 
 DEFINE_MSGR2_FEATURE( 0, 1, REVISION_1)   // msgr2.1
+// bit 1 is left alone, other implementations use it for a different
+// compression scheme
+DEFINE_MSGR2_FEATURE( 2, 1, SEGMENT_COMPRESSION)  // per segment on-wire compression
 
-#define CEPH_MSGR2_SUPPORTED_FEATURES (CEPH_MSGR2_FEATURE_REVISION_1)
+#define CEPH_MSGR2_SUPPORTED_FEATURES \
+	(CEPH_MSGR2_FEATURE_REVISION_1 | \
+	 CEPH_MSGR2_FEATURE_SEGMENT_COMPRESSION)
 
 #define CEPH_MSGR2_REQUIRED_FEATURES  (0ull)
 
@@ -8,6 +8,7 @@
 #include <set>
 #include <map>
 #include <string>
+#include <vector>
 #include <boost/scoped_ptr.hpp>
 #include "include/encoding.h"
 #include "common/Formatter.h"
@@ -189,6 +190,23 @@ public:
     return get(prefix, std::string(key, keylen), value);
   }
 
+  /// Retrieve a batch of keys at once, which backends may look up in
+  /// parallel. (*rs)[i] is 0, -ENOENT or another error for keys[i], as
+  /// from get(), and (*values)[i] its value.
+  virtual void multi_get(
+    const std::string &prefix,                ///< [in] Prefix/CF for keys
+    const std::vector<std::string> &keys,     ///< [in] Keys to retrieve
+    std::vector<int> *rs,                     ///< [out] Lookup results
+    std::vector<ceph::buffer::list> *values   ///< [out] Values retrieved
+    ) {
+    rs->resize(keys.size());
+    values->resize(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+      (*values)[i].clear();
+      (*rs)[i] = get(prefix, keys[i], &(*values)[i]);
+    }
+  }
+
   // This superclass is used both by kv iterators *and* by the ObjectMap
   // omap iterator.  The class hierarchies are unfortunately tied together
   // by the legacy DBOjectMap implementation :(.
@@ -400,6 +418,28 @@ public:
     return -EOPNOTSUPP;
   }
 
+  /// How keys under a prefix are mostly accessed
+  enum class access_hint_t {
+    NONE,
+    POINT_LOOKUP, ///< get() of individual keys
+    RANGE_SCAN,   ///< iteration over ranges of keys
+    WRITE_ONCE,   ///< keys are written once, read rarely and removed later
+  };
+
+  /// Let the backend tune its layout for the prefix, this needs to be done
+  /// BEFORE the DB is opened. Explicit per-prefix settings of the backend
+  /// (e.g. RocksDB column family options) take precedence.
+  virtual int set_prefix_access_hint(const std::string& prefix,
+				     access_hint_t hint) {
+    return -EOPNOTSUPP;
+  }
+
+  /// Sequence number of the last write, if the backend keeps one (0 if not).
+  /// Any committed write, by whatever opened the DB, changes it.
+  virtual uint64_t get_latest_sequence() {
+    return 0;
+  }
+
   virtual void get_statistics(ceph::Formatter *f) {
     return;
   }
@@ -54,6 +54,12 @@ using ceph::bufferptr;
 using ceph::decode;
 using ceph::encode;
 
+namespace {
+// point lookups start probing the reader slots at a per-thread position
+std::atomic<unsigned> next_thread_idx = {0};
+thread_local unsigned thread_idx = next_thread_idx++;
+}
+
 static void split_key(const string& raw_key, string *prefix, string *key)
 {
   size_t pos = raw_key.find(KEY_DELIM, 0);
@@ -70,10 +76,28 @@ static string make_key(const string &prefix, const string &value)
   return out;
 }
 
-void MemDB::_encode(mdb_iter_t iter, bufferlist &bl)
+static string past_prefix(const string &prefix)
+{
+  string limit = prefix;
+  limit.push_back(KEY_DELIM + 1);
+  return limit;
+}
+
+MemDB::node_t::~node_t()
+{
+  auto v = versions.load(std::memory_order_relaxed);
+  while (v) {
+    auto older = v->older.load(std::memory_order_relaxed);
+    delete v;
+    v = older;
+  }
+}
+
+void MemDB::_encode(const node_t *node, bufferlist &bl)
 {
-  encode(iter->first, bl);
-  encode(iter->second, bl);
+  auto v = node->versions.load(std::memory_order_relaxed);
+  encode(node->key, bl);
+  encode(v->value, bl);
 }
 
 std::string MemDB::_get_data_fn()
@@ -96,11 +120,14 @@ void MemDB::_save()
     return;
   }
   bufferlist bl;
-  mdb_iter_t iter = m_map.begin();
-  while (iter != m_map.end()) {
-    dout(10) << __func__ << " Key:"<< iter->first << dendl;
-    _encode(iter, bl);
-    ++iter;
+  for (auto node = m_head.next[0].load(std::memory_order_relaxed);
+       node;
+       node = node->next[0].load(std::memory_order_relaxed)) {
+    if (node->versions.load(std::memory_order_relaxed)->deleted) {
+      continue;
+    }
+    dout(10) << __func__ << " Key:"<< node->key << dendl;
+    _encode(node, bl);
   }
   bl.write_fd(fd);
 
@@ -134,6 +161,7 @@ int MemDB::_load()
 
   ssize_t file_size = st.st_size;
   ssize_t bytes_done = 0;
+  uint64_t seq = m_last_seq.load() + 1;
   while (bytes_done < file_size) {
     string key;
     bufferptr datap;
@@ -142,9 +170,9 @@ int MemDB::_load()
     bytes_done += ceph::decode_file(fd, datap);
 
     dout(10) << __func__ << " Key:"<< key << dendl;
-    m_map[key] = datap;
-    m_total_bytes += datap.length();
+    _put(key, std::move(datap), seq);
   }
+  m_last_seq.store(seq);
   VOID_TEMP_FAILURE_RETRY(::close(fd));
   return 0;
 }
@@ -217,12 +245,252 @@ MemDB::~MemDB()
 
 void MemDB::close()
 {
+  if (!logger) {
+    // not open, or closed already
+    return;
+  }
   /*
    * Save whatever in memory btree.
    */
   _save();
-  if (logger)
-    m_cct->get_perfcounters_collection()->remove(logger);
+  _clear();
+  m_cct->get_perfcounters_collection()->remove(logger);
+  delete logger;
+  logger = nullptr;
+}
+
+void MemDB::_clear()
+{
+  std::lock_guard<std::mutex> l(m_lock);
+  auto node = m_head.next[0].load(std::memory_order_relaxed);
+  while (node) {
+    auto next = node->next[0].load(std::memory_order_relaxed);
+    delete node;
+    node = next;
+  }
+  for (int i = 0; i < max_height; ++i) {
+    m_head.next[i].store(nullptr, std::memory_order_relaxed);
+  }
+  for (auto& p : m_gc_retired) {
+    delete p.second;
+  }
+  m_gc_retired.clear();
+  m_gc_pending.clear();
+}
+
+/*
+ * Snapshots.
+ *
+ * A writer frees nothing a snapshot at or after the oldest announced one
+ * can reach.  A reader which announces itself after the writer looked at
+ * the slots settles on a sequence it reads afterwards, which is at least
+ * the one the writer saw, so it is covered as well.
+ */
+void MemDB::_get_snapshot(snapshot_t *snap, bool pin)
+{
+  if (!pin) {
+    int i = thread_idx % num_reader_slots;
+    for (int n = 0; n < num_reader_slots; ++n) {
+      auto& slot = m_reader_slots[(i + n) % num_reader_slots];
+      uint64_t seq = m_last_seq.load();
+      uint64_t expected = 0;
+      if (!slot.seq.compare_exchange_strong(expected, seq)) {
+	continue;
+      }
+      uint64_t last;
+      while ((last = m_last_seq.load()) != seq) {
+	slot.seq.store(last);
+	seq = last;
+      }
+      snap->seq = seq;
+      snap->slot = (i + n) % num_reader_slots;
+      return;
+    }
+  }
+  // iterators may live long, and there may be many of them
+  std::lock_guard<std::mutex> l(m_snapshot_lock);
+  snap->seq = m_last_seq.load();
+  snap->slot = -1;
+  snap->pos = m_snapshots.insert(snap->seq);
+}
+
+void MemDB::_put_snapshot(snapshot_t &snap)
+{
+  if (snap.slot >= 0) {
+    m_reader_slots[snap.slot].seq.store(0);
+  } else {
+    std::lock_guard<std::mutex> l(m_snapshot_lock);
+    m_snapshots.erase(snap.pos);
+  }
+}
+
+uint64_t MemDB::_get_oldest_snapshot()
+{
+  uint64_t oldest = m_last_seq.load();
+  for (auto& slot : m_reader_slots) {
+    uint64_t seq = slot.seq.load();
+    if (seq && seq < oldest) {
+      oldest = seq;
+    }
+  }
+  std::lock_guard<std::mutex> l(m_snapshot_lock);
+  if (!m_snapshots.empty() && *m_snapshots.begin() < oldest) {
+    oldest = *m_snapshots.begin();
+  }
+  return oldest;
+}
+
+/*
+ * Skiplist.  Only the writer holding m_lock modifies it, a node is fully
+ * set up before it is linked in, so readers need nothing but acquire loads.
+ */
+int MemDB::_random_height()
+{
+  // xorshift64, one level up in four
+  m_rand ^= m_rand << 13;
+  m_rand ^= m_rand >> 7;
+  m_rand ^= m_rand << 17;
+  uint64_t r = m_rand;
+  int height = 1;
+  while (height < max_height && (r & 3) == 0) {
+    ++height;
+    r >>= 2;
+  }
+  return height;
+}
+
+MemDB::node_t* MemDB::_find_greater_or_equal(const std::string &key,
+					     node_t **prev)
+{
+  node_t *x = &m_head;
+  int level = max_height - 1;
+  while (true) {
+    node_t *next = x->next[level].load(std::memory_order_acquire);
+    if (next && next->key < key) {
+      x = next;
+    } else {
+      if (prev) {
+	prev[level] = x;
+      }
+      if (level == 0) {
+	return next;
+      }
+      --level;
+    }
+  }
+}
+
+MemDB::node_t* MemDB::_find_less_than(const std::string &key)
+{
+  node_t *x = &m_head;
+  int level = max_height - 1;
+  while (true) {
+    node_t *next = x->next[level].load(std::memory_order_acquire);
+    if (next && next->key < key) {
+      x = next;
+    } else if (level == 0) {
+      return x == &m_head ? nullptr : x;
+    } else {
+      --level;
+    }
+  }
+}
+
+MemDB::node_t* MemDB::_find_last()
+{
+  node_t *x = &m_head;
+  int level = max_height - 1;
+  while (true) {
+    node_t *next = x->next[level].load(std::memory_order_acquire);
+    if (next) {
+      x = next;
+    } else if (level == 0) {
+      return x == &m_head ? nullptr : x;
+    } else {
+      --level;
+    }
+  }
+}
+
+MemDB::node_t* MemDB::_find(const std::string &key)
+{
+  node_t *node = _find_greater_or_equal(key, nullptr);
+  if (node && node->key == key) {
+    return node;
+  }
+  return nullptr;
+}
+
+MemDB::node_t* MemDB::_insert(const std::string &key, node_t **prev)
+{
+  node_t *node = new node_t(key, _random_height());
+  for (int i = 0; i < node->height; ++i) {
+    node->next[i].store(prev[i]->next[i].load(std::memory_order_relaxed),
+			std::memory_order_relaxed);
+    prev[i]->next[i].store(node, std::memory_order_release);
+  }
+  return node;
+}
+
+void MemDB::_unlink(node_t *node)
+{
+  // the node's own links stay intact for readers still standing on it
+  node_t *prev[max_height];
+  node_t *found = _find_greater_or_equal(node->key, prev);
+  ceph_assert(found == node);
+  for (int i = 0; i < node->height; ++i) {
+    if (prev[i]->next[i].load(std::memory_order_relaxed) == node) {
+      prev[i]->next[i].store(node->next[i].load(std::memory_order_relaxed),
+			     std::memory_order_release);
+    }
+  }
+  node->unlinked = true;
+}
+
+void MemDB::_add_version(node_t *node, version_t *v)
+{
+  version_t *older = node->versions.load(std::memory_order_relaxed);
+  v->older.store(older, std::memory_order_relaxed);
+  node->versions.store(v, std::memory_order_release);
+  if (older || v->deleted) {
+    m_gc_pending.emplace_back(v->seq, node);
+  }
+}
+
+void MemDB::_gc(uint64_t oldest, uint64_t seq)
+{
+  // no snapshot left which started before these were unlinked
+  while (!m_gc_retired.empty() && m_gc_retired.front().first <= oldest) {
+    delete m_gc_retired.front().second;
+    m_gc_retired.pop_front();
+  }
+  while (!m_gc_pending.empty() && m_gc_pending.front().first <= oldest) {
+    node_t *node = m_gc_pending.front().second;
+    m_gc_pending.pop_front();
+    if (node->unlinked) {
+      continue;
+    }
+    // every snapshot stops at this version or a newer one, what is
+    // behind it can go right away
+    version_t *v = node->versions.load(std::memory_order_relaxed);
+    while (v->seq > oldest) {
+      v = v->older.load(std::memory_order_relaxed);
+      ceph_assert(v);
+    }
+    version_t *older = v->older.load(std::memory_order_relaxed);
+    v->older.store(nullptr, std::memory_order_relaxed);
+    while (older) {
+      version_t *p = older->older.load(std::memory_order_relaxed);
+      delete older;
+      older = p;
+    }
+    if (v->deleted && v == node->versions.load(std::memory_order_relaxed)) {
+      // deleted for everyone; snapshots older than this transaction may
+      // still walk through it though
+      _unlink(node);
+      m_gc_retired.emplace_back(seq, node);
+    }
+  }
 }
 
 int MemDB::submit_transaction(KeyValueDB::Transaction t)
@@ -232,18 +500,25 @@ int MemDB::submit_transaction(KeyValueDB::Transaction t)
   MDBTransactionImpl* mt =  static_cast<MDBTransactionImpl*>(t.get());
 
   dtrace << __func__ << " " << mt->get_ops().size() << dendl;
-  for(auto& op : mt->get_ops()) {
-    if(op.first == MDBTransactionImpl::WRITE) {
-      ms_op_t set_op = op.second;
-      _setkey(set_op);
-    } else if (op.first == MDBTransactionImpl::MERGE) {
-      ms_op_t merge_op = op.second;
-      _merge(merge_op);
-    } else {
-      ms_op_t rm_op = op.second;
-      ceph_assert(op.first == MDBTransactionImpl::DELETE);
-      _rmkey(rm_op);
+  {
+    std::lock_guard<std::mutex> l(m_lock);
+    uint64_t seq = m_last_seq.load() + 1;
+    _gc(_get_oldest_snapshot(), seq);
+    for(auto& op : mt->get_ops()) {
+      if(op.first == MDBTransactionImpl::WRITE) {
+	ms_op_t set_op = op.second;
+	_setkey(set_op, seq);
+      } else if (op.first == MDBTransactionImpl::MERGE) {
+	ms_op_t merge_op = op.second;
+	_merge(merge_op, seq);
+      } else {
+	ms_op_t rm_op = op.second;
+	ceph_assert(op.first == MDBTransactionImpl::DELETE);
+	_rmkey(rm_op, seq);
+      }
     }
+    // readers see the whole transaction from here on
+    m_last_seq.store(seq);
   }
 
   utime_t lat = ceph_clock_now() - start;
@@ -314,44 +589,51 @@ void MemDB::MDBTransactionImpl::merge(
   return;
 }
 
-int MemDB::_setkey(ms_op_t &op)
+/*
+ * Caller holds m_lock.
+ */
+void MemDB::_put(const std::string &key, bufferptr &&bp, uint64_t seq)
+{
+  node_t *prev[max_height];
+  node_t *node = _find_greater_or_equal(key, prev);
+  if (node && node->key == key) {
+    auto cur = node->versions.load(std::memory_order_relaxed);
+    if (!cur->deleted) {
+      ceph_assert(m_total_bytes >= cur->value.length());
+      m_total_bytes -= cur->value.length();
+    }
+  } else {
+    node = _insert(key, prev);
+  }
+  m_total_bytes += bp.length();
+  _add_version(node, new version_t(seq, false, std::move(bp)));
+}
+
+int MemDB::_setkey(ms_op_t &op, uint64_t seq)
 {
-  std::lock_guard<std::mutex> l(m_lock);
   std::string key = make_key(op.first.first, op.first.second);
   bufferlist bl = op.second;
 
-  m_total_bytes += bl.length();
-
-  bufferlist bl_old;
-  if (_get(op.first.first, op.first.second, &bl_old)) {
-    /*
-     * delete and free existing key.
-     */
-    ceph_assert(m_total_bytes >= bl_old.length());
-    m_total_bytes -= bl_old.length();
-    m_map.erase(key);
-  }
-
-  m_map[key] = bufferptr((char *) bl.c_str(), bl.length());
-  iterator_seq_no++;
+  _put(key, bufferptr((char *) bl.c_str(), bl.length()), seq);
   return 0;
 }
 
-int MemDB::_rmkey(ms_op_t &op)
+int MemDB::_rmkey(ms_op_t &op, uint64_t seq)
 {
-  std::lock_guard<std::mutex> l(m_lock);
   std::string key = make_key(op.first.first, op.first.second);
 
-  bufferlist bl_old;
-  if (_get(op.first.first, op.first.second, &bl_old)) {
-    ceph_assert(m_total_bytes >= bl_old.length());
-    m_total_bytes -= bl_old.length();
+  node_t *node = _find(key);
+  if (!node) {
+    return 0;
   }
-  iterator_seq_no++;
-  /*
-   * Erase will call the destructor for bufferptr.
-   */
-  return m_map.erase(key);
+  auto cur = node->versions.load(std::memory_order_relaxed);
+  if (cur->deleted) {
+    return 0;
+  }
+  ceph_assert(m_total_bytes >= cur->value.length());
+  m_total_bytes -= cur->value.length();
+  _add_version(node, new version_t(seq, true, bufferptr()));
+  return 1;
 }
 
 std::shared_ptr<KeyValueDB::MergeOperator> MemDB::_find_merge_op(const std::string &prefix)
@@ -367,13 +649,11 @@ std::shared_ptr<KeyValueDB::MergeOperator> MemDB::_find_merge_op(const std::stri
 }
 
 
-int MemDB::_merge(ms_op_t &op)
+int MemDB::_merge(ms_op_t &op, uint64_t seq)
 {
-  std::lock_guard<std::mutex> l(m_lock);
   std::string prefix = op.first.first;
   std::string key = make_key(op.first.first, op.first.second);
   bufferlist bl = op.second;
-  int64_t bytes_adjusted = bl.length();
 
   /*
    *  find the operator for this prefix
@@ -384,65 +664,55 @@ int MemDB::_merge(ms_op_t &op)
   /*
    * call the merge operator with value and non value
    */
-  bufferlist bl_old;
-  if (_get(op.first.first, op.first.second, &bl_old) == false) {
-    std::string new_val;
+  node_t *node = _find(key);
+  const version_t *cur =
+    node ? node->versions.load(std::memory_order_relaxed) : nullptr;
+  std::string new_val;
+  if (!cur || cur->deleted) {
     /*
      * Merge non existent.
      */
     mop->merge_nonexistent(bl.c_str(), bl.length(), &new_val);
-    m_map[key] = bufferptr(new_val.c_str(), new_val.length());
   } else {
     /*
      * Merge existing.
      */
-    std::string new_val;
-    mop->merge(bl_old.c_str(), bl_old.length(), bl.c_str(), bl.length(), &new_val);
-    m_map[key] = bufferptr(new_val.c_str(), new_val.length());
-    bytes_adjusted -= bl_old.length();
-    bl_old.clear();
+    mop->merge(cur->value.c_str(), cur->value.length(),
+	       bl.c_str(), bl.length(), &new_val);
   }
-
-  ceph_assert((int64_t)m_total_bytes + bytes_adjusted >= 0);
-  m_total_bytes += bytes_adjusted;
-  iterator_seq_no++;
+  _put(key, bufferptr(new_val.c_str(), new_val.length()), seq);
   return 0;
 }
 
-/*
- * Caller take btree lock.
- */
-bool MemDB::_get(const string &prefix, const string &k, bufferlist *out)
+bool MemDB::_get(uint64_t seq, const string &prefix, const string &k,
+		 bufferlist *out)
 {
-  string key = make_key(prefix, k);
-
-  mdb_iter_t iter = m_map.find(key);
-  if (iter == m_map.end()) {
+  node_t *node = _find(make_key(prefix, k));
+  if (!node) {
     return false;
   }
-
-  out->push_back((m_map[key].clone()));
+  auto v = node->get(seq);
+  if (!v) {
+    return false;
+  }
+  out->push_back(bufferptr(v->value.c_str(), v->value.length()));
   return true;
 }
 
-bool MemDB::_get_locked(const string &prefix, const string &k, bufferlist *out)
-{
-  std::lock_guard<std::mutex> l(m_lock);
-  return _get(prefix, k, out);
-}
-
-
 int MemDB::get(const string &prefix, const std::string& key,
                  bufferlist *out)
 {
   utime_t start = ceph_clock_now();
   int ret;
 
-  if (_get_locked(prefix, key, out)) {
+  snapshot_t snap;
+  _get_snapshot(&snap, false);
+  if (_get(snap.seq, prefix, key, out)) {
     ret = 0;
   } else {
     ret = -ENOENT;
   }
+  _put_snapshot(snap);
 
   utime_t lat = ceph_clock_now() - start;
   logger->inc(l_memdb_gets);
@@ -456,11 +726,14 @@ int MemDB::get(const string &prefix, const std::set<string> &keys,
 {
   utime_t start = ceph_clock_now();
 
+  snapshot_t snap;
+  _get_snapshot(&snap, false);
   for (const auto& i : keys) {
     bufferlist bl;
-    if (_get_locked(prefix, i, &bl))
+    if (_get(snap.seq, prefix, i, &bl))
       out->insert(make_pair(i, bl));
   }
+  _put_snapshot(snap);
 
   utime_t lat = ceph_clock_now() - start;
   logger->inc(l_memdb_gets);
@@ -469,61 +742,54 @@ int MemDB::get(const string &prefix, const std::set<string> &keys,
   return 0;
 }
 
-void MemDB::MDBWholeSpaceIteratorImpl::fill_current()
+void MemDB::MDBWholeSpaceIteratorImpl::fill_current(const version_t *v)
 {
   bufferlist bl;
-  bl.push_back(m_iter->second.clone());
-  m_key_value = std::make_pair(m_iter->first, bl);
+  bl.push_back(bufferptr(v->value.c_str(), v->value.length()));
+  m_key_value = std::make_pair(m_node->key, bl);
 }
 
 bool MemDB::MDBWholeSpaceIteratorImpl::valid()
 {
-  if (m_key_value.first.empty()) {
-    return false;
-  }
-  return true;
+  return m_node != nullptr;
 }
 
-bool MemDB::MDBWholeSpaceIteratorImpl::iterator_validate() {
-
-  if (this_seq_no != *global_seq_no) {
-    auto key = m_key_value.first;
-    ceph_assert(!key.empty());
-
-    bool restart_iter = false;
-    if (!m_using_btree) {
-      /*
-       * Map is modified and marker key does not exists, 
-       * restart the iterator from next key.
-       */
-      if (m_map_p->find(key) == m_map_p->end()) {
-        restart_iter = true;
-      }
-    } else {
-      restart_iter = true;
-    }
+void
+MemDB::MDBWholeSpaceIteratorImpl::free_last()
+{
+  m_node = nullptr;
+  m_key_value.first.clear();
+  m_key_value.second.clear();
+}
 
-    if (restart_iter) {
-      m_iter = m_map_p->lower_bound(key);
-      if (m_iter == m_map_p->end()) {
-        return false;
-      }
+/*
+ * First node from the given one on which is visible in our snapshot.
+ * Nodes we step on can't be freed while the snapshot is held.
+ */
+int MemDB::MDBWholeSpaceIteratorImpl::_seek(node_t *node)
+{
+  free_last();
+  for (; node; node = node->next[0].load(std::memory_order_acquire)) {
+    if (auto v = node->get(m_snap.seq); v) {
+      m_node = node;
+      fill_current(v);
+      return 0;
     }
-
-    /*
-     * This iter is valid now.
-     */
-    this_seq_no = *global_seq_no;
   }
-
-  return true;
+  return -1;
 }
 
-void
-MemDB::MDBWholeSpaceIteratorImpl::free_last()
+int MemDB::MDBWholeSpaceIteratorImpl::_seek_back(node_t *node)
 {
-  m_key_value.first.clear();
-  m_key_value.second.clear();
+  free_last();
+  for (; node; node = m_db->_find_less_than(node->key)) {
+    if (auto v = node->get(m_snap.seq); v) {
+      m_node = node;
+      fill_current(v);
+      return 0;
+    }
+  }
+  return -1;
 }
 
 string MemDB::MDBWholeSpaceIteratorImpl::key()
@@ -557,36 +823,18 @@ bufferlist MemDB::MDBWholeSpaceIteratorImpl::value()
 
 int MemDB::MDBWholeSpaceIteratorImpl::next()
 {
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
-  if (!iterator_validate()) {
-    free_last();
-    return -1;
-  }
-  free_last();
-  ++m_iter;
-  if (m_iter != m_map_p->end()) {
-    fill_current();
-    return 0;
-  } else {
+  if (!m_node) {
     return -1;
   }
+  return _seek(m_node->next[0].load(std::memory_order_acquire));
 }
 
 int MemDB::MDBWholeSpaceIteratorImpl:: prev()
 {
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
-  if (!iterator_validate()) {
-    free_last();
-    return -1;
-  }
-  free_last();
-  if (m_iter != m_map_p->begin()) {
-    --m_iter;
-    fill_current();
-    return 0;
-  } else {
+  if (!m_node) {
     return -1;
   }
+  return _seek_back(m_db->_find_less_than(m_node->key));
 }
 
 /*
@@ -594,68 +842,41 @@ int MemDB::MDBWholeSpaceIteratorImpl:: prev()
  */
 int MemDB::MDBWholeSpaceIteratorImpl::seek_to_first(const std::string &k)
 {
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
-  free_last();
-  if (k.empty()) {
-    m_iter = m_map_p->begin();
-  } else {
-    m_iter = m_map_p->lower_bound(k);
-  }
-  
-  if (m_iter == m_map_p->end()) {
-    return -1;
-  }
-  fill_current();
-  return 0;
+  return _seek(m_db->_find_greater_or_equal(k, nullptr));
 }
 
+/*
+ * Last key with the given prefix, if prefix is null then last key in btree.
+ */
 int MemDB::MDBWholeSpaceIteratorImpl::seek_to_last(const std::string &k)
 {
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
-  free_last();
   if (k.empty()) {
-    m_iter = m_map_p->end();
-    --m_iter;
-  } else {
-    m_iter = m_map_p->lower_bound(k);
-  }
-
-  if (m_iter == m_map_p->end()) {
-    return -1;
+    return _seek_back(m_db->_find_last());
   }
-  fill_current();
-  return 0;
+  return _seek_back(m_db->_find_less_than(past_prefix(k)));
 }
 
 MemDB::MDBWholeSpaceIteratorImpl::~MDBWholeSpaceIteratorImpl()
 {
   free_last();
+  m_db->_put_snapshot(m_snap);
 }
 
 int MemDB::MDBWholeSpaceIteratorImpl::upper_bound(const std::string &prefix,
     const std::string &after) {
 
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
-
   dtrace << "upper_bound " << prefix.c_str() << after.c_str() << dendl;
   string k = make_key(prefix, after);
-  m_iter = m_map_p->upper_bound(k);
-  if (m_iter != m_map_p->end()) {
-    fill_current();
-    return 0;
+  node_t *node = m_db->_find_greater_or_equal(k, nullptr);
+  if (node && node->key == k) {
+    node = node->next[0].load(std::memory_order_acquire);
   }
-  return -1;
+  return _seek(node);
 }
 
 int MemDB::MDBWholeSpaceIteratorImpl::lower_bound(const std::string &prefix,
     const std::string &to) {
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
   dtrace << "lower_bound " << prefix.c_str() << to.c_str() << dendl;
   string k = make_key(prefix, to);
-  m_iter = m_map_p->lower_bound(k);
-  if (m_iter != m_map_p->end()) {
-    fill_current();
-    return 0;
-  }
-  return -1;
+  return _seek(m_db->_find_greater_or_equal(k, nullptr));
 }
@@ -9,11 +9,15 @@
 #define CEPH_OS_BLUESTORE_MEMDB_H
 
 #include "include/buffer.h"
+#include <atomic>
+#include <deque>
+#include <mutex>
 #include <ostream>
 #include <set>
 #include <map>
 #include <string>
 #include <memory>
+#include <vector>
 #include <boost/scoped_ptr.hpp>
 #include "include/common_fwd.h"
 #include "include/encoding.h"
@@ -33,18 +37,90 @@ enum {
   l_memdb_last,
 };
 
+/*
+ * The keys live in a skiplist which is modified by one transaction at a
+ * time and read without any locking, in the spirit of the rocksdb/leveldb
+ * memtable.  Every key keeps a short chain of versions tagged with the
+ * sequence number of the transaction which wrote them, so that readers
+ * see a consistent snapshot: a transaction becomes visible as a whole once
+ * its sequence number is published, and an iterator keeps seeing the
+ * store as of its creation however long it lives.
+ *
+ * Versions and deleted keys no reader can see anymore are reclaimed by
+ * the next transactions.  Readers announce the snapshot they use in a
+ * small array of slots (point lookups) or in a set (iterators) so that
+ * nothing they may still reach is freed under them.
+ */
 class MemDB : public KeyValueDB
 {
   typedef std::pair<std::pair<std::string, std::string>, ceph::bufferlist> ms_op_t;
-  std::mutex m_lock;
-  uint64_t m_total_bytes;
+
+  struct version_t {
+    const uint64_t seq;
+    const bool deleted;
+    const ceph::bufferptr value;
+    std::atomic<version_t*> older = {nullptr};
+
+    version_t(uint64_t seq, bool deleted, ceph::bufferptr&& value)
+      : seq(seq), deleted(deleted), value(std::move(value)) {}
+  };
+
+  static constexpr int max_height = 16;
+
+  struct node_t {
+    const std::string key;
+    std::atomic<version_t*> versions = {nullptr};	///< newest first
+    const int height;
+    bool unlinked = false;
+    std::unique_ptr<std::atomic<node_t*>[]> next;
+
+    node_t(std::string key, int height)
+      : key(std::move(key)), height(height),
+	next(new std::atomic<node_t*>[height]) {
+      for (int i = 0; i < height; ++i) {
+	next[i].store(nullptr, std::memory_order_relaxed);
+      }
+    }
+    ~node_t();
+
+    /// the version a reader at snapshot seq sees, nullptr if none or deleted
+    const version_t* get(uint64_t seq) const {
+      for (auto v = versions.load(std::memory_order_acquire); v;
+	   v = v->older.load(std::memory_order_acquire)) {
+	if (v->seq <= seq) {
+	  return v->deleted ? nullptr : v;
+	}
+      }
+      return nullptr;
+    }
+  };
+
+  struct snapshot_t {
+    uint64_t seq = 0;
+    int slot = -1;	///< -1 if pinned in m_snapshots
+    std::multiset<uint64_t>::iterator pos;
+  };
+
+  static constexpr int num_reader_slots = 64;
+  struct alignas(64) reader_slot_t {
+    std::atomic<uint64_t> seq = {0};	///< 0 if unused
+  };
+
+  std::mutex m_lock;	///< serializes writers
+  std::atomic<uint64_t> m_total_bytes;
   uint64_t m_allocated_bytes;
 
-  typedef std::map<std::string, ceph::bufferptr> mdb_map_t;
-  typedef mdb_map_t::iterator mdb_iter_t;
-  bool m_using_btree;
+  node_t m_head;
+  std::atomic<uint64_t> m_last_seq;	///< last published transaction
+  reader_slot_t m_reader_slots[num_reader_slots];
+  std::mutex m_snapshot_lock;
+  std::multiset<uint64_t> m_snapshots;
+  uint64_t m_rand;	///< skiplist height generator state
 
-  mdb_map_t m_map;
+  /// nodes written by a transaction which may have reclaimable versions
+  std::deque<std::pair<uint64_t, node_t*>> m_gc_pending;
+  /// unlinked nodes, freed once no snapshot predates their unlinking
+  std::deque<std::pair<uint64_t, node_t*>> m_gc_retired;
 
   CephContext *m_cct;
   PerfCounters *logger;
@@ -55,18 +131,34 @@ class MemDB : public KeyValueDB
   int transaction_rollback(KeyValueDB::Transaction t);
   int _open(std::ostream &out);
   void close() override;
-  bool _get(const std::string &prefix, const std::string &k, ceph::bufferlist *out);
-  bool _get_locked(const std::string &prefix, const std::string &k, ceph::bufferlist *out);
+  bool _get(uint64_t seq, const std::string &prefix, const std::string &k,
+	    ceph::bufferlist *out);
   std::string _get_data_fn();
-  void _encode(mdb_iter_t iter, ceph::bufferlist &bl);
+  void _encode(const node_t *node, ceph::bufferlist &bl);
   void _save();
   int _load();
-  uint64_t iterator_seq_no;
+
+  void _get_snapshot(snapshot_t *snap, bool pin);
+  void _put_snapshot(snapshot_t &snap);
+  uint64_t _get_oldest_snapshot();
+
+  int _random_height();
+  node_t* _find_greater_or_equal(const std::string &key, node_t **prev);
+  node_t* _find_less_than(const std::string &key);
+  node_t* _find_last();
+  node_t* _find(const std::string &key);
+  node_t* _insert(const std::string &key, node_t **prev);
+  void _unlink(node_t *node);
+  void _add_version(node_t *node, version_t *v);
+  void _put(const std::string &key, ceph::bufferptr &&bp, uint64_t seq);
+  void _gc(uint64_t oldest, uint64_t seq);
+  void _clear();
 
 public:
   MemDB(CephContext *c, const std::string &path, void *p) :
-    m_total_bytes(0), m_allocated_bytes(0), m_using_btree(false),
-    m_cct(c), logger(NULL), m_priv(p), m_db_path(path), iterator_seq_no(1)
+    m_total_bytes(0), m_allocated_bytes(0),
+    m_head(std::string(), max_height), m_last_seq(1), m_rand(0xdeadbeef),
+    m_cct(c), logger(NULL), m_priv(p), m_db_path(path)
   {
     //Nothing as of now
   }
@@ -121,10 +213,9 @@ private:
   /*
    * Transaction states.
    */
-  int _merge(const std::string &k, ceph::bufferptr &bl);
-  int _merge(ms_op_t &op);
-  int _setkey(ms_op_t &op);
-  int _rmkey(ms_op_t &op);
+  int _merge(ms_op_t &op, uint64_t seq);
+  int _setkey(ms_op_t &op, uint64_t seq);
+  int _rmkey(ms_op_t &op, uint64_t seq);
 
 public:
 
@@ -152,27 +243,20 @@ public:
   using KeyValueDB::get;
 
   class MDBWholeSpaceIteratorImpl : public KeyValueDB::WholeSpaceIteratorImpl {
+    MemDB *m_db;
+    snapshot_t m_snap;
+    node_t *m_node = nullptr;
+    std::pair<std::string, ceph::bufferlist> m_key_value;
 
-      mdb_iter_t m_iter;
-      std::pair<std::string, ceph::bufferlist> m_key_value;
-      mdb_map_t *m_map_p;
-      std::mutex *m_map_lock_p;
-      uint64_t *global_seq_no;
-      uint64_t this_seq_no;
-      bool m_using_btree;
+    int _seek(node_t *node);
+    int _seek_back(node_t *node);
 
   public:
-    MDBWholeSpaceIteratorImpl(mdb_map_t *btree_p, std::mutex *btree_lock_p,
-                              uint64_t *iterator_seq_no, bool using_btree) {
-      m_map_p = btree_p;
-      m_map_lock_p = btree_lock_p;
-      std::lock_guard<std::mutex> l(*m_map_lock_p);
-      global_seq_no = iterator_seq_no;
-      this_seq_no = *iterator_seq_no;
-      m_using_btree = using_btree;
+    explicit MDBWholeSpaceIteratorImpl(MemDB *db) : m_db(db) {
+      m_db->_get_snapshot(&m_snap, true);
     }
 
-    void fill_current();
+    void fill_current(const version_t *v);
     void free_last();
 
 
@@ -185,7 +269,6 @@ public:
     int upper_bound(const std::string &prefix, const std::string &after) override;
     int lower_bound(const std::string &prefix, const std::string &to) override;
     bool valid() override;
-    bool iterator_validate();
 
     int next() override;
     int prev() override;
@@ -199,12 +282,10 @@ public:
   };
 
   uint64_t get_estimated_size(std::map<std::string,uint64_t> &extra) override {
-      std::lock_guard<std::mutex> l(m_lock);
       return m_allocated_bytes;
   };
 
   int get_statfs(struct store_statfs_t *buf) override {
-    std::lock_guard<std::mutex> l(m_lock);
     buf->reset();
     buf->total = m_total_bytes;
     buf->allocated = m_allocated_bytes;
@@ -214,9 +295,8 @@ public:
 
   WholeSpaceIterator get_wholespace_iterator(IteratorOpts opts = 0) override {
     return std::shared_ptr<KeyValueDB::WholeSpaceIteratorImpl>(
-      new MDBWholeSpaceIteratorImpl(&m_map, &m_lock, &iterator_seq_no, m_using_btree));
+      new MDBWholeSpaceIteratorImpl(this));
   }
 };
 
 #endif
-
@@ -181,6 +181,16 @@ int RocksDBStore::set_merge_operator(
   return 0;
 }
 
+int RocksDBStore::set_prefix_access_hint(
+  const string& prefix,
+  access_hint_t hint)
+{
+  // If you fail here, it's because you can't do this on an open database
+  ceph_assert(db == nullptr);
+  access_hints[prefix] = hint;
+  return 0;
+}
+
 class CephRocksdbLogger : public rocksdb::Logger {
   CephContext *cct;
 public:
@@ -448,6 +458,61 @@ int RocksDBStore::install_cf_mergeop(
   return 0;
 }
 
+void RocksDBStore::install_cf_access_hint(
+  const string &cf_name,
+  rocksdb::ColumnFamilyOptions *cf_opt)
+{
+  ceph_assert(cf_opt != nullptr);
+  auto p = access_hints.find(cf_name);
+  if (p == access_hints.end() || p->second == access_hint_t::NONE) {
+    return;
+  }
+  // Only the defaults derived from our config are adjusted here, explicit
+  // options of the column family are applied on top of these.
+  rocksdb::BlockBasedTableOptions column_bbt_opts = bbt_opts;
+  uint64_t bloom_bits = cct->_conf.get_val<uint64_t>("rocksdb_bloom_bits_per_key");
+  switch (p->second) {
+  case access_hint_t::POINT_LOOKUP:
+    // small blocks and whole key bloom filters, in memtables as well
+    column_bbt_opts.block_size = std::min<size_t>(column_bbt_opts.block_size, 4096);
+    if (!column_bbt_opts.filter_policy) {
+      column_bbt_opts.filter_policy.reset(
+	rocksdb::NewBloomFilterPolicy(bloom_bits ? bloom_bits : 10));
+    }
+    column_bbt_opts.whole_key_filtering = true;
+    cf_opt->memtable_prefix_bloom_size_ratio = 0.02;
+    cf_opt->memtable_whole_key_filtering = true;
+    break;
+  case access_hint_t::RANGE_SCAN:
+    // large blocks for fewer reads per scan; filters don't help seeks but
+    // are kept for the occasional get()
+    column_bbt_opts.block_size = std::max<size_t>(column_bbt_opts.block_size, 16384);
+    break;
+  case access_hint_t::WRITE_ONCE:
+    // no lookups to filter, compact the files untouched for the longest
+    // first as keys are not overwritten
+    column_bbt_opts.filter_policy.reset();
+    cf_opt->compaction_pri = rocksdb::kOldestSmallestSeqFirst;
+    break;
+  case access_hint_t::NONE:
+    break;
+  }
+  dout(10) << __func__ << " " << cf_name << " hint " << (int)p->second
+	   << " block_size " << column_bbt_opts.block_size
+	   << " filter " << (column_bbt_opts.filter_policy ? "bloom" : "none")
+	   << dendl;
+  if (column_bbt_opts.block_size == bbt_opts.block_size &&
+      column_bbt_opts.filter_policy == bbt_opts.filter_policy &&
+      column_bbt_opts.whole_key_filtering == bbt_opts.whole_key_filtering) {
+    // keep sharing the default table factory
+    return;
+  }
+  // the block cache is still the shared one, so this is not a per-CF
+  // cache (cf_bbt_opts), just the base for explicit block cache options
+  hint_bbt_opts[cf_name] = column_bbt_opts;
+  cf_opt->table_factory.reset(rocksdb::NewBlockBasedTableFactory(column_bbt_opts));
+}
+
 int RocksDBStore::create_and_open(ostream &out,
 				  const std::string& cfs)
 {
@@ -774,6 +839,7 @@ int RocksDBStore::create_shards(const rocksdb::Options& opt,
     // copy default CF settings, block cache, merge operators as
     // the base for new CF
     rocksdb::ColumnFamilyOptions cf_opt(opt);
+    install_cf_access_hint(p.name, &cf_opt);
     // user input options will override the base options
     std::unordered_map<std::string, std::string> column_opts_map;
     std::string block_cache_opts;
@@ -927,6 +993,7 @@ int RocksDBStore::verify_sharding(const rocksdb::Options& opt,
 
   for (auto& column : stored_sharding_def) {
     rocksdb::ColumnFamilyOptions cf_opt(opt);
+    install_cf_access_hint(column.name, &cf_opt);
     std::unordered_map<std::string, std::string> options_map;
     std::string block_cache_opt;
 
@@ -983,7 +1050,10 @@ int RocksDBStore::verify_sharding(const rocksdb::Options& opt,
       }
 
       rocksdb::BlockBasedTableOptions column_bbt_opts;
-      status = GetBlockBasedTableOptionsFromMap(bbt_opts, cache_options_map, &column_bbt_opts);
+      auto base_bbt_opts = hint_bbt_opts.find(column.name);
+      status = GetBlockBasedTableOptionsFromMap(
+	base_bbt_opts != hint_bbt_opts.end() ? base_bbt_opts->second : bbt_opts,
+	cache_options_map, &column_bbt_opts);
       if (!status.ok()) {
 	derr << __func__ << " invalid block cache options; column=" << column.name <<
 	  " options=" << block_cache_opt << dendl;
@@ -1175,6 +1245,7 @@ int RocksDBStore::do_open(ostream &out,
   
   PerfCountersBuilder plb(cct, "rocksdb", l_rocksdb_first, l_rocksdb_last);
   plb.add_u64_counter(l_rocksdb_gets, "get", "Gets");
+  plb.add_u64_counter(l_rocksdb_multi_get_keys, "multi_get_keys", "Keys looked up in batches");
   plb.add_time_avg(l_rocksdb_get_latency, "get_latency", "Get latency");
   plb.add_time_avg(l_rocksdb_submit_latency, "submit_latency", "Submit Latency");
   plb.add_time_avg(l_rocksdb_submit_sync_latency, "submit_sync_latency", "Submit Sync Latency");
@@ -1182,6 +1253,8 @@ int RocksDBStore::do_open(ostream &out,
   plb.add_u64_counter(l_rocksdb_compact_range, "compact_range", "Compactions by range");
   plb.add_u64_counter(l_rocksdb_compact_queue_merge, "compact_queue_merge", "Mergings of ranges in compaction queue");
   plb.add_u64(l_rocksdb_compact_queue_len, "compact_queue_len", "Length of compaction queue");
+  plb.add_u64_counter(l_rocksdb_delete_range, "delete_range", "DeleteRange operations");
+  plb.add_u64_counter(l_rocksdb_tombstone_compact, "tombstone_compact", "Range compactions queued to drop deletion tombstones");
   plb.add_time_avg(l_rocksdb_write_wal_time, "rocksdb_write_wal_time", "Rocksdb write wal time");
   plb.add_time_avg(l_rocksdb_write_memtable_time, "rocksdb_write_memtable_time", "Rocksdb write memtable time");
   plb.add_time_avg(l_rocksdb_write_delay_time, "rocksdb_write_delay_time", "Rocksdb write delay time");
@@ -1497,6 +1570,12 @@ int RocksDBStore::submit_common(rocksdb::WriteOptions& woptions, KeyValueDB::Tra
     _t->bat.Iterate(&rocks_txc);
     derr << __func__ << " error: " << s.ToString() << " code = " << s.code()
          << " Rocksdb transaction: " << rocks_txc.seen.str() << dendl;
+  } else {
+    logger->inc(l_rocksdb_delete_range, _t->range_deletes);
+    for (auto& [start, end] : _t->compact_ranges) {
+      logger->inc(l_rocksdb_tombstone_compact);
+      compact_tombstones_async(start, end);
+    }
   }
 
   if (cct->_conf->rocksdb_perf) {
@@ -1642,6 +1721,25 @@ void RocksDBStore::RocksDBTransactionImpl::rm_single_key(const string &prefix,
   }
 }
 
+void RocksDBStore::RocksDBTransactionImpl::note_deleted_range(
+  uint64_t keys,
+  bool delete_range,
+  const string &start,
+  const string &end)
+{
+  // Either way the range is left with tombstones which every iterator
+  // through it has to skip until compaction drops them, so rather than
+  // waiting for rocksdb to get there on its own schedule we compact the
+  // range once the transaction is committed.
+  if (delete_range) {
+    ++range_deletes;
+  }
+  if (db->delete_range_compact_threshold &&
+      (delete_range || keys >= db->delete_range_compact_threshold)) {
+    compact_ranges.emplace_back(start, end);
+  }
+}
+
 void RocksDBStore::RocksDBTransactionImpl::rmkeys_by_prefix(const string &prefix)
 {
   auto p_iter = db->cf_handles.find(prefix);
@@ -1652,18 +1750,24 @@ void RocksDBStore::RocksDBTransactionImpl::rmkeys_by_prefix(const string &prefix
     for (it->seek_to_first(); it->valid() && (--cnt) != 0; it->next()) {
       bat.Delete(db->default_cf, combine_strings(prefix, it->key()));
     }
+    string endprefix = prefix;
+    endprefix.push_back('\x01');
     if (cnt == 0) {
 	bat.RollbackToSavePoint();
-	string endprefix = prefix;
-        endprefix.push_back('\x01');
 	bat.DeleteRange(db->default_cf,
                         combine_strings(prefix, string()),
                         combine_strings(endprefix, string()));
     } else {
       bat.PopSavePoint();
     }
+    note_deleted_range(db->delete_range_threshold - cnt, cnt == 0,
+		       combine_strings(prefix, string()),
+		       combine_strings(endprefix, string()));
   } else {
     ceph_assert(p_iter->second.handles.size() >= 1);
+    string endprefix = "\xff\xff\xff\xff";  // FIXME: this is cheating...
+    uint64_t keys = 0;
+    bool delete_range = false;
     for (auto cf : p_iter->second.handles) {
       uint64_t cnt = db->delete_range_threshold;
       bat.SetSavePoint();
@@ -1673,12 +1777,16 @@ void RocksDBStore::RocksDBTransactionImpl::rmkeys_by_prefix(const string &prefix
       }
       if (cnt == 0) {
 	bat.RollbackToSavePoint();
-	string endprefix = "\xff\xff\xff\xff";  // FIXME: this is cheating...
 	bat.DeleteRange(cf, string(), endprefix);
+	delete_range = true;
       } else {
 	bat.PopSavePoint();
       }
+      keys += db->delete_range_threshold - cnt;
     }
+    note_deleted_range(keys, delete_range,
+		       combine_strings(prefix, string()),
+		       combine_strings(prefix, endprefix));
   }
 }
 
@@ -1704,8 +1812,13 @@ void RocksDBStore::RocksDBTransactionImpl::rm_range_keys(const string &prefix,
     } else {
       bat.PopSavePoint();
     }
+    note_deleted_range(db->delete_range_threshold - cnt, cnt == 0,
+		       combine_strings(prefix, start),
+		       combine_strings(prefix, end));
   } else {
     ceph_assert(p_iter->second.handles.size() >= 1);
+    uint64_t keys = 0;
+    bool delete_range = false;
     for (auto cf : p_iter->second.handles) {
       uint64_t cnt = db->delete_range_threshold;
       bat.SetSavePoint();
@@ -1719,11 +1832,16 @@ void RocksDBStore::RocksDBTransactionImpl::rm_range_keys(const string &prefix,
       if (cnt == 0) {
 	bat.RollbackToSavePoint();
 	bat.DeleteRange(cf, rocksdb::Slice(start), rocksdb::Slice(end));
+	delete_range = true;
       } else {
 	bat.PopSavePoint();
       }
+      keys += db->delete_range_threshold - cnt;
       delete it;
     }
+    note_deleted_range(keys, delete_range,
+		       combine_strings(prefix, start),
+		       combine_strings(prefix, end));
   }
 }
 
@@ -1772,41 +1890,69 @@ int RocksDBStore::get(
     const std::set<string> &keys,
     std::map<string, bufferlist> *out)
 {
-  rocksdb::PinnableSlice value;
+  std::vector<string> key_vec(keys.begin(), keys.end());
+  std::vector<int> rs;
+  std::vector<bufferlist> values;
+  multi_get(prefix, key_vec, &rs, &values);
+  for (size_t i = 0; i < key_vec.size(); ++i) {
+    if (rs[i] == 0) {
+      (*out)[key_vec[i]] = std::move(values[i]);
+    }
+  }
+  return 0;
+}
+
+void RocksDBStore::multi_get(
+    const string &prefix,
+    const std::vector<string> &keys,
+    std::vector<int> *rs,
+    std::vector<bufferlist> *values)
+{
+  const size_t n = keys.size();
+  rs->resize(n);
+  values->resize(n);
+  if (n == 0) {
+    return;
+  }
   utime_t start = ceph_clock_now();
+  std::vector<rocksdb::ColumnFamilyHandle*> cfs(n);
+  std::vector<rocksdb::Slice> slices(n);
+  std::vector<string> combined;
   if (cf_handles.count(prefix) > 0) {
-    for (auto& key : keys) {
-      auto cf_handle = get_cf_handle(prefix, key);
-      auto status = db->Get(rocksdb::ReadOptions(),
-			    cf_handle,
-			    rocksdb::Slice(key),
-			    &value);
-      if (status.ok()) {
-	(*out)[key].append(value.data(), value.size());
-      } else if (status.IsIOError()) {
-	ceph_abort_msg(status.getState());
-      }
-      value.Reset();
+    for (size_t i = 0; i < n; ++i) {
+      cfs[i] = get_cf_handle(prefix, keys[i]);
+      slices[i] = rocksdb::Slice(keys[i]);
     }
   } else {
-    for (auto& key : keys) {
-      string k = combine_strings(prefix, key);
-      auto status = db->Get(rocksdb::ReadOptions(),
-			    default_cf,
-			    rocksdb::Slice(k),
-			    &value);
-      if (status.ok()) {
-	(*out)[key].append(value.data(), value.size());
-      } else if (status.IsIOError()) {
-	ceph_abort_msg(status.getState());
-      }
-      value.Reset();
+    // reserved so that the slices stay valid
+    combined.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+      combined.push_back(combine_strings(prefix, keys[i]));
+      cfs[i] = default_cf;
+      slices[i] = rocksdb::Slice(combined.back());
+    }
+  }
+  std::vector<rocksdb::PinnableSlice> pinned(n);
+  std::vector<rocksdb::Status> statuses(n);
+  // the batched lookup shares the work of finding the files and blocks
+  // the keys are in, and reads the blocks of one file in parallel
+  db->MultiGet(rocksdb::ReadOptions(), n, cfs.data(), slices.data(),
+	       pinned.data(), statuses.data());
+  for (size_t i = 0; i < n; ++i) {
+    (*values)[i].clear();
+    if (statuses[i].ok()) {
+      (*values)[i].append(pinned[i].data(), pinned[i].size());
+      (*rs)[i] = 0;
+    } else if (statuses[i].IsIOError()) {
+      ceph_abort_msg(statuses[i].getState());
+    } else {
+      (*rs)[i] = statuses[i].IsNotFound() ? -ENOENT : -EIO;
     }
   }
   utime_t lat = ceph_clock_now() - start;
   logger->inc(l_rocksdb_gets);
+  logger->inc(l_rocksdb_multi_get_keys, n);
   logger->tinc(l_rocksdb_get_latency, lat);
-  return 0;
 }
 
 int RocksDBStore::get(
@@ -1937,6 +2083,28 @@ void RocksDBStore::compact_thread_entry()
       l.lock();
       continue;
     }
+    if (!tombstone_queue.empty()) {
+      auto next = tombstone_compact_last +
+	ceph::make_timespan(delete_range_compact_interval);
+      if (ceph::mono_clock::now() >= next) {
+	// everything queued since the last round, coalesced; these are
+	// not exclusive so that they don't hold up rocksdb's own
+	// compactions
+	std::map<std::string,std::string> ranges;
+	ranges.swap(tombstone_queue);
+	l.unlock();
+	for (auto& [start, end] : ranges) {
+	  logger->inc(l_rocksdb_compact_range);
+	  compact_range(start, end, false);
+	}
+	l.lock();
+	tombstone_compact_last = ceph::mono_clock::now();
+	continue;
+      }
+      dout(10) << __func__ << " waiting for tombstone compaction" << dendl;
+      compact_queue_cond.wait_until(l, next);
+      continue;
+    }
     dout(10) << __func__ << " waiting" << dendl;
     compact_queue_cond.wait(l);
   }
@@ -1996,9 +2164,34 @@ bool RocksDBStore::check_omap_dir(string &omap_dir)
   return status.ok();
 }
 
-void RocksDBStore::compact_range(const string& start, const string& end)
+void RocksDBStore::compact_tombstones_async(const string& start,
+					    const string& end)
+{
+  std::lock_guard l(compact_queue_lock);
+  string s = start, e = end;
+  // merge with every queued range it overlaps or touches
+  auto p = tombstone_queue.upper_bound(s);
+  if (p != tombstone_queue.begin() && std::prev(p)->second >= s) {
+    --p;
+  }
+  while (p != tombstone_queue.end() && p->first <= e) {
+    s = std::min(s, p->first);
+    e = std::max(e, p->second);
+    p = tombstone_queue.erase(p);
+    logger->inc(l_rocksdb_compact_queue_merge);
+  }
+  tombstone_queue.emplace(s, e);
+  compact_queue_cond.notify_all();
+  if (!compact_thread.is_started()) {
+    compact_thread.create("rstore_compact");
+  }
+}
+
+void RocksDBStore::compact_range(const string& start, const string& end,
+				 bool exclusive)
 {
   rocksdb::CompactRangeOptions options;
+  options.exclusive_manual_compaction = exclusive;
   rocksdb::Slice cstart(start);
   rocksdb::Slice cend(end);
   string prefix_start, key_start;
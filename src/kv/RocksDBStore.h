@@ -32,6 +32,7 @@
 enum {
   l_rocksdb_first = 34300,
   l_rocksdb_gets,
+  l_rocksdb_multi_get_keys,
   l_rocksdb_get_latency,
   l_rocksdb_submit_latency,
   l_rocksdb_submit_sync_latency,
@@ -39,6 +40,8 @@ enum {
   l_rocksdb_compact_range,
   l_rocksdb_compact_queue_merge,
   l_rocksdb_compact_queue_len,
+  l_rocksdb_delete_range,
+  l_rocksdb_tombstone_compact,
   l_rocksdb_write_wal_time,
   l_rocksdb_write_memtable_time,
   l_rocksdb_write_delay_time,
@@ -125,6 +128,10 @@ private:
 
   int submit_common(rocksdb::WriteOptions& woptions, KeyValueDB::Transaction t);
   int install_cf_mergeop(const std::string &cf_name, rocksdb::ColumnFamilyOptions *cf_opt);
+  std::map<std::string, access_hint_t> access_hints;
+  /// table options tuned by access hints, sharing the default block cache
+  std::unordered_map<std::string, rocksdb::BlockBasedTableOptions> hint_bbt_opts;
+  void install_cf_access_hint(const std::string &cf_name, rocksdb::ColumnFamilyOptions *cf_opt);
   int create_db_dir();
   int do_open(std::ostream &out, bool create_if_missing, bool open_readonly,
 	      const std::string& cfs="");
@@ -159,6 +166,10 @@ private:
     ceph::make_mutex("RocksDBStore::compact_thread_lock");
   ceph::condition_variable compact_queue_cond;
   std::list<std::pair<std::string,std::string>> compact_queue;
+  /// ranges left full of tombstones, coalesced (start -> end) and compacted
+  /// at most once every delete_range_compact_interval
+  std::map<std::string,std::string> tombstone_queue;
+  ceph::mono_time tombstone_compact_last;
   bool compact_queue_stop;
   class CompactThread : public Thread {
     RocksDBStore *db;
@@ -173,8 +184,11 @@ private:
 
   void compact_thread_entry();
 
-  void compact_range(const std::string& start, const std::string& end);
+  void compact_range(const std::string& start, const std::string& end,
+		     bool exclusive = true);
   void compact_range_async(const std::string& start, const std::string& end);
+  void compact_tombstones_async(const std::string& start,
+				const std::string& end);
   int tryInterpret(const std::string& key, const std::string& val,
 		   rocksdb::Options& opt);
 
@@ -183,6 +197,8 @@ public:
   bool compact_on_mount;
   bool disableWAL;
   const uint64_t delete_range_threshold;
+  const uint64_t delete_range_compact_threshold;
+  const double delete_range_compact_interval;
   void compact() override;
 
   void compact_async() override {
@@ -228,7 +244,9 @@ public:
     compact_thread(this),
     compact_on_mount(false),
     disableWAL(false),
-    delete_range_threshold(cct->_conf.get_val<uint64_t>("rocksdb_delete_range_threshold"))
+    delete_range_threshold(cct->_conf.get_val<uint64_t>("rocksdb_delete_range_threshold")),
+    delete_range_compact_threshold(cct->_conf.get_val<uint64_t>("rocksdb_delete_range_compact_threshold")),
+    delete_range_compact_interval(cct->_conf.get_val<double>("rocksdb_delete_range_compact_interval"))
   {}
 
   ~RocksDBStore() override;
@@ -251,6 +269,9 @@ public:
   int repair(std::ostream &out) override;
   void split_stats(const std::string &s, char delim, std::vector<std::string> &elems);
   void get_statistics(ceph::Formatter *f) override;
+  uint64_t get_latest_sequence() override {
+    return db->GetLatestSequenceNumber();
+  }
 
   PerfCounters *get_perf_counters() override
   {
@@ -268,9 +289,19 @@ public:
   public:
     rocksdb::WriteBatch bat;
     RocksDBStore *db;
+    /// DeleteRange ops in bat
+    uint64_t range_deletes = 0;
+    /// ranges (prefixed keys) which get enough tombstones from this
+    /// transaction to be worth compacting once it is committed
+    std::vector<std::pair<std::string, std::string>> compact_ranges;
 
     explicit RocksDBTransactionImpl(RocksDBStore *_db);
   private:
+    void note_deleted_range(
+      uint64_t keys,
+      bool delete_range,
+      const std::string &start,
+      const std::string &end);
     void put_bat(
       rocksdb::WriteBatch& bat,
       rocksdb::ColumnFamilyHandle *cf,
@@ -330,6 +361,11 @@ public:
     const char *key,
     size_t keylen,
     ceph::bufferlist *out) override;
+  void multi_get(
+    const std::string &prefix,
+    const std::vector<std::string> &keys,
+    std::vector<int> *rs,
+    std::vector<ceph::bufferlist> *values) override;
 
 
   class RocksDBWholeSpaceIteratorImpl :
@@ -392,6 +428,8 @@ public:
   int set_merge_operator(
     const std::string& prefix,
     std::shared_ptr<KeyValueDB::MergeOperator> mop) override;
+  int set_prefix_access_hint(const std::string& prefix,
+			     access_hint_t hint) override;
   std::string assoc_name; ///< Name of associative operator
 
   uint64_t get_estimated_size(std::map<std::string,uint64_t> &extra) override {
@@ -487,7 +525,8 @@ err:
   virtual std::shared_ptr<PriorityCache::PriCache>
       get_priority_cache(string prefix) const override {
     auto it = cf_bbt_opts.find(prefix);
-    if (it != cf_bbt_opts.end()) {
+    if (it != cf_bbt_opts.end() &&
+	it->second.block_cache != bbt_opts.block_cache) {
       return dynamic_pointer_cast<PriorityCache::PriCache>(
           it->second.block_cache);
     }
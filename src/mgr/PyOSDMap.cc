@@ -148,6 +148,8 @@ static PyObject *osdmap_calc_pg_upmaps(BasePyOSDMap* self, PyObject *args)
 	   << " pools " << pools
 	   << dendl;
   PyThreadState *tstate = PyEval_SaveThread();
+  // no ParallelPGMapper here, the initial pg mapping is done serially on
+  // the calling (balancer) thread
   int r = self->osdmap->calc_pg_upmaps(g_ceph_context,
 				 max_deviation,
 				 max_iterations,
@@ -420,6 +420,7 @@ public:
   OSDMonitor *osdmon;
   utime_t start;
   epoch_t epoch;
+  bool check = false;  ///< cross-check an incremental mapping
   C_UpdateCreatingPGs(OSDMonitor *osdmon, epoch_t e) :
     osdmon(osdmon), start(ceph_clock_now()), epoch(e) {}
   void finish(int r) override {
@@ -427,6 +428,9 @@ public:
       utime_t end = ceph_clock_now();
       dout(10) << "osdmap epoch " << epoch << " mapping took "
 	       << (end - start) << " seconds" << dendl;
+      if (check) {
+	osdmon->check_mapping(epoch);
+      }
       osdmon->update_creating_pgs();
       osdmon->check_pg_creates_subs();
     }
@@ -777,6 +781,7 @@ void OSDMonitor::update_from_paxos(bool *need_bootstrap)
     dout(7) << __func__ << " loading latest full map e" << latest_full << dendl;
     osdmap = OSDMap();
     osdmap.decode(latest_bl);
+    mapping_incs.clear();
   }
 
   bufferlist bl;
@@ -817,6 +822,12 @@ void OSDMonitor::update_from_paxos(bool *need_bootstrap)
     OSDMap::Incremental inc(inc_bl);
     err = osdmap.apply_incremental(inc);
     ceph_assert(err == 0);
+    if (inc.crush.length()) {
+      // the mapping will be recalculated from scratch anyway
+      mapping_incs.clear();
+    } else {
+      mapping_incs.push_back(inc);
+    }
 
     if (!t)
       t.reset(new MonitorDBStore::Transaction);
@@ -859,6 +870,7 @@ void OSDMonitor::update_from_paxos(bool *need_bootstrap)
 
 	osdmap = OSDMap();
 	osdmap.decode(orig_full_bl);
+	mapping_incs.clear();
 
 	dout(20) << __func__ << " canonical full osdmap:\n";
 	JSONFormatter jf(true);
@@ -1057,8 +1069,16 @@ void OSDMonitor::start_mapping()
   }
   if (!osdmap.get_pools().empty()) {
     auto fin = new C_UpdateCreatingPGs(this, osdmap.get_epoch());
-    mapping_job = mapping.start_update(osdmap, mapper,
-				       g_conf()->mon_osd_mapping_pgs_per_chunk);
+    if (g_conf().get_val<bool>("mon_osd_mapping_incremental")) {
+      fin->check =
+	g_conf().get_val<bool>("mon_osd_mapping_incremental_check");
+      mapping_job = mapping.start_update(
+	osdmap, mapper, g_conf()->mon_osd_mapping_pgs_per_chunk,
+	mapping_incs);
+    } else {
+      mapping_job = mapping.start_update(
+	osdmap, mapper, g_conf()->mon_osd_mapping_pgs_per_chunk);
+    }
     dout(10) << __func__ << " started mapping job " << mapping_job.get()
 	     << " at " << fin->start << dendl;
     mapping_job->set_finish_event(fin);
@@ -1066,6 +1086,43 @@ void OSDMonitor::start_mapping()
     dout(10) << __func__ << " no pools, no mapping job" << dendl;
     mapping_job = nullptr;
   }
+  mapping_incs.clear();
+}
+
+void OSDMonitor::check_mapping(epoch_t e)
+{
+  if (mapping.get_epoch() != e || osdmap.get_epoch() != e) {
+    dout(10) << __func__ << " mapping e" << mapping.get_epoch()
+	     << " osdmap e" << osdmap.get_epoch() << ", skipping" << dendl;
+    return;
+  }
+  OSDMapMapping full;
+  full.update(osdmap);
+  unsigned mismatched = 0;
+  for (auto& [poolid, pool] : osdmap.get_pools()) {
+    for (unsigned ps = 0; ps < pool.get_pg_num(); ++ps) {
+      pg_t pgid(ps, poolid);
+      vector<int> up, acting, full_up, full_acting;
+      int up_primary, acting_primary, full_up_primary, full_acting_primary;
+      mapping.get(pgid, &up, &up_primary, &acting, &acting_primary);
+      full.get(pgid, &full_up, &full_up_primary, &full_acting,
+	       &full_acting_primary);
+      if (up != full_up || up_primary != full_up_primary ||
+	  acting != full_acting || acting_primary != full_acting_primary) {
+	derr << __func__ << " " << pgid << " incremental up " << up
+	     << " p" << up_primary << " acting " << acting
+	     << " p" << acting_primary << " != full up " << full_up
+	     << " p" << full_up_primary << " acting " << full_acting
+	     << " p" << full_acting_primary << dendl;
+	++mismatched;
+      }
+    }
+  }
+  if (mismatched) {
+    ceph_abort_msg("incremental pg mapping differs from full recalculation");
+  }
+  dout(10) << __func__ << " e" << e << " " << full.get_num_pgs()
+	   << " pgs match" << dendl;
 }
 
 void OSDMonitor::update_msgr_features()
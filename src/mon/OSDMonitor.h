@@ -390,7 +390,11 @@ private:
   ParallelPGMapper mapper;                        ///< for background pg work
   OSDMapMapping mapping;                          ///< pg <-> osd mappings
   std::unique_ptr<ParallelPGMapper::Job> mapping_job;  ///< background mapping job
+  /// incrementals applied since the last start_mapping()
+  std::vector<OSDMap::Incremental> mapping_incs;
   void start_mapping();
+  /// abort if mapping (as of e) differs from a full recalculation
+  void check_mapping(epoch_t e);
 
   void update_logger();
 
@@ -107,6 +107,31 @@ public:
     return ms_fast_preprocess(m.get());
   }
 
+  /**
+   * Let the Dispatcher supply the buffer the data payload of an incoming
+   * Message is received into, e.g. to have it aligned the way the
+   * ObjectStore wants it or to land it in memory the caller already owns.
+   * This is called from the messenger thread once the message header is
+   * known and before the payload is read off the wire, so it has to be as
+   * cheap and lock-free as ms_fast_preprocess(). It is only a hint: the
+   * Messenger may not be able to receive in place (e.g. in secure mode)
+   * and then doesn't ask at all.
+   *
+   * @param con The Connection the Message arrives on.
+   * @param type The Message type.
+   * @param tid The Message tid.
+   * @param data_off The data offset from the Message header.
+   * @param data_len The length of the data payload.
+   * @param bl Empty; fill it with at least data_len bytes of buffers,
+   * which may be scattered over any number of bufferptrs.
+   * @return true if bl was filled in, false to let the Messenger allocate.
+   */
+  virtual bool ms_get_rx_data_buffer(Connection *con, int type, uint64_t tid,
+				     uint32_t data_off, uint32_t data_len,
+				     ceph::buffer::list *bl) {
+    return false;
+  }
+
   /**
    * The Messenger calls this function to deliver a single message.
    *
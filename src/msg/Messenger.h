@@ -699,6 +699,23 @@ public:
       dispatcher->ms_fast_preprocess2(m);
     }
   }
+  /**
+   * Ask the Dispatchers, in order, for the buffer to receive the data
+   * payload of a Message into.
+   *
+   * @return true if one of them supplied it.
+   */
+  bool ms_get_rx_data_buffer(Connection *con, int type, uint64_t tid,
+			     uint32_t data_off, uint32_t data_len,
+			     ceph::buffer::list *bl) {
+    for (const auto &dispatcher : dispatchers) {
+      if (dispatcher->ms_get_rx_data_buffer(con, type, tid, data_off,
+					    data_len, bl)) {
+	return true;
+      }
+    }
+    return false;
+  }
   /**
    *  Deliver a single Message. Send it to each Dispatcher
    *  in sequence until one of them handles it.
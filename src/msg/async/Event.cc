@@ -142,6 +142,9 @@ int EventCenter::init(int nevent, unsigned center_id, const std::string &type)
   file_events.resize(nevent);
   this->nevent = nevent;
 
+  busy_poll_max_us = cct->_conf.get_val<uint64_t>("ms_async_busy_poll_us");
+  busy_poll_us = busy_poll_max_us;
+
   if (!driver->need_wakeup())
     return 0;
 
@@ -377,7 +380,47 @@ int EventCenter::process_time_events()
   return processed;
 }
 
-int EventCenter::process_events(unsigned timeout_microseconds,  ceph::timespan *working_dur)
+int EventCenter::busy_poll(std::vector<FiredFileEvent> &fired_events,
+                           unsigned *timeout_microseconds,
+                           ceph::timespan *spin_dur)
+{
+  struct timeval tv = {0, 0};
+  auto start = ceph::mono_clock::now();
+  auto end = start + std::chrono::microseconds(
+    std::min(busy_poll_us, *timeout_microseconds));
+  auto now = start;
+  int numevents;
+  do {
+    numevents = driver->event_wait(fired_events, &tv);
+    now = ceph::mono_clock::now();
+  } while (numevents == 0 && now < end);
+  ++busy_polls;
+
+  auto spent = now - start;
+  if (spin_dur)
+    *spin_dur += spent;
+  auto spent_us = std::chrono::duration_cast<std::chrono::microseconds>(spent).count();
+  *timeout_microseconds -= std::min<uint64_t>(spent_us, *timeout_microseconds);
+
+  // Poll longer while events keep showing up within the budget, back off
+  // while they don't so that a mostly idle worker doesn't burn its core.
+  // Never below 1/16 of the maximum to notice when the load picks up.
+  if (numevents) {
+    ++busy_poll_hits;
+    busy_poll_us = std::min(busy_poll_us * 2, busy_poll_max_us);
+  } else {
+    busy_poll_us = std::max(busy_poll_us / 2, std::max(busy_poll_max_us / 16, 1u));
+  }
+  ldout(cct, 30) << __func__ << " polled " << spent_us << " usec, got "
+                 << numevents << " events, next budget " << busy_poll_us
+                 << " usec" << dendl;
+  return numevents;
+}
+
+int EventCenter::process_events(unsigned timeout_microseconds,
+                                ceph::timespan *working_dur,
+                                ceph::timespan *spin_dur,
+                                ceph::timespan *idle_dur)
 {
   struct timeval tv;
   int numevents;
@@ -400,12 +443,25 @@ int EventCenter::process_events(unsigned timeout_microseconds,  ceph::timespan *
   bool blocking = pollers.empty() && !external_num_events.load();
   if (!blocking)
     timeout_microseconds = 0;
-  tv.tv_sec = timeout_microseconds / 1000000;
-  tv.tv_usec = timeout_microseconds % 1000000;
 
-  ldout(cct, 30) << __func__ << " wait second " << tv.tv_sec << " usec " << tv.tv_usec << dendl;
   std::vector<FiredFileEvent> fired_events;
-  numevents = driver->event_wait(fired_events, &tv);
+  numevents = 0;
+  if (busy_poll_max_us && timeout_microseconds)
+    numevents = busy_poll(fired_events, &timeout_microseconds, spin_dur);
+
+  if (numevents == 0) {
+    tv.tv_sec = timeout_microseconds / 1000000;
+    tv.tv_usec = timeout_microseconds % 1000000;
+
+    ldout(cct, 30) << __func__ << " wait second " << tv.tv_sec << " usec " << tv.tv_usec << dendl;
+    if (idle_dur && timeout_microseconds) {
+      auto idle_start = ceph::mono_clock::now();
+      numevents = driver->event_wait(fired_events, &tv);
+      *idle_dur += ceph::mono_clock::now() - idle_start;
+    } else {
+      numevents = driver->event_wait(fired_events, &tv);
+    }
+  }
   auto working_start = ceph::mono_clock::now();
   for (int event_id = 0; event_id < numevents; event_id++) {
     int rfired = 0;
@@ -175,8 +175,16 @@ class EventCenter {
   EventCallbackRef notify_handler;
   unsigned center_id;
   AssociatedCenters *global_centers = nullptr;
+  // Busy polling before blocking in the driver, see ms_async_busy_poll_us.
+  // The current budget adapts to how often polling finds an event.
+  unsigned busy_poll_max_us = 0;
+  unsigned busy_poll_us = 0;
+  uint64_t busy_polls = 0;      ///< busy_poll() rounds
+  uint64_t busy_poll_hits = 0;  ///< rounds which found an event
 
   int process_time_events();
+  int busy_poll(std::vector<FiredFileEvent> &fired_events,
+                unsigned *timeout_microseconds, ceph::timespan *spin_dur);
   FileEvent *_get_file_event(int fd) {
     ceph_assert(fd < nevent);
     return &file_events[fd];
@@ -196,6 +204,9 @@ class EventCenter {
   void set_owner();
   pthread_t get_owner() const { return owner; }
   unsigned get_id() const { return center_id; }
+  uint64_t get_busy_polls() const { return busy_polls; }
+  uint64_t get_busy_poll_hits() const { return busy_poll_hits; }
+  unsigned get_busy_poll_us() const { return busy_poll_us; }
 
   EventDriver *get_driver() { return driver; }
 
@@ -204,7 +215,10 @@ class EventCenter {
   uint64_t create_time_event(uint64_t milliseconds, EventCallbackRef ctxt);
   void delete_file_event(int fd, int mask);
   void delete_time_event(uint64_t id);
-  int process_events(unsigned timeout_microseconds, ceph::timespan *working_dur = nullptr);
+  int process_events(unsigned timeout_microseconds,
+                     ceph::timespan *working_dur = nullptr,
+                     ceph::timespan *spin_dur = nullptr,
+                     ceph::timespan *idle_dur = nullptr);
   void wakeup();
 
   // Used by external thread
@@ -21,6 +21,13 @@
 #include <errno.h>
 
 #include <algorithm>
+#include <deque>
+#include <map>
+
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#include <linux/errqueue.h>
+#define HAVE_MSG_ZEROCOPY
+#endif
 
 #include "PosixStack.h"
 
@@ -37,16 +44,193 @@
 #undef dout_prefix
 #define dout_prefix *_dout << "PosixStack "
 
+#ifdef HAVE_MSG_ZEROCOPY
+// Data sent with MSG_ZEROCOPY must stay untouched until the kernel is
+// done with it.  Every such sendmsg call gets the next id from the
+// kernel, completions are reported on the socket error queue as ranges
+// of ids, which also wakes up the EventCenter (EPOLLERR).
+struct ZerocopyTracker {
+  PerfCounters *logger = nullptr;
+  uint32_t next = 0;	///< id of the next MSG_ZEROCOPY sendmsg
+  uint32_t done = 0;	///< all ids below this one completed
+  std::map<uint32_t, uint32_t> done_ooo; ///< completed [lo, hi] past a gap
+  std::deque<uint32_t> call_bytes; ///< bytes sent by each id from done on
+  /// sent data and the last id it was sent with
+  std::deque<std::pair<uint32_t, ceph::buffer::list>> pending;
+
+  bool outstanding() const {
+    return done != next;
+  }
+
+  /// note a MSG_ZEROCOPY sendmsg which sent bytes
+  void sent(uint32_t bytes) {
+    call_bytes.push_back(bytes);
+    ++next;
+  }
+
+  /// keep bl until every call made so far completed
+  void pin(ceph::buffer::list&& bl) {
+    pending.emplace_back(next - 1, std::move(bl));
+  }
+
+  void complete(uint32_t lo, uint32_t hi, bool copied) {
+    // the kernel reports whether it had to copy per range of calls
+    uint64_t bytes = 0;
+    for (uint32_t id = lo; id != hi + 1; ++id) {
+      if ((uint32_t)(id - done) < call_bytes.size()) {
+	bytes += call_bytes[id - done];
+      }
+    }
+    logger->inc(copied ? l_msgr_send_zerocopy_copied_bytes :
+		l_msgr_send_zerocopy_bytes, bytes);
+    if (lo != done) {
+      // rare, but completions may be reported out of order
+      done_ooo[lo] = hi;
+      return;
+    }
+    uint32_t old_done = done;
+    done = hi + 1;
+    for (auto p = done_ooo.find(done);
+	 p != done_ooo.end();
+	 p = done_ooo.find(done)) {
+      done = p->second + 1;
+      done_ooo.erase(p);
+    }
+    call_bytes.erase(call_bytes.begin(),
+		     call_bytes.begin() + std::min<size_t>(done - old_done,
+							   call_bytes.size()));
+    while (!pending.empty() &&
+	   (int32_t)(pending.front().first - done) < 0) {
+      pending.pop_front();
+    }
+  }
+
+  /// read completions off the error queue, with @force drain it even if
+  /// no call is outstanding: anything left there keeps EPOLLERR raised
+  void reap(int fd, bool force) {
+    while (force || outstanding()) {
+      char control[128];
+      struct msghdr msg;
+      // FIPS zeroization audit 20191115: this memset is not security related.
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      if (::recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+	break;
+      }
+      for (auto cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+	if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+	    !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+	  continue;
+	}
+	auto serr = reinterpret_cast<struct sock_extended_err*>(CMSG_DATA(cm));
+	if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+	  continue;
+	}
+	complete(serr->ee_info, serr->ee_data,
+		 serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED);
+      }
+    }
+  }
+};
+
+// Closing the socket doesn't stop the kernel from sending what is still
+// queued, from the very pages zerocopy sends were made with.  Keep the fd
+// and the sent data around until the last completion came in.  A peer
+// that doesn't take the data within ZEROCOPY_LINGER_MAX gets a reset,
+// which makes the kernel drop the send queue.  So does stopping the
+// worker: nothing would poll the socket any more.
+class C_zerocopy_linger : public EventCallback {
+  static constexpr uint64_t ZEROCOPY_LINGER_POLL_US = 10000;
+  static constexpr auto ZEROCOPY_LINGER_MAX = std::chrono::seconds(10);
+
+  CephContext *cct;
+  PosixWorker *worker;
+  int fd;
+  ZerocopyTracker zerocopy;
+  ceph::mono_time deadline;
+  bool lingering = false;	///< in worker->zerocopy_lingering
+  uint64_t time_id = 0;	///< pending poll, 0 if none
+
+ public:
+  C_zerocopy_linger(CephContext *cct, PosixWorker *w, int fd,
+		    ZerocopyTracker&& zc)
+    : cct(cct), worker(w), fd(fd), zerocopy(std::move(zc)),
+      deadline(ceph::mono_clock::now() + ZEROCOPY_LINGER_MAX) {}
+
+  void do_request(uint64_t id) override {
+    time_id = 0;
+    zerocopy.reap(fd, false);
+    // external events left over when the worker stopped are run by
+    // ~EventCenter, when no time event will ever fire again
+    if (zerocopy.outstanding() && worker->is_init() &&
+	ceph::mono_clock::now() < deadline) {
+      if (!lingering) {
+	worker->zerocopy_lingering.insert(this);
+	lingering = true;
+      }
+      time_id = worker->center.create_time_event(ZEROCOPY_LINGER_POLL_US,
+						 this);
+      return;
+    }
+    finish();
+  }
+
+  /// close the socket now, resetting it if sends are still in flight
+  void finish() {
+    if (time_id) {
+      worker->center.delete_time_event(time_id);
+    }
+    if (zerocopy.outstanding()) {
+      ldout(cct, 1) << __func__ << " fd " << fd << " still has "
+		    << (zerocopy.next - zerocopy.done)
+		    << " zerocopy sends in flight, resetting" << dendl;
+      struct linger l = {1, 0};
+      ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+    }
+    compat_closesocket(fd);
+    if (lingering) {
+      worker->zerocopy_lingering.erase(this);
+    }
+    delete this;
+  }
+};
+#endif
+
 class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
   ceph::NetHandler &handler;
   int _fd;
   entity_addr_t sa;
   bool connected;
 
+#ifdef HAVE_MSG_ZEROCOPY
+  CephContext *cct;
+  PosixWorker *worker;
+  size_t zerocopy_min_size = 0;	///< 0 if disabled
+  ZerocopyTracker zerocopy;
+#endif
+
  public:
   explicit PosixConnectedSocketImpl(ceph::NetHandler &h, const entity_addr_t &sa,
-				    int f, bool connected)
-      : handler(h), _fd(f), sa(sa), connected(connected) {}
+				    int f, bool connected, Worker *w)
+      : handler(h), _fd(f), sa(sa), connected(connected) {
+#ifdef HAVE_MSG_ZEROCOPY
+    cct = w->cct;
+    worker = static_cast<PosixWorker*>(w);
+    zerocopy.logger = w->get_perf_counter();
+    zerocopy_min_size =
+      cct->_conf.get_val<Option::size_t>("ms_tcp_zerocopy_min_size");
+    if (zerocopy_min_size) {
+      int on = 1;
+      if (::setsockopt(_fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) < 0) {
+	int r = ceph_sock_errno();
+	ldout(cct, 1) << __func__ << " couldn't set SO_ZEROCOPY: "
+		      << cpp_strerror(r) << dendl;
+	zerocopy_min_size = 0;
+      }
+    }
+#endif
+  }
 
   int is_connected() override {
     if (connected)
@@ -64,6 +248,9 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
   }
 
   ssize_t read(char *buf, size_t len) override {
+    #ifdef HAVE_MSG_ZEROCOPY
+    zerocopy.reap(_fd, false);
+    #endif
     #ifdef _WIN32
     ssize_t r = ::recv(_fd, buf, len, 0);
     #else
@@ -71,29 +258,58 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
     #endif
     if (r < 0)
       r = -ceph_sock_errno();
+    #ifdef HAVE_MSG_ZEROCOPY
+    // EPOLLERR is reported as readable, a wakeup without data may have
+    // been for the error queue
+    if (r == -EAGAIN && zerocopy_min_size) {
+      zerocopy.reap(_fd, true);
+    }
+    #endif
     return r;
   }
 
   // return the sent length
   // < 0 means error occurred
   #ifndef _WIN32
-  static ssize_t do_sendmsg(int fd, struct msghdr &msg, unsigned len, bool more)
+  // zerocopy_calls counts the sendmsg calls made with MSG_ZEROCOPY
+  ssize_t do_sendmsg(struct msghdr &msg, unsigned len, bool more,
+		     bool use_zerocopy, unsigned *zerocopy_calls)
   {
     size_t sent = 0;
     while (1) {
       MSGR_SIGPIPE_STOPPER;
       ssize_t r;
-      r = ::sendmsg(fd, &msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+      int flags = MSG_NOSIGNAL | (more ? MSG_MORE : 0);
+      #ifdef HAVE_MSG_ZEROCOPY
+      if (use_zerocopy) {
+        flags |= MSG_ZEROCOPY;
+      }
+      #endif
+      r = ::sendmsg(_fd, &msg, flags);
       if (r < 0) {
         int err = ceph_sock_errno();
         if (err == EINTR) {
           continue;
         } else if (err == EAGAIN) {
           break;
+        } else if (err == ENOBUFS && use_zerocopy) {
+          // no room left to track completions, copy the rest
+          use_zerocopy = false;
+          #ifdef HAVE_MSG_ZEROCOPY
+          zerocopy.logger->inc(l_msgr_send_zerocopy_fallback_bytes,
+                               len - sent);
+          #endif
+          continue;
         }
         return -err;
       }
 
+      #ifdef HAVE_MSG_ZEROCOPY
+      if (use_zerocopy) {
+        zerocopy.sent(r);
+        ++*zerocopy_calls;
+      }
+      #endif
       sent += r;
       if (len == sent) break;
 
@@ -115,6 +331,10 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
 
   ssize_t send(ceph::buffer::list &bl, bool more) override {
     size_t sent_bytes = 0;
+    unsigned zerocopy_calls = 0;
+    #ifdef HAVE_MSG_ZEROCOPY
+    zerocopy.reap(_fd, false);
+    #endif
     auto pb = std::cbegin(bl.buffers());
     uint64_t left_pbrs = bl.get_num_buffers();
     while (left_pbrs) {
@@ -133,9 +353,24 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
 	msglen += pb->length();
 	++pb;
       }
-      ssize_t r = do_sendmsg(_fd, msg, msglen, left_pbrs || more);
-      if (r < 0)
+      bool use_zerocopy = false;
+      #ifdef HAVE_MSG_ZEROCOPY
+      use_zerocopy = zerocopy_min_size && msglen >= zerocopy_min_size;
+      #endif
+      unsigned calls = 0;
+      ssize_t r = do_sendmsg(msg, msglen, left_pbrs || more,
+			     use_zerocopy, &calls);
+      zerocopy_calls += calls;
+      if (r < 0) {
+        #ifdef HAVE_MSG_ZEROCOPY
+        // whatever went out before the error may still be in use, and we
+        // don't know how much that was: hold on to all of it
+        if (zerocopy_calls) {
+          zerocopy.pin(ceph::buffer::list(bl));
+        }
+        #endif
         return r;
+      }
 
       // "r" is the remaining length
       sent_bytes += r;
@@ -150,8 +385,14 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
         bl.splice(sent_bytes, bl.length()-sent_bytes, &swapped);
         bl.swap(swapped);
       } else {
-        bl.clear();
+        bl.swap(swapped);
       }
+      // "swapped" now holds what was sent
+      #ifdef HAVE_MSG_ZEROCOPY
+      if (zerocopy_calls) {
+        zerocopy.pin(std::move(swapped));
+      }
+      #endif
     }
 
     return static_cast<ssize_t>(sent_bytes);
@@ -204,6 +445,17 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
     ::shutdown(_fd, SHUT_RDWR);
   }
   void close() override {
+    #ifdef HAVE_MSG_ZEROCOPY
+    zerocopy.reap(_fd, false);
+    if (zerocopy.outstanding()) {
+      ldout(cct, 10) << __func__ << " fd " << _fd << " lingering for "
+		     << (zerocopy.next - zerocopy.done)
+		     << " zerocopy sends" << dendl;
+      worker->center.dispatch_event_external(
+	new C_zerocopy_linger(cct, worker, _fd, std::move(zerocopy)));
+      return;
+    }
+    #endif
     compat_closesocket(_fd);
   }
   int fd() const override {
@@ -259,7 +511,7 @@ int PosixServerSocketImpl::accept(ConnectedSocket *sock, const SocketOptions &op
   out->set_sockaddr((sockaddr*)&ss);
   handler.set_priority(sd, opt.priority, out->get_family());
 
-  std::unique_ptr<PosixConnectedSocketImpl> csi(new PosixConnectedSocketImpl(handler, *out, sd, true));
+  std::unique_ptr<PosixConnectedSocketImpl> csi(new PosixConnectedSocketImpl(handler, *out, sd, true, w));
   *sock = ConnectedSocket(std::move(csi));
   return 0;
 }
@@ -268,6 +520,16 @@ void PosixWorker::initialize()
 {
 }
 
+void PosixWorker::destroy()
+{
+#ifdef HAVE_MSG_ZEROCOPY
+  // the event loop is gone, nothing polls lingering sockets any more
+  while (!zerocopy_lingering.empty()) {
+    (*zerocopy_lingering.begin())->finish();
+  }
+#endif
+}
+
 int PosixWorker::listen(entity_addr_t &sa,
 			unsigned addr_slot,
 			const SocketOptions &opt,
@@ -328,7 +590,7 @@ int PosixWorker::connect(const entity_addr_t &addr, const SocketOptions &opts, C
 
   net.set_priority(sd, opts.priority, addr.get_family());
   *socket = ConnectedSocket(
-      std::unique_ptr<PosixConnectedSocketImpl>(new PosixConnectedSocketImpl(net, addr, sd, !opts.nonblock)));
+      std::unique_ptr<PosixConnectedSocketImpl>(new PosixConnectedSocketImpl(net, addr, sd, !opts.nonblock, this)));
   return 0;
 }
 
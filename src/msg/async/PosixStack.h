@@ -17,6 +17,7 @@
 #ifndef CEPH_MSG_ASYNC_POSIXSTACK_H
 #define CEPH_MSG_ASYNC_POSIXSTACK_H
 
+#include <set>
 #include <thread>
 
 #include "msg/msg_types.h"
@@ -24,9 +25,14 @@
 
 #include "Stack.h"
 
+class C_zerocopy_linger;
+
 class PosixWorker : public Worker {
   ceph::NetHandler net;
+  /// closed sockets waiting for their zerocopy sends to complete
+  std::set<C_zerocopy_linger*> zerocopy_lingering;
   void initialize() override;
+  friend class C_zerocopy_linger;
  public:
   PosixWorker(CephContext *c, unsigned i)
       : Worker(c, i), net(c) {}
@@ -35,6 +41,7 @@ class PosixWorker : public Worker {
 	     const SocketOptions &opt,
 	     ServerSocket *socks) override;
   int connect(const entity_addr_t &addr, const SocketOptions &opts, ConnectedSocket *socket) override;
+  void destroy() override;
 };
 
 class PosixNetworkStack : public NetworkStack {
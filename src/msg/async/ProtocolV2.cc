@@ -9,6 +9,7 @@
 #include "common/EventTrace.h"
 #include "common/ceph_crypto.h"
 #include "common/errno.h"
+#include "compressor/Compressor.h"
 #include "include/random.h"
 #include "auth/AuthClient.h"
 #include "auth/AuthServer.h"
@@ -28,6 +29,8 @@ std::ostream &ProtocolV2::_conn_prefix(std::ostream *_dout) {
                                                   REVISION_1)
                 << " rx=" << session_stream_handlers.rx.get()
                 << " tx=" << session_stream_handlers.tx.get()
+                << " comp rx=" << session_compression_handlers.rx.get()
+                << " tx=" << session_compression_handlers.tx.get()
                 << ").";
 }
 
@@ -82,6 +85,7 @@ if(connection->interceptor) { \
 
 ProtocolV2::ProtocolV2(AsyncConnection *connection)
     : Protocol(2, connection),
+      compression_method(Compressor::COMP_ALG_NONE),
       state(NONE),
       peer_supported_features(0),
       client_cookie(0),
@@ -94,8 +98,10 @@ ProtocolV2::ProtocolV2(AsyncConnection *connection)
       replacing(false),
       can_write(false),
       bannerExchangeCallback(nullptr),
-      tx_frame_asm(&session_stream_handlers, false),
-      rx_frame_asm(&session_stream_handlers, false),
+      tx_frame_asm(&session_stream_handlers, false,
+                   &session_compression_handlers),
+      rx_frame_asm(&session_stream_handlers, false,
+                   &session_compression_handlers),
       next_tag(static_cast<Tag>(0)),
       keepalive(false) {
 }
@@ -232,6 +238,9 @@ void ProtocolV2::reset_security() {
   auth_meta.reset(new AuthConnectionMeta);
   session_stream_handlers.rx.reset(nullptr);
   session_stream_handlers.tx.reset(nullptr);
+  session_compression_handlers.rx.reset(nullptr);
+  session_compression_handlers.tx.reset(nullptr);
+  compression_method = Compressor::COMP_ALG_NONE;
   pre_auth.rxbuf.clear();
   pre_auth.txbuf.clear();
 }
@@ -699,6 +708,7 @@ void ProtocolV2::write_event() {
     }
     connection->write_lock.unlock();
 
+    update_compression_counters();
     connection->logger->tinc(l_msgr_running_send_time,
                              ceph::mono_clock::now() - start);
     if (r < 0) {
@@ -1059,6 +1069,7 @@ CtPtr ProtocolV2::read_frame() {
   rx_preamble.clear();
   rx_epilogue.clear();
   rx_segments_data.clear();
+  rx_segment_ptrs.clear();
 
   return READ(rx_frame_asm.get_preamble_onwire_len(),
               handle_read_frame_preamble_main);
@@ -1135,6 +1146,8 @@ CtPtr ProtocolV2::handle_read_frame_dispatch() {
     case Tag::KEEPALIVE2_ACK:
     case Tag::ACK:
     case Tag::WAIT:
+    case Tag::COMPRESSION_REQUEST:
+    case Tag::COMPRESSION_DONE:
       return handle_frame_payload();
     case Tag::MESSAGE:
       return handle_message();
@@ -1159,11 +1172,16 @@ CtPtr ProtocolV2::read_frame_segment() {
     return _handle_read_frame_segment();
   }
 
-  rx_buffer_t rx_buffer;
+  ceph_assert(rx_segment_ptrs.empty());
   uint16_t align = rx_frame_asm.get_segment_align(seg_idx);
   try {
-    rx_buffer = ceph::buffer::ptr_node::create(ceph::buffer::create_aligned(
-        onwire_len, align));
+    if (next_tag == Tag::MESSAGE && seg_idx == SegmentIndex::Msg::DATA &&
+        rx_frame_asm.is_segment_onwire_verbatim(seg_idx)) {
+      prepare_rx_data_buffers(onwire_len, align);
+    } else {
+      rx_segment_ptrs.emplace_back(ceph::buffer::create_aligned(onwire_len,
+                                                                align));
+    }
   } catch (std::bad_alloc&) {
     // Catching because of potential issues with satisfying alignment.
     ldout(cct, 1) << __func__ << " can't allocate aligned rx_buffer"
@@ -1173,6 +1191,61 @@ CtPtr ProtocolV2::read_frame_segment() {
     return _fault();
   }
 
+  return read_frame_segment_ptr();
+}
+
+void ProtocolV2::prepare_rx_data_buffers(uint32_t len, uint16_t align) {
+  // the message header has been disassembled already on msgr2.1, see
+  // _handle_read_frame_segment(), on msgr2.0 it is still in its on-wire
+  // form
+  uint32_t data_off = 0;
+  auto& header_bl = rx_segments_data[SegmentIndex::Msg::HEADER];
+  if ((rx_frame_asm.get_is_rev1() ||
+       !rx_frame_asm.is_segment_compressed(SegmentIndex::Msg::HEADER)) &&
+      header_bl.length() >= sizeof(ceph_msg_header2)) {
+    auto header = reinterpret_cast<const ceph_msg_header2*>(
+        header_bl.c_str());
+    data_off = header->data_off;
+
+    ceph::bufferlist bl;
+    if (messenger->ms_get_rx_data_buffer(connection, header->type,
+                                         header->tid, data_off, len, &bl)) {
+      if (bl.length() >= len) {
+        ldout(cct, 20) << __func__ << " using supplied buffer len=" << len
+                       << " in " << bl.get_num_buffers() << " ptrs" << dendl;
+        for (const auto& p : bl.buffers()) {
+          if (len == 0) {
+            break;
+          }
+          if (p.length() == 0) {
+            continue;
+          }
+          rx_segment_ptrs.emplace_back(p, 0, std::min(p.length(), len));
+          len -= rx_segment_ptrs.back().length();
+        }
+        return;
+      }
+      ldout(cct, 1) << __func__ << " ignoring supplied buffer len="
+                    << bl.length() << " < " << len << dendl;
+    }
+  }
+
+  // Lay the payload out the way msgr1 does: with data_off modulo the
+  // alignment matching the in-memory offset, so that the block aligned
+  // parts of e.g. an object write are aligned in memory as well and the
+  // ObjectStore doesn't need to realign them.
+  uint32_t head = align ? data_off % align : 0;
+  ceph::bufferptr ptr(ceph::buffer::create_aligned(head + len, align));
+  ptr.set_offset(head);
+  ptr.set_length(len);
+  rx_segment_ptrs.push_back(std::move(ptr));
+}
+
+CtPtr ProtocolV2::read_frame_segment_ptr() {
+  ceph_assert(!rx_segment_ptrs.empty());
+  auto rx_buffer = ceph::buffer::ptr_node::create(
+      std::move(rx_segment_ptrs.front()));
+  rx_segment_ptrs.pop_front();
   return READ_RXBUF(std::move(rx_buffer), handle_read_frame_segment);
 }
 
@@ -1186,10 +1259,27 @@ CtPtr ProtocolV2::handle_read_frame_segment(rx_buffer_t &&rx_buffer, int r) {
   }
 
   rx_segments_data.back().push_back(std::move(rx_buffer));
+  if (!rx_segment_ptrs.empty()) {
+    return read_frame_segment_ptr();
+  }
   return _handle_read_frame_segment();
 }
 
 CtPtr ProtocolV2::_handle_read_frame_segment() {
+  if (rx_segments_data.size() == 1) {
+    // msgr2.1 lets us interpret the first segment before reading in the
+    // rest of the frame, prepare_rx_data_buffers() needs the message header
+    try {
+      rx_frame_asm.disassemble_first_segment(rx_preamble,
+                                             rx_segments_data[0]);
+    } catch (FrameError& e) {
+      ldout(cct, 1) << __func__ << " " << e.what() << dendl;
+      return _fault();
+    } catch (ceph::crypto::onwire::MsgAuthError&) {
+      ldout(cct, 1) << __func__ << "bad auth tag" << dendl;
+      return _fault();
+    }
+  }
   if (rx_segments_data.size() == rx_frame_asm.get_num_segments()) {
     // OK, all segments planned to read are read. Can go with epilogue.
     uint32_t epilogue_onwire_len = rx_frame_asm.get_epilogue_onwire_len();
@@ -1249,6 +1339,10 @@ CtPtr ProtocolV2::handle_frame_payload() {
       return handle_message_ack(payload);
     case Tag::WAIT:
       return handle_wait(payload);
+    case Tag::COMPRESSION_REQUEST:
+      return handle_compression_request(payload);
+    case Tag::COMPRESSION_DONE:
+      return handle_compression_done(payload);
     default:
       ceph_abort();
   }
@@ -1306,7 +1400,6 @@ CtPtr ProtocolV2::handle_read_frame_epilogue_main(rx_buffer_t &&buffer, int r)
 CtPtr ProtocolV2::_handle_read_frame_epilogue_main() {
   bool aborted;
   try {
-    rx_frame_asm.disassemble_first_segment(rx_preamble, rx_segments_data[0]);
     aborted = !rx_frame_asm.disassemble_remaining_segments(
         rx_segments_data.data(), rx_epilogue);
   } catch (FrameError& e) {
@@ -1462,6 +1555,7 @@ CtPtr ProtocolV2::handle_message() {
   connection->logger->inc(l_msgr_recv_messages);
   connection->logger->inc(l_msgr_recv_bytes,
                           rx_frame_asm.get_frame_onwire_len());
+  update_compression_counters();
 
   messenger->ms_fast_preprocess(message);
   fast_dispatch_time = ceph::mono_clock::now();
@@ -1827,6 +1921,80 @@ CtPtr ProtocolV2::handle_auth_done(ceph::bufferlist &payload)
   return WRITE(sig_frame, "auth signature", read_frame);
 }
 
+bool ProtocolV2::is_compression_wanted() const {
+  // the length of compressed frames would tell about the plaintext
+  if (auth_meta->is_mode_secure()) {
+    return false;
+  }
+  if (messenger->get_mytype() != CEPH_ENTITY_TYPE_OSD &&
+      connection->get_peer_type() != CEPH_ENTITY_TYPE_OSD) {
+    return false;
+  }
+  return cct->_conf.get_val<std::string>("ms_osd_compress_mode") == "force";
+}
+
+void ProtocolV2::update_compression_counters() {
+  if (session_compression_handlers.rx) {
+    session_compression_handlers.rx->update_perf_counters(connection->logger);
+  }
+  if (session_compression_handlers.tx) {
+    session_compression_handlers.tx->update_perf_counters(connection->logger);
+  }
+}
+
+CtPtr ProtocolV2::send_compression_request() {
+  ldout(cct, 20) << __func__ << dendl;
+
+  state = COMPRESSION_CONNECTING;
+
+  bool is_compress = is_compression_wanted();
+  std::vector<uint32_t> preferred_methods;
+  std::map<std::string, std::string> crush_location;
+  if (is_compress) {
+    preferred_methods = ceph::compression::onwire::get_preferred_methods(cct);
+    for (auto& [type, name] : cct->crush_location.get_location()) {
+      crush_location.emplace(type, name);
+    }
+  }
+  auto request = CompressionRequestFrame::Encode(is_compress,
+                                                 preferred_methods,
+                                                 crush_location);
+
+  ldout(cct, 5) << __func__ << " is_compress=" << is_compress
+                << " preferred_methods=" << preferred_methods
+                << " crush_location=" << crush_location << dendl;
+
+  return WRITE(request, "compression request", read_frame);
+}
+
+CtPtr ProtocolV2::handle_compression_done(ceph::bufferlist &payload) {
+  ldout(cct, 20) << __func__
+                 << " payload.length()=" << payload.length() << dendl;
+
+  if (state != COMPRESSION_CONNECTING) {
+    lderr(cct) << __func__ << " state changed!" << dendl;
+    return _fault();
+  }
+
+  auto response = CompressionDoneFrame::Decode(payload);
+  ldout(cct, 5) << __func__ << " is_compress=" << response.is_compress()
+                << " method=" << Compressor::get_comp_alg_name(
+                     response.method()) << dendl;
+
+  if (response.is_compress()) {
+    compression_method = response.method();
+    session_compression_handlers =
+      ceph::compression::onwire::rxtx_t::create_handler_pair(
+        cct, compression_method,
+        cct->_conf.get_val<Option::size_t>("ms_osd_compress_min_size"));
+    if (!session_compression_handlers.rx) {
+      // the peer is going to send compressed frames
+      return _fault();
+    }
+  }
+  return finish_client_auth();
+}
+
 CtPtr ProtocolV2::finish_client_auth() {
   if (!server_cookie) {
     ceph_assert(connect_seq == 0);
@@ -2206,6 +2374,69 @@ CtPtr ProtocolV2::finish_auth()
   return WRITE(sig_frame, "auth signature", read_frame);
 }
 
+CtPtr ProtocolV2::handle_compression_request(ceph::bufferlist &payload)
+{
+  ldout(cct, 20) << __func__
+                 << " payload.length()=" << payload.length() << dendl;
+
+  if (state != COMPRESSION_ACCEPTING) {
+    lderr(cct) << __func__ << " state changed!" << dendl;
+    return _fault();
+  }
+
+  auto request = CompressionRequestFrame::Decode(payload);
+  compression_method = Compressor::COMP_ALG_NONE;
+  if (request.is_compress() && is_compression_wanted()) {
+    // don't bother compressing within the same bucket of the configured
+    // crush level, e.g. the same datacenter
+    const auto& level =
+      cct->_conf.get_val<std::string>("ms_osd_compress_crush_level");
+    bool same_bucket = false;
+    if (!level.empty()) {
+      auto our_location = cct->crush_location.get_location();
+      auto& peer_location = request.crush_location();
+      auto ours = our_location.find(level);
+      auto peers = peer_location.find(level);
+      if (ours == our_location.end() || peers == peer_location.end()) {
+        same_bucket = ours == our_location.end() &&
+                      peers == peer_location.end();
+      } else {
+        same_bucket = ours->second == peers->second;
+      }
+    }
+    if (!same_bucket) {
+      compression_method = ceph::compression::onwire::pick_method(
+        ceph::compression::onwire::get_preferred_methods(cct),
+        request.preferred_methods());
+    }
+  }
+
+  ldout(cct, 5) << __func__ << " peer is_compress=" << request.is_compress()
+                << " preferred_methods=" << request.preferred_methods()
+                << " crush_location=" << request.crush_location()
+                << ", using " << Compressor::get_comp_alg_name(
+                     compression_method) << dendl;
+
+  auto response = CompressionDoneFrame::Encode(
+    compression_method != Compressor::COMP_ALG_NONE, compression_method);
+  return WRITE(response, "compression done", finish_compression);
+}
+
+CtPtr ProtocolV2::finish_compression()
+{
+  // the compression starts with the frames following CompressionDone
+  session_compression_handlers =
+    ceph::compression::onwire::rxtx_t::create_handler_pair(
+      cct, compression_method,
+      cct->_conf.get_val<Option::size_t>("ms_osd_compress_min_size"));
+  if (compression_method != Compressor::COMP_ALG_NONE &&
+      !session_compression_handlers.rx) {
+    return _fault();
+  }
+  state = SESSION_ACCEPTING;
+  return CONTINUE(read_frame);
+}
+
 CtPtr ProtocolV2::handle_auth_request_more(ceph::bufferlist &payload)
 {
   ldout(cct, 20) << __func__
@@ -2251,11 +2482,19 @@ CtPtr ProtocolV2::handle_auth_signature(ceph::bufferlist &payload)
 
   if (state == AUTH_ACCEPTING_SIGN) {
     // server had sent AuthDone and client responded with correct pre-auth
-    // signature. we can start accepting new sessions/reconnects.
-    state = SESSION_ACCEPTING;
+    // signature. we can start accepting new sessions/reconnects, after
+    // the compression has been agreed on if both sides support it.
+    if (HAVE_MSGR2_FEATURE(peer_supported_features, SEGMENT_COMPRESSION)) {
+      state = COMPRESSION_ACCEPTING;
+    } else {
+      state = SESSION_ACCEPTING;
+    }
     return CONTINUE(read_frame);
   } else if (state == AUTH_CONNECTING_SIGN) {
     // this happened at client side
+    if (HAVE_MSGR2_FEATURE(peer_supported_features, SEGMENT_COMPRESSION)) {
+      return send_compression_request();
+    }
     return finish_client_auth();
   } else {
     ceph_abort("state corruption");
@@ -2664,6 +2903,7 @@ CtPtr ProtocolV2::reuse_connection(const AsyncConnectionRef& existing,
   // this happens in the event center's thread as there should be
   // no user outside its boundaries (simlarly to e.g. outgoing_bl).
   auto temp_stream_handlers = std::move(session_stream_handlers);
+  auto temp_compression_handlers = std::move(session_compression_handlers);
   exproto->auth_meta = auth_meta;
 
   ldout(messenger->cct, 5) << __func__ << " stop myself to swap existing"
@@ -2693,7 +2933,9 @@ CtPtr ProtocolV2::reuse_connection(const AsyncConnectionRef& existing,
         new_worker,
         new_center,
         exproto,
-        temp_stream_handlers=std::move(temp_stream_handlers)
+        temp_stream_handlers=std::move(temp_stream_handlers),
+        temp_compression_handlers=std::move(temp_compression_handlers),
+        compression_method=compression_method
       ](ConnectedSocket &cs) mutable {
         // we need to delete time event in original thread
         {
@@ -2708,6 +2950,9 @@ CtPtr ProtocolV2::reuse_connection(const AsyncConnectionRef& existing,
           existing->outgoing_bl.clear();
           existing->open_write = false;
           exproto->session_stream_handlers = std::move(temp_stream_handlers);
+          exproto->session_compression_handlers =
+            std::move(temp_compression_handlers);
+          exproto->compression_method = compression_method;
           existing->write_lock.unlock();
           if (exproto->state == NONE) {
             existing->shutdown_socket();
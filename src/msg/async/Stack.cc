@@ -19,6 +19,7 @@
 #include "include/compat.h"
 #include "common/Cond.h"
 #include "common/errno.h"
+#include "common/numa.h"
 #include "PosixStack.h"
 #ifdef HAVE_RDMA
 #include "rdma/RDMAStack.h"
@@ -41,6 +42,17 @@ std::function<void ()> NetworkStack::add_thread(unsigned worker_id)
       char tp_name[16];
       sprintf(tp_name, "msgr-worker-%u", w->id);
       ceph_pthread_setname(pthread_self(), tp_name);
+      if (!worker_cpus.empty()) {
+        int cpu = worker_cpus[w->id % worker_cpus.size()];
+        int r = set_cpu_affinity_this_thread(cpu);
+        if (r < 0) {
+          lderr(cct) << __func__ << " failed to pin worker " << w->id
+                     << " to cpu " << cpu << ": " << cpp_strerror(r) << dendl;
+        } else {
+          ldout(cct, 1) << __func__ << " pinned worker " << w->id
+                        << " to cpu " << cpu << dendl;
+        }
+      }
       const unsigned EventMaxWaitUs = 30000000;
       w->center.set_owner();
       ldout(cct, 10) << __func__ << " starting" << dendl;
@@ -50,13 +62,20 @@ std::function<void ()> NetworkStack::add_thread(unsigned worker_id)
         ldout(cct, 30) << __func__ << " calling event process" << dendl;
 
         ceph::timespan dur;
-        int r = w->center.process_events(EventMaxWaitUs, &dur);
+        ceph::timespan spin_dur = ceph::timespan::zero();
+        ceph::timespan idle_dur = ceph::timespan::zero();
+        int r = w->center.process_events(EventMaxWaitUs, &dur,
+                                         &spin_dur, &idle_dur);
         if (r < 0) {
           ldout(cct, 20) << __func__ << " process events failed: "
                          << cpp_strerror(errno) << dendl;
           // TODO do something?
         }
         w->perf_logger->tinc(l_msgr_running_total_time, dur);
+        if (spin_dur != ceph::timespan::zero())
+          w->perf_logger->tinc(l_msgr_busy_poll_time, spin_dur);
+        if (idle_dur != ceph::timespan::zero())
+          w->perf_logger->tinc(l_msgr_idle_time, idle_dur);
       }
       w->reset();
       w->destroy();
@@ -111,6 +130,19 @@ NetworkStack::NetworkStack(CephContext *c)
                   << dendl;
     num_workers = EventCenter::MAX_EVENTCENTER;
   }
+
+  auto cores = cct->_conf.get_val<std::string>("ms_async_affinity_cores");
+  if (!cores.empty()) {
+    size_t cpu_set_size;
+    cpu_set_t cpu_set;
+    if (parse_cpu_set_list(cores.c_str(), &cpu_set_size, &cpu_set) < 0) {
+      lderr(cct) << __func__ << " unable to parse ms_async_affinity_cores '"
+                 << cores << "', not pinning workers" << dendl;
+    } else {
+      auto cpus = cpu_set_to_set(cpu_set_size, &cpu_set);
+      worker_cpus.assign(cpus.begin(), cpus.end());
+    }
+  }
 }
 
 void NetworkStack::start()
@@ -203,6 +203,21 @@ enum {
   l_msgr_send_messages_queue_lat,
   l_msgr_handle_ack_lat,
 
+  l_msgr_send_zerocopy_bytes,
+  l_msgr_send_zerocopy_copied_bytes,
+  l_msgr_send_zerocopy_fallback_bytes,
+
+  l_msgr_send_uncompressed_bytes,
+  l_msgr_send_compressed_bytes,
+  l_msgr_send_compress_rejected,
+  l_msgr_recv_compressed_bytes,
+  l_msgr_recv_uncompressed_bytes,
+  l_msgr_compress_time,
+  l_msgr_decompress_time,
+
+  l_msgr_busy_poll_time,
+  l_msgr_idle_time,
+
   l_msgr_last,
 };
 
@@ -246,6 +261,21 @@ class Worker {
     plb.add_time_avg(l_msgr_send_messages_queue_lat, "msgr_send_messages_queue_lat", "Network sent messages lat");
     plb.add_time_avg(l_msgr_handle_ack_lat, "msgr_handle_ack_lat", "Connection handle ack lat");
 
+    plb.add_u64_counter(l_msgr_send_zerocopy_bytes, "msgr_send_zerocopy_bytes", "Network bytes sent with MSG_ZEROCOPY and completed without a copy", NULL, 0, unit_t(UNIT_BYTES));
+    plb.add_u64_counter(l_msgr_send_zerocopy_copied_bytes, "msgr_send_zerocopy_copied_bytes", "Network bytes sent with MSG_ZEROCOPY the kernel copied anyway", NULL, 0, unit_t(UNIT_BYTES));
+    plb.add_u64_counter(l_msgr_send_zerocopy_fallback_bytes, "msgr_send_zerocopy_fallback_bytes", "Network bytes copied as MSG_ZEROCOPY ran out of completion slots", NULL, 0, unit_t(UNIT_BYTES));
+
+    plb.add_u64_counter(l_msgr_send_uncompressed_bytes, "msgr_send_uncompressed_bytes", "Frame segment bytes passed to on-wire compression", NULL, 0, unit_t(UNIT_BYTES));
+    plb.add_u64_counter(l_msgr_send_compressed_bytes, "msgr_send_compressed_bytes", "Frame segment bytes sent after on-wire compression", NULL, 0, unit_t(UNIT_BYTES));
+    plb.add_u64_counter(l_msgr_send_compress_rejected, "msgr_send_compress_rejected", "Frame segments sent uncompressed as compression didn't shrink them");
+    plb.add_u64_counter(l_msgr_recv_compressed_bytes, "msgr_recv_compressed_bytes", "Compressed frame segment bytes received", NULL, 0, unit_t(UNIT_BYTES));
+    plb.add_u64_counter(l_msgr_recv_uncompressed_bytes, "msgr_recv_uncompressed_bytes", "Received frame segment bytes after decompression", NULL, 0, unit_t(UNIT_BYTES));
+    plb.add_time(l_msgr_compress_time, "msgr_compress_time", "The total time spent in on-wire compression");
+    plb.add_time(l_msgr_decompress_time, "msgr_decompress_time", "The total time spent in on-wire decompression");
+
+    plb.add_time(l_msgr_busy_poll_time, "msgr_busy_poll_time", "The total time spent busy polling for events");
+    plb.add_time(l_msgr_idle_time, "msgr_idle_time", "The total time spent sleeping while waiting for events");
+
     perf_logger = plb.create_perf_counters();
     cct->get_perfcounters_collection()->add(perf_logger);
   }
@@ -296,6 +326,7 @@ class NetworkStack {
   unsigned num_workers = 0;
   ceph::spinlock pool_spin;
   bool started = false;
+  std::vector<int> worker_cpus;	///< see ms_async_affinity_cores
 
   std::function<void ()> add_thread(unsigned i);
 
@@ -0,0 +1,216 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "compression_onwire.h"
+
+#include <algorithm>
+
+#include "Stack.h"
+#include "common/ceph_time.h"
+#include "common/debug.h"
+#include "common/perf_counters.h"
+#include "compressor/Compressor.h"
+#include "include/encoding.h"
+#include "include/str_list.h"
+
+#define dout_subsys ceph_subsys_ms
+#undef dout_prefix
+#define dout_prefix *_dout << "compression_onwire "
+
+namespace ceph::compression::onwire {
+
+class OnWireTxHandler : public TxHandler {
+  CephContext* const cct;
+  CompressorRef compressor;
+  const uint32_t min_size;
+
+  uint64_t in_bytes = 0;
+  uint64_t out_bytes = 0;
+  uint64_t rejected = 0;
+  ceph::timespan spent = ceph::timespan::zero();
+
+public:
+  OnWireTxHandler(CephContext* cct, CompressorRef compressor,
+		  uint32_t min_size)
+    : cct(cct), compressor(std::move(compressor)),
+      min_size(std::max(min_size, 1u)) {
+  }
+
+  bool compress(ceph::bufferlist& bl) override {
+    if (bl.length() < min_size) {
+      return false;
+    }
+    // the receiver allocates the original length up front
+    ceph::bufferlist out;
+    encode((uint32_t)bl.length(), out);
+    ceph::bufferlist compressed;
+    boost::optional<int32_t> compressor_message;
+    auto start = ceph::mono_clock::now();
+    int r = compressor->compress(bl, compressed, compressor_message);
+    spent += ceph::mono_clock::now() - start;
+    out.claim_append(compressed);
+    in_bytes += bl.length();
+    if (r < 0 || out.length() >= bl.length()) {
+      ldout(cct, 20) << __func__ << " " << compressor->get_type_name()
+		     << " r=" << r << " " << bl.length() << " -> "
+		     << out.length() << ", sending uncompressed" << dendl;
+      out_bytes += bl.length();
+      ++rejected;
+      return false;
+    }
+    out_bytes += out.length();
+    bl.swap(out);
+    return true;
+  }
+
+  void update_perf_counters(PerfCounters* logger) override {
+    if (!in_bytes) {
+      return;
+    }
+    logger->inc(l_msgr_send_uncompressed_bytes, in_bytes);
+    logger->inc(l_msgr_send_compressed_bytes, out_bytes);
+    logger->inc(l_msgr_send_compress_rejected, rejected);
+    logger->tinc(l_msgr_compress_time, spent);
+    in_bytes = out_bytes = rejected = 0;
+    spent = ceph::timespan::zero();
+  }
+};
+
+class OnWireRxHandler : public RxHandler {
+  CephContext* const cct;
+  CompressorRef compressor;
+  const uint64_t max_size;
+
+  uint64_t in_bytes = 0;
+  uint64_t out_bytes = 0;
+  ceph::timespan spent = ceph::timespan::zero();
+
+public:
+  OnWireRxHandler(CephContext* cct, CompressorRef compressor)
+    : cct(cct), compressor(std::move(compressor)),
+      max_size(cct->_conf.get_val<Option::size_t>("ms_osd_decompress_max_size")) {
+  }
+
+  bool decompress(ceph::bufferlist& bl) override {
+    uint32_t raw_len;
+    if (bl.length() < sizeof(raw_len)) {
+      ldout(cct, 1) << __func__ << " short compressed segment "
+		    << bl.length() << " bytes" << dendl;
+      return false;
+    }
+    auto p = bl.cbegin();
+    decode(raw_len, p);
+    if (raw_len == 0 || raw_len > max_size) {
+      ldout(cct, 1) << __func__ << " compressed segment claims " << raw_len
+		    << " bytes, limit is " << max_size << dendl;
+      return false;
+    }
+    ceph::bufferlist in;
+    in.substr_of(bl, sizeof(raw_len), bl.length() - sizeof(raw_len));
+    ceph::bufferptr out(ceph::buffer::create_page_aligned(raw_len));
+    auto start = ceph::mono_clock::now();
+    int r = compressor->decompress_into(in, out);
+    spent += ceph::mono_clock::now() - start;
+    if (r < 0) {
+      ldout(cct, 1) << __func__ << " " << compressor->get_type_name()
+		    << " failed to decompress " << bl.length() << " bytes into "
+		    << raw_len << " r=" << r << dendl;
+      return false;
+    }
+    in_bytes += bl.length();
+    out_bytes += raw_len;
+    bl.clear();
+    bl.push_back(std::move(out));
+    return true;
+  }
+
+  void update_perf_counters(PerfCounters* logger) override {
+    if (!in_bytes) {
+      return;
+    }
+    logger->inc(l_msgr_recv_compressed_bytes, in_bytes);
+    logger->inc(l_msgr_recv_uncompressed_bytes, out_bytes);
+    logger->tinc(l_msgr_decompress_time, spent);
+    in_bytes = out_bytes = 0;
+    spent = ceph::timespan::zero();
+  }
+};
+
+// Only plugins that decompress into a caller sized buffer are used on the
+// wire, see Compressor::decompress_into().
+static bool is_onwire_capable(const CompressorRef& compressor)
+{
+  ceph::bufferptr empty;
+  return compressor->decompress_into(ceph::bufferlist(), empty) != -EOPNOTSUPP;
+}
+
+rxtx_t rxtx_t::create_handler_pair(
+  CephContext* cct,
+  uint32_t method,
+  uint32_t min_size)
+{
+  if (method == Compressor::COMP_ALG_NONE) {
+    return {};
+  }
+  // separate instances, the plugins are not required to be reentrant
+  auto tx_compressor = Compressor::create(cct, method);
+  auto rx_compressor = Compressor::create(cct, method);
+  if (!tx_compressor || !rx_compressor) {
+    ldout(cct, 1) << __func__ << " unable to load compressor "
+		  << Compressor::get_comp_alg_name(method) << dendl;
+    return {};
+  }
+  if (!is_onwire_capable(rx_compressor)) {
+    ldout(cct, 1) << __func__ << " compressor "
+		  << Compressor::get_comp_alg_name(method)
+		  << " can't bound its output, not used on the wire" << dendl;
+    return {};
+  }
+  return {
+    std::make_unique<OnWireRxHandler>(cct, std::move(rx_compressor)),
+    std::make_unique<OnWireTxHandler>(cct, std::move(tx_compressor),
+				      min_size)
+  };
+}
+
+std::vector<uint32_t> get_preferred_methods(CephContext* cct)
+{
+  std::vector<uint32_t> methods;
+  for (auto& name : get_str_vec(
+	 cct->_conf.get_val<std::string>("ms_osd_compression_algorithm"),
+	 ";, \t")) {
+    auto alg = Compressor::get_comp_alg_type(name);
+    if (!alg || *alg == Compressor::COMP_ALG_NONE) {
+      ldout(cct, 1) << __func__ << " ignoring unknown compression algorithm "
+		    << name << dendl;
+      continue;
+    }
+    auto compressor = Compressor::create(cct, *alg);
+    if (!compressor) {
+      ldout(cct, 5) << __func__ << " compressor " << name
+		    << " not available" << dendl;
+      continue;
+    }
+    if (!is_onwire_capable(compressor)) {
+      ldout(cct, 1) << __func__ << " compressor " << name
+		    << " can't be used on the wire" << dendl;
+      continue;
+    }
+    methods.push_back(*alg);
+  }
+  return methods;
+}
+
+uint32_t pick_method(const std::vector<uint32_t>& our_methods,
+                     const std::vector<uint32_t>& peer_methods)
+{
+  for (auto method : peer_methods) {
+    if (std::find(our_methods.begin(), our_methods.end(), method) !=
+	our_methods.end()) {
+      return method;
+    }
+  }
+  return Compressor::COMP_ALG_NONE;
+}
+
+} // namespace ceph::compression::onwire
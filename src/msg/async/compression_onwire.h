@@ -0,0 +1,79 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ *
+ */
+
+#ifndef CEPH_COMPRESSION_ONWIRE_H
+#define CEPH_COMPRESSION_ONWIRE_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "include/buffer.h"
+#include "include/common_fwd.h"
+
+namespace ceph::compression::onwire {
+
+// msgr2 compresses frame segments independently of each other, a
+// segment is flagged as compressed in the preamble and starts with its
+// original length (__le32). Compression is
+// applied before the crc/encryption, so the rest of the frame
+// assembly sees the compressed segments only.
+class TxHandler {
+public:
+  virtual ~TxHandler() = default;
+
+  // Replaces the segment with its compressed form and returns true. If
+  // the segment is too small or doesn't shrink it is left untouched and
+  // false is returned.
+  virtual bool compress(ceph::bufferlist& bl) = 0;
+
+  // Accounts bytes and time spent since the previous call.
+  virtual void update_perf_counters(PerfCounters* logger) = 0;
+};
+
+class RxHandler {
+public:
+  virtual ~RxHandler() = default;
+
+  // Replaces the segment with its decompressed form. Returns false if
+  // the segment can't be decompressed, or if its original length, which
+  // is sent ahead of the compressed data, exceeds
+  // ms_osd_decompress_max_size or doesn't match.
+  virtual bool decompress(ceph::bufferlist& bl) = 0;
+
+  virtual void update_perf_counters(PerfCounters* logger) = 0;
+};
+
+struct rxtx_t {
+  std::unique_ptr<RxHandler> rx;
+  std::unique_ptr<TxHandler> tx;
+
+  // method is one of Compressor::CompressionAlgorithm. Returns empty
+  // handlers if it is COMP_ALG_NONE or the plugin can't be loaded.
+  static rxtx_t create_handler_pair(
+    CephContext* cct,
+    uint32_t method,
+    uint32_t min_size);
+};
+
+// Algorithms listed in ms_osd_compression_algorithm this side is able to
+// use, in order of preference.
+std::vector<uint32_t> get_preferred_methods(CephContext* cct);
+
+// The first of the peer's preferred methods this side supports as well,
+// COMP_ALG_NONE if there is none.
+uint32_t pick_method(const std::vector<uint32_t>& our_methods,
+                     const std::vector<uint32_t>& peer_methods);
+
+} // namespace ceph::compression::onwire
+
+#endif // CEPH_COMPRESSION_ONWIRE_H
@@ -70,6 +70,9 @@ void FrameAssembler::fill_preamble(Tag tag,
   for (size_t i = 0; i < m_descs.size(); i++) {
     preamble.segments[i].length = m_descs[i].logical_len;
     preamble.segments[i].alignment = m_descs[i].align;
+    if (m_descs[i].compressed) {
+      preamble.flags |= FRAME_EARLY_SEGMENT_COMPRESSED(i);
+    }
   }
   preamble.num_segments = m_descs.size();
   preamble.crc = ceph_crc32c(
@@ -96,6 +99,27 @@ uint64_t FrameAssembler::get_frame_onwire_len() const {
   return onwire_len;
 }
 
+void FrameAssembler::asm_compress(bufferlist segment_bls[]) {
+  for (size_t i = 0; i < m_descs.size(); i++) {
+    m_descs[i].compressed = m_compression && m_compression->tx &&
+                            m_compression->tx->compress(segment_bls[i]);
+    m_descs[i].logical_len = segment_bls[i].length();
+  }
+}
+
+void FrameAssembler::disasm_decompress(size_t seg_idx,
+                                       bufferlist& segment_bl) const {
+  if (!m_descs[seg_idx].compressed) {
+    return;
+  }
+  ceph_assert(m_compression && m_compression->rx);
+  if (!m_compression->rx->decompress(segment_bl)) {
+    throw FrameError(fmt::format(
+        "bad compressed segment seg_idx={} length={}", seg_idx,
+        segment_bl.length()));
+  }
+}
+
 bufferlist FrameAssembler::asm_crc_rev0(const preamble_block_t& preamble,
                                         bufferlist segment_bls[]) const {
   epilogue_crc_rev0_block_t epilogue;
@@ -242,9 +266,9 @@ bufferlist FrameAssembler::assemble_frame(Tag tag, bufferlist segment_bls[],
                                           size_t segment_count) {
   m_descs.resize(calc_num_segments(segment_bls, segment_count));
   for (size_t i = 0; i < m_descs.size(); i++) {
-    m_descs[i].logical_len = segment_bls[i].length();
     m_descs[i].align = segment_aligns[i];
   }
+  asm_compress(segment_bls);
 
   preamble_block_t preamble;
   fill_preamble(tag, preamble);
@@ -313,9 +337,23 @@ Tag FrameAssembler::disassemble_preamble(bufferlist& preamble_bl) {
   }
 
   m_descs.resize(preamble->num_segments);
+  const bool compression = m_compression && m_compression->rx;
+  if ((preamble->flags &
+       ~(compression ? FRAME_EARLY_SEGMENT_COMPRESSED_MASK : 0)) ||
+      preamble->_reserved) {
+    throw FrameError(fmt::format(
+        "unexpected preamble flags={:#x} reserved={:#x}",
+        preamble->flags, preamble->_reserved));
+  }
   for (size_t i = 0; i < m_descs.size(); i++) {
     m_descs[i].logical_len = preamble->segments[i].length;
     m_descs[i].align = preamble->segments[i].alignment;
+    m_descs[i].compressed =
+        preamble->flags & FRAME_EARLY_SEGMENT_COMPRESSED(i);
+    if (m_descs[i].compressed && m_descs[i].logical_len == 0) {
+      throw FrameError(fmt::format(
+          "empty compressed segment seg_idx={}", i));
+    }
   }
   return static_cast<Tag>(preamble->tag);
 }
@@ -432,6 +470,7 @@ void FrameAssembler::disassemble_first_segment(bufferlist& preamble_bl,
     } else {
       disasm_first_crc_rev1(preamble_bl, segment_bl);
     }
+    disasm_decompress(0, segment_bl);
   } else {
     // noop, everything is handled in disassemble_remaining_segments()
   }
@@ -440,6 +479,8 @@ void FrameAssembler::disassemble_first_segment(bufferlist& preamble_bl,
 bool FrameAssembler::disassemble_remaining_segments(
     bufferlist segment_bls[], bufferlist& epilogue_bl) const {
   ceph_assert(!m_descs.empty());
+  bool complete;
+  size_t first_remaining = 0;
   if (m_is_rev1) {
     if (m_descs.size() == 1) {
       // no epilogue if only one segment
@@ -447,14 +488,22 @@ bool FrameAssembler::disassemble_remaining_segments(
       return true;
     }
     if (m_crypto->rx) {
-      return disasm_remaining_secure_rev1(segment_bls, epilogue_bl);
+      complete = disasm_remaining_secure_rev1(segment_bls, epilogue_bl);
+    } else {
+      complete = disasm_remaining_crc_rev1(segment_bls, epilogue_bl);
     }
-    return disasm_remaining_crc_rev1(segment_bls, epilogue_bl);
+    first_remaining = 1;  // see disassemble_first_segment()
+  } else if (m_crypto->rx) {
+    complete = disasm_all_secure_rev0(segment_bls, epilogue_bl);
+  } else {
+    complete = disasm_all_crc_rev0(segment_bls, epilogue_bl);
   }
-  if (m_crypto->rx) {
-    return disasm_all_secure_rev0(segment_bls, epilogue_bl);
+  if (complete) {
+    for (size_t i = first_remaining; i < m_descs.size(); i++) {
+      disasm_decompress(i, segment_bls[i]);
+    }
   }
-  return disasm_all_crc_rev0(segment_bls, epilogue_bl);
+  return complete;
 }
 
 std::ostream& operator<<(std::ostream& os, const FrameAssembler& frame_asm) {
@@ -463,7 +512,8 @@ std::ostream& operator<<(std::ostream& os, const FrameAssembler& frame_asm) {
     for (size_t i = 0; i < frame_asm.m_descs.size(); i++) {
       os << " + " << frame_asm.get_segment_onwire_len(i)
          << " (logical " << frame_asm.m_descs[i].logical_len
-         << "/" << frame_asm.m_descs[i].align << ")";
+         << "/" << frame_asm.m_descs[i].align
+         << (frame_asm.m_descs[i].compressed ? " compressed" : "") << ")";
     }
     os << " + " << frame_asm.get_epilogue_onwire_len() << " ";
   }
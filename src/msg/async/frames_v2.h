@@ -3,6 +3,7 @@
 
 #include "include/types.h"
 #include "common/Clock.h"
+#include "compression_onwire.h"
 #include "crypto_onwire.h"
 #include <array>
 #include <iosfwd>
@@ -55,7 +56,9 @@ enum class Tag : __u8 {
   MESSAGE,
   KEEPALIVE2,
   KEEPALIVE2_ACK,
-  ACK
+  ACK,
+  COMPRESSION_REQUEST,
+  COMPRESSION_DONE
 };
 
 struct segment_t {
@@ -102,7 +105,8 @@ struct preamble_block_t {
   __u8 num_segments;
 
   segment_t segments[MAX_NUM_SEGMENTS];
-  __u8 _reserved[2];
+  __u8 flags;  // FRAME_EARLY_SEGMENT_COMPRESSED(i)
+  __u8 _reserved;
 
   // CRC32 for this single preamble block.
   ceph_le32 crc;
@@ -169,15 +173,26 @@ static constexpr uint32_t FRAME_PREAMBLE_WITH_INLINE_SIZE =
 #define FRAME_LATE_STATUS_RESERVED_FALSE  0xe0
 #define FRAME_LATE_STATUS_RESERVED_MASK   0xf0
 
+// Segment i is compressed with the algorithm negotiated at connection
+// setup (CEPH_MSGR2_FEATURE_SEGMENT_COMPRESSION), its length in
+// segments[i] is the compressed one.  The low nibble of flags is not
+// ours, other implementations use bit 0 for whole frame compression.
+// Any flag that wasn't negotiated is a framing error.
+#define FRAME_EARLY_SEGMENT_COMPRESSED(i)    (0x10 << (i))
+#define FRAME_EARLY_SEGMENT_COMPRESSED_MASK  0xf0
+
 struct FrameError : std::runtime_error {
   using runtime_error::runtime_error;
 };
 
 class FrameAssembler {
 public:
-  // crypto must be non-null
-  FrameAssembler(const ceph::crypto::onwire::rxtx_t* crypto, bool is_rev1)
-      : m_crypto(crypto), m_is_rev1(is_rev1) {}
+  // crypto must be non-null, compression may be null if the user
+  // never negotiates it
+  FrameAssembler(const ceph::crypto::onwire::rxtx_t* crypto, bool is_rev1,
+                 const ceph::compression::onwire::rxtx_t* compression =
+                     nullptr)
+      : m_crypto(crypto), m_compression(compression), m_is_rev1(is_rev1) {}
 
   void set_is_rev1(bool is_rev1) {
     m_descs.clear();
@@ -203,6 +218,20 @@ public:
     return m_descs[seg_idx].align;
   }
 
+  bool is_segment_compressed(size_t seg_idx) const {
+    ceph_assert(seg_idx < m_descs.size());
+    return m_descs[seg_idx].compressed;
+  }
+
+  // Whether the segment goes on the wire as is and thus can be received
+  // directly into its final buffer: crc mode, not compressed and, for
+  // msgr2.1, not the first segment which is followed by its crc.
+  bool is_segment_onwire_verbatim(size_t seg_idx) const {
+    ceph_assert(seg_idx < m_descs.size());
+    return !m_crypto->rx && !m_descs[seg_idx].compressed &&
+           !(m_is_rev1 && seg_idx == 0);
+  }
+
   // Preamble:
   //
   //   preamble_block_t
@@ -299,6 +328,10 @@ public:
 
   Tag disassemble_preamble(bufferlist& preamble_bl);
 
+  // Compressed segments are decompressed by disassemble_first_segment()
+  // and disassemble_remaining_segments(), until then the logical length
+  // of a compressed segment is its compressed length.
+  //
   // Like msgr1, and unlike msgr2.0, msgr2.1 allows interpreting the
   // first segment before reading in the rest of the frame.
   //
@@ -334,6 +367,7 @@ private:
   struct segment_desc_t {
     uint32_t logical_len;
     uint16_t align;
+    bool compressed;
   };
 
   uint32_t get_segment_padded_len(size_t seg_idx) const {
@@ -367,12 +401,16 @@ private:
   bool disasm_remaining_secure_rev1(bufferlist segment_bls[],
                                     bufferlist& epilogue_bl) const;
 
+  void asm_compress(bufferlist segment_bls[]);
+  void disasm_decompress(size_t seg_idx, bufferlist& segment_bl) const;
+
   void fill_preamble(Tag tag, preamble_block_t& preamble) const;
   friend std::ostream& operator<<(std::ostream& os,
                                   const FrameAssembler& frame_asm);
 
   boost::container::static_vector<segment_desc_t, MAX_NUM_SEGMENTS> m_descs;
   const ceph::crypto::onwire::rxtx_t* m_crypto;
+  const ceph::compression::onwire::rxtx_t* m_compression;
   bool m_is_rev1;  // msgr2.1?
 };
 
@@ -765,6 +803,39 @@ protected:
   using ControlFrame::ControlFrame;
 };
 
+struct CompressionRequestFrame
+    : public ControlFrame<CompressionRequestFrame,
+                          bool,  // compression wanted
+                          std::vector<uint32_t>,  // preferred methods
+                          std::map<std::string, std::string>> { // crush location
+  static const Tag tag = Tag::COMPRESSION_REQUEST;
+  using ControlFrame::Encode;
+  using ControlFrame::Decode;
+
+  inline bool &is_compress() { return get_val<0>(); }
+  inline std::vector<uint32_t> &preferred_methods() { return get_val<1>(); }
+  inline std::map<std::string, std::string> &crush_location() {
+    return get_val<2>();
+  }
+
+protected:
+  using ControlFrame::ControlFrame;
+};
+
+struct CompressionDoneFrame : public ControlFrame<CompressionDoneFrame,
+                                                  bool,  // compression enabled
+                                                  uint32_t> { // method
+  static const Tag tag = Tag::COMPRESSION_DONE;
+  using ControlFrame::Encode;
+  using ControlFrame::Decode;
+
+  inline bool &is_compress() { return get_val<0>(); }
+  inline uint32_t &method() { return get_val<1>(); }
+
+protected:
+  using ControlFrame::ControlFrame;
+};
+
 using segment_bls_t =
     boost::container::static_vector<bufferlist, MAX_NUM_SEGMENTS>;
 
@@ -286,6 +286,11 @@ public:
     return 0;
   }
 
+  // return the alignment written data is best handed in with, if any
+  virtual uint64_t get_data_alignment() const {
+    return 0;
+  }
+
   /// enumerate hardware devices (by 'devname', e.g., 'sda' as in /sys/block/sda)
   virtual int get_devices(std::set<std::string> *devls) {
     return -EOPNOTSUPP;
@@ -159,6 +159,17 @@ void Allocator::release(const PExtentVector& release_vec)
   release(release_set);
 }
 
+void Allocator::allocate_batch(const interval_set<uint64_t>* release_set,
+                               std::vector<alloc_request_t>& requests)
+{
+  if (release_set && !release_set->empty()) {
+    release(*release_set);
+  }
+  for (auto& r : requests) {
+    r.result = allocate(r.want, r.unit, r.max_alloc_size, r.hint, r.extents);
+  }
+}
+
 /**
  * Gives fragmentation a numeric value.
  *
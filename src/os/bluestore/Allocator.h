@@ -53,6 +53,37 @@ public:
   virtual void release(const interval_set<uint64_t>& release_set) = 0;
   void release(const PExtentVector& release_set);
 
+  /*
+   * A single allocation request within a batch, see allocate_batch().
+   * 'result' receives what allocate() would have returned for the request.
+   */
+  struct alloc_request_t {
+    uint64_t want = 0;
+    uint64_t unit = 0;
+    uint64_t max_alloc_size = 0;
+    int64_t hint = 0;
+    PExtentVector* extents = nullptr;
+    int64_t result = 0;
+
+    alloc_request_t() = default;
+    alloc_request_t(uint64_t _want, uint64_t _unit, uint64_t _max_alloc_size,
+                    int64_t _hint, PExtentVector* _extents)
+      : want(_want), unit(_unit), max_alloc_size(_max_alloc_size),
+        hint(_hint), extents(_extents) {}
+  };
+
+  /*
+   * Batched release + allocate. The release set (if any) is returned to
+   * the free space first, then every request is served in order.
+   * Implementations may override this to do the whole batch under a single
+   * lock acquisition; the default one just falls back to per-call methods.
+   */
+  virtual void allocate_batch(const interval_set<uint64_t>* release_set,
+                              std::vector<alloc_request_t>& requests);
+  void allocate_batch(std::vector<alloc_request_t>& requests) {
+    allocate_batch(nullptr, requests);
+  }
+
   virtual void dump() = 0;
   virtual void dump(std::function<void(uint64_t offset, uint64_t length)> notify) = 0;
 
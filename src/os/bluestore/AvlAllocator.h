@@ -82,6 +82,8 @@ public:
     int64_t  hint,
     PExtentVector *extents) override;
   void release(const interval_set<uint64_t>& release_set) override;
+  void allocate_batch(const interval_set<uint64_t>* release_set,
+                      std::vector<alloc_request_t>& requests) override;
   int64_t get_capacity() const {
     return num_total;
   }
@@ -245,6 +247,8 @@ protected:
     uint64_t max_alloc_size,
     int64_t  hint,
     PExtentVector *extents);
+  // apply defaults and 32-bit extent length cap to max_alloc_size
+  uint64_t _normalize_max_alloc_size(uint64_t want, uint64_t max_alloc_size) const;
 
   void _release(const interval_set<uint64_t>& release_set);
   void _release(const PExtentVector&  release_set);
@@ -2680,7 +2680,8 @@ ceph::bufferlist BlueFS::FileWriter::flush_buffer(
   return bl;
 }
 
-int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
+int BlueFS::_flush_range_prepare(FileWriter *h, uint64_t offset,
+				 uint64_t length, flush_plan_t *plan)
 {
   dout(10) << __func__ << " " << h << " pos 0x" << std::hex << h->pos
 	   << " 0x" << offset << "~" << length << std::dec
@@ -2692,12 +2693,6 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
 
   ceph_assert(h->file->num_readers.load() == 0);
 
-  bool buffered;
-  if (h->file->fnode.ino == 1)
-    buffered = false;
-  else
-    buffered = cct->_conf->bluefs_buffered_io;
-
   if (offset + length <= h->pos)
     return 0;
   if (offset < h->pos) {
@@ -2713,7 +2708,6 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
   vselector->sub_usage(h->file->vselector_hint, h->file->fnode);
   // do not bother to dirty the file if we are overwriting
   // previously allocated extents.
-  bool must_dirty = false;
   if (allocated < offset + length) {
     // we should never run out of log space here; see the min runway check
     // in _flush_and_sync_log.
@@ -2729,10 +2723,53 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
       ceph_abort_msg("bluefs enospc");
       return r;
     }
-    must_dirty = true;
+    plan->must_dirty = true;
+  }
+  vselector->add_usage(h->file->vselector_hint, h->file->fnode);
+
+  uint64_t x_off = 0;
+  auto p = h->file->fnode.seek(offset, &x_off);
+  ceph_assert(p != h->file->fnode.extents.end());
+  dout(20) << __func__ << " in " << *p << " x_off 0x"
+           << std::hex << x_off << std::dec << dendl;
+
+  unsigned partial = x_off & ~super.block_mask();
+  if (partial) {
+    dout(20) << __func__ << " using partial tail 0x"
+             << std::hex << partial << std::dec << dendl;
+    x_off -= partial;
+    offset -= partial;
+    length += partial;
+  }
+
+  // snapshot the target extents; fnode.extents may be reallocated by a
+  // racing _preallocate once we drop the lock.
+  plan->offset = offset;
+  plan->length = length;
+  plan->partial = partial;
+  plan->x_off = x_off;
+  uint64_t covered = 0;
+  for (; covered < x_off + length; ++p) {
+    ceph_assert(p != h->file->fnode.extents.end());
+    plan->extents.push_back(*p);
+    covered += p->length;
+  }
+  return 0;
+}
+
+void BlueFS::_flush_range_commit(FileWriter *h, const flush_plan_t& plan)
+{
+  // the new size only becomes visible (and loggable) once the data
+  // backing it has been queued
+  if (h->file->deleted) {
+    dout(10) << __func__ << "  deleted, no-op" << dendl;
+    return;
   }
-  if (h->file->fnode.size < offset + length) {
-    h->file->fnode.size = offset + length;
+  bool must_dirty = plan.must_dirty;
+  uint64_t end = plan.offset + plan.length;
+  vselector->sub_usage(h->file->vselector_hint, h->file->fnode);
+  if (h->file->fnode.size < end) {
+    h->file->fnode.size = end;
     if (h->file->fnode.ino > 1) {
       // we do not need to dirty the log file (or it's compacting
       // replacement) when the file size changes because replay is
@@ -2764,21 +2801,19 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
       }
     }
   }
+  vselector->add_usage(h->file->vselector_hint, h->file->fnode);
   dout(20) << __func__ << " file now " << h->file->fnode << dendl;
+}
 
-  uint64_t x_off = 0;
-  auto p = h->file->fnode.seek(offset, &x_off);
-  ceph_assert(p != h->file->fnode.extents.end());
-  dout(20) << __func__ << " in " << *p << " x_off 0x"
-           << std::hex << x_off << std::dec << dendl;
+void BlueFS::_flush_range_data(FileWriter *h, flush_plan_t& plan)
+{
+  bool buffered;
+  if (h->file->fnode.ino == 1)
+    buffered = false;
+  else
+    buffered = cct->_conf->bluefs_buffered_io;
 
-  unsigned partial = x_off & ~super.block_mask();
-  if (partial) {
-    dout(20) << __func__ << " using partial tail 0x"
-             << std::hex << partial << std::dec << dendl;
-    x_off -= partial;
-    offset -= partial;
-    length += partial;
+  if (plan.partial) {
     dout(20) << __func__ << " waiting for previous aio to complete" << dendl;
     for (auto p : h->iocv) {
       if (p) {
@@ -2787,10 +2822,10 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
     }
   }
 
-  auto bl = h->flush_buffer(cct, partial, length, super);
-  ceph_assert(bl.length() >= length);
-  h->pos = offset + length;
-  length = bl.length();
+  auto bl = h->flush_buffer(cct, plan.partial, plan.length, super);
+  ceph_assert(bl.length() >= plan.length);
+  h->pos = plan.offset + plan.length;
+  uint64_t length = bl.length();
 
   switch (h->writer_type) {
   case WRITER_WAL:
@@ -2807,7 +2842,10 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
 
   uint64_t bloff = 0;
   uint64_t bytes_written_slow = 0;
+  uint64_t x_off = plan.x_off;
+  auto p = plan.extents.begin();
   while (length > 0) {
+    ceph_assert(p != plan.extents.end());
     uint64_t x_len = std::min(p->length - x_off, length);
     bufferlist t;
     t.substr_of(bl, bloff, x_len);
@@ -2836,9 +2874,40 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
       }
     }
   }
-  vselector->add_usage(h->file->vselector_hint, h->file->fnode);
   dout(20) << __func__ << " h " << h << " pos now 0x"
            << std::hex << h->pos << std::dec << dendl;
+}
+
+int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
+{
+  flush_plan_t plan;
+  int r = _flush_range_prepare(h, offset, length, &plan);
+  if (r < 0 || plan.length == 0) {
+    return r;
+  }
+  _flush_range_data(h, plan);
+  _flush_range_commit(h, plan);
+  return 0;
+}
+
+int BlueFS::_flush_range_F(FileWriter *h, uint64_t offset, uint64_t length)
+{
+  ceph_assert(ceph_mutex_is_locked(h->lock));
+  ceph_assert(h->file->fnode.ino > 1);
+  flush_plan_t plan;
+  {
+    // only the metadata update needs the global lock; the data goes
+    // out under h->lock so writers to different files do not serialize.
+    std::lock_guard l(lock);
+    ceph_assert(h->pos <= h->file->fnode.size);
+    int r = _flush_range_prepare(h, offset, length, &plan);
+    if (r < 0 || plan.length == 0) {
+      return r;
+    }
+  }
+  _flush_range_data(h, plan);
+  std::lock_guard l(lock);
+  _flush_range_commit(h, plan);
   return 0;
 }
 
@@ -2872,16 +2941,6 @@ void BlueFS::wait_for_aio(FileWriter *h)
 }
 #endif
 
-int BlueFS::_flush(FileWriter *h, bool force, std::unique_lock<ceph::mutex>& l)
-{
-  bool flushed = false;
-  int r = _flush(h, force, &flushed);
-  if (r == 0 && flushed) {
-    _maybe_compact_log(l);
-  }
-  return r;
-}
-
 int BlueFS::_flush(FileWriter *h, bool force, bool *flushed)
 {
   uint64_t length = h->get_buffer_length();
@@ -2912,6 +2971,48 @@ int BlueFS::_flush(FileWriter *h, bool force, bool *flushed)
   return r;
 }
 
+int BlueFS::_flush_F(FileWriter *h, bool force, bool *flushed)
+{
+  uint64_t length = h->get_buffer_length();
+  uint64_t offset = h->pos;
+  if (flushed) {
+    *flushed = false;
+  }
+  if (!force &&
+      length < cct->_conf->bluefs_min_flush_size) {
+    dout(10) << __func__ << " " << h << " ignoring, length " << length
+	     << " < min_flush_size " << cct->_conf->bluefs_min_flush_size
+	     << dendl;
+    return 0;
+  }
+  if (length == 0) {
+    dout(10) << __func__ << " " << h << " no dirty data" << dendl;
+    return 0;
+  }
+  // h->file->fnode is only stable under lock, _flush_range_prepare
+  // logs it
+  int r = _flush_range_F(h, offset, length);
+  if (flushed) {
+    *flushed = true;
+  }
+  return r;
+}
+
+void BlueFS::flush(FileWriter *h, bool force)
+{
+  bool flushed = false;
+  int r;
+  {
+    std::lock_guard hl(h->lock);
+    r = _flush_F(h, force, &flushed);
+    ceph_assert(r == 0);
+  }
+  if (r == 0 && flushed) {
+    std::unique_lock l(lock);
+    _maybe_compact_log(l);
+  }
+}
+
 int BlueFS::_truncate(FileWriter *h, uint64_t offset)
 {
   dout(10) << __func__ << " 0x" << std::hex << offset << std::dec
@@ -2950,16 +3051,17 @@ int BlueFS::_truncate(FileWriter *h, uint64_t offset)
   return 0;
 }
 
-int BlueFS::_fsync(FileWriter *h, std::unique_lock<ceph::mutex>& l)
+int BlueFS::_fsync_F(FileWriter *h)
 {
   dout(10) << __func__ << " " << h << " " << h->file->fnode << dendl;
-  int r = _flush(h, true);
+  int r = _flush_F(h, true);
   if (r < 0)
      return r;
-  uint64_t old_dirty_seq = h->file->dirty_seq;
 
-  _flush_bdev_safely(h);
+  _flush_bdev(h);
 
+  std::unique_lock l(lock);
+  uint64_t old_dirty_seq = h->file->dirty_seq;
   if (old_dirty_seq) {
     uint64_t s = log_seq;
     dout(20) << __func__ << " file metadata was dirty (" << old_dirty_seq
@@ -2968,10 +3070,17 @@ int BlueFS::_fsync(FileWriter *h, std::unique_lock<ceph::mutex>& l)
     ceph_assert(h->file->dirty_seq == 0 ||  // cleaned
 	   h->file->dirty_seq > s);    // or redirtied by someone else
   }
+  _maybe_compact_log(l);
   return 0;
 }
 
-void BlueFS::_flush_bdev_safely(FileWriter *h)
+int BlueFS::fsync(FileWriter *h)
+{
+  std::lock_guard hl(h->lock);
+  return _fsync_F(h);
+}
+
+void BlueFS::_flush_bdev(FileWriter *h)
 {
   std::array<bool, MAX_BDEV> flush_devs = h->dirty_devs;
   h->dirty_devs.fill(false);
@@ -2979,18 +3088,19 @@ void BlueFS::_flush_bdev_safely(FileWriter *h)
   if (!cct->_conf->bluefs_sync_write) {
     list<aio_t> completed_ios;
     _claim_completed_aios(h, &completed_ios);
-    lock.unlock();
     wait_for_aio(h);
     completed_ios.clear();
-    flush_bdev(flush_devs);
-    lock.lock();
-  } else
-#endif
-  {
-    lock.unlock();
-    flush_bdev(flush_devs);
-    lock.lock();
   }
+#endif
+  flush_bdev(flush_devs);
+}
+
+void BlueFS::_flush_bdev_safely(FileWriter *h)
+{
+  // used for the internal log writers, whose state is protected by lock
+  lock.unlock();
+  _flush_bdev(h);
+  lock.lock();
 }
 
 void BlueFS::flush_bdev(std::array<bool, MAX_BDEV>& dirty_bdevs)
@@ -183,6 +183,9 @@ public:
     int writer_type = 0;    ///< WRITER_*
     int write_hint = WRITE_LIFE_NOT_SET;
 
+    /// serializes data flushes through this writer; when both are
+    /// needed it is taken before BlueFS::lock.  Unused for the internal
+    /// log writers (ino 0 and 1), which are protected by BlueFS::lock.
     ceph::mutex lock = ceph::make_mutex("BlueFS::FileWriter::lock");
     std::array<IOContext*,MAX_BDEV> iocv; ///< for each bdev
     std::array<bool, MAX_BDEV> dirty_devs;
@@ -297,6 +300,9 @@ public:
   };
 
 private:
+  /// protects the namespace (dir_map, file_map), fnodes, allocators,
+  /// the pending log transaction and dirty_files.  Data I/O for user
+  /// files is issued under FileWriter::lock only.
   ceph::mutex lock = ceph::make_mutex("BlueFS::lock");
 
   PerfCounters *logger = nullptr;
@@ -384,10 +390,26 @@ private:
   int _allocate_without_fallback(uint8_t id, uint64_t len,
 				 PExtentVector* extents);
 
+  /// a data flush prepared under lock and issued without it
+  struct flush_plan_t {
+    uint64_t offset = 0;     ///< block aligned logical offset of the write
+    uint64_t length = 0;     ///< bytes to take from the writer (0 = no-op)
+    unsigned partial = 0;    ///< bytes re-written from the cached tail block
+    uint64_t x_off = 0;      ///< offset into the first extent
+    bool must_dirty = false; ///< extents were allocated for the write
+    mempool::bluefs::vector<bluefs_extent_t> extents; ///< target extents
+  };
+
+  int _flush_range_prepare(FileWriter *h, uint64_t offset, uint64_t length,
+			   flush_plan_t *plan);
+  void _flush_range_data(FileWriter *h, flush_plan_t& plan);
+  void _flush_range_commit(FileWriter *h, const flush_plan_t& plan);
   int _flush_range(FileWriter *h, uint64_t offset, uint64_t length);
-  int _flush(FileWriter *h, bool force, std::unique_lock<ceph::mutex>& l);
   int _flush(FileWriter *h, bool force, bool *flushed = nullptr);
-  int _fsync(FileWriter *h, std::unique_lock<ceph::mutex>& l);
+  // the _F variants are called with h->lock held and BlueFS::lock unlocked
+  int _flush_range_F(FileWriter *h, uint64_t offset, uint64_t length);
+  int _flush_F(FileWriter *h, bool force, bool *flushed = nullptr);
+  int _fsync_F(FileWriter *h);
 
 #ifdef HAVE_LIBAIO
   void _claim_completed_aios(FileWriter *h, std::list<aio_t> *ls);
@@ -420,6 +442,7 @@ private:
 
   //void _aio_finish(void *priv);
 
+  void _flush_bdev(FileWriter *h);  // safe to call without a lock
   void _flush_bdev_safely(FileWriter *h);
   void flush_bdev();  // this is safe to call without a lock
   void flush_bdev(std::array<bool, MAX_BDEV>& dirty_bdevs);  // this is safe to call without a lock
@@ -566,11 +589,7 @@ public:
   // handler for discard event
   void handle_discard(unsigned dev, interval_set<uint64_t>& to_release);
 
-  void flush(FileWriter *h, bool force = false) {
-    std::unique_lock l(lock);
-    int r = _flush(h, force, l);
-    ceph_assert(r == 0);
-  }
+  void flush(FileWriter *h, bool force = false);
 
   void append_try_flush(FileWriter *h, const char* buf, size_t len) {
     size_t max_size = 1ull << 30; // cap to 1GB
@@ -593,15 +612,10 @@ public:
     }
   }
   void flush_range(FileWriter *h, uint64_t offset, uint64_t length) {
-    std::lock_guard l(lock);
-    _flush_range(h, offset, length);
-  }
-  int fsync(FileWriter *h) {
-    std::unique_lock l(lock);
-    int r = _fsync(h, l);
-    _maybe_compact_log(l);
-    return r;
+    std::lock_guard hl(h->lock);
+    _flush_range_F(h, offset, length);
   }
+  int fsync(FileWriter *h);
   int64_t read(FileReader *h, uint64_t offset, size_t len,
 	   ceph::buffer::list *outbl, char *out) {
     // no need to hold the global lock here; we only touch h and
@@ -625,6 +639,7 @@ public:
     return _preallocate(f, offset, len);
   }
   int truncate(FileWriter *h, uint64_t offset) {
+    std::lock_guard hl(h->lock);
     std::lock_guard l(lock);
     return _truncate(h, offset);
   }
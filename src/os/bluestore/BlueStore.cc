@@ -28,6 +28,7 @@
 #include "os/kv.h"
 #include "include/compat.h"
 #include "include/intarith.h"
+#include "include/random.h"
 #include "include/stringify.h"
 #include "include/str_map.h"
 #include "include/util.h"
@@ -36,6 +37,7 @@
 #include "common/PriorityCache.h"
 #include "common/RWLock.h"
 #include "Allocator.h"
+#include "MagazineAllocator.h"
 #include "FreelistManager.h"
 #include "BlueFS.h"
 #include "BlueRocksEnv.h"
@@ -1660,6 +1662,51 @@ int BlueStore::BufferSpace::_discard(BufferCacheShard* cache, uint32_t offset, u
   return cache_private;
 }
 
+void BlueStore::BufferSpace::did_read(
+  BufferCacheShard* cache,
+  uint32_t offset,
+  bufferlist& bl)
+{
+  std::lock_guard l(cache->lock);
+  // Whatever is cached already holds the same data, so only fill the gaps
+  // with slices of what was just read.  Replacing cached buffers instead
+  // would trim the ones sticking out of the range and copy what is left of
+  // them (see Buffer::maybe_rebuild) on every padded or overlapping read.
+  uint32_t end = offset + bl.length();
+  uint32_t pos = offset;
+  while (pos < end) {
+    auto i = _data_lower_bound(pos);
+    if (i != buffer_map.end() && i->first <= pos && !i->second->is_empty()) {
+      pos = i->second->end();
+      continue;
+    }
+    uint32_t gap_end = end;
+    for (; i != buffer_map.end() && i->first < end; ++i) {
+      if (!i->second->is_empty()) {
+	gap_end = i->first;
+	break;
+      }
+    }
+    Buffer *b;
+    if (pos == offset && gap_end == end) {
+      b = new Buffer(this, Buffer::STATE_CLEAN, 0, offset, bl);
+    } else {
+      bufferlist t;
+      t.substr_of(bl, pos - offset, gap_end - pos);
+      b = new Buffer(this, Buffer::STATE_CLEAN, 0, pos, t);
+      // don't pin the whole read buffer for a small slice of it
+      if (b->maybe_rebuild()) {
+	cache->logger->inc(l_bluestore_read_copied_bytes, b->length);
+      }
+    }
+    // only empty (history) buffers are left in the gap
+    b->cache_private = _discard(cache, pos, gap_end - pos);
+    _add_buffer(cache, b, 1, nullptr);
+    pos = gap_end;
+  }
+  cache->_trim();
+}
+
 void BlueStore::BufferSpace::read(
   BufferCacheShard* cache, 
   uint32_t offset,
@@ -1835,7 +1882,10 @@ BlueStore::OnodeRef BlueStore::OnodeSpace::add(const ghobject_t& oid,
     return p->second;
   }
   ldout(cache->cct, 20) << __func__ << " " << oid << " " << o << dendl;
-  onode_map[oid] = o;
+  {
+    std::unique_lock ml(map_lock);
+    onode_map[oid] = o;
+  }
   cache->_add(o.get(), 1);
   cache->_trim();
   return o;
@@ -1844,15 +1894,43 @@ BlueStore::OnodeRef BlueStore::OnodeSpace::add(const ghobject_t& oid,
 void BlueStore::OnodeSpace::_remove(const ghobject_t& oid)
 {
   ldout(cache->cct, 20) << __func__ << " " << oid << " " << dendl;
+  std::unique_lock ml(map_lock);
   onode_map.erase(oid);
 }
 
 BlueStore::OnodeRef BlueStore::OnodeSpace::lookup(const ghobject_t& oid)
 {
   ldout(cache->cct, 30) << __func__ << dendl;
+  // only time one lookup in every 64 per thread, reading the clock twice
+  // costs about as much as the lockless hit itself
+  static thread_local unsigned lookup_seq = 0;
+  bool timed = (lookup_seq++ & 63) == 0;
+  mono_clock::time_point start;
+  if (timed) {
+    start = mono_clock::now();
+  }
   OnodeRef o;
   bool hit = false;
 
+  {
+    std::shared_lock ml(map_lock);
+    auto p = onode_map.find(oid);
+    if (p != onode_map.end() && p->second->try_get_pinned()) {
+      o.reset(p->second.get(), false);
+      hit = true;
+    }
+  }
+  if (hit) {
+    ldout(cache->cct, 30) << __func__ << " " << oid << " lockless hit " << o
+                          << " " << o->nref << dendl;
+    cache->logger->inc(l_bluestore_onode_hits);
+    cache->logger->inc(l_bluestore_onode_hits_lockless);
+    if (timed) {
+      cache->logger->tinc(l_bluestore_onode_hit_lat, mono_clock::now() - start);
+    }
+    return o;
+  }
+
   {
     std::lock_guard l(cache->lock);
     ceph::unordered_map<ghobject_t,OnodeRef>::iterator p = onode_map.find(oid);
@@ -1875,6 +1953,9 @@ BlueStore::OnodeRef BlueStore::OnodeSpace::lookup(const ghobject_t& oid)
 
   if (hit) {
     cache->logger->inc(l_bluestore_onode_hits);
+    if (timed) {
+      cache->logger->tinc(l_bluestore_onode_hit_lat, mono_clock::now() - start);
+    }
   } else {
     cache->logger->inc(l_bluestore_onode_misses);
   }
@@ -1888,6 +1969,7 @@ void BlueStore::OnodeSpace::clear()
   for (auto &p : onode_map) {
     cache->_rm(p.second.get());
   }
+  std::unique_lock ml(map_lock);
   onode_map.clear();
 }
 
@@ -1904,6 +1986,7 @@ void BlueStore::OnodeSpace::rename(
   const mempool::bluestore_cache_meta::string& new_okey)
 {
   std::lock_guard l(cache->lock);
+  std::unique_lock ml(map_lock);
   ldout(cache->cct, 30) << __func__ << " " << old_oid << " -> " << new_oid
 			<< dendl;
   ceph::unordered_map<ghobject_t,OnodeRef>::iterator po, pn;
@@ -1932,6 +2015,7 @@ void BlueStore::OnodeSpace::rename(
 
   o->oid = new_oid;
   o->key = new_okey;
+  ml.unlock();
   cache->_trim();
 }
 
@@ -3040,7 +3124,21 @@ unsigned BlueStore::ExtentMap::decode_some(bufferlist& bl)
   */
 
   ceph_assert(bl.get_num_buffers() <= 1);
-  auto p = bl.front().begin_deep();
+  // blobs decoded below keep their csum_data as views into a single
+  // buffer shared by the whole shard rather than a separate allocation
+  // per blob, which dominates memory usage of heavily fragmented
+  // objects.  make sure that buffer is tight, not some larger one the
+  // value happened to be read into.
+  bufferptr bp = bl.front();
+  if (bp.raw_length() != bp.length()) {
+    bp = bufferptr(bp.c_str(), bp.length());
+  }
+  // inline_bl is accounted by the caller, a shard's value only lives on
+  // as blob metadata
+  if (&bl != &inline_bl) {
+    bp.reassign_to_mempool(mempool::mempool_bluestore_cache_other);
+  }
+  auto p = bp.cbegin();
   __u8 struct_v;
   denc(struct_v, p);
   // Version 2 differs from v1 in blob's ref_map
@@ -3158,6 +3256,8 @@ void BlueStore::ExtentMap::decode_spanning_blobs(
     spanning_blob_map[b->id] = b;
     uint64_t sbid = 0;
     b->decode(onode->c, p, struct_v, &sbid, true);
+    b->dirty_blob().csum_data.reassign_to_mempool(
+      mempool::mempool_bluestore_cache_other);
     onode->c->open_shared_blob(sbid, b);
   }
 }
@@ -3999,6 +4099,41 @@ BlueStore::OnodeRef BlueStore::Collection::get_onode(
   return onode_map.add(oid, o);
 }
 
+void BlueStore::Collection::prefetch_onodes(
+  const vector<ghobject_t>& oids)
+{
+  ceph_assert(ceph_mutex_is_locked(lock));
+
+  vector<const ghobject_t*> missing;
+  vector<string> keys;
+  for (auto& oid : oids) {
+    if (onode_map.lookup(oid)) {
+      continue;
+    }
+    missing.push_back(&oid);
+    keys.emplace_back();
+    get_object_key(store->cct, oid, &keys.back());
+  }
+  if (keys.size() < 2) {
+    // nothing to gain over get_onode()
+    return;
+  }
+  vector<int> rs;
+  vector<bufferlist> vals;
+  store->db->multi_get(PREFIX_OBJ, keys, &rs, &vals);
+  unsigned loaded = 0;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (rs[i] < 0 || vals[i].length() == 0) {
+      continue;
+    }
+    OnodeRef o(Onode::decode(this, *missing[i], keys[i], vals[i]));
+    onode_map.add(*missing[i], o);
+    ++loaded;
+  }
+  ldout(store->cct, 20) << __func__ << " loaded " << loaded << " of "
+			<< keys.size() << " onodes" << dendl;
+}
+
 void BlueStore::Collection::split_cache(
   Collection *dest)
 {
@@ -4036,8 +4171,13 @@ void BlueStore::Collection::split_cache(
       OnodeRef o_pin = o;
       ceph_assert(o->pinned);
 
-      p = onode_map.onode_map.erase(p);
-      dest->onode_map.onode_map[o->oid] = o;
+      {
+        std::lock(onode_map.map_lock, dest->onode_map.map_lock);
+        std::unique_lock ml(onode_map.map_lock, std::adopt_lock);
+        std::unique_lock ml2(dest->onode_map.map_lock, std::adopt_lock);
+        p = onode_map.onode_map.erase(p);
+        dest->onode_map.onode_map[o->oid] = o;
+      }
       if (o->cached) {
         get_onode_cache()->move_pinned(dest->get_onode_cache(), o.get());
       }
@@ -4490,7 +4630,6 @@ BlueStore::BlueStore(CephContext *cct,
     throttle(cct),
     finisher(cct, "commit_finisher", "cfin"),
     kv_sync_thread(this),
-    kv_finalize_thread(this),
     zoned_cleaner_thread(this),
     min_alloc_size(_min_alloc_size),
     min_alloc_size_order(ctz(_min_alloc_size)),
@@ -4540,6 +4679,9 @@ const char **BlueStore::get_tracked_conf_keys() const
     "bluestore_deferred_batch_ops",
     "bluestore_deferred_batch_ops_hdd",
     "bluestore_deferred_batch_ops_ssd",
+    "bluestore_deferred_adaptive",
+    "bluestore_deferred_adaptive_interval",
+    "bluestore_deferred_adaptive_max_size",
     "bluestore_throttle_bytes",
     "bluestore_throttle_deferred_bytes",
     "bluestore_throttle_cost_per_io_hdd",
@@ -4599,7 +4741,8 @@ void BlueStore::handle_conf_change(const ConfigProxy& conf,
       changed.count("bluestore_max_alloc_size") ||
       changed.count("bluestore_deferred_batch_ops") ||
       changed.count("bluestore_deferred_batch_ops_hdd") ||
-      changed.count("bluestore_deferred_batch_ops_ssd")) {
+      changed.count("bluestore_deferred_batch_ops_ssd") ||
+      changed.count("bluestore_deferred_adaptive")) {
     if (bdev) {
       // only after startup
       _set_alloc_sizes();
@@ -4622,6 +4765,13 @@ void BlueStore::handle_conf_change(const ConfigProxy& conf,
       _set_max_defer_interval();
     }
   }
+  if (changed.count("bluestore_deferred_adaptive") ||
+      changed.count("bluestore_deferred_adaptive_interval") ||
+      changed.count("bluestore_deferred_adaptive_max_size")) {
+    if (bdev) {
+      _set_deferred_adaptive();
+    }
+  }
   if (changed.count("osd_memory_target") ||
       changed.count("osd_memory_base") ||
       changed.count("osd_memory_cache_min") ||
@@ -5017,6 +5167,27 @@ void BlueStore::_init_logger()
     "Average collection listing latency");
   b.add_time_avg(l_bluestore_remove_lat, "remove_lat",
     "Average removal latency");
+  b.add_time(l_bluestore_alloc_init_lat, "alloc_init_lat",
+    "Time spent to initialize allocator at mount");
+  b.add_u64(l_bluestore_alloc_init_from_snapshot, "alloc_init_from_snapshot",
+    "Whether allocator was initialized from a snapshot saved on umount");
+  b.add_u64_counter(l_bluestore_onode_hits_lockless, "bluestore_onode_hits_lockless",
+    "Sum for onode-lookups hit in the cache without taking cache shard lock");
+  b.add_time_avg(l_bluestore_onode_hit_lat, "onode_hit_lat",
+    "Average onode cache hit latency (sampled)");
+  b.add_u64(l_bluestore_prefer_deferred_size, "prefer_deferred_size",
+    "Current size threshold for deferred writes");
+  b.add_u64(l_bluestore_deferred_batch_ops, "deferred_batch_ops",
+    "Current number of deferred ops queued before submit");
+  b.add_u64_counter(l_bluestore_deferred_tune_up, "deferred_tune_up",
+    "Times adaptive tuning raised the deferred write threshold");
+  b.add_u64_counter(l_bluestore_deferred_tune_down, "deferred_tune_down",
+    "Times adaptive tuning lowered the deferred write threshold");
+  b.add_u64_counter(l_bluestore_deferred_tune_hold, "deferred_tune_hold",
+    "Times adaptive tuning kept the deferred write threshold");
+  b.add_u64_counter(l_bluestore_read_copied_bytes, "read_copied_bytes",
+    "Bytes copied by the read path (decompression excluded)",
+    NULL, 0, unit_t(UNIT_BYTES));
 
   logger = b.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
@@ -5207,6 +5378,14 @@ void BlueStore::_set_alloc_sizes(void)
     }
   }
 
+  // (re)start adaptive tuning from the configured values
+  prefer_deferred_size_base = prefer_deferred_size.load();
+  deferred_batch_ops_base = deferred_batch_ops.load();
+  if (logger) {
+    logger->set(l_bluestore_prefer_deferred_size, prefer_deferred_size);
+    logger->set(l_bluestore_deferred_batch_ops, deferred_batch_ops);
+  }
+
   dout(10) << __func__ << " min_alloc_size 0x" << std::hex << min_alloc_size
 	   << std::dec << " order " << (int)min_alloc_size_order
 	   << " max_alloc_size 0x" << std::hex << max_alloc_size
@@ -5216,6 +5395,60 @@ void BlueStore::_set_alloc_sizes(void)
 	   << dendl;
 }
 
+void BlueStore::_tune_deferred(uint64_t kv_commit_lat_ns)
+{
+  uint64_t count = direct_aio_count.exchange(0);
+  uint64_t sum = direct_aio_lat_ns.exchange(0);
+  uint64_t throttled = deferred_throttle_submits.exchange(0);
+  uint64_t direct_lat_ns = count ? sum / count : 0;
+
+  uint64_t size = prefer_deferred_size;
+  int ops = deferred_batch_ops;
+  uint64_t base_size = prefer_deferred_size_base;
+  int base_ops = deferred_batch_ops_base;
+  uint64_t max_size = std::max<uint64_t>(
+    base_size,
+    deferred_adaptive_max_size.load());
+  uint64_t block_size = bdev->get_block_size();
+
+  int idx;
+  if (throttled) {
+    // deferred writes are not drained as fast as they come in, we are
+    // flooding the WAL: defer less and flush sooner
+    size = size / 2 < block_size ? 0 : p2align(size / 2, block_size);
+    ops = std::max(1, std::max(base_ops / 4, ops / 2));
+    idx = l_bluestore_deferred_tune_down;
+  } else if (direct_lat_ns && kv_commit_lat_ns &&
+	     direct_lat_ns > kv_commit_lat_ns * 2) {
+    // a synchronous device write costs much more than a kv commit; defer
+    // more and batch the deferred ios harder to make them cheaper
+    size = std::min(max_size, size ? size * 2 : block_size);
+    ops = std::min(std::max(1, base_ops * 4), ops * 2);
+    idx = l_bluestore_deferred_tune_up;
+  } else if (direct_lat_ns && kv_commit_lat_ns &&
+	     direct_lat_ns < kv_commit_lat_ns) {
+    size = size / 2 < block_size ? 0 : p2align(size / 2, block_size);
+    ops = std::max(base_ops, ops / 2);
+    idx = l_bluestore_deferred_tune_down;
+  } else {
+    idx = l_bluestore_deferred_tune_hold;
+  }
+  logger->inc(idx);
+  if (size != prefer_deferred_size || ops != deferred_batch_ops) {
+    dout(10) << __func__ << " direct aio " << direct_lat_ns << "ns x " << count
+	     << ", kv commit " << kv_commit_lat_ns << "ns"
+	     << ", throttled " << throttled
+	     << ": prefer_deferred_size 0x" << std::hex << prefer_deferred_size
+	     << " -> 0x" << size << std::dec
+	     << ", deferred_batch_ops " << deferred_batch_ops << " -> " << ops
+	     << dendl;
+    prefer_deferred_size = size;
+    deferred_batch_ops = ops;
+    logger->set(l_bluestore_prefer_deferred_size, size);
+    logger->set(l_bluestore_deferred_batch_ops, ops);
+  }
+}
+
 int BlueStore::_open_bdev(bool create)
 {
   ceph_assert(bdev == NULL);
@@ -5241,6 +5474,7 @@ int BlueStore::_open_bdev(bool create)
   block_size_order = ctz(block_size);
   ceph_assert(block_size == 1u << block_size_order);
   _set_max_defer_interval();
+  _set_deferred_adaptive();
   // and set cache_size based on device type
   r = _set_cache_sizes();
   if (r < 0) {
@@ -5415,16 +5649,29 @@ int BlueStore::_create_alloc()
     alloc_size = _zoned_piggyback_device_parameters_onto(alloc_size);
   }
 
-  shared_alloc.set(Allocator::create(cct, cct->_conf->bluestore_allocator,
+  auto magazine_size =
+    cct->_conf.get_val<uint64_t>("bluestore_allocator_magazine_size");
+  if (bdev->is_smr()) {
+    magazine_size = 0;
+  }
+  // with magazines on top the backing allocator gets an anonymous name,
+  // "block" admin socket commands go to the magazine layer
+  Allocator* a = Allocator::create(cct, cct->_conf->bluestore_allocator,
     bdev->get_size(),
-    alloc_size, "block"));
+    alloc_size, magazine_size ? "" : "block");
 
-  if (!shared_alloc.a) {
+  if (!a) {
     lderr(cct) << __func__ << "Failed to create allocator:: "
       << cct->_conf->bluestore_allocator
       << dendl;
     return -EINVAL;
   }
+  if (magazine_size) {
+    a = new MagazineAllocator(cct, a,
+      cct->_conf.get_val<uint64_t>("bluestore_allocator_magazines"),
+      magazine_size, "block");
+  }
+  shared_alloc.set(a);
   return 0;
 }
 
@@ -5441,19 +5688,30 @@ int BlueStore::_init_alloc()
   }
 
   uint64_t num = 0, bytes = 0;
+  utime_t start = ceph_clock_now();
+  bool from_snapshot = false;
 
   dout(1) << __func__ << " opening allocation metadata" << dendl;
-  // initialize from freelist
-  fm->enumerate_reset();
-  uint64_t offset, length;
-  while (fm->enumerate_next(db, &offset, &length)) {
-    shared_alloc.a->init_add_free(offset, length);
-    ++num;
-    bytes += length;
+  if (bluefs && !bdev->is_smr() &&
+      cct->_conf.get_val<bool>("bluestore_allocator_snapshot")) {
+    from_snapshot = _load_alloc_snapshot(&num, &bytes) == 0;
+  }
+  if (!from_snapshot) {
+    // initialize from freelist
+    fm->enumerate_reset();
+    uint64_t offset, length;
+    while (fm->enumerate_next(db, &offset, &length)) {
+      shared_alloc.a->init_add_free(offset, length);
+      ++num;
+      bytes += length;
+    }
+    fm->enumerate_reset();
   }
-  fm->enumerate_reset();
+  logger->tset(l_bluestore_alloc_init_lat, ceph_clock_now() - start);
+  logger->set(l_bluestore_alloc_init_from_snapshot, from_snapshot);
 
   dout(1) << __func__
+          << (from_snapshot ? " (from snapshot)" : "")
           << " loaded " << byte_u_t(bytes) << " in " << num << " extents"
           << std::hex
           << ", allocator type " << shared_alloc.a->get_type()
@@ -5466,6 +5724,236 @@ int BlueStore::_init_alloc()
   return 0;
 }
 
+static const std::string ALLOC_SNAPSHOT_DIR = "bluestore.alloc";
+static const std::string ALLOC_SNAPSHOT_FILE = "snapshot";
+static const std::string ALLOC_SNAPSHOT_NONCE_KEY = "alloc_snapshot_nonce";
+
+// A snapshot is only valid for the exact kv state it was taken at: a
+// random nonce is stored in the DB as the very last write and recorded in
+// the snapshot along with the resulting kv sequence number.  The nonce is
+// removed by the first write after a mount; any write by anything else
+// (offline tools, older binaries) moves the sequence number on.
+int BlueStore::_prepare_alloc_snapshot()
+{
+  ceph_assert(db);
+  uint64_t nonce = ceph::util::generate_random_number<uint64_t>(
+    1, std::numeric_limits<uint64_t>::max());
+  KeyValueDB::Transaction t = db->get_transaction();
+  bufferlist bl;
+  encode(nonce, bl);
+  t->set(PREFIX_SUPER, ALLOC_SNAPSHOT_NONCE_KEY, bl);
+  int r = db->submit_transaction_sync(t);
+  if (r < 0) {
+    derr << __func__ << " failed to store nonce: " << cpp_strerror(r) << dendl;
+    return r;
+  }
+  alloc_snapshot_kv_seq = db->get_latest_sequence();
+  if (!alloc_snapshot_kv_seq) {
+    dout(1) << __func__ << " kv backend has no sequence numbers" << dendl;
+    return -EOPNOTSUPP;
+  }
+  alloc_snapshot_nonce = nonce;
+  return 0;
+}
+
+int BlueStore::_store_alloc_snapshot()
+{
+  ceph_assert(bluefs);
+  ceph_assert(shared_alloc.a);
+  utime_t start = ceph_clock_now();
+
+  // extents still queued for async discard are free in the freelist but
+  // not yet in the allocator; let the discard thread hand them back
+  bdev->discard_drain();
+
+  // what we persist is the freelist's view of the device: free space in
+  // the allocator plus everything bluefs owns on the shared device, as
+  // bluefs marks its own extents as used again when mounted.
+  interval_set<uint64_t> free_set;
+  shared_alloc.a->dump([&](uint64_t offset, uint64_t length) {
+    free_set.union_insert(offset, length);
+  });
+  interval_set<uint64_t> bluefs_extents;
+  bluefs->get_block_extents(bluefs_layout.shared_bdev, &bluefs_extents);
+  for (auto p = bluefs_extents.begin(); p != bluefs_extents.end(); ++p) {
+    free_set.union_insert(p.get_start(), p.get_len());
+  }
+
+  bufferlist payload;
+  for (auto p = free_set.begin(); p != free_set.end(); ++p) {
+    encode(p.get_start(), payload);
+    encode(p.get_len(), payload);
+  }
+  bufferlist bl;
+  ENCODE_START(2, 2, bl);
+  encode(alloc_snapshot_nonce, bl);
+  encode(alloc_snapshot_kv_seq, bl);
+  encode(bdev->get_size(), bl);
+  encode((uint64_t)shared_alloc.a->get_block_size(), bl);
+  encode((uint64_t)free_set.num_intervals(), bl);
+  encode(free_set.size(), bl);
+  encode(payload.crc32c(-1), bl);
+  encode(payload, bl);
+  ENCODE_FINISH(bl);
+
+  if (!bluefs->dir_exists(ALLOC_SNAPSHOT_DIR)) {
+    bluefs->mkdir(ALLOC_SNAPSHOT_DIR);
+  }
+  BlueFS::FileWriter *h = nullptr;
+  int r = bluefs->open_for_write(ALLOC_SNAPSHOT_DIR, ALLOC_SNAPSHOT_FILE,
+				 &h, false);
+  if (r < 0) {
+    derr << __func__ << " failed to open snapshot file: "
+	 << cpp_strerror(r) << dendl;
+    return r;
+  }
+  h->append(bl);
+  r = bluefs->fsync(h);
+  bluefs->close_writer(h);
+  if (r < 0) {
+    derr << __func__ << " failed to write snapshot: " << cpp_strerror(r)
+	 << dendl;
+    bluefs->unlink(ALLOC_SNAPSHOT_DIR, ALLOC_SNAPSHOT_FILE);
+    bluefs->sync_metadata(false);
+    return r;
+  }
+  dout(1) << __func__ << " saved " << byte_u_t(free_set.size())
+	  << " in " << free_set.num_intervals() << " extents, "
+	  << byte_u_t(bl.length()) << " in "
+	  << (ceph_clock_now() - start) << " seconds" << dendl;
+  return 0;
+}
+
+int BlueStore::_load_alloc_snapshot(uint64_t *num, uint64_t *bytes)
+{
+  ceph_assert(bluefs);
+  uint64_t size = 0;
+  utime_t mtime;
+  int r = bluefs->stat(ALLOC_SNAPSHOT_DIR, ALLOC_SNAPSHOT_FILE, &size, &mtime);
+  if (r < 0) {
+    dout(10) << __func__ << " no allocator snapshot" << dendl;
+    return r;
+  }
+  BlueFS::FileReader *h = nullptr;
+  r = bluefs->open_for_read(ALLOC_SNAPSHOT_DIR, ALLOC_SNAPSHOT_FILE, &h);
+  if (r < 0) {
+    return r;
+  }
+  bufferlist bl;
+  int64_t got = bluefs->read(h, 0, size, &bl, nullptr);
+  delete h;
+  if (got < 0 || (uint64_t)got != size) {
+    derr << __func__ << " failed to read snapshot, got " << got
+	 << " of " << size << " bytes, falling back to freelist" << dendl;
+    return got < 0 ? got : -EIO;
+  }
+
+  std::vector<std::pair<uint64_t, uint64_t>> extents;
+  uint64_t total = 0;
+  try {
+    auto p = bl.cbegin();
+    uint64_t nonce, kv_seq, dev_size, block_size, count, free_bytes;
+    uint32_t crc;
+    bufferlist payload;
+    DECODE_START(2, p);
+    if (struct_v < 2) {
+      derr << __func__ << " snapshot not tied to kv state"
+	   << ", falling back to freelist" << dendl;
+      return -ESTALE;
+    }
+    decode(nonce, p);
+    decode(kv_seq, p);
+    decode(dev_size, p);
+    decode(block_size, p);
+    decode(count, p);
+    decode(free_bytes, p);
+    decode(crc, p);
+    decode(payload, p);
+    DECODE_FINISH(p);
+    bufferlist nonce_bl;
+    uint64_t db_nonce = 0;
+    if (db->get(PREFIX_SUPER, ALLOC_SNAPSHOT_NONCE_KEY, &nonce_bl) >= 0) {
+      auto q = nonce_bl.cbegin();
+      decode(db_nonce, q);
+    }
+    uint64_t db_seq = db->get_latest_sequence();
+    if (nonce != db_nonce || kv_seq != db_seq) {
+      derr << __func__ << " snapshot is stale (nonce " << nonce
+	   << " vs " << db_nonce << ", kv seq " << kv_seq << " vs " << db_seq
+	   << "), falling back to freelist" << dendl;
+      return -ESTALE;
+    }
+    if (dev_size != bdev->get_size() ||
+	block_size != (uint64_t)shared_alloc.a->get_block_size()) {
+      derr << __func__ << " snapshot is for device size 0x" << std::hex
+	   << dev_size << " block size 0x" << block_size << std::dec
+	   << ", falling back to freelist" << dendl;
+      return -ESTALE;
+    }
+    if (payload.crc32c(-1) != crc) {
+      derr << __func__ << " snapshot checksum mismatch"
+	   << ", falling back to freelist" << dendl;
+      return -EIO;
+    }
+    extents.reserve(count);
+    auto q = payload.cbegin();
+    for (uint64_t i = 0; i < count; ++i) {
+      uint64_t offset, length;
+      decode(offset, q);
+      decode(length, q);
+      if (offset + length > dev_size || length == 0) {
+	derr << __func__ << " bad snapshot extent 0x" << std::hex << offset
+	     << "~" << length << std::dec << ", falling back to freelist"
+	     << dendl;
+	return -EIO;
+      }
+      extents.emplace_back(offset, length);
+      total += length;
+    }
+    if (total != free_bytes) {
+      derr << __func__ << " snapshot free bytes mismatch"
+	   << ", falling back to freelist" << dendl;
+      return -EIO;
+    }
+  } catch (ceph::buffer::error& e) {
+    derr << __func__ << " failed to decode snapshot: " << e.what()
+	 << ", falling back to freelist" << dendl;
+    return -EIO;
+  }
+
+  for (auto& e : extents) {
+    shared_alloc.a->init_add_free(e.first, e.second);
+  }
+  *num = extents.size();
+  *bytes = total;
+  return 0;
+}
+
+void BlueStore::_remove_alloc_snapshot()
+{
+  ceph_assert(bluefs);
+  ceph_assert(db);
+  // any further modification invalidates the snapshot, make sure it
+  // can't be picked up after a crash: drop the nonce before anything
+  // else is written
+  bufferlist bl;
+  if (db->get(PREFIX_SUPER, ALLOC_SNAPSHOT_NONCE_KEY, &bl) >= 0) {
+    dout(10) << __func__ << " removing nonce" << dendl;
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rmkey(PREFIX_SUPER, ALLOC_SNAPSHOT_NONCE_KEY);
+    int r = db->submit_transaction_sync(t);
+    ceph_assert(r == 0);
+  }
+  uint64_t size = 0;
+  utime_t mtime;
+  if (bluefs->stat(ALLOC_SNAPSHOT_DIR, ALLOC_SNAPSHOT_FILE, &size, &mtime) < 0) {
+    return;
+  }
+  dout(10) << __func__ << dendl;
+  bluefs->unlink(ALLOC_SNAPSHOT_DIR, ALLOC_SNAPSHOT_FILE);
+  bluefs->sync_metadata(false);
+}
+
 void BlueStore::_close_alloc()
 {
   ceph_assert(bdev);
@@ -5902,6 +6390,9 @@ int BlueStore::_open_db_and_around(bool read_only, bool to_repair)
   if (r < 0) {
     goto out_alloc;
   }
+  if (bluefs && !read_only) {
+    _remove_alloc_snapshot();
+  }
   return 0;
 
 out_alloc:
@@ -6094,6 +6585,19 @@ int BlueStore::_prepare_db_environment(bool create, bool read_only,
 
   FreelistManager::setup_merge_operators(db, freelist_type);
   db->set_merge_operator(PREFIX_STAT, merge_op);
+  if (cct->_conf.get_val<bool>("bluestore_rocksdb_cf_access_hints")) {
+    // only matter for prefixes which are column families, see
+    // bluestore_rocksdb_cfs
+    db->set_prefix_access_hint(PREFIX_OBJ,
+			       KeyValueDB::access_hint_t::POINT_LOOKUP);
+    for (auto& prefix : {PREFIX_OMAP, PREFIX_PGMETA_OMAP,
+			 PREFIX_PERPOOL_OMAP, PREFIX_PERPG_OMAP}) {
+      db->set_prefix_access_hint(prefix,
+				 KeyValueDB::access_hint_t::RANGE_SCAN);
+    }
+    db->set_prefix_access_hint(PREFIX_DEFERRED,
+			       KeyValueDB::access_hint_t::WRITE_ONCE);
+  }
   db->set_cache_size(cache_kv_ratio * cache_size);
   return 0;
 }
@@ -6154,11 +6658,19 @@ int BlueStore::_open_db(bool create, bool to_repair_db, bool read_only)
 void BlueStore::_close_db(bool cold_close)
 {
   ceph_assert(db);
+  if (alloc_snapshot_on_close && _prepare_alloc_snapshot() < 0) {
+    alloc_snapshot_on_close = false;
+  }
   delete db;
   db = NULL;
   if (bluefs) {
+    if (alloc_snapshot_on_close) {
+      // rocksdb is gone, nothing touches bluefs or the allocator anymore
+      _store_alloc_snapshot();
+    }
     _close_bluefs(cold_close);
   }
+  alloc_snapshot_on_close = false;
 }
 
 void BlueStore::_dump_alloc_on_failure()
@@ -7074,6 +7586,10 @@ int BlueStore::umount()
     _shutdown_cache();
     dout(20) << __func__ << " closing" << dendl;
 
+    alloc_snapshot_on_close =
+      bluefs && !bdev->is_smr() &&
+      !cct->_conf->bluestore_debug_no_reuse_blocks &&
+      cct->_conf.get_val<bool>("bluestore_allocator_snapshot");
   }
   _close_db_and_around(false);
 
@@ -9330,8 +9846,9 @@ BlueStore::CollectionRef BlueStore::_get_collection(const coll_t& cid)
 void BlueStore::_queue_reap_collection(CollectionRef& c)
 {
   dout(10) << __func__ << " " << c << " " << c->cid << dendl;
-  // _reap_collections and this in the same thread,
-  // so no need a lock.
+  // with several kv_finalize shards this may race with
+  // _reap_collections on another shard.
+  std::lock_guard l(removed_collections_lock);
   removed_collections.push_back(c);
 }
 
@@ -9340,8 +9857,7 @@ void BlueStore::_reap_collections()
 
   list<CollectionRef> removed_colls;
   {
-    // _queue_reap_collection and this in the same thread.
-    // So no need a lock.
+    std::lock_guard l(removed_collections_lock);
     if (!removed_collections.empty())
       removed_colls.swap(removed_collections);
     else
@@ -9371,6 +9887,7 @@ void BlueStore::_reap_collections()
   if (removed_colls.empty()) {
     dout(10) << __func__ << " all reaped" << dendl;
   } else {
+    std::lock_guard l(removed_collections_lock);
     removed_collections.splice(removed_collections.begin(), removed_colls);
   }
 }
@@ -9773,6 +10290,10 @@ int BlueStore::_generate_read_result_bl(
           return -EIO;
         }
         if (buffered) {
+          if (bdev->is_io_buffer(req.bl)) {
+            // don't pin the device's registered buffers in the cache
+            req.bl.rebuild();
+          }
           bptr->shared_blob->bc.did_read(bptr->shared_blob->get_cache(),
                                          req.r_off, req.bl);
         }
@@ -10811,14 +11332,23 @@ int BlueStore::omap_get_values(
     const string& prefix = o->get_omap_prefix();
     o->get_omap_key(string(), &final_key);
     size_t base_key_len = final_key.size();
+    // look them up in a single batch
+    vector<string> final_keys;
+    final_keys.reserve(keys.size());
     for (set<string>::const_iterator p = keys.begin(); p != keys.end(); ++p) {
       final_key.resize(base_key_len); // keep prefix
       final_key += *p;
-      bufferlist val;
-      if (db->get(prefix, final_key, &val) >= 0) {
-	dout(30) << __func__ << "  got " << pretty_binary_string(final_key)
+      final_keys.push_back(final_key);
+    }
+    vector<int> rs;
+    vector<bufferlist> vals;
+    db->multi_get(prefix, final_keys, &rs, &vals);
+    auto p = keys.begin();
+    for (size_t i = 0; i < final_keys.size(); ++i, ++p) {
+      if (rs[i] >= 0) {
+	dout(30) << __func__ << "  got " << pretty_binary_string(final_keys[i])
 		 << " -> " << *p << dendl;
-	out->insert(make_pair(*p, val));
+	out->emplace_hint(out->end(), *p, std::move(vals[i]));
       }
     }
   }
@@ -11276,6 +11806,10 @@ void BlueStore::_txc_state_proc(TransContext *txc)
       {
 	mono_clock::duration lat = throttle.log_state_latency(
 	  *txc, logger, l_bluestore_state_aio_wait_lat);
+	if (txc->had_ios) {
+	  direct_aio_lat_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(lat).count();
+	  ++direct_aio_count;
+	}
 	if (ceph::to_seconds<double>(lat) >= cct->_conf->bluestore_log_op_age) {
 	  dout(0) << __func__ << " slow aio_wait, txc = " << txc
 		  << ", latency = " << lat
@@ -11711,12 +12245,25 @@ void BlueStore::_txc_finish(TransContext *txc)
     }
   }
 
+  // release to allocator only after all preceding txc's have also
+  // finished any deferred writes that potentially land in these
+  // blocks.  gather everything up and queue it, the write path hands
+  // it to the allocator along with its next allocation (see
+  // _do_alloc_write) so that both take the allocator lock once.
+  interval_set<uint64_t> to_release;
+  for (auto& t : releasing_txc) {
+    _txc_release_alloc(&t, &to_release);
+  }
+  if (!to_release.empty()) {
+    std::lock_guard l(alloc_release_lock);
+    if (alloc_release_pending.empty()) {
+      alloc_release_pending.swap(to_release);
+    } else {
+      alloc_release_pending.insert(to_release);
+    }
+  }
   while (!releasing_txc.empty()) {
-    // release to allocator only after all preceding txc's have also
-    // finished any deferred writes that potentially land in these
-    // blocks
     auto txc = &releasing_txc.front();
-    _txc_release_alloc(txc);
     releasing_txc.pop_front();
     throttle.log_state_latency(*txc, logger, l_bluestore_state_done_lat);
     throttle.complete(*txc);
@@ -11740,7 +12287,8 @@ void BlueStore::_txc_finish(TransContext *txc)
   }
 }
 
-void BlueStore::_txc_release_alloc(TransContext *txc)
+void BlueStore::_txc_release_alloc(TransContext *txc,
+				   interval_set<uint64_t> *to_release)
 {
   // it's expected we're called with lazy_release_lock already taken!
   if (likely(!cct->_conf->bluestore_debug_no_reuse_blocks)) {
@@ -11759,7 +12307,11 @@ void BlueStore::_txc_release_alloc(TransContext *txc)
     }
     dout(10) << __func__ << "(sync) " << txc << " " << std::hex
              << txc->released << std::dec << dendl;
-    shared_alloc.a->release(txc->released);
+    if (to_release->empty()) {
+      to_release->swap(txc->released);
+    } else {
+      to_release->insert(txc->released);
+    }
   }
 
 out:
@@ -11767,6 +12319,24 @@ out:
   txc->released.clear();
 }
 
+void BlueStore::_alloc_release_take(interval_set<uint64_t> *to_release)
+{
+  std::lock_guard l(alloc_release_lock);
+  to_release->swap(alloc_release_pending);
+}
+
+void BlueStore::_alloc_release_flush()
+{
+  interval_set<uint64_t> to_release;
+  _alloc_release_take(&to_release);
+  if (!to_release.empty()) {
+    dout(20) << __func__ << " 0x" << std::hex << to_release.size()
+	     << std::dec << " in " << to_release.num_intervals()
+	     << " extents" << dendl;
+    shared_alloc.a->release(to_release);
+  }
+}
+
 void BlueStore::_osr_attach(Collection *c)
 {
   // note: caller has RWLock on coll_map
@@ -11887,9 +12457,9 @@ void BlueStore::_osr_drain_all()
     std::lock_guard l(kv_lock);
     kv_cond.notify_one();
   }
-  {
-    std::lock_guard l(kv_finalize_lock);
-    kv_finalize_cond.notify_one();
+  for (auto& shard : kv_finalize_shards) {
+    std::lock_guard l(shard->lock);
+    shard->cond.notify_one();
   }
   for (auto osr : s) {
     dout(20) << __func__ << " drain " << osr << dendl;
@@ -11924,7 +12494,33 @@ void BlueStore::_kv_start()
 
   finisher.start();
   kv_sync_thread.create("bstore_kv_sync");
-  kv_finalize_thread.create("bstore_kv_final");
+
+  unsigned num_shards = std::max<uint64_t>(
+    1, cct->_conf->bluestore_kv_finalize_shards);
+  ceph_assert(kv_finalize_shards.empty());
+  for (unsigned i = 0; i < num_shards; ++i) {
+    auto shard = std::make_unique<KVFinalizeShard>(this, i);
+    PerfCountersBuilder b(cct, "bluestore-kv_final." + stringify(i),
+			  l_bluestore_kv_final_shard_first,
+			  l_bluestore_kv_final_shard_last);
+    b.add_u64_avg(l_bluestore_kv_final_shard_batch_txc, "batch_txc",
+		  "Average number of committed txcs per finalize batch");
+    b.add_u64_avg(l_bluestore_kv_final_shard_batch_deferred,
+		  "batch_deferred",
+		  "Average number of stable deferred batches per finalize batch");
+    b.add_time_avg(l_bluestore_kv_final_shard_queue_lat, "queue_lat",
+		   "Average time a batch waits before this shard picks it up");
+    b.add_time_avg(l_bluestore_kv_final_shard_lat, "finalize_lat",
+		   "Average time to finalize a batch on this shard");
+    shard->logger = b.create_perf_counters();
+    cct->get_perfcounters_collection()->add(shard->logger);
+    kv_finalize_shards.push_back(std::move(shard));
+  }
+  for (unsigned i = 0; i < num_shards; ++i) {
+    // thread names are limited to 15 chars
+    kv_finalize_shards[i]->thread.create(
+      i == 0 ? "bstore_kv_final" : ("bstore_kv_fin" + stringify(i)).c_str());
+  }
 }
 
 void BlueStore::_kv_stop()
@@ -11938,25 +12534,28 @@ void BlueStore::_kv_stop()
     kv_stop = true;
     kv_cond.notify_all();
   }
-  {
-    std::unique_lock l{kv_finalize_lock};
-    while (!kv_finalize_started) {
-      kv_finalize_cond.wait(l);
-    }
-    kv_finalize_stop = true;
-    kv_finalize_cond.notify_all();
-  }
   kv_sync_thread.join();
-  kv_finalize_thread.join();
+  // the sync thread is gone, so nothing more can be queued for finalize
+  for (auto& shard : kv_finalize_shards) {
+    std::unique_lock l{shard->lock};
+    while (!shard->started) {
+      shard->cond.wait(l);
+    }
+    shard->stop = true;
+    shard->cond.notify_all();
+  }
+  for (auto& shard : kv_finalize_shards) {
+    shard->thread.join();
+    cct->get_perfcounters_collection()->remove(shard->logger);
+    delete shard->logger;
+  }
+  kv_finalize_shards.clear();
+  _alloc_release_flush();
   ceph_assert(removed_collections.empty());
   {
     std::lock_guard l(kv_lock);
     kv_stop = false;
   }
-  {
-    std::lock_guard l(kv_finalize_lock);
-    kv_finalize_stop = false;
-  }
   dout(10) << __func__ << " stopping finishers" << dendl;
   finisher.wait_for_empty();
   finisher.stop();
@@ -11976,6 +12575,10 @@ void BlueStore::_kv_sync_thread()
   timespan twait = ceph::make_timespan(0);
   size_t kv_submitted = 0;
 
+  auto tune_last = t0;
+  timespan tune_kv_lat = ceph::make_timespan(0);
+  uint64_t tune_kv_commits = 0;
+
   while (true) {
     auto period = cct->_conf->bluestore_kv_sync_util_logging_s;
     auto observation_period =
@@ -12161,31 +12764,7 @@ void BlueStore::_kv_sync_thread()
       }
 #endif
 
-      {
-	std::unique_lock m{kv_finalize_lock};
-	if (kv_committing_to_finalize.empty()) {
-	  kv_committing_to_finalize.swap(kv_committing);
-	} else {
-	  kv_committing_to_finalize.insert(
-	      kv_committing_to_finalize.end(),
-	      kv_committing.begin(),
-	      kv_committing.end());
-	  kv_committing.clear();
-	}
-	if (deferred_stable_to_finalize.empty()) {
-	  deferred_stable_to_finalize.swap(deferred_stable);
-	} else {
-	  deferred_stable_to_finalize.insert(
-	      deferred_stable_to_finalize.end(),
-	      deferred_stable.begin(),
-	      deferred_stable.end());
-	  deferred_stable.clear();
-	}
-	if (!kv_finalize_in_progress) {
-	  kv_finalize_in_progress = true;
-	  kv_finalize_cond.notify_one();
-	}
-      }
+      _kv_finalize_queue(kv_committing, deferred_stable);
 
       if (new_nid_max) {
 	nid_max = new_nid_max;
@@ -12218,6 +12797,21 @@ void BlueStore::_kv_sync_thread()
 	  l_bluestore_kv_sync_lat,
 	  dur,
 	  cct->_conf->bluestore_log_op_age);
+
+	if (committing_size) {
+	  tune_kv_lat += dur_kv;
+	  ++tune_kv_commits;
+	}
+	if (deferred_adaptive &&
+	    finish - tune_last >= ceph::make_timespan(
+	      deferred_adaptive_interval)) {
+	  _tune_deferred(tune_kv_commits ?
+	    std::chrono::duration_cast<std::chrono::nanoseconds>(
+	      tune_kv_lat).count() / tune_kv_commits : 0);
+	  tune_last = finish;
+	  tune_kv_lat = ceph::make_timespan(0);
+	  tune_kv_commits = 0;
+	}
       }
 
       l.lock();
@@ -12230,34 +12824,118 @@ void BlueStore::_kv_sync_thread()
   kv_sync_started = false;
 }
 
-void BlueStore::_kv_finalize_thread()
+void BlueStore::_kv_finalize_queue(
+  deque<TransContext*>& committed,
+  deque<DeferredBatch*>& deferred_stable)
 {
+  if (kv_finalize_shards.size() == 1) {
+    auto& shard = *kv_finalize_shards[0];
+    std::lock_guard l(shard.lock);
+    if (shard.kv_committing_to_finalize.empty() &&
+	shard.deferred_stable_to_finalize.empty()) {
+      shard.queued_since = mono_clock::now();
+    }
+    if (shard.kv_committing_to_finalize.empty()) {
+      shard.kv_committing_to_finalize.swap(committed);
+    } else {
+      shard.kv_committing_to_finalize.insert(
+	shard.kv_committing_to_finalize.end(),
+	committed.begin(),
+	committed.end());
+      committed.clear();
+    }
+    if (shard.deferred_stable_to_finalize.empty()) {
+      shard.deferred_stable_to_finalize.swap(deferred_stable);
+    } else {
+      shard.deferred_stable_to_finalize.insert(
+	shard.deferred_stable_to_finalize.end(),
+	deferred_stable.begin(),
+	deferred_stable.end());
+      deferred_stable.clear();
+    }
+    if (!shard.in_progress) {
+      shard.in_progress = true;
+      shard.cond.notify_one();
+    }
+    return;
+  }
+
+  // split by sequencer so that each osr is always finalized, in order, by
+  // the same shard.
+  unsigned n = kv_finalize_shards.size();
+  vector<deque<TransContext*>> txcs(n);
+  vector<deque<DeferredBatch*>> batches(n);
+  for (auto txc : committed) {
+    txcs[txc->osr->get_sequencer_id() % n].push_back(txc);
+  }
+  committed.clear();
+  for (auto b : deferred_stable) {
+    batches[b->osr->get_sequencer_id() % n].push_back(b);
+  }
+  deferred_stable.clear();
+
+  auto now = mono_clock::now();
+  for (unsigned i = 0; i < n; ++i) {
+    if (txcs[i].empty() && batches[i].empty()) {
+      continue;
+    }
+    auto& shard = *kv_finalize_shards[i];
+    std::lock_guard l(shard.lock);
+    if (shard.kv_committing_to_finalize.empty() &&
+	shard.deferred_stable_to_finalize.empty()) {
+      shard.queued_since = now;
+    }
+    shard.kv_committing_to_finalize.insert(
+      shard.kv_committing_to_finalize.end(),
+      txcs[i].begin(),
+      txcs[i].end());
+    shard.deferred_stable_to_finalize.insert(
+      shard.deferred_stable_to_finalize.end(),
+      batches[i].begin(),
+      batches[i].end());
+    if (!shard.in_progress) {
+      shard.in_progress = true;
+      shard.cond.notify_one();
+    }
+  }
+}
+
+void BlueStore::_kv_finalize_thread(unsigned shard_id)
+{
+  auto& shard = *kv_finalize_shards[shard_id];
   deque<TransContext*> kv_committed;
   deque<DeferredBatch*> deferred_stable;
-  dout(10) << __func__ << " start" << dendl;
-  std::unique_lock l(kv_finalize_lock);
-  ceph_assert(!kv_finalize_started);
-  kv_finalize_started = true;
-  kv_finalize_cond.notify_all();
+  dout(10) << __func__ << " shard " << shard_id << " start" << dendl;
+  std::unique_lock l(shard.lock);
+  ceph_assert(!shard.started);
+  shard.started = true;
+  shard.cond.notify_all();
   while (true) {
     ceph_assert(kv_committed.empty());
     ceph_assert(deferred_stable.empty());
-    if (kv_committing_to_finalize.empty() &&
-	deferred_stable_to_finalize.empty()) {
-      if (kv_finalize_stop)
+    if (shard.kv_committing_to_finalize.empty() &&
+	shard.deferred_stable_to_finalize.empty()) {
+      if (shard.stop)
 	break;
       dout(20) << __func__ << " sleep" << dendl;
-      kv_finalize_in_progress = false;
-      kv_finalize_cond.wait(l);
+      shard.in_progress = false;
+      shard.cond.wait(l);
       dout(20) << __func__ << " wake" << dendl;
     } else {
-      kv_committed.swap(kv_committing_to_finalize);
-      deferred_stable.swap(deferred_stable_to_finalize);
+      kv_committed.swap(shard.kv_committing_to_finalize);
+      deferred_stable.swap(shard.deferred_stable_to_finalize);
+      auto queued_since = shard.queued_since;
       l.unlock();
       dout(20) << __func__ << " kv_committed " << kv_committed << dendl;
       dout(20) << __func__ << " deferred_stable " << deferred_stable << dendl;
 
       auto start = mono_clock::now();
+      shard.logger->tinc(l_bluestore_kv_final_shard_queue_lat,
+			 start - queued_since);
+      shard.logger->inc(l_bluestore_kv_final_shard_batch_txc,
+			kv_committed.size());
+      shard.logger->inc(l_bluestore_kv_final_shard_batch_deferred,
+			deferred_stable.size());
 
       while (!kv_committed.empty()) {
 	TransContext *txc = kv_committed.front();
@@ -12278,28 +12956,38 @@ void BlueStore::_kv_finalize_thread()
       deferred_stable.clear();
 
       if (!deferred_aggressive) {
-	if (deferred_queue_size >= deferred_batch_ops.load() ||
-	    throttle.should_submit_deferred()) {
+	if (deferred_queue_size >= deferred_batch_ops.load()) {
+	  deferred_try_submit();
+	} else if (throttle.should_submit_deferred()) {
+	  ++deferred_throttle_submits;
 	  deferred_try_submit();
 	}
       }
 
+      // whatever the write path did not pick up goes back now, so that
+      // freed space is not held back longer than a finalize batch
+      _alloc_release_flush();
+
       // this is as good a place as any ...
       _reap_collections();
 
-      logger->set(l_bluestore_fragmentation,
+      if (shard_id == 0) {
+	logger->set(l_bluestore_fragmentation,
 	  (uint64_t)(shared_alloc.a->get_fragmentation() * 1000));
+      }
 
+      auto dur = mono_clock::now() - start;
+      shard.logger->tinc(l_bluestore_kv_final_shard_lat, dur);
       log_latency("kv_final",
 	l_bluestore_kv_final_lat,
-	mono_clock::now() - start,
+	dur,
 	cct->_conf->bluestore_log_op_age);
 
       l.lock();
     }
   }
-  dout(10) << __func__ << " finish" << dendl;
-  kv_finalize_started = false;
+  dout(10) << __func__ << " shard " << shard_id << " finish" << dendl;
+  shard.started = false;
 }
 
 void BlueStore::_zoned_cleaner_start() {
@@ -12750,6 +13438,45 @@ void BlueStore::_txc_aio_submit(TransContext *txc)
   bdev->aio_submit(&txc->ioc);
 }
 
+void BlueStore::_txc_prefetch_onodes(Transaction *t,
+				     const vector<CollectionRef>& cvec)
+{
+  // Load the onodes of all the objects a transaction touches in one go
+  // rather than one by one as the ops get to them.
+  map<Collection*, vector<ghobject_t>> oids;
+  Transaction::iterator i = t->begin();
+  vector<bool> seen(i.objects.size());
+  while (i.have_op()) {
+    Transaction::Op *op = i.decode_op();
+    switch (op->op) {
+    case Transaction::OP_NOP:
+    case Transaction::OP_CREATE:  // a new object, nothing to load
+    case Transaction::OP_RMCOLL:
+    case Transaction::OP_MKCOLL:
+    case Transaction::OP_SPLIT_COLLECTION:
+    case Transaction::OP_SPLIT_COLLECTION2:
+    case Transaction::OP_MERGE_COLLECTION:
+    case Transaction::OP_COLL_HINT:
+    case Transaction::OP_COLL_SETATTR:
+    case Transaction::OP_COLL_RMATTR:
+    case Transaction::OP_COLL_RENAME:
+      continue;
+    }
+    const CollectionRef& c = cvec[op->cid];
+    if (!c || seen[op->oid]) {
+      continue;
+    }
+    seen[op->oid] = true;
+    oids[c.get()].push_back(i.get_oid(op->oid));
+  }
+  for (auto& [c, v] : oids) {
+    if (v.size() > 1) {
+      std::shared_lock l(c->lock);
+      c->prefetch_onodes(v);
+    }
+  }
+}
+
 void BlueStore::_txc_add_transaction(TransContext *txc, Transaction *t)
 {
   Transaction::iterator i = t->begin();
@@ -12765,6 +13492,10 @@ void BlueStore::_txc_add_transaction(TransContext *txc, Transaction *t)
   
   vector<OnodeRef> ovec(i.objects.size());
 
+  if (i.objects.size() > 1) {
+    _txc_prefetch_onodes(t, cvec);
+  }
+
   for (int pos = 0; i.have_op(); ++pos) {
     Transaction::Op *op = i.decode_op();
     int r = 0;
@@ -14028,9 +14759,17 @@ int BlueStore::_do_alloc_write(
   PExtentVector prealloc;
   prealloc.reserve(2 * wctx->writes.size());;
   int64_t prealloc_left = 0;
-  prealloc_left = shared_alloc.a->allocate(
-    need, min_alloc_size, need,
-    0, &prealloc);
+  {
+    // return the space freed by finished txcs under the same allocator
+    // lock acquisition
+    interval_set<uint64_t> released;
+    _alloc_release_take(&released);
+    std::vector<Allocator::alloc_request_t> requests;
+    requests.emplace_back(need, min_alloc_size, need, 0, &prealloc);
+    shared_alloc.a->allocate_batch(
+      released.empty() ? nullptr : &released, requests);
+    prealloc_left = requests.front().result;
+  }
   if (prealloc_left < 0 || prealloc_left < (int64_t)need) {
     derr << __func__ << " failed to allocate 0x" << std::hex << need
          << " allocated 0x " << (prealloc_left < 0 ? 0 : prealloc_left)
@@ -144,9 +144,28 @@ enum {
   l_bluestore_omap_get_values_lat,
   l_bluestore_clist_lat,
   l_bluestore_remove_lat,
+  l_bluestore_alloc_init_lat,
+  l_bluestore_alloc_init_from_snapshot,
+  l_bluestore_onode_hits_lockless,
+  l_bluestore_onode_hit_lat,
+  l_bluestore_prefer_deferred_size,
+  l_bluestore_deferred_batch_ops,
+  l_bluestore_deferred_tune_up,
+  l_bluestore_deferred_tune_down,
+  l_bluestore_deferred_tune_hold,
+  l_bluestore_read_copied_bytes,
   l_bluestore_last
 };
 
+enum {
+  l_bluestore_kv_final_shard_first = 732550,
+  l_bluestore_kv_final_shard_batch_txc,
+  l_bluestore_kv_final_shard_batch_deferred,
+  l_bluestore_kv_final_shard_queue_lat,
+  l_bluestore_kv_final_shard_lat,
+  l_bluestore_kv_final_shard_last
+};
+
 #define META_POOL_ID ((uint64_t)-1ull)
 
 class BlueStore : public ObjectStore,
@@ -170,6 +189,14 @@ public:
     max_defer_interval =
 	cct->_conf.get_val<double>("bluestore_max_defer_interval");
   }
+  void _set_deferred_adaptive() {
+    deferred_adaptive =
+	cct->_conf.get_val<bool>("bluestore_deferred_adaptive");
+    deferred_adaptive_interval =
+	cct->_conf.get_val<double>("bluestore_deferred_adaptive_interval");
+    deferred_adaptive_max_size =
+	cct->_conf.get_val<Option::size_t>("bluestore_deferred_adaptive_max_size");
+  }
 
   struct TransContext;
 
@@ -255,12 +282,14 @@ public:
       }
       length = newlen;
     }
-    void maybe_rebuild() {
+    bool maybe_rebuild() {
       if (data.length() &&
 	  (data.get_num_buffers() > 1 ||
 	   data.front().wasted() > data.length() / MAX_BUFFER_SLOP_RATIO_DEN)) {
 	data.rebuild();
+	return true;
       }
+      return false;
     }
 
     void dump(ceph::Formatter *f) const {
@@ -375,13 +404,7 @@ public:
       cache->_trim();
     }
     void _finish_write(BufferCacheShard* cache, uint64_t seq);
-    void did_read(BufferCacheShard* cache, uint32_t offset, ceph::buffer::list& bl) {
-      std::lock_guard l(cache->lock);
-      Buffer *b = new Buffer(this, Buffer::STATE_CLEAN, 0, offset, bl);
-      b->cache_private = _discard(cache, offset, bl.length());
-      _add_buffer(cache, b, 1, nullptr);
-      cache->_trim();
-    }
+    void did_read(BufferCacheShard* cache, uint32_t offset, ceph::buffer::list& bl);
 
     void read(BufferCacheShard* cache, uint32_t offset, uint32_t length,
 	      BlueStore::ready_regions_t& res,
@@ -1134,6 +1157,18 @@ public:
     void flush();
     void get();
     void put();
+    /// take a reference without the cache shard lock, only possible if
+    /// the onode is pinned and referenced by someone else: that holder's
+    /// put() can't unpin it then and unpinned onodes are never trimmed
+    bool try_get_pinned() {
+      int n = nref.load();
+      while (pinned && n >= 3) {
+	if (nref.compare_exchange_weak(n, n + 1)) {
+	  return true;
+	}
+      }
+      return false;
+    }
 
     inline bool put_cache() {
       ceph_assert(!cached);
@@ -1290,6 +1325,11 @@ public:
   private:
     /// forward lookups
     mempool::bluestore_cache_meta::unordered_map<ghobject_t,OnodeRef> onode_map;
+    /// modifications of onode_map take it exclusively, in addition to
+    /// cache->lock (which is taken first). lookups of pinned onodes only
+    /// need it shared and thus don't serialize on the cache shard lock.
+    ceph::shared_mutex map_lock =
+      ceph::make_shared_mutex("BlueStore::OnodeSpace::map_lock");
 
     friend struct Collection; // for split_cache()
     friend struct Onode; // for put()
@@ -1343,6 +1383,8 @@ public:
       return onode_map.cache;
     }
     OnodeRef get_onode(const ghobject_t& oid, bool create, bool is_createop=false);
+    /// load the onodes which aren't cached yet in a single batch
+    void prefetch_onodes(const std::vector<ghobject_t>& oids);
 
     // the terminology is confusing here, sorry!
     //
@@ -1982,12 +2024,29 @@ public:
   };
   struct KVFinalizeThread : public Thread {
     BlueStore *store;
-    explicit KVFinalizeThread(BlueStore *s) : store(s) {}
+    unsigned shard;
+    KVFinalizeThread(BlueStore *s, unsigned shard) : store(s), shard(shard) {}
     void *entry() override {
-      store->_kv_finalize_thread();
+      store->_kv_finalize_thread(shard);
       return NULL;
     }
   };
+  /// committed txcs are finalized by one of these, picked by sequencer
+  /// id, so that per-sequencer ordering of commit callbacks is preserved
+  struct KVFinalizeShard {
+    KVFinalizeThread thread;
+    ceph::mutex lock = ceph::make_mutex("BlueStore::kv_finalize_lock");
+    ceph::condition_variable cond;
+    bool started = false;
+    bool stop = false;
+    bool in_progress = false;
+    std::deque<TransContext*> kv_committing_to_finalize;   ///< pending finalization
+    std::deque<DeferredBatch*> deferred_stable_to_finalize; ///< pending finalization
+    mono_clock::time_point queued_since; ///< oldest pending handoff
+    PerfCounters *logger = nullptr;
+
+    KVFinalizeShard(BlueStore *s, unsigned shard) : thread(s, shard) {}
+  };
   struct ZonedCleanerThread : public Thread {
     BlueStore *store;
     explicit ZonedCleanerThread(BlueStore *s) : store(s) {}
@@ -2055,6 +2114,12 @@ private:
   FreelistManager *fm = nullptr;
 
   bluefs_shared_alloc_context_t shared_alloc;
+  /// save allocator state to bluefs when db gets closed (clean umount)
+  bool alloc_snapshot_on_close = false;
+  /// ties the snapshot to the kv state it was taken at, see
+  /// _prepare_alloc_snapshot()
+  uint64_t alloc_snapshot_nonce = 0;
+  uint64_t alloc_snapshot_kv_seq = 0;
 
   uuid_d fsid;
   int path_fd = -1;  ///< open handle to $path
@@ -2082,6 +2147,12 @@ private:
   ceph::mutex deferred_lock = ceph::make_mutex("BlueStore::deferred_lock");
   ceph::mutex atomic_alloc_and_submit_lock =
       ceph::make_mutex("BlueStore::atomic_alloc_and_submit_lock");
+  ceph::mutex alloc_release_lock =
+      ceph::make_mutex("BlueStore::alloc_release_lock");
+  /// released by _txc_finish, handed to the allocator together with the
+  /// next allocation of the write path or at the end of the kv finalize
+  /// batch, whichever comes first
+  interval_set<uint64_t> alloc_release_pending;
   std::atomic<uint64_t> deferred_seq = {0};
   deferred_osr_queue_t deferred_queue; ///< osr's with deferred io pending
   std::atomic_int deferred_queue_size = {0};         ///< num txc's queued across all osrs
@@ -2095,20 +2166,13 @@ private:
   bool _kv_only = false;
   bool kv_sync_started = false;
   bool kv_stop = false;
-  bool kv_finalize_started = false;
-  bool kv_finalize_stop = false;
   std::deque<TransContext*> kv_queue;             ///< ready, already submitted
   std::deque<TransContext*> kv_queue_unsubmitted; ///< ready, need submit by kv thread
   std::deque<TransContext*> kv_committing;        ///< currently syncing
   std::deque<DeferredBatch*> deferred_done_queue;   ///< deferred ios done
   bool kv_sync_in_progress = false;
 
-  KVFinalizeThread kv_finalize_thread;
-  ceph::mutex kv_finalize_lock = ceph::make_mutex("BlueStore::kv_finalize_lock");
-  ceph::condition_variable kv_finalize_cond;
-  std::deque<TransContext*> kv_committing_to_finalize;   ///< pending finalization
-  std::deque<DeferredBatch*> deferred_stable_to_finalize; ///< pending finalization
-  bool kv_finalize_in_progress = false;
+  std::vector<std::unique_ptr<KVFinalizeShard>> kv_finalize_shards;
 
   ZonedCleanerThread zoned_cleaner_thread;
   ceph::mutex zoned_cleaner_lock = ceph::make_mutex("BlueStore::zoned_cleaner_lock");
@@ -2119,6 +2183,8 @@ private:
 
   PerfCounters *logger = nullptr;
 
+  ceph::mutex removed_collections_lock =
+    ceph::make_mutex("BlueStore::removed_collections_lock");
   std::list<CollectionRef> removed_collections;
 
   ceph::shared_mutex debug_read_error_lock =
@@ -2155,6 +2221,16 @@ private:
   ///< size threshold for forced deferred writes
   std::atomic<uint64_t> prefer_deferred_size = {0};
 
+  ///< configured values the adaptive tuning starts from, see _tune_deferred()
+  std::atomic<uint64_t> prefer_deferred_size_base = {0};
+  std::atomic<int> deferred_batch_ops_base = {0};
+
+  ///< direct write aio latency sampled for the adaptive deferred tuning
+  std::atomic<uint64_t> direct_aio_lat_ns = {0};
+  std::atomic<uint64_t> direct_aio_count = {0};
+  ///< times the deferred throttle forced a submit since the last tuning
+  std::atomic<uint64_t> deferred_throttle_submits = {0};
+
   ///< approx cost per io, in bytes
   std::atomic<uint64_t> throttle_cost_per_io = {0};
 
@@ -2183,6 +2259,9 @@ private:
   uint64_t osd_memory_cache_min = 0; ///< Min memory to assign when autotuning cache
   double osd_memory_cache_resize_interval = 0; ///< Time to wait between cache resizing 
   double max_defer_interval = 0; ///< Time to wait between last deferred submit
+  std::atomic<bool> deferred_adaptive = {false}; ///< see _tune_deferred()
+  std::atomic<double> deferred_adaptive_interval = {0}; ///< seconds between tunings
+  std::atomic<uint64_t> deferred_adaptive_max_size = {0}; ///< tuning upper bound
   std::atomic<uint32_t> config_changed = {0}; ///< Counter to determine if there is a configuration change.
 
   typedef std::map<uint64_t, volatile_statfs> osd_pools_map;
@@ -2356,6 +2435,7 @@ private:
   int _write_fsid();
   void _close_fsid();
   void _set_alloc_sizes();
+  void _tune_deferred(uint64_t kv_commit_lat_ns);
   void _set_blob_size();
   void _set_finisher_num();
   void _set_per_pool_omap();
@@ -2399,6 +2479,12 @@ private:
   int _create_alloc();
   int _init_alloc();
   void _close_alloc();
+  /// persist free extents of the shared allocator to bluefs, rocksdb
+  /// must be closed already
+  int _prepare_alloc_snapshot();
+  int _store_alloc_snapshot();
+  int _load_alloc_snapshot(uint64_t *num, uint64_t *bytes);
+  void _remove_alloc_snapshot();
   int _open_collections();
   void _fsck_collections(int64_t* errors);
   void _close_collections();
@@ -2453,6 +2539,8 @@ private:
 			    std::list<Context*> *on_commits,
 			    TrackedOpRef osd_op=TrackedOpRef());
   void _txc_update_store_statfs(TransContext *txc);
+  void _txc_prefetch_onodes(Transaction *t,
+			    const std::vector<CollectionRef>& cvec);
   void _txc_add_transaction(TransContext *txc, Transaction *t);
   void _txc_calc_cost(TransContext *txc);
   void _txc_write_nodes(TransContext *txc, KeyValueDB::Transaction t);
@@ -2468,7 +2556,14 @@ private:
   void _txc_apply_kv(TransContext *txc, bool sync_submit_transaction);
   void _txc_committed_kv(TransContext *txc);
   void _txc_finish(TransContext *txc);
-  void _txc_release_alloc(TransContext *txc);
+  /// discard/queue txc->released; whatever is left for the allocator is
+  /// accumulated in to_release so the caller can release it in one batch
+  void _txc_release_alloc(TransContext *txc,
+			  interval_set<uint64_t> *to_release);
+  /// take what is queued in alloc_release_pending
+  void _alloc_release_take(interval_set<uint64_t> *to_release);
+  /// release what is queued in alloc_release_pending to the allocator
+  void _alloc_release_flush();
 
   void _osr_attach(Collection *c);
   void _osr_register_zombie(OpSequencer *osr);
@@ -2479,7 +2574,9 @@ private:
   void _kv_start();
   void _kv_stop();
   void _kv_sync_thread();
-  void _kv_finalize_thread();
+  void _kv_finalize_queue(std::deque<TransContext*>& committed,
+			  std::deque<DeferredBatch*>& deferred_stable);
+  void _kv_finalize_thread(unsigned shard);
 
   void _zoned_cleaner_start();
   void _zoned_cleaner_stop();
@@ -2593,6 +2690,10 @@ public:
   uint64_t get_min_alloc_size() const override {
     return min_alloc_size;
   }
+  uint64_t get_data_alignment() const override {
+    // anything else is realigned before it is submitted to the device
+    return block_size;
+  }
 
   int get_devices(std::set<std::string> *ls) override;
 
@@ -30,16 +30,19 @@ int64_t HybridAllocator::allocate(
   ceph_assert(isp2(unit));
   ceph_assert(want % unit == 0);
 
-  if (max_alloc_size == 0) {
-    max_alloc_size = want;
-  }
-  if (constexpr auto cap = std::numeric_limits<decltype(bluestore_pextent_t::length)>::max();
-      max_alloc_size >= cap) {
-    max_alloc_size = p2align(uint64_t(cap), (uint64_t)get_block_size());
-  }
+  max_alloc_size = _normalize_max_alloc_size(want, max_alloc_size);
 
   std::lock_guard l(lock);
+  return _allocate_hybrid(want, unit, max_alloc_size, hint, extents);
+}
 
+int64_t HybridAllocator::_allocate_hybrid(
+  uint64_t want,
+  uint64_t unit,
+  uint64_t max_alloc_size,
+  int64_t  hint,
+  PExtentVector* extents)
+{
   int64_t res;
   PExtentVector local_extents;
 
@@ -112,6 +115,28 @@ void HybridAllocator::release(const interval_set<uint64_t>& release_set) {
   _release(release_set);
 }
 
+void HybridAllocator::allocate_batch(
+  const interval_set<uint64_t>* release_set,
+  std::vector<alloc_request_t>& requests)
+{
+  ldout(cct, 10) << __func__ << " requests " << requests.size()
+                 << " release " << (release_set ? release_set->num_intervals() : 0)
+                 << dendl;
+  for (auto& r : requests) {
+    ceph_assert(isp2(r.unit));
+    ceph_assert(r.want % r.unit == 0);
+    r.max_alloc_size = _normalize_max_alloc_size(r.want, r.max_alloc_size);
+  }
+  std::lock_guard l(lock);
+  if (release_set) {
+    _release(*release_set);
+  }
+  for (auto& r : requests) {
+    r.result = _allocate_hybrid(r.want, r.unit, r.max_alloc_size, r.hint,
+                                r.extents);
+  }
+}
+
 uint64_t HybridAllocator::get_free()
 {
   std::lock_guard l(lock);
@@ -27,6 +27,8 @@ public:
     int64_t  hint,
     PExtentVector *extents) override;
   void release(const interval_set<uint64_t>& release_set) override;
+  void allocate_batch(const interval_set<uint64_t>* release_set,
+                      std::vector<alloc_request_t>& requests) override;
   uint64_t get_free() override;
   double get_fragmentation() override;
 
@@ -44,6 +46,13 @@ protected:
     return bmap_alloc;
   }
 private:
+  // lock to be held by the caller
+  int64_t _allocate_hybrid(
+    uint64_t want,
+    uint64_t unit,
+    uint64_t max_alloc_size,
+    int64_t  hint,
+    PExtentVector *extents);
 
   void _spillover_range(uint64_t start, uint64_t end) override;
 
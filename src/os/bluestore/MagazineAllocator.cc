@@ -0,0 +1,251 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "MagazineAllocator.h"
+
+#include <thread>
+
+#include "common/debug.h"
+
+#define dout_context cct
+#define dout_subsys ceph_subsys_bluestore
+#undef  dout_prefix
+#define dout_prefix *_dout << "MagazineAllocator "
+
+namespace {
+// threads are spread over the magazines round robin in order of their
+// first allocator call
+std::atomic<size_t> next_thread_idx = {0};
+thread_local size_t thread_idx = next_thread_idx++;
+}
+
+MagazineAllocator::MagazineAllocator(CephContext* _cct,
+				     Allocator* _backing,
+				     size_t _num_magazines,
+				     size_t _magazine_size,
+				     const std::string& name)
+  : Allocator(name, _backing->get_capacity(), _backing->get_block_size()),
+    cct(_cct),
+    backing(_backing),
+    chunk_size(_backing->get_block_size()),
+    magazine_size(_magazine_size),
+    num_magazines(_num_magazines ? _num_magazines :
+		  std::max(1u, std::thread::hardware_concurrency())),
+    magazines(new magazine_t[num_magazines])
+{
+  ceph_assert(chunk_size > 0);
+  // keep whatever we hand out in a single call within 32-bit extent length
+  magazine_size = std::min<size_t>(magazine_size, (1ull << 31) / chunk_size);
+  for (size_t i = 0; i < num_magazines; ++i) {
+    magazines[i].chunks.reserve(magazine_size + magazine_size / 2);
+  }
+  ldout(cct, 10) << __func__ << " " << backing->get_type()
+		 << " magazines " << num_magazines
+		 << " x " << magazine_size
+		 << " chunks of 0x" << std::hex << chunk_size << std::dec
+		 << dendl;
+}
+
+MagazineAllocator::~MagazineAllocator()
+{
+  _drain_all();
+}
+
+MagazineAllocator::magazine_t* MagazineAllocator::_try_get_magazine()
+{
+  auto m = &magazines[thread_idx % num_magazines];
+  if (m->busy.test_and_set(std::memory_order_acquire)) {
+    return nullptr;
+  }
+  return m;
+}
+
+MagazineAllocator::magazine_t* MagazineAllocator::_get_magazine(size_t i)
+{
+  auto m = &magazines[i];
+  while (m->busy.test_and_set(std::memory_order_acquire)) {
+    std::this_thread::yield();
+  }
+  return m;
+}
+
+void MagazineAllocator::_refill(magazine_t* m, int64_t hint)
+{
+  // a single contiguous run if possible, chunks are pushed in reverse so
+  // that consecutive allocations come out adjacent
+  uint64_t want = (magazine_size / 2) * chunk_size;
+  PExtentVector extents;
+  int64_t r = backing->allocate(want, chunk_size, want, hint, &extents);
+  if (r <= 0) {
+    return;
+  }
+  for (auto e = extents.rbegin(); e != extents.rend(); ++e) {
+    for (uint64_t o = e->end(); o > e->offset; ) {
+      o -= chunk_size;
+      m->chunks.push_back(o);
+    }
+  }
+  cached += r;
+  ldout(cct, 20) << __func__ << " got 0x" << std::hex << r << std::dec
+		 << " in " << extents.size() << " extents" << dendl;
+}
+
+void MagazineAllocator::_drain(magazine_t* m, size_t count,
+			       interval_set<uint64_t>* to_release)
+{
+  // the oldest chunks go first
+  count = std::min(count, m->chunks.size());
+  for (size_t i = 0; i < count; ++i) {
+    to_release->insert(m->chunks[i], chunk_size);
+  }
+  m->chunks.erase(m->chunks.begin(), m->chunks.begin() + count);
+  cached -= count * chunk_size;
+}
+
+void MagazineAllocator::_drain_all()
+{
+  interval_set<uint64_t> to_release;
+  for (size_t i = 0; i < num_magazines; ++i) {
+    auto m = _get_magazine(i);
+    _drain(m, m->chunks.size(), &to_release);
+    _put_magazine(m);
+  }
+  if (!to_release.empty()) {
+    ldout(cct, 10) << __func__ << " 0x" << std::hex << to_release.size()
+		   << std::dec << " in " << to_release.num_intervals()
+		   << " extents" << dendl;
+    backing->release(to_release);
+  }
+}
+
+int64_t MagazineAllocator::allocate(
+  uint64_t want,
+  uint64_t unit,
+  uint64_t max_alloc_size,
+  int64_t hint,
+  PExtentVector *extents)
+{
+  if (unit != chunk_size || want == 0 || !_cacheable(want)) {
+    return backing->allocate(want, unit, max_alloc_size, hint, extents);
+  }
+  auto m = _try_get_magazine();
+  if (!m) {
+    ++misses;
+    return backing->allocate(want, unit, max_alloc_size, hint, extents);
+  }
+  size_t need = want / chunk_size;
+  if (m->chunks.size() < need) {
+    _refill(m, hint);
+  }
+  if (m->chunks.size() < need) {
+    // running low on space, the other magazines may hold what we need
+    _put_magazine(m);
+    ++misses;
+    _drain_all();
+    return backing->allocate(want, unit, max_alloc_size, hint, extents);
+  }
+
+  if (max_alloc_size == 0 || max_alloc_size > want) {
+    max_alloc_size = want;
+  }
+  auto first = extents->size();
+  for (size_t i = 0; i < need; ++i) {
+    uint64_t offset = m->chunks.back();
+    m->chunks.pop_back();
+    if (extents->size() > first &&
+	extents->back().end() == offset &&
+	extents->back().length + chunk_size <= max_alloc_size) {
+      extents->back().length += chunk_size;
+    } else {
+      extents->emplace_back(offset, chunk_size);
+    }
+  }
+  cached -= want;
+  _put_magazine(m);
+  ++hits;
+  return want;
+}
+
+void MagazineAllocator::release(const interval_set<uint64_t>& release_set)
+{
+  auto m = _try_get_magazine();
+  if (!m) {
+    backing->release(release_set);
+    return;
+  }
+  interval_set<uint64_t> to_release;
+  for (auto p = release_set.begin(); p != release_set.end(); ++p) {
+    auto offset = p.get_start();
+    auto length = p.get_len();
+    if (offset % chunk_size || !_cacheable(length)) {
+      to_release.insert(offset, length);
+      continue;
+    }
+    for (uint64_t o = offset + length; o > offset; ) {
+      o -= chunk_size;
+      m->chunks.push_back(o);
+    }
+    cached += length;
+  }
+  if (m->chunks.size() > magazine_size) {
+    _drain(m, m->chunks.size() - magazine_size / 2, &to_release);
+  }
+  _put_magazine(m);
+  if (!to_release.empty()) {
+    backing->release(to_release);
+  }
+}
+
+void MagazineAllocator::dump()
+{
+  backing->dump();
+  ldout(cct, 0) << __func__ << " cached 0x" << std::hex << cached << std::dec
+		<< " in " << num_magazines << " magazines"
+		<< ", hits " << hits << ", misses " << misses << dendl;
+}
+
+void MagazineAllocator::dump(std::function<void(uint64_t offset, uint64_t length)> notify)
+{
+  // report cached chunks merged with their free neighbours
+  interval_set<uint64_t> free;
+  backing->dump([&](uint64_t offset, uint64_t length) {
+    free.insert(offset, length);
+  });
+  for (size_t i = 0; i < num_magazines; ++i) {
+    auto m = _get_magazine(i);
+    for (auto o : m->chunks) {
+      free.insert(o, chunk_size);
+    }
+    _put_magazine(m);
+  }
+  for (auto p = free.begin(); p != free.end(); ++p) {
+    notify(p.get_start(), p.get_len());
+  }
+}
+
+void MagazineAllocator::init_add_free(uint64_t offset, uint64_t length)
+{
+  backing->init_add_free(offset, length);
+}
+
+void MagazineAllocator::init_rm_free(uint64_t offset, uint64_t length)
+{
+  _drain_all();
+  backing->init_rm_free(offset, length);
+}
+
+uint64_t MagazineAllocator::get_free()
+{
+  return backing->get_free() + cached;
+}
+
+double MagazineAllocator::get_fragmentation()
+{
+  return backing->get_fragmentation();
+}
+
+void MagazineAllocator::shutdown()
+{
+  _drain_all();
+  backing->shutdown();
+}
@@ -0,0 +1,81 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "Allocator.h"
+
+/*
+ * Per-thread magazines of free block_size chunks layered over any other
+ * Allocator. Small allocations and releases are served from the calling
+ * thread's magazine without touching the backing allocator, magazines are
+ * refilled from and drained to it in bulk. A magazine which is busy is never
+ * waited for, the backing allocator is used directly instead.
+ */
+class MagazineAllocator : public Allocator {
+  CephContext* cct;
+  std::unique_ptr<Allocator> backing;
+  const uint64_t chunk_size;
+  size_t magazine_size;	///< max chunks held by a single magazine
+
+  struct alignas(64) magazine_t {
+    std::atomic_flag busy = ATOMIC_FLAG_INIT;
+    std::vector<uint64_t> chunks; ///< free chunk offsets, most recent last
+  };
+  const size_t num_magazines;
+  std::unique_ptr<magazine_t[]> magazines;
+
+  std::atomic<uint64_t> cached = {0};	///< bytes held by all magazines
+  std::atomic<uint64_t> hits = {0};
+  std::atomic<uint64_t> misses = {0};
+
+  magazine_t* _try_get_magazine();
+  magazine_t* _get_magazine(size_t i);
+  void _put_magazine(magazine_t* m) {
+    m->busy.clear(std::memory_order_release);
+  }
+  bool _cacheable(uint64_t length) const {
+    return length % chunk_size == 0 &&
+      length / chunk_size <= magazine_size / 2;
+  }
+  void _refill(magazine_t* m, int64_t hint);
+  void _drain(magazine_t* m, size_t count,
+	      interval_set<uint64_t>* to_release);
+  void _drain_all();
+
+public:
+  /// takes ownership of the backing allocator
+  MagazineAllocator(CephContext* cct, Allocator* backing,
+		    size_t num_magazines, size_t magazine_size,
+		    const std::string& name);
+  ~MagazineAllocator() override;
+
+  const char* get_type() const override {
+    return backing->get_type();
+  }
+  int64_t allocate(
+    uint64_t want,
+    uint64_t unit,
+    uint64_t max_alloc_size,
+    int64_t hint,
+    PExtentVector *extents) override;
+  void release(const interval_set<uint64_t>& release_set) override;
+
+  void dump() override;
+  void dump(std::function<void(uint64_t offset, uint64_t length)> notify) override;
+
+  void init_add_free(uint64_t offset, uint64_t length) override;
+  void init_rm_free(uint64_t offset, uint64_t length) override;
+
+  uint64_t get_free() override;
+  double get_fragmentation() override;
+  void shutdown() override;
+
+  uint64_t get_cached() const {
+    return cached;
+  }
+};
@@ -71,6 +71,13 @@ int64_t StupidAllocator::allocate_int(
   uint64_t *offset, uint32_t *length)
 {
   std::lock_guard l(lock);
+  return _allocate_int(want_size, alloc_unit, hint, offset, length);
+}
+
+int64_t StupidAllocator::_allocate_int(
+  uint64_t want_size, uint64_t alloc_unit, int64_t hint,
+  uint64_t *offset, uint32_t *length)
+{
   ldout(cct, 10) << __func__ << " want_size 0x" << std::hex << want_size
 	   	 << " alloc_unit 0x" << alloc_unit
 	   	 << " hint 0x" << hint << std::dec
@@ -189,6 +196,17 @@ int64_t StupidAllocator::allocate(
   uint64_t max_alloc_size,
   int64_t hint,
   PExtentVector *extents)
+{
+  std::lock_guard l(lock);
+  return _allocate(want_size, alloc_unit, max_alloc_size, hint, extents);
+}
+
+int64_t StupidAllocator::_allocate(
+  uint64_t want_size,
+  uint64_t alloc_unit,
+  uint64_t max_alloc_size,
+  int64_t hint,
+  PExtentVector *extents)
 {
   uint64_t allocated_size = 0;
   uint64_t offset = 0;
@@ -202,7 +220,7 @@ int64_t StupidAllocator::allocate(
   max_alloc_size = std::min(max_alloc_size, 0x10000000 - alloc_unit);
 
   while (allocated_size < want_size) {
-    res = allocate_int(std::min(max_alloc_size, (want_size - allocated_size)),
+    res = _allocate_int(std::min(max_alloc_size, (want_size - allocated_size)),
        alloc_unit, hint, &offset, &length);
     if (res != 0) {
       /*
@@ -240,6 +258,28 @@ void StupidAllocator::release(
   const interval_set<uint64_t>& release_set)
 {
   std::lock_guard l(lock);
+  _release(release_set);
+}
+
+void StupidAllocator::allocate_batch(
+  const interval_set<uint64_t>* release_set,
+  std::vector<alloc_request_t>& requests)
+{
+  std::lock_guard l(lock);
+  ldout(cct, 10) << __func__ << " requests " << requests.size()
+		 << " release " << (release_set ? release_set->num_intervals() : 0)
+		 << dendl;
+  if (release_set) {
+    _release(*release_set);
+  }
+  for (auto& r : requests) {
+    r.result = _allocate(r.want, r.unit, r.max_alloc_size, r.hint, r.extents);
+  }
+}
+
+void StupidAllocator::_release(
+  const interval_set<uint64_t>& release_set)
+{
   for (interval_set<uint64_t>::const_iterator p = release_set.begin();
        p != release_set.end();
        ++p) {
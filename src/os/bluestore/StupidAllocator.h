@@ -36,6 +36,14 @@ class StupidAllocator : public Allocator {
     interval_set_t::iterator p,
     uint64_t alloc_unit);
 
+  int64_t _allocate(
+    uint64_t want_size, uint64_t alloc_unit, uint64_t max_alloc_size,
+    int64_t hint, PExtentVector *extents);
+  int64_t _allocate_int(
+    uint64_t want_size, uint64_t alloc_unit, int64_t hint,
+    uint64_t *offset, uint32_t *length);
+  void _release(const interval_set<uint64_t>& release_set);
+
 public:
   StupidAllocator(CephContext* cct,
                   const std::string& name,
@@ -58,6 +66,9 @@ public:
   void release(
     const interval_set<uint64_t>& release_set) override;
 
+  void allocate_batch(const interval_set<uint64_t>* release_set,
+                      std::vector<alloc_request_t>& requests) override;
+
   uint64_t get_free() override;
   double get_fragmentation() override;
 
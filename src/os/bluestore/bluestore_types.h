@@ -513,8 +513,8 @@ public:
       denc(csum_chunk_order, p);
       int len;
       denc_varint(len, p);
+      // a view into p's buffer if p is shallow, the caller accounts it
       csum_data = p.get_ptr(len);
-      csum_data.reassign_to_mempool(mempool::mempool_bluestore_cache_other);
     }
     if (has_unused()) {
       denc(unused, p);
@@ -109,6 +109,7 @@ ostream &operator<<(ostream &lhs, const ECBackend::read_request_t &rhs)
   return lhs << "read_request_t(to_read=[" << rhs.to_read << "]"
 	     << ", need=" << rhs.need
 	     << ", want_attrs=" << rhs.want_attrs
+	     << (rhs.partial ? ", partial" : "")
 	     << ")";
 }
 
@@ -169,11 +170,13 @@ ostream &operator<<(ostream &lhs, const ECBackend::Op &rhs)
       << " temp_cleared=" << rhs.temp_cleared
       << " pending_read=" << rhs.pending_read
       << " remote_read=" << rhs.remote_read
+      << (rhs.remote_read_deferred ? " (deferred)" : "")
       << " remote_read_result=" << rhs.remote_read_result
       << " pending_apply=" << rhs.pending_apply
       << " pending_commit=" << rhs.pending_commit
       << " plan.to_read=" << rhs.plan.to_read
       << " plan.will_write=" << rhs.plan.will_write
+      << " plan.parity_delta=" << rhs.plan.parity_delta
       << ")";
   return lhs;
 }
@@ -1216,8 +1219,7 @@ void ECBackend::handle_sub_read_reply(
       ceph_assert(req_iter != rop.to_read.find(i->first)->second.to_read.end());
       ceph_assert(riter != rop.complete[i->first].returned.end());
       pair<uint64_t, uint64_t> adjusted =
-	sinfo.aligned_offset_len_to_chunk(
-	  make_pair(req_iter->get<0>(), req_iter->get<1>()));
+	rop.to_read.find(i->first)->second.get_chunk_extent(sinfo, *req_iter);
       ceph_assert(adjusted.first == j->first);
       riter->get<2>()[from] = std::move(j->second);
     }
@@ -1462,6 +1464,7 @@ void ECBackend::on_change()
   waiting_reads.clear();
   waiting_state.clear();
   waiting_commit.clear();
+  parity_delta_in_flight.clear();
   for (auto &&op: tid_to_op_map) {
     cache.release_write_pin(op.second.pin);
   }
@@ -1770,7 +1773,7 @@ void ECBackend::do_read_op(ReadOp &op)
 	 j != i->second.to_read.end();
 	 ++j) {
       pair<uint64_t, uint64_t> chunk_off_len =
-	sinfo.aligned_offset_len_to_chunk(make_pair(j->get<0>(), j->get<1>()));
+	i->second.get_chunk_extent(sinfo, *j);
       for (auto k = i->second.need.begin();
 	   k != i->second.need.end();
 	   ++k) {
@@ -1892,6 +1895,10 @@ void ECBackend::start_rmw(Op *op, PGTransactionUPtr &&t)
       return ref;
     },
     get_parent()->get_dpp());
+  if (get_parent()->get_pool().allows_ecoverwrites() &&
+      cct->_conf.get_val<bool>("osd_ec_parity_delta_writes")) {
+    ECTransaction::plan_parity_delta(sinfo, ec_impl, &op->plan);
+  }
 
   dout(10) << __func__ << ": " << *op << dendl;
 
@@ -1899,6 +1906,147 @@ void ECBackend::start_rmw(Op *op, PGTransactionUPtr &&t)
   check_ops();
 }
 
+void ECBackend::start_rmw_read(Op *op)
+{
+  ceph_assert(get_parent()->get_pool().allows_ecoverwrites());
+  objects_read_async_no_cache(
+    op->remote_read,
+    [this, op](map<hobject_t,pair<int, extent_map> > &&results) {
+      for (auto &&i: results) {
+	op->remote_read_result.emplace(i.first, i.second.second);
+      }
+      check_ops();
+    });
+}
+
+struct ParityDeltaReadComplete :
+  public GenContext<pair<RecoveryMessages*, ECBackend::read_result_t& > &> {
+  ECBackend *ec;
+  ECBackend::Op *op;
+  ParityDeltaReadComplete(ECBackend *ec, ECBackend::Op *op)
+    : ec(ec), op(op) {}
+  void finish(pair<RecoveryMessages *, ECBackend::read_result_t &> &in) override {
+    ec->handle_parity_delta_read(op, in.second);
+  }
+};
+
+bool ECBackend::try_start_parity_delta_read(Op *op)
+{
+  ceph_assert(op->plan.parity_delta.size() == 1);
+  const hobject_t &hoid = op->plan.parity_delta.begin()->first;
+
+  // the old chunks are read from disk, nothing in flight may change them
+  for (auto &&i : {&waiting_reads, &waiting_commit}) {
+    for (auto &&j : *i) {
+      if (&j != op && j.plan.will_write.count(hoid)) {
+	dout(20) << __func__ << ": " << hoid << " has writes in flight"
+		 << dendl;
+	return false;
+      }
+    }
+  }
+
+  set<int> want = op->plan.parity_delta.begin()->second;
+  const vector<int> &mapping = ec_impl->get_chunk_mapping();
+  for (unsigned i = ec_impl->get_data_chunk_count();
+       i < ec_impl->get_chunk_count();
+       ++i) {
+    want.insert(mapping.size() > i ? mapping[i] : i);
+  }
+
+  set<int> have;
+  map<shard_id_t, pg_shard_t> shards;
+  get_all_avail_shards(hoid, set<pg_shard_t>(), have, shards, false);
+  map<pg_shard_t, vector<pair<int, int>>> need;
+  for (auto shard : want) {
+    auto siter = shards.find(shard_id_t(shard));
+    if (siter == shards.end()) {
+      dout(20) << __func__ << ": " << hoid << " shard " << shard
+	       << " unavailable" << dendl;
+      return false;
+    }
+    need[siter->second].push_back(
+      make_pair(0, ec_impl->get_sub_chunk_count()));
+  }
+
+  list<boost::tuple<uint64_t, uint64_t, uint32_t> > to_read;
+  for (auto &&extent : op->plan.to_read.at(hoid)) {
+    to_read.emplace_back(extent.first, extent.second, 0);
+  }
+
+  dout(10) << __func__ << ": " << hoid << " reading shards " << want
+	   << " of " << op->plan.to_read << dendl;
+  op->parity_delta = true;
+  op->using_cache = false;
+  op->delta_read_pending = true;
+  parity_delta_in_flight.insert(hoid);
+
+  map<hobject_t, set<int>> obj_want_to_read;
+  obj_want_to_read.insert(make_pair(hoid, std::move(want)));
+  map<hobject_t, read_request_t> for_read_op;
+  for_read_op.insert(
+    make_pair(
+      hoid,
+      read_request_t(
+	to_read,
+	need,
+	false,
+	new ParityDeltaReadComplete(this, op))));
+  start_read_op(
+    CEPH_MSG_PRIO_DEFAULT,
+    obj_want_to_read,
+    for_read_op,
+    OpRequestRef(),
+    false,
+    false);
+  return true;
+}
+
+void ECBackend::handle_parity_delta_read(Op *op, read_result_t &res)
+{
+  ceph_assert(op->delta_read_pending);
+  op->delta_read_pending = false;
+  const hobject_t &hoid = op->plan.parity_delta.begin()->first;
+
+  map<int, extent_map> chunks;
+  bool complete = res.r == 0 && res.errors.empty();
+  for (auto &&extent : res.returned) {
+    if (!complete)
+      break;
+    auto [off, len] = sinfo.aligned_offset_len_to_chunk(
+      make_pair(extent.get<0>(), extent.get<1>()));
+    for (auto &&i : extent.get<2>()) {
+      chunks[i.first.shard].insert(off, len, i.second);
+    }
+  }
+  const vector<int> &mapping = ec_impl->get_chunk_mapping();
+  for (unsigned i = ec_impl->get_data_chunk_count();
+       complete && i < ec_impl->get_chunk_count();
+       ++i) {
+    complete = chunks.count(mapping.size() > i ? mapping[i] : i);
+  }
+  for (auto shard : op->plan.parity_delta.begin()->second) {
+    complete = complete && chunks.count(shard);
+  }
+
+  if (complete) {
+    op->delta_read_result[hoid] = std::move(chunks);
+  } else {
+    // Read the stripes instead. Later writes to the object may be in
+    // waiting_reads by now, but their reads are deferred until this op
+    // commits and nothing else writes the object meanwhile, so the
+    // stripes on disk are still the ones to read. op->parity_delta
+    // stays set: the object stays in parity_delta_in_flight and
+    // try_finish_rmw() starts the deferred reads.
+    dout(10) << __func__ << ": " << hoid << " read failed r=" << res.r
+	     << " errors=" << res.errors << ", falling back to rmw" << dendl;
+    op->plan.parity_delta.clear();
+    op->remote_read = op->plan.to_read;
+    start_rmw_read(op);
+  }
+  check_ops();
+}
+
 bool ECBackend::try_state_to_reads()
 {
   if (waiting_state.empty())
@@ -1913,7 +2061,6 @@ bool ECBackend::try_state_to_reads()
 	     << dendl;
     return false;
   }
-
   if (!pipeline_state.caching_enabled()) {
     op->using_cache = false;
   } else if (op->invalidates_cache()) {
@@ -1925,6 +2072,15 @@ bool ECBackend::try_state_to_reads()
   waiting_state.pop_front();
   waiting_reads.push_back(*op);
 
+  if (!op->plan.parity_delta.empty()) {
+    if (!is_queued_behind(op->plan.parity_delta.begin()->first) &&
+	try_start_parity_delta_read(op)) {
+      dout(10) << __func__ << ": " << *op << dendl;
+      return true;
+    }
+    op->plan.parity_delta.clear();
+  }
+
   if (op->using_cache) {
     cache.open_write_pin(op->pin);
 
@@ -1959,20 +2115,41 @@ bool ECBackend::try_state_to_reads()
   dout(10) << __func__ << ": " << *op << dendl;
 
   if (!op->remote_read.empty()) {
-    ceph_assert(get_parent()->get_pool().allows_ecoverwrites());
-    objects_read_async_no_cache(
-      op->remote_read,
-      [this, op](map<hobject_t,pair<int, extent_map> > &&results) {
-	for (auto &&i: results) {
-	  op->remote_read_result.emplace(i.first, i.second.second);
-	}
-	check_ops();
-      });
+    if (is_parity_delta_in_flight(op->remote_read)) {
+      // the chunks on disk are about to change, read them once the
+      // delta committed, see try_finish_rmw()
+      dout(20) << __func__ << ": deferring reads of " << *op
+	       << " behind a parity delta write" << dendl;
+      op->remote_read_deferred = true;
+    } else {
+      start_rmw_read(op);
+    }
   }
 
   return true;
 }
 
+bool ECBackend::is_queued_behind(const hobject_t &hoid) const
+{
+  for (auto &&op : waiting_state) {
+    if (op.plan.will_write.count(hoid)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ECBackend::is_parity_delta_in_flight(
+  const map<hobject_t,extent_set> &objects) const
+{
+  for (auto &&i : objects) {
+    if (parity_delta_in_flight.count(i.first)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 bool ECBackend::try_reads_to_commit()
 {
   if (waiting_reads.empty())
@@ -2021,6 +2198,7 @@ bool ECBackend::try_reads_to_commit()
       get_parent()->get_info().pgid.pgid,
       sinfo,
       op->remote_read_result,
+      op->delta_read_result,
       op->log_entries,
       &written,
       &trans,
@@ -2049,7 +2227,13 @@ bool ECBackend::try_reads_to_commit()
     written_set[i.first] = i.second.get_interval_set();
   }
   dout(20) << __func__ << ": written_set: " << written_set << dendl;
-  ceph_assert(written_set == op->plan.will_write);
+  map<hobject_t,extent_set> will_write = op->plan.will_write;
+  for (auto &&i: op->plan.parity_delta) {
+    // parity deltas are written as chunks, not stripes
+    written_set.erase(i.first);
+    will_write.erase(i.first);
+  }
+  ceph_assert(written_set == will_write);
 
   if (op->using_cache) {
     for (auto &&hpair: written) {
@@ -2059,6 +2243,7 @@ bool ECBackend::try_reads_to_commit()
   }
   op->remote_read.clear();
   op->remote_read_result.clear();
+  op->delta_read_result.clear();
 
   ObjectStore::Transaction empty;
   bool should_write_local = false;
@@ -2179,6 +2364,20 @@ bool ECBackend::try_finish_rmw()
   if (op->using_cache) {
     cache.release_write_pin(op->pin);
   }
+  if (op->parity_delta) {
+    for (auto &&hpair: op->plan.will_write) {
+      parity_delta_in_flight.erase(
+	parity_delta_in_flight.find(hpair.first));
+    }
+    for (auto &&i : waiting_reads) {
+      if (i.remote_read_deferred &&
+	  !is_parity_delta_in_flight(i.remote_read)) {
+	dout(20) << __func__ << ": starting deferred reads of " << i << dendl;
+	i.remote_read_deferred = false;
+	start_rmw_read(&i);
+      }
+    }
+  }
   tid_to_op_map.erase(op->tid);
 
   if (waiting_reads.empty() &&
@@ -2225,9 +2424,13 @@ void ECBackend::objects_read_async(
 	 to_read.begin();
        i != to_read.end();
        ++i) {
+    // objects_read_and_reconstruct widens these to stripe bounds unless
+    // it can read just the bytes asked for
     pair<uint64_t, uint64_t> tmp =
-      sinfo.offset_len_to_stripe_bounds(
-	make_pair(i->first.get<0>(), i->first.get<1>()));
+      make_pair(i->first.get<0>(), i->first.get<1>());
+    if (!tmp.second) {
+      tmp = sinfo.offset_len_to_stripe_bounds(tmp);
+    }
 
     es.union_insert(tmp.first, tmp.second);
     flags |= i->first.get<2>();
@@ -2333,12 +2536,46 @@ struct CallClientContexts :
   ECBackend *ec;
   ECBackend::ClientAsyncReadStatus *status;
   list<boost::tuple<uint64_t, uint64_t, uint32_t> > to_read;
+  // shards of the data chunks to_read touches, empty if to_read is
+  // stripe aligned and decoded as a whole
+  set<int> want;
   CallClientContexts(
     hobject_t hoid,
     ECBackend *ec,
     ECBackend::ClientAsyncReadStatus *status,
-    const list<boost::tuple<uint64_t, uint64_t, uint32_t> > &to_read)
-    : hoid(hoid), ec(ec), status(status), to_read(to_read) {}
+    const list<boost::tuple<uint64_t, uint64_t, uint32_t> > &to_read,
+    const set<int> &want = set<int>())
+    : hoid(hoid), ec(ec), status(status), to_read(to_read), want(want) {}
+  int finish_partial(
+    const boost::tuple<uint64_t, uint64_t, uint32_t> &read,
+    pair<uint64_t, uint64_t> returned,
+    map<int, bufferlist> &to_decode,
+    bufferlist *bl) {
+    pair<uint64_t, uint64_t> in(read.get<0>(), read.get<1>());
+    pair<uint64_t, uint64_t> bounds =
+      ec->sinfo.offset_len_to_stripe_bounds(in);
+    if (returned == bounds) {
+      // degraded or retried, we got whole chunks to decode from
+      int r = ECUtil::decode_extent(
+	ec->sinfo, ec->ec_impl, to_decode, want, in, bl);
+      if (r < 0) {
+	return r;
+      }
+    } else {
+      ceph_assert(returned == in);
+      set<int> data_chunks;
+      ECUtil::assemble_extent(
+	ec->sinfo, ec->ec_impl, to_decode,
+	ec->sinfo.offset_len_to_chunk_bounds(in, &data_chunks).first,
+	in, bl);
+    }
+    // the extent is within the object, a short chunk means a shard is
+    // missing data
+    if (bl->length() != in.second) {
+      return -EIO;
+    }
+    return 0;
+  }
   void finish(pair<RecoveryMessages *, ECBackend::read_result_t &> &in) override {
     ECBackend::read_result_t &res = in.second;
     extent_map result;
@@ -2347,11 +2584,6 @@ struct CallClientContexts :
     ceph_assert(res.returned.size() == to_read.size());
     ceph_assert(res.errors.empty());
     for (auto &&read: to_read) {
-      pair<uint64_t, uint64_t> adjusted =
-	ec->sinfo.offset_len_to_stripe_bounds(
-	  make_pair(read.get<0>(), read.get<1>()));
-      ceph_assert(res.returned.front().get<0>() == adjusted.first &&
-	     res.returned.front().get<1>() == adjusted.second);
       map<int, bufferlist> to_decode;
       bufferlist bl;
       for (map<pg_shard_t, bufferlist>::iterator j =
@@ -2360,6 +2592,26 @@ struct CallClientContexts :
 	   ++j) {
 	to_decode[j->first.shard] = std::move(j->second);
       }
+      if (!want.empty()) {
+	int r = finish_partial(
+	  read,
+	  make_pair(res.returned.front().get<0>(),
+		    res.returned.front().get<1>()),
+	  to_decode,
+	  &bl);
+	if (r < 0) {
+	  res.r = r;
+	  goto out;
+	}
+	result.insert(read.get<0>(), bl.length(), std::move(bl));
+	res.returned.pop_front();
+	continue;
+      }
+      pair<uint64_t, uint64_t> adjusted =
+	ec->sinfo.offset_len_to_stripe_bounds(
+	  make_pair(read.get<0>(), read.get<1>()));
+      ceph_assert(res.returned.front().get<0>() == adjusted.first &&
+	     res.returned.front().get<1>() == adjusted.second);
       int r = ECUtil::decode(
 	ec->sinfo,
 	ec->ec_impl,
@@ -2384,7 +2636,6 @@ out:
     ec->kick_reads();
   }
 };
-
 void ECBackend::objects_read_and_reconstruct(
   const map<hobject_t,
     std::list<boost::tuple<uint64_t, uint64_t, uint32_t> >
@@ -2402,10 +2653,88 @@ void ECBackend::objects_read_and_reconstruct(
   map<hobject_t, set<int>> obj_want_to_read;
   set<int> want_to_read;
   get_want_to_read_shards(&want_to_read);
-    
+  // without overwrites the shards are only checked against the hinfo
+  // crcs when read whole (see handle_sub_read), keep reading them whole
+  const bool partial_reads =
+    !fast_read &&
+    get_parent()->get_pool().allows_ecoverwrites() &&
+    cct->_conf.get_val<bool>("osd_ec_partial_reads");
+
   map<hobject_t, read_request_t> for_read_op;
   for (auto &&to_read: reads) {
     map<pg_shard_t, vector<pair<int, int>>> shards;
+    set<int> want;
+    bool small = partial_reads;
+    for (auto &&extent: to_read.second) {
+      if (extent.get<1>() >= sinfo.get_stripe_width()) {
+	small = false;
+	break;
+      }
+    }
+    if (small) {
+      get_want_to_read_shards(to_read.second, &want);
+      if (want.size() >= want_to_read.size()) {
+	want.clear();
+      }
+    }
+    if (!want.empty() &&
+	get_min_avail_to_read_shards(
+	  to_read.first, want, false, false, &shards) == 0) {
+      bool direct = shards.size() == want.size();
+      for (auto &&p: shards) {
+	direct = direct && want.count(p.first.shard) &&
+	  p.second.size() == 1 &&
+	  p.second.front() == make_pair(0, ec_impl->get_sub_chunk_count());
+      }
+      list<boost::tuple<uint64_t, uint64_t, uint32_t> > extents;
+      if (direct) {
+	// every data chunk is there, read just the bytes asked for
+	extents = to_read.second;
+      } else {
+	// decoding takes whole chunks, read the stripes of each extent
+	// from the minimal set of shards
+	for (auto &&extent: to_read.second) {
+	  auto bounds = sinfo.offset_len_to_stripe_bounds(
+	    make_pair(extent.get<0>(), extent.get<1>()));
+	  extents.push_back(
+	    boost::make_tuple(bounds.first, bounds.second, extent.get<2>()));
+	}
+      }
+      dout(20) << __func__ << " " << to_read.first << " "
+	       << (direct ? "partial" : "degraded partial")
+	       << " read of shards " << want << dendl;
+      CallClientContexts *c = new CallClientContexts(
+	to_read.first,
+	this,
+	&(in_progress_client_reads.back()),
+	to_read.second,
+	want);
+      for_read_op.insert(
+	make_pair(
+	  to_read.first,
+	  read_request_t(
+	    extents,
+	    shards,
+	    false,
+	    c,
+	    direct)));
+      obj_want_to_read.insert(make_pair(to_read.first, want));
+      continue;
+    }
+
+    shards.clear();
+    extent_set es;
+    uint32_t flags = 0;
+    for (auto &&extent: to_read.second) {
+      auto bounds = sinfo.offset_len_to_stripe_bounds(
+	make_pair(extent.get<0>(), extent.get<1>()));
+      es.union_insert(bounds.first, bounds.second);
+      flags |= extent.get<2>();
+    }
+    list<boost::tuple<uint64_t, uint64_t, uint32_t> > extents;
+    for (auto j = es.begin(); j != es.end(); ++j) {
+      extents.push_back(boost::make_tuple(j.get_start(), j.get_len(), flags));
+    }
     int r = get_min_avail_to_read_shards(
       to_read.first,
       want_to_read,
@@ -2418,12 +2747,12 @@ void ECBackend::objects_read_and_reconstruct(
       to_read.first,
       this,
       &(in_progress_client_reads.back()),
-      to_read.second);
+      extents);
     for_read_op.insert(
       make_pair(
 	to_read.first,
 	read_request_t(
-	  to_read.second,
+	  extents,
 	  shards,
 	  false,
 	  c)));
@@ -2449,14 +2778,36 @@ int ECBackend::send_all_remaining_reads(
   for (set<pg_shard_t>::iterator i = ots.begin(); i != ots.end(); ++i)
     already_read.insert(i->shard);
   dout(10) << __func__ << " have/error shards=" << already_read << dendl;
+  const bool partial = rop.to_read.find(hoid)->second.partial;
+  if (partial) {
+    // what we got covers the bytes asked for only, decoding needs
+    // whole chunks so all the shards used are read again
+    already_read.clear();
+  }
   map<pg_shard_t, vector<pair<int, int>>> shards;
   int r = get_remaining_shards(hoid, already_read, rop.want_to_read[hoid],
 			       rop.complete[hoid], &shards, rop.for_recovery);
   if (r)
     return r;
 
-  list<boost::tuple<uint64_t, uint64_t, uint32_t> > offsets =
-    rop.to_read.find(hoid)->second.to_read;
+  list<boost::tuple<uint64_t, uint64_t, uint32_t> > offsets;
+  if (partial) {
+    auto &returned = rop.complete[hoid].returned;
+    returned.clear();
+    for (auto &&extent: rop.to_read.find(hoid)->second.to_read) {
+      auto bounds = sinfo.offset_len_to_stripe_bounds(
+	make_pair(extent.get<0>(), extent.get<1>()));
+      offsets.push_back(
+	boost::make_tuple(bounds.first, bounds.second, extent.get<2>()));
+      returned.push_back(
+	boost::make_tuple(
+	  bounds.first,
+	  bounds.second,
+	  map<pg_shard_t, bufferlist>()));
+    }
+  } else {
+    offsets = rop.to_read.find(hoid)->second.to_read;
+  }
   GenContext<pair<RecoveryMessages *, read_result_t& > &> *c =
     rop.to_read.find(hoid)->second.cb;
 
@@ -215,6 +215,20 @@ private:
       want_to_read->insert(chunk);
     }
   }
+  /// shards holding the data chunks the extents touch
+  void get_want_to_read_shards(
+    const std::list<boost::tuple<uint64_t, uint64_t, uint32_t> > &extents,
+    std::set<int> *want_to_read) const {
+    const std::vector<int> &chunk_mapping = ec_impl->get_chunk_mapping();
+    std::set<int> data_chunks;
+    for (auto &&extent: extents) {
+      sinfo.offset_len_to_chunk_bounds(
+	std::make_pair(extent.get<0>(), extent.get<1>()), &data_chunks);
+    }
+    for (int i: data_chunks) {
+      want_to_read->insert((int)chunk_mapping.size() > i ? chunk_mapping[i] : i);
+    }
+  }
 
   /**
    * Recovery
@@ -351,13 +365,28 @@ public:
     std::map<pg_shard_t, std::vector<std::pair<int, int>>> need;
     bool want_attrs;
     GenContext<std::pair<RecoveryMessages *, read_result_t& > &> *cb;
+    /// to_read holds logical extents smaller than a stripe, each shard
+    /// in need reads just the chunk range covering them (see
+    /// stripe_info_t::offset_len_to_chunk_bounds) rather than whole stripes
+    bool partial;
     read_request_t(
       const std::list<boost::tuple<uint64_t, uint64_t, uint32_t> > &to_read,
       const std::map<pg_shard_t, std::vector<std::pair<int, int>>> &need,
       bool want_attrs,
-      GenContext<std::pair<RecoveryMessages *, read_result_t& > &> *cb)
+      GenContext<std::pair<RecoveryMessages *, read_result_t& > &> *cb,
+      bool partial = false)
       : to_read(to_read), need(need), want_attrs(want_attrs),
-	cb(cb) {}
+	cb(cb), partial(partial) {}
+    std::pair<uint64_t, uint64_t> get_chunk_extent(
+      const ECUtil::stripe_info_t &sinfo,
+      const boost::tuple<uint64_t, uint64_t, uint32_t> &extent) const {
+      std::pair<uint64_t, uint64_t> in(extent.get<0>(), extent.get<1>());
+      if (!partial) {
+	return sinfo.aligned_offset_len_to_chunk(in);
+      }
+      std::set<int> data_chunks;
+      return sinfo.offset_len_to_chunk_bounds(in, &data_chunks);
+    }
   };
   friend ostream &operator<<(ostream &lhs, const read_request_t &rhs);
 
@@ -481,8 +510,21 @@ public:
     std::map<hobject_t,extent_set> pending_read; // subset already being read
     std::map<hobject_t,extent_set> remote_read;  // subset we must read
     std::map<hobject_t,extent_map> remote_read_result;
+
+    /// set once the op started a parity delta read, the op bypasses the
+    /// cache and later ops on its object read from disk once it
+    /// committed. Stays set if the read fails and the op falls back to
+    /// an rmw (plan.parity_delta is cleared then), try_finish_rmw()
+    /// releases the object.
+    bool parity_delta = false;
+    /// remote_read waits for a parity delta write to commit
+    bool remote_read_deferred = false;
+    bool delta_read_pending = false;
+    std::map<hobject_t,std::map<int,extent_map>> delta_read_result;
+
     bool read_in_progress() const {
-      return !remote_read.empty() && remote_read_result.empty();
+      return (!remote_read.empty() && remote_read_result.empty()) ||
+	delta_read_pending;
     }
 
     /// In progress write state.
@@ -558,6 +600,7 @@ public:
   op_list waiting_state;        /// writes waiting on pipe_state
   op_list waiting_reads;        /// writes waiting on partial stripe reads
   op_list waiting_commit;       /// writes waiting on initial commit
+  std::multiset<hobject_t> parity_delta_in_flight; /// objects of parity delta ops
   eversion_t completed_to;
   eversion_t committed_to;
   void start_rmw(Op *op, PGTransactionUPtr &&t);
@@ -565,6 +608,12 @@ public:
   bool try_reads_to_commit();
   bool try_finish_rmw();
   void check_ops();
+  void start_rmw_read(Op *op);
+  bool try_start_parity_delta_read(Op *op);
+  bool is_queued_behind(const hobject_t &hoid) const;
+  bool is_parity_delta_in_flight(
+    const std::map<hobject_t,extent_set> &objects) const;
+  void handle_parity_delta_read(Op *op, read_result_t &res);
 
   ceph::ErasureCodeInterfaceRef ec_impl;
 
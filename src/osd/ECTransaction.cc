@@ -92,6 +92,151 @@ void encode_and_write(
   }
 }
 
+static int shard_of(const ErasureCodeInterfaceRef &ecimpl, unsigned i)
+{
+  const vector<int> &mapping = ecimpl->get_chunk_mapping();
+  return mapping.size() > i ? mapping[i] : static_cast<int>(i);
+}
+
+void write_parity_delta(
+  pg_t pgid,
+  const hobject_t &oid,
+  const ECUtil::stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ecimpl,
+  const extent_set &stripes,
+  const extent_map &updates,
+  const map<int, extent_map> &old_chunks,
+  const set<int> &data_shards,
+  uint32_t flags,
+  map<shard_id_t, ObjectStore::Transaction> *transactions,
+  DoutPrefixProvider *dpp) {
+  const uint64_t stripe_width = sinfo.get_stripe_width();
+  const uint64_t chunk_size = sinfo.get_chunk_size();
+
+  auto get_old = [&](int shard, uint64_t off, uint64_t len) {
+    auto citer = old_chunks.find(shard);
+    ceph_assert(citer != old_chunks.end());
+    auto range = citer->second.intersect(off, len);
+    ceph_assert(range.ext_count() == 1);
+    ceph_assert(range.begin().get_off() == off);
+    ceph_assert(range.begin().get_len() == len);
+    return range.begin().get_val();
+  };
+
+  for (auto &&stripe : stripes) {
+    const uint64_t chunk_off =
+      sinfo.aligned_logical_offset_to_chunk_offset(stripe.first);
+    const uint64_t chunk_len =
+      sinfo.aligned_logical_offset_to_chunk_offset(stripe.second);
+
+    map<int, bufferlist> old_data;
+    map<int, ceph::bufferptr> new_data;
+    for (auto shard : data_shards) {
+      old_data[shard] = get_old(shard, chunk_off, chunk_len);
+      auto &bp = new_data[shard];
+      bp = ceph::bufferptr(ceph::buffer::create(chunk_len));
+      old_data[shard].begin().copy(chunk_len, bp.c_str());
+    }
+
+    // apply the updates to the touched chunks, a chunk at a time
+    for (auto &&update : updates.intersect(stripe.first, stripe.second)) {
+      const uint64_t end = update.get_off() + update.get_len();
+      auto p = update.get_val().begin();
+      for (uint64_t pos = update.get_off(); pos < end; ) {
+	const uint64_t in_chunk = pos % chunk_size;
+	const uint64_t len = std::min(chunk_size - in_chunk, end - pos);
+	const int shard = shard_of(ecimpl, (pos % stripe_width) / chunk_size);
+	ceph_assert(new_data.count(shard));
+	const uint64_t dst =
+	  sinfo.logical_to_prev_chunk_offset(pos) - chunk_off + in_chunk;
+	p.copy(len, new_data[shard].c_str() + dst);
+	pos += len;
+      }
+    }
+
+    map<int, bufferlist> new_bls;
+    for (auto &&i : new_data) {
+      new_bls[i.first].push_back(std::move(i.second));
+    }
+    map<int, bufferlist> parity;
+    for (unsigned i = ecimpl->get_data_chunk_count();
+	 i < ecimpl->get_chunk_count();
+	 ++i) {
+      int shard = shard_of(ecimpl, i);
+      parity[shard] = get_old(shard, chunk_off, chunk_len);
+    }
+    int r = ECUtil::encode_parity_delta(
+      sinfo, ecimpl, old_data, new_bls, &parity);
+    ceph_assert(r == 0);
+
+    ldpp_dout(dpp, 20) << __func__ << ": " << oid
+		       << " " << stripe.first << "~" << stripe.second
+		       << " data shards " << data_shards
+		       << dendl;
+    new_bls.insert(parity.begin(), parity.end());
+    for (auto &&i : new_bls) {
+      auto titer = transactions->find(shard_id_t(i.first));
+      if (titer == transactions->end()) {
+	continue;
+      }
+      titer->second.write(
+	coll_t(spg_t(pgid, titer->first)),
+	ghobject_t(oid, ghobject_t::NO_GEN, titer->first),
+	chunk_off,
+	chunk_len,
+	i.second,
+	flags);
+    }
+  }
+}
+
+void ECTransaction::plan_parity_delta(
+  const ECUtil::stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ecimpl,
+  WritePlan *plan) {
+  ceph_assert(plan);
+  if (!(ecimpl->get_supported_optimizations() &
+	ceph::ErasureCodeInterface::FLAG_EC_PLUGIN_PARITY_DELTA_OPTIMIZATION))
+    return;
+  // jerasure and isa encode and decode the chunks by position and do not
+  // honour a chunk mapping, a delta of a remapped layout is not checked
+  if (!ecimpl->get_chunk_mapping().empty())
+    return;
+  // every stripe written is a partial one of a single existing object
+  if (plan->invalidates_cache ||
+      plan->to_read.size() != 1 ||
+      plan->will_write.size() != 1 ||
+      plan->to_read != plan->will_write ||
+      plan->t->op_map.size() != 1)
+    return;
+  const hobject_t &oid = plan->to_read.begin()->first;
+  auto &op = plan->t->op_map.begin()->second;
+  if (plan->t->op_map.begin()->first != oid ||
+      !op.is_none() ||
+      op.truncate ||
+      op.buffer_updates.empty())
+    return;
+
+  const uint64_t stripe_width = sinfo.get_stripe_width();
+  const uint64_t chunk_size = sinfo.get_chunk_size();
+  const unsigned k = ecimpl->get_data_chunk_count();
+  const unsigned m = ecimpl->get_coding_chunk_count();
+  set<int> shards;
+  for (auto &&extent : op.buffer_updates) {
+    const uint64_t end = extent.get_off() + extent.get_len();
+    for (uint64_t pos = extent.get_off();
+	 pos < end && shards.size() < k;
+	 pos = pos - pos % chunk_size + chunk_size) {
+      shards.insert(shard_of(ecimpl, (pos % stripe_width) / chunk_size));
+    }
+  }
+  // per stripe, a read-modify-write reads k chunks and writes k + m,
+  // a parity delta reads and writes the touched and the coding chunks
+  if (2 * (shards.size() + m) >= 2 * k + m)
+    return;
+  plan->parity_delta[oid] = std::move(shards);
+}
+
 bool ECTransaction::requires_overwrite(
   uint64_t prev_size,
   const PGTransaction::ObjectOperation &op) {
@@ -111,6 +256,7 @@ void ECTransaction::generate_transactions(
   pg_t pgid,
   const ECUtil::stripe_info_t &sinfo,
   const map<hobject_t,extent_map> &partial_extents,
+  const map<hobject_t,map<int,extent_map>> &delta_extents,
   vector<pg_log_entry_t> &entries,
   map<hobject_t,extent_map> *written_map,
   map<shard_id_t, ObjectStore::Transaction> *transactions,
@@ -553,39 +699,71 @@ void ECTransaction::generate_transactions(
       for (unsigned i = 0; i < ecimpl->get_chunk_count(); ++i) {
 	want.insert(i);
       }
+      auto save_rollback_extent = [&](uint64_t off, uint64_t len) {
+	uint64_t restore_from = sinfo.aligned_logical_offset_to_chunk_offset(
+	  off);
+	uint64_t restore_len = sinfo.aligned_logical_offset_to_chunk_offset(
+	  len);
+	ldpp_dout(dpp, 20) << __func__ << ": overwriting "
+			   << restore_from << "~" << restore_len
+			   << dendl;
+	if (rollback_extents.empty()) {
+	  for (auto &&st : *transactions) {
+	    st.second.touch(
+	      coll_t(spg_t(pgid, st.first)),
+	      ghobject_t(oid, entry->version.version, st.first));
+	  }
+	}
+	rollback_extents.emplace_back(make_pair(restore_from, restore_len));
+	for (auto &&st : *transactions) {
+	  st.second.clone_range(
+	    coll_t(spg_t(pgid, st.first)),
+	    ghobject_t(oid, ghobject_t::NO_GEN, st.first),
+	    ghobject_t(oid, entry->version.version, st.first),
+	    restore_from,
+	    restore_len,
+	    restore_from);
+	}
+      };
+
       auto to_overwrite = to_write.intersect(0, append_after);
       ldpp_dout(dpp, 20) << __func__ << ": to_overwrite: "
 			 << to_overwrite
 			 << dendl;
+      auto pditer = plan.parity_delta.find(oid);
+      if (pditer != plan.parity_delta.end()) {
+	auto diter = delta_extents.find(oid);
+	ceph_assert(diter != delta_extents.end());
+	ceph_assert(to_write.intersect(
+	  append_after,
+	  std::numeric_limits<uint64_t>::max() - append_after).empty());
+	const extent_set &stripes = plan.to_read.at(oid);
+	if (entry) {
+	  // the rollback restores every shard, untouched ones included
+	  for (auto &&stripe : stripes) {
+	    save_rollback_extent(stripe.first, stripe.second);
+	  }
+	}
+	write_parity_delta(
+	  pgid,
+	  oid,
+	  sinfo,
+	  ecimpl,
+	  stripes,
+	  to_overwrite,
+	  diter->second,
+	  pditer->second,
+	  fadvise_flags,
+	  transactions,
+	  dpp);
+	to_overwrite.clear();
+      }
       for (auto &&extent: to_overwrite) {
 	ceph_assert(extent.get_off() + extent.get_len() <= append_after);
 	ceph_assert(sinfo.logical_offset_is_stripe_aligned(extent.get_off()));
 	ceph_assert(sinfo.logical_offset_is_stripe_aligned(extent.get_len()));
 	if (entry) {
-	  uint64_t restore_from = sinfo.aligned_logical_offset_to_chunk_offset(
-	    extent.get_off());
-	  uint64_t restore_len = sinfo.aligned_logical_offset_to_chunk_offset(
-	    extent.get_len());
-	  ldpp_dout(dpp, 20) << __func__ << ": overwriting "
-			     << restore_from << "~" << restore_len
-			     << dendl;
-	  if (rollback_extents.empty()) {
-	    for (auto &&st : *transactions) {
-	      st.second.touch(
-		coll_t(spg_t(pgid, st.first)),
-		ghobject_t(oid, entry->version.version, st.first));
-	    }
-	  }
-	  rollback_extents.emplace_back(make_pair(restore_from, restore_len));
-	  for (auto &&st : *transactions) {
-	    st.second.clone_range(
-	      coll_t(spg_t(pgid, st.first)),
-	      ghobject_t(oid, ghobject_t::NO_GEN, st.first),
-	      ghobject_t(oid, entry->version.version, st.first),
-	      restore_from,
-	      restore_len,
-	      restore_from);
-	  }
+	  save_rollback_extent(extent.get_off(), extent.get_len());
 	}
 	encode_and_write(
 	  pgid,
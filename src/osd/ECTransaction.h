@@ -30,6 +30,10 @@ namespace ECTransaction {
     std::map<hobject_t,extent_set> will_write; // superset of to_read
 
     std::map<hobject_t,ECUtil::HashInfoRef> hash_infos;
+
+    /// set by plan_parity_delta: data shards touched by an overwrite
+    /// which may be applied as a parity delta
+    std::map<hobject_t,std::set<int>> parity_delta;
   };
 
   bool requires_overwrite(
@@ -182,12 +186,32 @@ namespace ECTransaction {
     return plan;
   }
 
+  /**
+   * A small overwrite of existing stripes only changes some of their
+   * data chunks. With a linear code it is cheaper to read the old
+   * contents of those and of the coding chunks and to write them back
+   * updated (see ECUtil::encode_parity_delta) than to read and rewrite
+   * the whole stripes. Fills plan->parity_delta if the plan is such a
+   * single object overwrite and the delta moves fewer bytes.
+   */
+  void plan_parity_delta(
+    const ECUtil::stripe_info_t &sinfo,
+    ceph::ErasureCodeInterfaceRef &ecimpl,
+    WritePlan *plan);
+
+  /**
+   * delta_extents holds, for the objects in plan.parity_delta, the old
+   * contents of the touched data chunks and of the coding chunks over
+   * plan.to_read, keyed by shard and chunk offset. Those objects are
+   * not added to written.
+   */
   void generate_transactions(
     WritePlan &plan,
     ceph::ErasureCodeInterfaceRef &ecimpl,
     pg_t pgid,
     const ECUtil::stripe_info_t &sinfo,
     const std::map<hobject_t,extent_map> &partial_extents,
+    const std::map<hobject_t,std::map<int,extent_map>> &delta_extents,
     std::vector<pg_log_entry_t> &entries,
     std::map<hobject_t,extent_map> *written,
     std::map<shard_id_t, ObjectStore::Transaction> *transactions,
@@ -9,6 +9,34 @@ using ceph::bufferlist;
 using ceph::ErasureCodeInterfaceRef;
 using ceph::Formatter;
 
+pair<uint64_t, uint64_t> ECUtil::stripe_info_t::offset_len_to_chunk_bounds(
+  pair<uint64_t, uint64_t> in,
+  set<int> *data_chunks) const {
+  ceph_assert(data_chunks);
+  ceph_assert(in.second > 0);
+  if (in.second >= stripe_width) {
+    for (uint64_t i = 0; i < stripe_width / chunk_size; ++i) {
+      data_chunks->insert(i);
+    }
+    return aligned_offset_len_to_chunk(offset_len_to_stripe_bounds(in));
+  }
+  // less than a stripe, at most one chunk per data chunk index and two
+  // for the first one
+  const uint64_t end = in.first + in.second;
+  uint64_t lo = std::numeric_limits<uint64_t>::max();
+  uint64_t hi = 0;
+  for (uint64_t pos = in.first; pos < end; ) {
+    const uint64_t in_chunk = pos % chunk_size;
+    const uint64_t len = std::min(chunk_size - in_chunk, end - pos);
+    const uint64_t off = logical_to_prev_chunk_offset(pos) + in_chunk;
+    data_chunks->insert((pos % stripe_width) / chunk_size);
+    lo = std::min(lo, off);
+    hi = std::max(hi, off + len);
+    pos += len;
+  }
+  return make_pair(lo, hi - lo);
+}
+
 int ECUtil::decode(
   const stripe_info_t &sinfo,
   ErasureCodeInterfaceRef &ec_impl,
@@ -161,6 +189,140 @@ int ECUtil::encode(
   return 0;
 }
 
+void ECUtil::assemble_extent(
+  const stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ec_impl,
+  const map<int, bufferlist> &chunks,
+  uint64_t chunk_off,
+  pair<uint64_t, uint64_t> in,
+  bufferlist *out) {
+  ceph_assert(out);
+  const uint64_t chunk_size = sinfo.get_chunk_size();
+  const vector<int> &mapping = ec_impl->get_chunk_mapping();
+  const uint64_t end = in.first + in.second;
+  for (uint64_t pos = in.first; pos < end; ) {
+    const uint64_t in_chunk = pos % chunk_size;
+    uint64_t len = std::min(chunk_size - in_chunk, end - pos);
+    const unsigned i = (pos % sinfo.get_stripe_width()) / chunk_size;
+    auto citer = chunks.find(mapping.size() > i ? mapping[i] : i);
+    ceph_assert(citer != chunks.end());
+    const uint64_t off = sinfo.logical_to_prev_chunk_offset(pos) + in_chunk;
+    ceph_assert(off >= chunk_off);
+    if (off - chunk_off >= citer->second.length()) {
+      break;
+    }
+    len = std::min(len, citer->second.length() - (off - chunk_off));
+    bufferlist bl;
+    bl.substr_of(citer->second, off - chunk_off, len);
+    out->claim_append(bl);
+    pos += len;
+  }
+}
+
+int ECUtil::decode_extent(
+  const stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ec_impl,
+  map<int, bufferlist> &to_decode,
+  const set<int> &want,
+  pair<uint64_t, uint64_t> in,
+  bufferlist *out) {
+  ceph_assert(out);
+  map<int, bufferlist> decoded;
+  map<int, bufferlist*> decode_out;
+  for (int shard : want) {
+    decode_out[shard] = &decoded[shard];
+  }
+  int r = decode(sinfo, ec_impl, to_decode, decode_out);
+  if (r < 0) {
+    return r;
+  }
+  assemble_extent(
+    sinfo, ec_impl, decoded,
+    sinfo.aligned_logical_offset_to_chunk_offset(
+      sinfo.logical_to_prev_stripe_offset(in.first)),
+    in, out);
+  return 0;
+}
+
+static bufferlist xor_chunks(const bufferlist &a, const bufferlist &b)
+{
+  ceph_assert(a.length() == b.length());
+  ceph::bufferptr out(ceph::buffer::create(a.length()));
+  a.begin().copy(a.length(), out.c_str());
+  char *dst = out.c_str();
+  for (auto &p : b.buffers()) {
+    const char *src = p.c_str();
+    for (unsigned i = 0; i < p.length(); ++i) {
+      dst[i] ^= src[i];
+    }
+    dst += p.length();
+  }
+  bufferlist bl;
+  bl.push_back(std::move(out));
+  return bl;
+}
+
+int ECUtil::encode_parity_delta(
+  const stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ec_impl,
+  const map<int, bufferlist> &old_data,
+  const map<int, bufferlist> &new_data,
+  map<int, bufferlist> *parity) {
+  ceph_assert(parity);
+  ceph_assert(!old_data.empty());
+  ceph_assert(old_data.size() == new_data.size());
+
+  const uint64_t chunk_size = sinfo.get_chunk_size();
+  const uint64_t total_data_size = old_data.begin()->second.length();
+  ceph_assert(total_data_size % chunk_size == 0);
+
+  const vector<int> &mapping = ec_impl->get_chunk_mapping();
+  auto shard_of = [&mapping](unsigned i) {
+    return mapping.size() > i ? mapping[i] : static_cast<int>(i);
+  };
+
+  map<int, bufferlist> delta;
+  for (auto &&i : old_data) {
+    auto niter = new_data.find(i.first);
+    ceph_assert(niter != new_data.end());
+    ceph_assert(i.second.length() == total_data_size);
+    delta[i.first] = xor_chunks(i.second, niter->second);
+  }
+
+  // lay the deltas out as stripes, the unchanged chunks have a 0 delta
+  const unsigned k = ec_impl->get_data_chunk_count();
+  bufferlist in;
+  for (uint64_t off = 0; off < total_data_size; off += chunk_size) {
+    for (unsigned i = 0; i < k; ++i) {
+      auto diter = delta.find(shard_of(i));
+      if (diter == delta.end()) {
+	in.append_zero(chunk_size);
+      } else {
+	bufferlist chunk;
+	chunk.substr_of(diter->second, off, chunk_size);
+	in.claim_append(chunk);
+      }
+    }
+  }
+
+  set<int> want;
+  for (unsigned i = k; i < ec_impl->get_chunk_count(); ++i) {
+    want.insert(shard_of(i));
+  }
+  map<int, bufferlist> parity_delta;
+  int r = encode(sinfo, ec_impl, in, want, &parity_delta);
+  if (r < 0)
+    return r;
+
+  for (auto shard : want) {
+    auto piter = parity->find(shard);
+    ceph_assert(piter != parity->end());
+    ceph_assert(piter->second.length() == total_data_size);
+    piter->second = xor_chunks(piter->second, parity_delta[shard]);
+  }
+  return 0;
+}
+
 void ECUtil::HashInfo::append(uint64_t old_size,
 			      map<int, bufferlist> &to_append) {
   ceph_assert(old_size == total_chunk_size);
@@ -77,6 +77,12 @@ public:
       (in.first - off) + in.second);
     return std::make_pair(off, len);
   }
+  /// chunk offset range holding the bytes of the logical extent on each
+  /// of the data chunks it touches, which are added to *data_chunks by
+  /// index (before any chunk mapping)
+  std::pair<uint64_t, uint64_t> offset_len_to_chunk_bounds(
+    std::pair<uint64_t, uint64_t> in,
+    std::set<int> *data_chunks) const;
 };
 
 int decode(
@@ -98,6 +104,52 @@ int encode(
   const std::set<int> &want,
   std::map<int, ceph::buffer::list> *out);
 
+/**
+ * Copy the logical extent in out of the data chunks read for it, which
+ * hold the chunk offsets from chunk_off on (see
+ * stripe_info_t::offset_len_to_chunk_bounds). chunks is keyed by shard
+ * and must hold every data chunk the extent touches, out is cut short
+ * where they are.
+ */
+void assemble_extent(
+  const stripe_info_t &sinfo,
+  ceph::ErasureCodeInterfaceRef &ec_impl,
+  const std::map<int, ceph::buffer::list> &chunks,
+  uint64_t chunk_off,
+  std::pair<uint64_t, uint64_t> in,
+  ceph::buffer::list *out);
+
+/**
+ * Decode the data chunks in want of the stripes around the logical
+ * extent in from to_decode, keyed by shard and starting at the stripe
+ * in.first falls in, and copy the extent to out as assemble_extent
+ * does. want must hold every data chunk the extent touches.
+ */
+int decode_extent(
+  const stripe_info_t &sinfo,
+  ceph::ErasureCodeInterfaceRef &ec_impl,
+  std::map<int, ceph::buffer::list> &to_decode,
+  const std::set<int> &want,
+  std::pair<uint64_t, uint64_t> in,
+  ceph::buffer::list *out);
+
+/**
+ * Update the coding chunks of stripes of which only some data chunks
+ * change, without the unchanged data chunks. Only valid for plugins
+ * with FLAG_EC_PLUGIN_PARITY_DELTA_OPTIMIZATION: the coding chunks of
+ * old ^ new are xored into the old coding chunks.
+ *
+ * old_data and new_data hold the changed data chunks, parity holds the
+ * old coding chunks on input and the new ones on output. All of them
+ * are keyed by shard and span the same chunk aligned range.
+ */
+int encode_parity_delta(
+  const stripe_info_t &sinfo,
+  ceph::ErasureCodeInterfaceRef &ec_impl,
+  const std::map<int, ceph::buffer::list> &old_data,
+  const std::map<int, ceph::buffer::list> &new_data,
+  std::map<int, ceph::buffer::list> *parity);
+
 class HashInfo {
   uint64_t total_chunk_size = 0;
   std::vector<uint32_t> cumulative_shard_hashes;
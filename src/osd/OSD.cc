@@ -2425,6 +2425,13 @@ int OSD::set_numa_affinity()
     // this takes precedence over the automagic logic above
     numa_node = node;
   }
+  if (numa_node >= 0 &&
+      cct->_conf.get_val<bool>("osd_op_shard_msgr_affinity")) {
+    // don't undo the placement of the op shards next to the messenger
+    dout(1) << __func__ << " not setting numa affinity, op shards are placed"
+	    << " per osd_op_shard_msgr_affinity" << dendl;
+    numa_node = -1;
+  }
   if (numa_node >= 0) {
     int r = get_numa_node_cpu_set(numa_node, &numa_cpu_set_size, &numa_cpu_set);
     if (r < 0) {
@@ -2450,6 +2457,60 @@ int OSD::set_numa_affinity()
   return 0;
 }
 
+void OSD::set_op_shard_affinity()
+{
+  // Messenger worker i runs on the i-th of ms_async_affinity_cores, see
+  // NetworkStack. Spread the op shards over the numa nodes of the
+  // workers, shard i on the node of worker i, so that the op threads
+  // share the nodes (and their memory) with the messenger instead of
+  // being scheduled anywhere. This is placement only: a connection
+  // carries ops for the PGs of every shard, so the worker an op arrives
+  // on is not tied to its shard. Pinning to the worker's own core would
+  // squeeze all op threads onto as many cores as there are workers.
+  auto cores = cct->_conf.get_val<std::string>("ms_async_affinity_cores");
+  size_t cpu_set_size;
+  cpu_set_t cpu_set;
+  if (cores.empty() ||
+      parse_cpu_set_list(cores.c_str(), &cpu_set_size, &cpu_set) < 0) {
+    derr << __func__ << " invalid ms_async_affinity_cores '" << cores
+	 << "', not placing op shards" << dendl;
+    return;
+  }
+  auto worker_cpu_set = cpu_set_to_set(cpu_set_size, &cpu_set);
+  std::vector<int> worker_cpus(worker_cpu_set.begin(), worker_cpu_set.end());
+  std::map<int, std::set<int>> node_cpus;
+  auto get_node_cpus = [&](int cpu) {
+    int node = get_cpu_numa_node(cpu);
+    if (node < 0) {
+      // no numa information, stay with the messenger cores
+      return worker_cpu_set;
+    }
+    auto p = node_cpus.find(node);
+    if (p == node_cpus.end()) {
+      std::set<int> cpus;
+      size_t node_set_size;
+      cpu_set_t node_set;
+      if (get_numa_node_cpu_set(node, &node_set_size, &node_set) == 0) {
+	cpus = cpu_set_to_set(node_set_size, &node_set);
+      } else {
+	cpus = worker_cpu_set;
+      }
+      p = node_cpus.emplace(node, std::move(cpus)).first;
+    }
+    return p->second;
+  };
+  uint64_t num_workers = cct->_conf->ms_async_op_threads;
+  std::vector<std::set<int>> thread_cpus;
+  for (int i = 0; i < get_num_op_threads(); ++i) {
+    // see ShardedOpWQ::_process()
+    uint32_t shard_index = i % num_shards;
+    int cpu = worker_cpus[(shard_index % num_workers) % worker_cpus.size()];
+    thread_cpus.push_back(get_node_cpus(cpu));
+  }
+  dout(1) << __func__ << " op thread cpus " << thread_cpus << dendl;
+  osd_op_tp.set_thread_cpus(std::move(thread_cpus));
+}
+
 // asok
 
 class OSDSocketHook : public AdminSocketHook {
@@ -3409,6 +3470,8 @@ int OSD::init()
   journal_is_rotational = store->is_journal_rotational();
   dout(2) << "journal looks like " << (journal_is_rotational ? "hdd" : "ssd")
           << dendl;
+  rx_data_align = std::max<uint64_t>(store->get_data_alignment(),
+				     CEPH_PAGE_SIZE);
 
   enable_disable_fuse(false);
 
@@ -3690,6 +3753,9 @@ int OSD::init()
     }
   }
 
+  if (cct->_conf.get_val<bool>("osd_op_shard_msgr_affinity")) {
+    set_op_shard_affinity();
+  }
   osd_op_tp.start();
 
   // start the heartbeat
@@ -7112,6 +7178,26 @@ void OSD::dispatch_session_waiting(const ceph::ref_t<Session>& session, OSDMapRe
   }
 }
 
+bool OSD::ms_get_rx_data_buffer(Connection *con, int type, uint64_t tid,
+				uint32_t data_off, uint32_t data_len,
+				ceph::buffer::list *bl)
+{
+  // the data of a client write is what ends up in the store, data_off is
+  // the object offset of its first byte. lay it out so that the parts
+  // aligned in the object are aligned in memory too, for the store to
+  // write them without copying them first.
+  if (type != CEPH_MSG_OSD_OP || data_len < rx_data_align) {
+    return false;
+  }
+  const uint32_t head = data_off % rx_data_align;
+  ceph::bufferptr ptr(
+    ceph::buffer::create_aligned(head + data_len, rx_data_align));
+  ptr.set_offset(head);
+  ptr.set_length(data_len);
+  bl->push_back(std::move(ptr));
+  return true;
+}
+
 void OSD::ms_fast_dispatch(Message *m)
 {
 
@@ -9746,7 +9832,8 @@ bool OSD::op_is_discardable(const MOSDOp *op)
 void OSD::enqueue_op(spg_t pg, OpRequestRef&& op, epoch_t epoch)
 {
   const utime_t stamp = op->get_req()->get_recv_stamp();
-  const utime_t latency = ceph_clock_now() - stamp;
+  const utime_t now = ceph_clock_now();
+  const utime_t latency = now - stamp;
   const unsigned priority = op->get_req()->get_priority();
   const int cost = op->get_req()->get_cost();
   const uint64_t owner = op->get_req()->get_source().num();
@@ -9774,6 +9861,7 @@ void OSD::enqueue_op(spg_t pg, OpRequestRef&& op, epoch_t epoch)
   }
 #endif
   op->mark_queued_for_pg();
+  op->set_queued_time(now);
   logger->tinc(l_osd_op_before_queue_op_lat, latency);
   if (type == MSG_OSD_PG_PUSH ||
       type == MSG_OSD_PG_PUSH_REPLY) {
@@ -9825,6 +9913,7 @@ void OSD::dequeue_op(
 	   << " pg " << *pg << dendl;
 
   logger->tinc(l_osd_op_before_dequeue_op_lat, latency);
+  logger->tinc(l_osd_op_queue_lat, now - op->get_queued_time());
 
   service.maybe_share_map(m->get_connection().get(),
 			  pg->get_osdmap(),
@@ -1124,6 +1124,7 @@ protected:
   PerfCounters      *logger;
   PerfCounters      *recoverystate_perf;
   ObjectStore *store;
+  uint64_t rx_data_align = 0; ///< see ms_get_rx_data_buffer()
 #ifdef HAVE_LIBFUSE
   FuseStore *fuse_store = nullptr;
 #endif
@@ -2003,6 +2004,9 @@ private:
     }
   }
   void ms_fast_dispatch(Message *m) override;
+  bool ms_get_rx_data_buffer(Connection *con, int type, uint64_t tid,
+			     uint32_t data_off, uint32_t data_len,
+			     ceph::buffer::list *bl) override;
   bool ms_dispatch(Message *m) override;
   void ms_handle_connect(Connection *con) override;
   void ms_handle_fast_connect(Connection *con) override;
@@ -2085,6 +2089,7 @@ public:
 
   int enable_disable_fuse(bool stop);
   int set_numa_affinity();
+  void set_op_shard_affinity();
 
   void suicide(int exitcode);
   int shutdown();
@@ -22,6 +22,9 @@
 #include <boost/algorithm/string.hpp>
 
 #include "OSDMap.h"
+#ifndef WITH_SEASTAR
+#include "OSDMapMapping.h"
+#endif
 #include "common/config.h"
 #include "common/errno.h"
 #include "common/Formatter.h"
@@ -2715,6 +2718,87 @@ void OSDMap::_pg_to_up_acting_osds(
     *acting_primary = _acting_primary;
 }
 
+void OSDMap::pg_range_to_up_acting_osds(
+  int64_t poolid, unsigned ps_begin, unsigned ps_end,
+  const std::function<void(pg_t, vector<int>&&, vector<int>&&, int,
+			   vector<int>&&, int)>& f) const
+{
+  const pg_pool_t *pool = get_pg_pool(poolid);
+  ceph_assert(pool);
+  ceph_assert(ps_begin <= ps_end);
+  unsigned size = pool->get_size();
+  vector<int> pps(ps_end - ps_begin);
+  for (unsigned ps = ps_begin; ps < ps_end; ++ps) {
+    pps[ps - ps_begin] = pool->raw_pg_to_pps(pg_t(ps, poolid));
+  }
+  vector<int> raws, raw_sizes;
+  int ruleno = crush->find_rule(pool->get_crush_rule(), pool->get_type(), size);
+  if (ruleno >= 0) {
+    crush->do_rule_batch(ruleno, pps, size, osd_weight, poolid,
+			 &raws, &raw_sizes);
+  }
+
+  for (unsigned i = 0; i < pps.size(); ++i) {
+    pg_t pg(ps_begin + i, poolid);
+    vector<int> raw;
+    if (ruleno >= 0) {
+      auto p = raws.begin() + i * size;
+      raw.assign(p, p + std::max(raw_sizes[i], 0));
+    }
+    _remove_nonexistent_osds(*pool, raw);
+
+    vector<int> up, acting;
+    int up_primary, acting_primary;
+    _get_temp_osds(*pool, pg, &acting, &acting_primary);
+    _apply_upmap(*pool, pg, &raw);
+    _raw_to_up_osds(*pool, raw, &up);
+    up_primary = _pick_primary(up);
+    _apply_primary_affinity(pps[i], *pool, &up, &up_primary);
+    if (acting.empty()) {
+      acting = up;
+      if (acting_primary == -1) {
+	acting_primary = up_primary;
+      }
+    }
+    f(pg, std::move(raw), std::move(up), up_primary,
+      std::move(acting), acting_primary);
+  }
+}
+
+void OSDMap::get_pgs_overridden_with(const std::set<int>& osds,
+				     std::set<pg_t> *pgs) const
+{
+  for (auto p = pg_temp->begin(); p != pg_temp->end(); ++p) {
+    for (auto osd : p->second) {
+      if (osds.count(osd)) {
+	pgs->insert(p->first);
+	break;
+      }
+    }
+  }
+  for (auto& [pg, osd] : *primary_temp) {
+    if (osds.count(osd)) {
+      pgs->insert(pg);
+    }
+  }
+  for (auto& [pg, um] : pg_upmap) {
+    for (auto osd : um) {
+      if (osds.count(osd)) {
+	pgs->insert(pg);
+	break;
+      }
+    }
+  }
+  for (auto& [pg, items] : pg_upmap_items) {
+    for (auto& [from, to] : items) {
+      if (osds.count(from) || osds.count(to)) {
+	pgs->insert(pg);
+	break;
+      }
+    }
+  }
+}
+
 int OSDMap::calc_pg_role_broken(int osd, const vector<int>& acting, int nrep)
 {
   // This implementation is broken for EC PGs since the osd may appear
@@ -4632,14 +4716,91 @@ bool OSDMap::try_pg_upmap(
   return true;
 }
 
+// map the up sets of pgs [ps_begin, ps_end) of pool into ups
+static void map_up_range(
+  const OSDMap& osdmap,
+  int64_t pool,
+  unsigned ps_begin,
+  unsigned ps_end,
+  vector<vector<int>> *ups)
+{
+  osdmap.pg_range_to_up_acting_osds(
+    pool, ps_begin, ps_end,
+    [&](pg_t pgid, vector<int>&& raw, vector<int>&& up, int up_primary,
+	vector<int>&& acting, int acting_primary) {
+      (*ups)[pgid.ps()] = std::move(up);
+    });
+}
+
+#ifndef WITH_SEASTAR
+namespace {
+struct UpMappingJob : public ParallelPGMapper::Job {
+  map<int64_t, vector<vector<int>>> *up_by_pool;
+
+  UpMappingJob(const OSDMap& osdmap,
+	       map<int64_t, vector<vector<int>>> *up_by_pool)
+    : ParallelPGMapper::Job(&osdmap), up_by_pool(up_by_pool) {}
+  void process(const vector<pg_t>& pgs) override {
+    ceph_abort();
+  }
+  void process(int64_t pool, unsigned ps_begin, unsigned ps_end) override {
+    // the mapper hands us every pool of the map
+    auto p = up_by_pool->find(pool);
+    if (p != up_by_pool->end()) {
+      map_up_range(*osdmap, pool, ps_begin, ps_end, &p->second);
+    }
+  }
+  void complete() override {}
+};
+}
+#endif
+
+// map the up set of every pg of pools, on the mapper's threads if given
+static void calc_pgs_by_osd(
+  CephContext *cct,
+  const OSDMap& osdmap,
+  const vector<int64_t>& pools,
+  ParallelPGMapper *mapper,
+  map<int,set<pg_t>> *pgs_by_osd)
+{
+  map<int64_t, vector<vector<int>>> up_by_pool;
+  for (auto pool : pools) {
+    up_by_pool[pool].resize(osdmap.get_pg_pool(pool)->get_pg_num());
+  }
+#ifndef WITH_SEASTAR
+  if (mapper && !pools.empty()) {
+    UpMappingJob job(osdmap, &up_by_pool);
+    mapper->queue(&job, cct->_conf->mon_osd_mapping_pgs_per_chunk, {});
+    job.wait();
+  } else
+#endif
+  {
+    for (auto& [pool, ups] : up_by_pool) {
+      map_up_range(osdmap, pool, 0, ups.size(), &ups);
+    }
+  }
+  for (auto& [pool, ups] : up_by_pool) {
+    for (unsigned ps = 0; ps < ups.size(); ++ps) {
+      pg_t pg(ps, pool);
+      ldout(cct, 20) << __func__ << " " << pg << " up " << ups[ps] << dendl;
+      for (auto osd : ups[ps]) {
+        if (osd != CRUSH_ITEM_NONE)
+	  (*pgs_by_osd)[osd].insert(pg);
+      }
+    }
+  }
+}
+
 int OSDMap::calc_pg_upmaps(
   CephContext *cct,
   uint32_t max_deviation,
   int max,
   const set<int64_t>& only_pools,
-  OSDMap::Incremental *pending_inc)
+  OSDMap::Incremental *pending_inc,
+  ParallelPGMapper *mapper)
 {
   ldout(cct, 10) << __func__ << " pools " << only_pools << dendl;
+  auto start = ceph::mono_clock::now();
   OSDMap tmp;
   // Can't be less than 1 pg
   if (max_deviation < 1)
@@ -4650,19 +4811,11 @@ int OSDMap::calc_pg_upmaps(
   int total_pgs = 0;
   float osd_weight_total = 0;
   map<int,float> osd_weight;
+  vector<int64_t> pools_to_map;
   for (auto& i : pools) {
     if (!only_pools.empty() && !only_pools.count(i.first))
       continue;
-    for (unsigned ps = 0; ps < i.second.get_pg_num(); ++ps) {
-      pg_t pg(ps, i.first);
-      vector<int> up;
-      tmp.pg_to_up_acting_osds(pg, &up, nullptr, nullptr, nullptr);
-      ldout(cct, 20) << __func__ << " " << pg << " up " << up << dendl;
-      for (auto osd : up) {
-        if (osd != CRUSH_ITEM_NONE)
-	  pgs_by_osd[osd].insert(pg);
-      }
-    }
+    pools_to_map.push_back(i.first);
     total_pgs += i.second.get_size() * i.second.get_pg_num();
 
     map<int,float> pmap;
@@ -4683,6 +4836,7 @@ int OSDMap::calc_pg_upmaps(
       osd_weight_total += adjusted_weight;
     }
   }
+  calc_pgs_by_osd(cct, tmp, pools_to_map, mapper, &pgs_by_osd);
   for (auto& i : osd_weight) {
     int pgs = 0;
     auto p = pgs_by_osd.find(i.first);
@@ -4705,7 +4859,9 @@ int OSDMap::calc_pg_upmaps(
     lderr(cct) << __func__ << " abort due to max <= 0" << dendl;
     return 0;
   }
-  float stddev = 0;
+  // sum of squared deviations; only updated incrementally below, so keep
+  // it in double to limit the rounding error piling up across moves
+  double stddev = 0;
   map<int,float> osd_deviation;       // osd, deviation(pgs)
   multimap<float,int> deviation_osd;  // deviation(pgs), osd
   float cur_max_deviation = 0;
@@ -4721,7 +4877,7 @@ int OSDMap::calc_pg_upmaps(
                    << dendl;
     osd_deviation[i.first] = deviation;
     deviation_osd.insert(make_pair(deviation, i.first));
-    stddev += deviation * deviation;
+    stddev += (double)deviation * deviation;
     if (fabsf(deviation) > cur_max_deviation)
       cur_max_deviation = fabsf(deviation);
   }
@@ -4732,12 +4888,21 @@ int OSDMap::calc_pg_upmaps(
     return 0;
   }
   bool skip_overfull = false;
+  unsigned num_accepted = 0;
   auto aggressive =
     cct->_conf.get_val<bool>("osd_calc_pg_upmaps_aggressively");
   auto local_fallback_retries =
     cct->_conf.get_val<uint64_t>("osd_calc_pg_upmaps_local_fallback_retries");
+  auto max_time = ceph::make_timespan(
+    cct->_conf.get_val<double>("osd_calc_pg_upmaps_max_time"));
   while (max--) {
     ldout(cct, 30) << "Top of loop #" << max+1 << dendl;
+    if (max_time > ceph::timespan::zero() &&
+	ceph::mono_clock::now() - start > max_time) {
+      ldout(cct, 10) << __func__ << " out of time after " << num_changed
+		     << " changes" << dendl;
+      break;
+    }
     // build overfull and underfull
     set<int> overfull;
     set<int> more_overfull;
@@ -4787,7 +4952,18 @@ int OSDMap::calc_pg_upmaps(
 
     set<pg_t> to_unmap;
     map<pg_t, mempool::osdmap::vector<pair<int32_t,int32_t>>> to_upmap;
-    auto temp_pgs_by_osd = pgs_by_osd;
+    // only the osds the change touches, with the pgs they would end up
+    // with; all others keep theirs from pgs_by_osd
+    map<int,set<pg_t>> temp_pgs_by_osd;
+    auto temp_pgs = [&](int osd) -> set<pg_t>& {
+      auto p = temp_pgs_by_osd.find(osd);
+      if (p == temp_pgs_by_osd.end()) {
+	auto q = pgs_by_osd.find(osd);
+	p = temp_pgs_by_osd.emplace(
+	  osd, q != pgs_by_osd.end() ? q->second : set<pg_t>()).first;
+      }
+      return p->second;
+    };
     // always start with fullest, break if we find any changes to make
     for (auto p = deviation_osd.rbegin(); p != deviation_osd.rend(); ++p) {
       if (skip_overfull && !underfull.empty()) {
@@ -4844,8 +5020,8 @@ int OSDMap::calc_pg_upmaps(
                            << " which remapped " << pg
                            << " into overfull osd." << osd
                            << dendl;
-            temp_pgs_by_osd[q.second].erase(pg);
-            temp_pgs_by_osd[q.first].insert(pg);
+            temp_pgs(q.second).erase(pg);
+            temp_pgs(q.first).insert(pg);
           } else {
             new_upmap_items.push_back(q);
           }
@@ -4937,8 +5113,8 @@ int OSDMap::calc_pg_upmaps(
                          << dendl;
           existing.insert(orig[i]);
           existing.insert(out[i]);
-          temp_pgs_by_osd[orig[i]].erase(pg);
-          temp_pgs_by_osd[out[i]].insert(pg);
+          temp_pgs(orig[i]).erase(pg);
+          temp_pgs(out[i]).insert(pg);
           ceph_assert(new_upmap_items.size() < (size_t)pg_pool_size);
           new_upmap_items.push_back(make_pair(orig[i], out[i]));
           // append new remapping pairs slowly
@@ -5000,8 +5176,8 @@ int OSDMap::calc_pg_upmaps(
                            << " which remapped " << pg
                            << " out from underfull osd." << osd
                            << dendl;
-            temp_pgs_by_osd[j.second].erase(pg);
-            temp_pgs_by_osd[j.first].insert(pg);
+            temp_pgs(j.second).erase(pg);
+            temp_pgs(j.first).insert(pg);
           } else {
             new_upmap_items.push_back(j);
           }
@@ -5049,12 +5225,11 @@ int OSDMap::calc_pg_upmaps(
 
   test_change:
 
-    // test change, apply if change is good
+    // test change, apply if change is good; only the deviations of the
+    // osds it touches change
     ceph_assert(to_unmap.size() || to_upmap.size());
-    float new_stddev = 0;
+    double stddev_delta = 0;
     map<int,float> temp_osd_deviation;
-    multimap<float,int> temp_deviation_osd;
-    float cur_max_deviation = 0;
     for (auto& i : temp_pgs_by_osd) {
       // make sure osd is still there (belongs to this crush-tree)
       ceph_assert(osd_weight.count(i.first));
@@ -5066,13 +5241,13 @@ int OSDMap::calc_pg_upmaps(
                      << "\tdeviation " << deviation
                      << dendl;
       temp_osd_deviation[i.first] = deviation;
-      temp_deviation_osd.insert(make_pair(deviation, i.first));
-       new_stddev += deviation * deviation;
-      if (fabsf(deviation) > cur_max_deviation)
-        cur_max_deviation = fabsf(deviation);
+      float old_deviation = osd_deviation[i.first];
+      stddev_delta += (double)deviation * deviation -
+	(double)old_deviation * old_deviation;
     }
+    double new_stddev = stddev + stddev_delta;
     ldout(cct, 10) << " stddev " << stddev << " -> " << new_stddev << dendl;
-    if (new_stddev >= stddev) {
+    if (stddev_delta >= 0) {
       if (!aggressive) {
         ldout(cct, 10) << " break because stddev is not decreasing"
                        << " and aggressive mode is not enabled"
@@ -5101,11 +5276,29 @@ int OSDMap::calc_pg_upmaps(
     }
 
     // ready to go
-    ceph_assert(new_stddev < stddev);
+    ceph_assert(stddev_delta < 0);
     stddev = new_stddev;
-    pgs_by_osd = temp_pgs_by_osd;
-    osd_deviation = temp_osd_deviation;
-    deviation_osd = temp_deviation_osd;
+    for (auto& [osd, deviation] : temp_osd_deviation) {
+      auto r = deviation_osd.equal_range(osd_deviation[osd]);
+      for (auto p = r.first; p != r.second; ++p) {
+	if (p->second == osd) {
+	  deviation_osd.erase(p);
+	  break;
+	}
+      }
+      deviation_osd.insert(make_pair(deviation, osd));
+      osd_deviation[osd] = deviation;
+      pgs_by_osd[osd] = std::move(temp_pgs_by_osd[osd]);
+    }
+    cur_max_deviation = std::max(fabsf(deviation_osd.begin()->first),
+				 fabsf(deviation_osd.rbegin()->first));
+    if (++num_accepted % 64 == 0) {
+      // resync with the deviations to drop the accumulated rounding error
+      stddev = 0;
+      for (auto& [osd, deviation] : osd_deviation) {
+	stddev += (double)deviation * deviation;
+      }
+    }
     for (auto& i : to_unmap) {
       ldout(cct, 10) << " unmap pg " << i << dendl;
       ceph_assert(tmp.pg_upmap_items.count(i));
@@ -24,6 +24,7 @@
  *   disks, disk groups, total # osds,
  *
  */
+#include <functional>
 #include <vector>
 #include <list>
 #include <set>
@@ -43,6 +44,7 @@
 // forward declaration
 class CrushWrapper;
 class health_check_map_t;
+class ParallelPGMapper;
 
 /*
  * we track up to two intervals during which the osd was alive and
@@ -1245,6 +1247,20 @@ public:
     int up_primary, acting_primary;
     pg_to_up_acting_osds(pg, &up, &up_primary, &acting, &acting_primary);
   }
+  /**
+   * map the pgs [ps_begin, ps_end) of a pool like pg_to_up_acting_osds(),
+   * evaluating the CRUSH rule for all of them in one batch.
+   * f(pg, raw, up, up_primary, acting, acting_primary) is called for
+   * each pg in order, raw being the CRUSH mapping with upmaps applied.
+   */
+  void pg_range_to_up_acting_osds(
+    int64_t pool, unsigned ps_begin, unsigned ps_end,
+    const std::function<void(pg_t, std::vector<int>&&,
+			     std::vector<int>&&, int,
+			     std::vector<int>&&, int)>& f) const;
+  /// add pgs with a pg_temp, primary_temp or upmap entry naming any of osds
+  void get_pgs_overridden_with(const std::set<int>& osds,
+			       std::set<pg_t> *pgs) const;
   bool pg_is_ec(pg_t pg) const {
     auto i = pools.find(pg.pool());
     ceph_assert(i != pools.end());
@@ -1430,7 +1446,8 @@ public:
     uint32_t max_deviation, ///< max deviation from target (value >= 1)
     int max_iterations,  ///< max iterations to run
     const std::set<int64_t>& pools,        ///< [optional] restrict to pool
-    Incremental *pending_inc
+    Incremental *pending_inc,
+    ParallelPGMapper *mapper = nullptr     ///< [optional] to map pgs in parallel
     );
 
   int get_osds_by_bucket_name(const std::string &name, std::set<int> *osds) const;
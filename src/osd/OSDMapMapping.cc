@@ -8,6 +8,7 @@
 
 #include "common/debug.h"
 
+using std::set;
 using std::vector;
 
 MEMPOOL_DEFINE_OBJECT_FACTORY(OSDMapMapping, osdmapmapping,
@@ -59,6 +60,172 @@ void OSDMapMapping::update(const OSDMap& osdmap, pg_t pgid)
   _update_range(osdmap, pgid.pool(), pgid.ps(), pgid.ps() + 1);
 }
 
+void OSDMapMapping::update(const OSDMap& osdmap,
+			   const vector<OSDMap::Incremental>& incs)
+{
+  vector<pg_t> pgs;
+  if (!_start_incremental(osdmap, incs, &pgs)) {
+    update(osdmap);
+    return;
+  }
+  _update_pgs(osdmap, pgs);
+  _finish(osdmap);
+}
+
+std::unique_ptr<OSDMapMapping::MappingJob> OSDMapMapping::start_update(
+  const OSDMap& osdmap,
+  ParallelPGMapper& mapper,
+  unsigned pgs_per_item,
+  const vector<OSDMap::Incremental>& incs)
+{
+  vector<pg_t> pgs;
+  if (!_start_incremental(osdmap, incs, &pgs)) {
+    return start_update(osdmap, mapper, pgs_per_item);
+  }
+  std::unique_ptr<MappingJob> job(new MappingJob(&osdmap, this));
+  if (pgs.empty()) {
+    // nothing moved; the job is done before it started
+    job->finish = ceph_clock_now();
+    job->complete();
+  } else {
+    mapper.queue(job.get(), pgs_per_item, pgs);
+  }
+  return job;
+}
+
+static bool rule_reaches(const CrushWrapper& crush, int ruleno, int osd)
+{
+  for (int i = 0; i < crush.get_rule_len(ruleno); ++i) {
+    if (crush.get_rule_op(ruleno, i) != CRUSH_RULE_TAKE) {
+      continue;
+    }
+    int item = crush.get_rule_arg1(ruleno, i);
+    if (item == osd || (item < 0 && crush.subtree_contains(item, osd))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// find the pgs that incs may have remapped.  the rows still hold the
+// mapping as of epoch, so a pg none of incs names can only have moved if
+// one of the osds it mapped to changed, or if an osd its rule can reach
+// became more likely to be chosen by CRUSH.
+bool OSDMapMapping::_start_incremental(
+  const OSDMap& osdmap,
+  const vector<OSDMap::Incremental>& incs,
+  vector<pg_t> *pgs)
+{
+  if (!valid || incs.empty() ||
+      incs.front().epoch != epoch + 1 ||
+      incs.back().epoch != osdmap.get_epoch()) {
+    return false;
+  }
+  auto weight = osd_weight;
+  set<int> changed_osds;   // remap pgs mapped to these
+  set<int> grown_osds;     // remap pools whose rule can reach these
+  set<int64_t> changed_pools;
+  set<pg_t> changed_pgs;
+  epoch_t e = epoch;
+  for (auto& inc : incs) {
+    if (inc.epoch != ++e ||
+	inc.fullmap.length() ||
+	inc.crush.length() ||
+	inc.new_max_osd >= 0) {
+      return false;
+    }
+    for (auto& [pool, p] : inc.new_pools) {
+      changed_pools.insert(pool);
+    }
+    for (auto& [osd, state] : inc.new_state) {
+      changed_osds.insert(osd);
+      if (state & CEPH_OSD_EXISTS) {
+	grown_osds.insert(osd);
+      }
+    }
+    for (auto& [osd, addrs] : inc.new_up_client) {
+      changed_osds.insert(osd);
+    }
+    for (auto& [osd, aff] : inc.new_primary_affinity) {
+      changed_osds.insert(osd);
+    }
+    for (auto& [osd, w] : inc.new_weight) {
+      if (osd < 0 || osd >= (int)weight.size()) {
+	return false;
+      }
+      uint32_t old = weight[osd];
+      weight[osd] = w;
+      // CRUSH treats anything at or above CEPH_OSD_IN as fully in
+      if (w == old || (w >= CEPH_OSD_IN && old >= CEPH_OSD_IN)) {
+	continue;
+      }
+      // a lower weight only rejects the osd where it was chosen so far,
+      // a higher one may pull it in anywhere below the rule's roots
+      changed_osds.insert(osd);
+      if (w > old) {
+	grown_osds.insert(osd);
+      }
+    }
+    for (auto& [pg, v] : inc.new_pg_temp) {
+      changed_pgs.insert(pg);
+    }
+    for (auto& [pg, v] : inc.new_primary_temp) {
+      changed_pgs.insert(pg);
+    }
+    for (auto& [pg, v] : inc.new_pg_upmap) {
+      changed_pgs.insert(pg);
+    }
+    changed_pgs.insert(inc.old_pg_upmap.begin(), inc.old_pg_upmap.end());
+    for (auto& [pg, v] : inc.new_pg_upmap_items) {
+      changed_pgs.insert(pg);
+    }
+    changed_pgs.insert(inc.old_pg_upmap_items.begin(),
+		       inc.old_pg_upmap_items.end());
+  }
+  osdmap.get_pgs_overridden_with(changed_osds, &changed_pgs);
+
+  _start(osdmap);
+
+  vector<bool> osds(osdmap.get_max_osd());
+  for (auto osd : changed_osds) {
+    if (osd >= 0 && osd < (int)osds.size()) {
+      osds[osd] = true;
+    }
+  }
+  auto q = changed_pgs.begin();
+  for (auto& [poolid, pm] : pools) {
+    while (q != changed_pgs.end() && q->pool() < (uint64_t)poolid) {
+      ++q;
+    }
+    auto pool = osdmap.get_pg_pool(poolid);
+    bool whole = changed_pools.count(poolid);
+    if (!whole && !grown_osds.empty()) {
+      int ruleno = osdmap.crush->find_rule(pool->get_crush_rule(),
+					   pool->get_type(),
+					   pool->get_size());
+      for (auto osd : grown_osds) {
+	if (ruleno >= 0 && rule_reaches(*osdmap.crush, ruleno, osd)) {
+	  whole = true;
+	  break;
+	}
+      }
+    }
+    for (unsigned ps = 0; ps < pm.pg_num; ++ps) {
+      bool listed = false;
+      if (q != changed_pgs.end() && q->pool() == (uint64_t)poolid &&
+	  q->ps() == ps) {
+	listed = true;
+	++q;
+      }
+      if (whole || listed ||
+	  (!changed_osds.empty() && pm.maps_to_any(ps, osds))) {
+	pgs->push_back(pg_t(ps, poolid));
+      }
+    }
+  }
+  return true;
+}
+
 void OSDMapMapping::_build_rmap(const OSDMap& osdmap)
 {
   acting_rmap.resize(osdmap.get_max_osd());
@@ -89,7 +256,12 @@ void OSDMapMapping::_build_rmap(const OSDMap& osdmap)
 void OSDMapMapping::_finish(const OSDMap& osdmap)
 {
   _build_rmap(osdmap);
+  osd_weight.resize(osdmap.get_max_osd());
+  for (int osd = 0; osd < osdmap.get_max_osd(); ++osd) {
+    osd_weight[osd] = osdmap.get_weight(osd);
+  }
   epoch = osdmap.get_epoch();
+  valid = true;
 }
 
 void OSDMapMapping::_dump()
@@ -114,14 +286,29 @@ void OSDMapMapping::_update_range(
   ceph_assert(i != pools.end());
   ceph_assert(pg_begin <= pg_end);
   ceph_assert(pg_end <= i->second.pg_num);
-  for (unsigned ps = pg_begin; ps < pg_end; ++ps) {
-    std::vector<int> up, acting;
-    int up_primary, acting_primary;
-    osdmap.pg_to_up_acting_osds(
-      pg_t(ps, pool),
-      &up, &up_primary, &acting, &acting_primary);
-    i->second.set(ps, std::move(up), up_primary,
-		  std::move(acting), acting_primary);
+  osdmap.pg_range_to_up_acting_osds(
+    pool, pg_begin, pg_end,
+    [&](pg_t pgid, std::vector<int>&& raw,
+	std::vector<int>&& up, int up_primary,
+	std::vector<int>&& acting, int acting_primary) {
+      i->second.set(pgid.ps(), raw, up, up_primary, acting, acting_primary);
+    });
+}
+
+void OSDMapMapping::_update_pgs(
+  const OSDMap& osdmap,
+  const vector<pg_t>& pgs)
+{
+  // pgs come sorted; map runs of consecutive pgs as one range
+  for (size_t i = 0; i < pgs.size(); ) {
+    size_t j = i + 1;
+    while (j < pgs.size() &&
+	   pgs[j].pool() == pgs[i].pool() &&
+	   pgs[j].ps() == pgs[j - 1].ps() + 1) {
+      ++j;
+    }
+    _update_range(osdmap, pgs[i].pool(), pgs[i].ps(), pgs[j - 1].ps() + 1);
+    i = j;
   }
 }
 
@@ -8,12 +8,11 @@
 #include <vector>
 #include <map>
 
+#include "osd/OSDMap.h"
 #include "osd/osd_types.h"
 #include "common/WorkQueue.h"
 #include "common/Cond.h"
 
-class OSDMap;
-
 /// work queue to perform work on batches of pgids on multiple CPUs
 class ParallelPGMapper {
 public:
@@ -190,7 +189,9 @@ private:
 	1 + // num acting
 	1 + // num up
 	size + // acting
-	size;  // up
+	size + // up
+	1 + // num raw
+	size;  // raw (CRUSH, after upmap)
     }
 
     PoolMapping(int s, int p, bool e)
@@ -227,6 +228,7 @@ private:
     }
 
     void set(size_t ps,
+	     const std::vector<int>& raw,
 	     const std::vector<int>& up,
 	     int up_primary,
 	     const std::vector<int>& acting,
@@ -245,6 +247,36 @@ private:
       for (int i = 0; i < row[3]; ++i) {
 	row[4 + size + i] = up[i];
       }
+      int32_t *raw_row = row + 4 + 2 * size;
+      raw_row[0] = std::min<int32_t>(raw.size(), size);
+      for (int i = 0; i < raw_row[0]; ++i) {
+	raw_row[1 + i] = raw[i];
+      }
+    }
+
+    /// true if any of osds is in the raw, up or acting set of ps
+    bool maps_to_any(size_t ps, const std::vector<bool>& osds) const {
+      const int32_t *row = &table[row_size() * ps];
+      auto in = [&](int32_t osd) {
+	return osd >= 0 && (size_t)osd < osds.size() && osds[osd];
+      };
+      for (int i = 0; i < row[2]; ++i) {
+	if (in(row[4 + i])) {
+	  return true;
+	}
+      }
+      for (int i = 0; i < row[3]; ++i) {
+	if (in(row[4 + size + i])) {
+	  return true;
+	}
+      }
+      const int32_t *raw_row = row + 4 + 2 * size;
+      for (int i = 0; i < raw_row[0]; ++i) {
+	if (in(raw_row[1 + i])) {
+	  return true;
+	}
+      }
+      return false;
     }
   };
 
@@ -254,16 +286,27 @@ private:
   //unused: mempool::osdmap_mapping::vector<std::vector<pg_t>> up_rmap;  // osd -> pg
   epoch_t epoch = 0;
   uint64_t num_pgs = 0;
+  /// false while an update is in progress or after one was aborted
+  bool valid = false;
+  /// osd weights as of epoch, to tell weight increases from decreases
+  mempool::osdmap_mapping::vector<uint32_t> osd_weight;
 
   void _init_mappings(const OSDMap& osdmap);
   void _update_range(
     const OSDMap& map,
     int64_t pool,
     unsigned pg_begin, unsigned pg_end);
+  void _update_pgs(const OSDMap& map, const std::vector<pg_t>& pgs);
+
+  bool _start_incremental(
+    const OSDMap& osdmap,
+    const std::vector<OSDMap::Incremental>& incs,
+    std::vector<pg_t> *pgs);
 
   void _build_rmap(const OSDMap& osdmap);
 
   void _start(const OSDMap& osdmap) {
+    valid = false;
     _init_mappings(osdmap);
   }
   void _finish(const OSDMap& osdmap);
@@ -275,10 +318,10 @@ private:
   struct MappingJob : public ParallelPGMapper::Job {
     OSDMapMapping *mapping;
     MappingJob(const OSDMap *osdmap, OSDMapMapping *m)
-      : Job(osdmap), mapping(m) {
-      mapping->_start(*osdmap);
+      : Job(osdmap), mapping(m) {}
+    void process(const std::vector<pg_t>& pgs) override {
+      mapping->_update_pgs(*osdmap, pgs);
     }
-    void process(const std::vector<pg_t>& pgs) override {}
     void process(int64_t pool, unsigned ps_begin, unsigned ps_end) override {
       mapping->_update_range(*osdmap, pool, ps_begin, ps_end);
     }
@@ -328,15 +371,30 @@ public:
 
   void update(const OSDMap& map);
   void update(const OSDMap& map, pg_t pgid);
+  /**
+   * bring the mapping up to map, given the incrementals between the
+   * mapped epoch and map, by remapping only the pgs they may have
+   * moved.  falls back to a full update if the incrementals don't
+   * start from the mapped epoch or change CRUSH or max_osd.
+   */
+  void update(const OSDMap& map,
+	      const std::vector<OSDMap::Incremental>& incs);
 
   std::unique_ptr<MappingJob> start_update(
     const OSDMap& map,
     ParallelPGMapper& mapper,
     unsigned pgs_per_item) {
+    _start(map);
     std::unique_ptr<MappingJob> job(new MappingJob(&map, this));
     mapper.queue(job.get(), pgs_per_item, {});
     return job;
   }
+  /// like update(map, incs), in the background
+  std::unique_ptr<MappingJob> start_update(
+    const OSDMap& map,
+    ParallelPGMapper& mapper,
+    unsigned pgs_per_item,
+    const std::vector<OSDMap::Incremental>& incs);
 
   epoch_t get_epoch() const {
     return epoch;
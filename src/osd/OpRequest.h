@@ -66,6 +66,7 @@ private:
   entity_inst_t req_src_inst;
   uint8_t hit_flag_points;
   uint8_t latest_flag_point;
+  utime_t queued_time;
   utime_t dequeued_time;
   static const uint8_t flag_queued_for_pg=1 << 0;
   static const uint8_t flag_reached_pg =  1 << 1;
@@ -154,6 +155,12 @@ public:
     mark_flag_point(flag_commit_sent, "commit_sent");
   }
 
+  utime_t get_queued_time() const {
+    return queued_time;
+  }
+  void set_queued_time(utime_t q_time) {
+    queued_time = q_time;
+  }
   utime_t get_dequeued_time() const {
     return dequeued_time;
   }
@@ -230,6 +230,10 @@ PG::PG(OSDService *o, OSDMapRef curmap,
   ss << "PG " << info.pgid;
   trace_endpoint.copy_name(ss.str());
 #endif
+  recovery_state.set_pg_log_reader(
+    [this](const set<string>& keys, map<string,bufferlist>* out) {
+      return osd->store->omap_get_values(ch, pgmeta_oid, keys, out);
+    });
 }
 
 PG::~PG()
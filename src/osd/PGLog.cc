@@ -18,6 +18,7 @@
 #include "PGLog.h"
 #include "include/unordered_map.h"
 #include "common/ceph_context.h"
+#include "common/errno.h"
 
 using std::make_pair;
 using std::map;
@@ -53,6 +54,31 @@ void PGLog::IndexedLog::split_out_child(
   reset_rollback_info_trimmed_to_riter();
 }
 
+void PGLog::IndexedLog::add_dups(
+  mempool::osd_pglog::list<pg_log_dup_t> *to,
+  const pg_log_entry_t &e)
+{
+  to->push_back(pg_log_dup_t(e));
+  index(to->back());
+  uint32_t idx = 0;
+  for (const auto& extra : e.extra_reqids) {
+    int return_code = e.return_code;
+    if (return_code >= 0) {
+      auto it = e.extra_reqid_return_codes.find(idx);
+      if (it != e.extra_reqid_return_codes.end()) {
+	return_code = it->second;
+	// FIXME: we aren't setting op_returns for these extra_reqids
+      }
+    }
+    ++idx;
+
+    // note: extras have the same version as outer op
+    to->push_back(pg_log_dup_t(e.version, extra.second,
+			       extra.first, return_code));
+    index(to->back());
+  }
+}
+
 void PGLog::IndexedLog::trim(
   CephContext* cct,
   eversion_t s,
@@ -70,6 +96,30 @@ void PGLog::IndexedLog::trim(
     : log.rbegin()->version.version - cct->_conf->osd_pg_log_dups_tracked + 1;
 
   lgeneric_subdout(cct, osd, 20) << "earliest_dup_version = " << earliest_dup_version << dendl;
+
+  // paged out entries are older than anything in log, their dup records
+  // are all that is left of them
+  while (!paged.empty()) {
+    const auto v = paged.front().version;
+    if (v > s)
+      break;
+    lgeneric_subdout(cct, osd, 20) << "trim paged " << paged.front() << dendl;
+    if (trimmed)
+      trimmed->emplace(v);
+    if (v.version >= earliest_dup_version) {
+      if (write_from_dups != nullptr && *write_from_dups > v) {
+	lgeneric_subdout(cct, osd, 20) << "updating write_from_dups from " << *write_from_dups << " to " << v << dendl;
+	*write_from_dups = v;
+      }
+      dups.splice(dups.end(), paged, paged.begin());
+    } else {
+      unindex(paged.front());
+      paged.pop_front();
+    }
+    if (paged.empty() || paged.front().version != v)
+      --num_paged;
+  }
+
   while (!log.empty()) {
     const pg_log_entry_t &e = *log.begin();
     if (e.version > s)
@@ -86,25 +136,7 @@ void PGLog::IndexedLog::trim(
 	lgeneric_subdout(cct, osd, 20) << "updating write_from_dups from " << *write_from_dups << " to " << e.version << dendl;
 	*write_from_dups = e.version;
       }
-      dups.push_back(pg_log_dup_t(e));
-      index(dups.back());
-      uint32_t idx = 0;
-      for (const auto& extra : e.extra_reqids) {
-	int return_code = e.return_code;
-	if (return_code >= 0) {
-	  auto it = e.extra_reqid_return_codes.find(idx);
-	  if (it != e.extra_reqid_return_codes.end()) {
-	    return_code = it->second;
-	    // FIXME: we aren't setting op_returns for these extra_reqids
-	  }
-	}
-	++idx;
-
-	// note: extras have the same version as outer op
-	dups.push_back(pg_log_dup_t(e.version, extra.second,
-				    extra.first, return_code));
-	index(dups.back());
-      }
+      add_dups(&dups, e);
     }
 
     bool reset_complete_to = false;
@@ -161,6 +193,10 @@ ostream& PGLog::IndexedLog::print(ostream& out) const
     out << *p << std::endl;
   }
 
+  for (auto p = paged.begin(); p != paged.end(); ++p) {
+    out << "paged " << *p << std::endl;
+  }
+
   return out;
 }
 
@@ -178,6 +214,91 @@ void PGLog::clear() {
   undirty();
 }
 
+int PGLog::page_in(eversion_t from)
+{
+  if (log.paged.empty() || log.paged.back().version <= from)
+    return 0;
+  ceph_assert(log_reader);
+
+  set<string> keys;
+  log.for_each_version([&](const eversion_t &v) {
+    if (keys.size() == log.num_paged)
+      return false;
+    keys.insert(v.get_key_name());
+    return true;
+  });
+  map<string,bufferlist> values;
+  int r = 0;
+  // a short read is retried for the keys it missed before giving up
+  for (int attempt = 0; attempt < 3 && values.size() < keys.size(); ++attempt) {
+    set<string> to_read;
+    for (auto& key : keys) {
+      if (!values.count(key))
+	to_read.insert(key);
+    }
+    r = log_reader(to_read, &values);
+    if (r < 0) {
+      derr << __func__ << " reading " << to_read.size()
+	   << " paged out entries: " << cpp_strerror(r) << dendl;
+    }
+  }
+  if (values.size() != keys.size()) {
+    derr << __func__ << " got " << values.size() << " of " << keys.size()
+	 << " paged out entries, leaving them paged out" << dendl;
+    return r < 0 ? r : -EIO;
+  }
+
+  // keys sort by version
+  mempool::osd_pglog::list<pg_log_entry_t> entries;
+  try {
+    for (auto& [key, bl] : values) {
+      auto p = bl.cbegin();
+      entries.emplace_back();
+      entries.back().decode_with_checksum(p);
+    }
+  } catch (const ceph::buffer::error &e) {
+    derr << __func__ << " failed to decode paged out entry: " << e.what()
+	 << dendl;
+    return -EIO;
+  }
+  dout(10) << __func__ << " " << entries.size() << " entries ["
+	   << entries.front().version << "," << entries.back().version
+	   << "]" << dendl;
+  log.page_in(std::move(entries));
+  return 0;
+}
+
+void PGLog::page_in_or_abort(eversion_t from)
+{
+  // the callers rewrite, merge or hand out the log; going on without the
+  // paged out entries would corrupt it
+  if (page_in(from) < 0) {
+    ceph_abort_msg("unable to read back paged out pg log entries");
+  }
+}
+
+void PGLog::page_out(size_t keep, eversion_t bound)
+{
+  // the entries must be on disk, and stay there as they are
+  if (!log_reader || !keep ||
+      dirty_to != eversion_t() ||
+      log.complete_to != log.log.end() ||
+      !missing.get_items().empty()) {
+    return;
+  }
+  bound = std::min(bound, log.get_rollback_info_trimmed_to());
+  size_t n = log.page_out(keep, [&](const pg_log_entry_t &e) {
+    return e.version <= bound &&
+      e.version < dirty_from &&
+      e.version < writeout_from;
+  });
+  if (n) {
+    dout(10) << __func__ << " " << n << " entries up to " << bound
+	     << ", " << log.num_paged << " of " << log.get_num_entries()
+	     << " paged out" << dendl;
+  }
+}
+
 void PGLog::clear_info_log(
   spg_t pgid,
   ObjectStore::Transaction *t) {
@@ -326,6 +447,9 @@ void PGLog::rewind_divergent_log(eversion_t newhead,
   dout(10) << "rewind_divergent_log truncate divergent future " <<
     newhead << dendl;
 
+  // merging the divergent entries looks for prior versions of the objects
+  page_in_or_abort();
+
   // We need to preserve the original crt before it gets updated in rewind_from_head().
   // Later, in merge_object_divergent_entries(), we use it to check whether we can rollback
   // a divergent entry or not.
@@ -363,6 +487,8 @@ void PGLog::merge_log(pg_info_t &oinfo, pg_log_t&& olog, pg_shard_t fromosd,
   dout(10) << "merge_log " << olog << " from osd." << fromosd
            << " into " << log << dendl;
 
+  page_in_or_abort();
+
   // Check preconditions
 
   // If our log is empty, the incoming log needs to have not been trimmed.
@@ -590,9 +716,12 @@ bool PGLog::merge_log_dups(const pg_log_t& olog) {
 void PGLog::check() {
   if (!pg_log_debug)
     return;
-  if (log.log.size() != log_keys_debug.size()) {
-    derr << "log.log.size() != log_keys_debug.size()" << dendl;
+  if (log.get_num_entries() != log_keys_debug.size()) {
+    derr << "log.get_num_entries() != log_keys_debug.size()" << dendl;
     derr << "actual log:" << dendl;
+    for (auto i = log.paged.begin(); i != log.paged.end(); ++i) {
+      derr << "    paged " << *i << dendl;
+    }
     for (auto i = log.log.begin(); i != log.log.end(); ++i) {
       derr << "    " << *i << dendl;
     }
@@ -603,10 +732,11 @@ void PGLog::check() {
       derr << "    " << *i << dendl;
     }
   }
-  ceph_assert(log.log.size() == log_keys_debug.size());
-  for (auto i = log.log.begin(); i != log.log.end(); ++i) {
-    ceph_assert(log_keys_debug.count(i->get_key_name()));
-  }
+  ceph_assert(log.get_num_entries() == log_keys_debug.size());
+  log.for_each_version([this](const eversion_t &v) {
+    ceph_assert(log_keys_debug.count(v.get_key_name()));
+    return true;
+  });
 }
 
 // non-static
@@ -21,6 +21,7 @@
 #include "include/common_fwd.h"
 #include "osd_types.h"
 #include "os/ObjectStore.h"
+#include <functional>
 #include <list>
 
 #ifdef WITH_SEASTAR
@@ -140,6 +141,11 @@ struct PGLog : DoutPrefixProvider {
   };
   using LogEntryHandlerRef = std::unique_ptr<LogEntryHandler>;
 
+  /// reads the given pgmeta omap keys, used to page log entries back in
+  using LogReader = std::function<
+    int(const std::set<std::string>&,
+	std::map<std::string, ceph::buffer::list>*)>;
+
 public:
   /**
    * IndexLog - adds in-memory index of the log, by oid.
@@ -151,6 +157,11 @@ public:
     mutable ceph::unordered_multimap<osd_reqid_t,pg_log_entry_t*> extra_caller_ops;
     mutable ceph::unordered_map<osd_reqid_t,pg_log_dup_t*> dup_index;
 
+    // entries older than those in log which were paged out, kept as dups
+    // so that dup detection still sees them; see PGLog::page_out()
+    mempool::osd_pglog::list<pg_log_dup_t> paged;
+    size_t num_paged = 0;	// distinct versions in paged
+
     // recovery pointers
     std::list<pg_log_entry_t>::iterator complete_to; // not inclusive of referenced item
     version_t last_requested = 0;               // last object requested by primary
@@ -201,6 +212,10 @@ public:
 	++rollback_info_trimmed_to_riter;
     }
 
+    // adds the dup records trim() and page_out() replace an entry with
+    void add_dups(mempool::osd_pglog::list<pg_log_dup_t> *to,
+		  const pg_log_entry_t &e);
+
     // indexes objects, caller ops and extra caller ops
   public:
     IndexedLog() :
@@ -224,6 +239,8 @@ public:
 
     IndexedLog(const IndexedLog &rhs) :
       pg_log_t(rhs),
+      paged(rhs.paged),
+      num_paged(rhs.num_paged),
       complete_to(log.end()),
       last_requested(rhs.last_requested),
       indexed_data(0),
@@ -304,6 +321,8 @@ public:
 
       unindex();
       pg_log_t::clear();
+      paged.clear();
+      num_paged = 0;
       rollback_info_trimmed_to_riter = log.rbegin();
       reset_recovery_pointers();
     }
@@ -461,6 +480,9 @@ public:
 	for (auto& i : dups) {
 	  dup_index[i.reqid] = const_cast<pg_log_dup_t*>(&i);
 	}
+	for (auto& i : paged) {
+	  dup_index[i.reqid] = const_cast<pg_log_dup_t*>(&i);
+	}
       }
 
       constexpr __u16 any_log_entry_index =
@@ -637,6 +659,66 @@ public:
       std::set<std::string>* trimmed_dups,
       eversion_t *write_from_dups);
 
+    /// number of entries, paged out ones included
+    size_t get_num_entries() const {
+      return num_paged + log.size();
+    }
+
+    /// visit the versions of all entries, paged out ones included, oldest
+    /// first, until f returns false
+    template <typename F>
+    void for_each_version(F &&f) const {
+      for (auto p = paged.begin(); p != paged.end(); ++p) {
+	if (p != paged.begin() && std::prev(p)->version == p->version)
+	  continue;	// extra reqids of the same entry
+	if (!f(p->version))
+	  return;
+      }
+      for (auto& e : log) {
+	if (!f(e.version))
+	  return;
+      }
+    }
+
+    /**
+     * page_out
+     *
+     * Replaces the oldest entries with their dup records while pred(entry)
+     * holds, keeping at least keep entries in log.  The caller guarantees
+     * the entries are on disk to be read back by page_in().
+     *
+     * @return the number of entries paged out
+     */
+    template <typename F>
+    size_t page_out(size_t keep, F &&pred) {
+      ceph_assert(complete_to == log.end());
+      size_t n = 0;
+      while (log.size() > keep && pred(log.front())) {
+	unindex(log.front());
+	add_dups(&paged, log.front());
+	log.pop_front();
+	++n;
+      }
+      if (n) {
+	num_paged += n;
+	reset_rollback_info_trimmed_to_riter();
+      }
+      return n;
+    }
+
+    /// put back all paged out entries, oldest first
+    void page_in(mempool::osd_pglog::list<pg_log_entry_t> &&entries) {
+      ceph_assert(entries.size() == num_paged);
+      ceph_assert(log.empty() || entries.back().version < log.front().version);
+      auto to_index = indexed_data;
+      unindex();
+      paged.clear();
+      num_paged = 0;
+      log.splice(log.begin(), entries);
+      index(to_index);
+      reset_rollback_info_trimmed_to_riter();
+    }
+
     std::ostream& print(std::ostream& out) const;
   }; // IndexedLog
 
@@ -662,6 +744,7 @@ protected:
   bool dirty_log;
   bool clear_divergent_priors;
   bool may_include_deletes_in_missing_dirty = false;
+  LogReader log_reader;	///< paging is disabled without one
 
   void mark_dirty_to(eversion_t to) {
     if (to > dirty_to)
@@ -703,6 +786,7 @@ public:
   }
 
   void mark_log_for_rewrite() {
+    page_in_or_abort();
     mark_dirty_to(eversion_t::max());
     mark_dirty_from(eversion_t());
     mark_dirty_to_dups(eversion_t::max());
@@ -765,6 +849,25 @@ public:
 
   void clear();
 
+  void set_log_reader(LogReader &&reader) {
+    log_reader = std::move(reader);
+  }
+
+  /// read back paged out entries if any is newer than from; on error
+  /// they stay paged out
+  int page_in(eversion_t from = eversion_t());
+  /// page_in() where the log is needed to go on
+  void page_in_or_abort(eversion_t from = eversion_t());
+
+  /**
+   * page_out
+   *
+   * Drops all but the newest keep entries <= bound from memory, leaving
+   * their dup records behind for dup detection.  Only done while nothing
+   * is missing and the entries on disk are not going to be rewritten.
+   */
+  void page_out(size_t keep, eversion_t bound);
+
   //////////////////// get or std::set missing ////////////////////
 
   const pg_missing_tracker_t& get_missing() const { return missing; }
@@ -851,6 +954,7 @@ public:
       pg_t child_pgid,
       unsigned split_bits,
       PGLog *opg_log) {
+    page_in_or_abort();
     log.split_out_child(child_pgid, split_bits, &opg_log->log);
     missing.split_into(child_pgid, split_bits, &(opg_log->missing));
     opg_log->mark_dirty_to(eversion_t::max());
@@ -865,6 +969,10 @@ public:
   void merge_from(
     const std::vector<PGLog*>& sources,
     eversion_t last_update) {
+    page_in_or_abort();
+    for (auto s : sources) {
+      s->page_in_or_abort();
+    }
     unindex();
     missing.clear();
 
@@ -905,6 +1013,7 @@ public:
   void reset_complete_to(pg_info_t *info) {
     if (log.log.empty()) // caller is split_into()
       return;
+    page_in_or_abort();
     log.complete_to = log.log.begin();
     ceph_assert(log.complete_to != log.log.end());
     auto oldest_need = missing.get_oldest_need();
@@ -1394,7 +1503,7 @@ public:
     bool tolerate_divergent_missing_log,
     bool debug_verify_stored_missing = false
     ) {
-    return read_log_and_missing(
+    read_log_and_missing(
       store, ch, pgmeta_oid, info,
       log, missing, oss,
       tolerate_divergent_missing_log,
@@ -1402,6 +1511,10 @@ public:
       this,
       (pg_log_debug ? &log_keys_debug : nullptr),
       debug_verify_stored_missing);
+    if (cct && !clear_divergent_priors && !debug_verify_stored_missing) {
+      page_out(cct->_conf.get_val<uint64_t>("osd_pg_log_memory_entries"),
+	       info.last_complete);
+    }
   }
 
   template <typename missing_type>
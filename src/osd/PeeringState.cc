@@ -2821,13 +2821,15 @@ void PeeringState::activate(
       } else if (
 	pg_log.get_tail() > pi.last_update ||
 	pi.last_backfill == hobject_t() ||
-	(backfill_targets.count(*i) && pi.last_backfill.is_max())) {
-	/* ^ This last case covers a situation where a replica is not contiguous
+	(backfill_targets.count(*i) && pi.last_backfill.is_max()) ||
+	pg_log.page_in(pi.last_update) < 0) {
+	/* ^ The third case covers a situation where a replica is not contiguous
 	 * with the auth_log, but is contiguous with this replica.  Reshuffling
 	 * the active set to handle this would be tricky, so instead we just go
 	 * ahead and backfill it anyway.  This is probably preferrable in any
 	 * case since the replica in question would have to be significantly
-	 * behind.
+	 * behind.  The last one: the entries it lacks were paged out and can't
+	 * be read back, so the log doesn't reach it either.
 	 */
 	// backfill
 	pl->get_clog_debug() << info.pgid << " starting backfill to osd." << peer
@@ -2855,7 +2857,9 @@ void PeeringState::activate(
 	  get_osdmap_epoch(), pi,
 	  last_peering_reset /* epoch to create pg at */);
 
-	// send some recent log, so that op dup detection works well.
+	// send some recent log, so that op dup detection works well.  if
+	// the paged out entries can't be read back the newest ones will do.
+	(void)pg_log.page_in();
 	m->log.copy_up_to(cct, pg_log.get_log(),
 			  cct->_conf->osd_max_pg_log_entries);
 	m->info.log_tail = m->log.tail;
@@ -2869,7 +2873,7 @@ void PeeringState::activate(
 	  i->shard, pg_whoami.shard,
 	  get_osdmap_epoch(), info,
 	  last_peering_reset /* epoch to create pg at */);
-	// send new stuff to append to replicas log
+	// send new stuff to append to replicas log, paged in above
 	m->log.copy_after(cct, pg_log.get_log(), pi.last_update);
       }
 
@@ -3119,6 +3123,7 @@ void PeeringState::proc_replica_log(
   psdout(10) << "proc_replica_log for osd." << from << ": "
 	     << oinfo << " " << olog << " " << omissing << dendl;
 
+  pg_log.page_in_or_abort();
   pg_log.proc_replica_log(oinfo, olog, omissing, from);
 
   peer_info[from] = oinfo;
@@ -3161,6 +3166,11 @@ void PeeringState::fulfill_log(
     info, query_epoch);
   mlog->missing = pg_log.get_missing();
 
+  // Paged out entries must be read back: a log with a hole would be
+  // merged into the primary's master log, and not replying would leave
+  // the primary in GetLog.  If they can't be read, give up on this osd
+  // so that the pg peers without it.
+
   // primary -> other, when building master log
   if (query.type == pg_query_t::LOG) {
     psdout(10) << " sending info+missing+log since " << query.since
@@ -3170,12 +3180,16 @@ void PeeringState::fulfill_log(
 			     << query.since
 			     << " when my log.tail is " << pg_log.get_tail()
 			     << ", sending full log instead";
+      pg_log.page_in_or_abort();
       mlog->log = pg_log.get_log();           // primary should not have requested this!!
-    } else
+    } else {
+      pg_log.page_in_or_abort(query.since);
       mlog->log.copy_after(cct, pg_log.get_log(), query.since);
+    }
   }
   else if (query.type == pg_query_t::FULLLOG) {
     psdout(10) << " sending info+missing+full log" << dendl;
+    pg_log.page_in_or_abort();
     mlog->log = pg_log.get_log();
   }
 
@@ -4226,6 +4240,7 @@ void PeeringState::append_log(
   // update the local pg, pg log
   dirty_info = true;
   write_if_dirty(t);
+  page_out_log();
 
   if (!is_primary())
     min_last_complete_ondisk = mlcod;
@@ -4436,17 +4451,19 @@ void PeeringState::calc_trim_to()
         cct->_conf->osd_pg_log_trim_max >= cct->_conf->osd_pg_log_trim_min) {
       return;
     }
-    auto it = pg_log.get_log().log.begin();
     eversion_t new_trim_to;
-    for (size_t i = 0; i < num_to_trim; ++i) {
-      new_trim_to = it->version;
-      ++it;
+    size_t i = 0;
+    pg_log.get_log().for_each_version([&](const eversion_t &v) {
+      if (i++ == num_to_trim)
+        return false;
+      new_trim_to = v;
       if (new_trim_to > limit) {
         new_trim_to = limit;
         psdout(10) << "calc_trim_to trimming to min_last_complete_ondisk" << dendl;
-        break;
+        return false;
       }
-    }
+      return true;
+    });
     psdout(10) << "calc_trim_to " << pg_trim_to << " -> " << new_trim_to << dendl;
     pg_trim_to = new_trim_to;
     assert(pg_trim_to <= pg_log.get_head());
@@ -4477,23 +4494,22 @@ void PeeringState::calc_trim_to_aggressive()
 	cct->_conf->osd_pg_log_trim_max >= cct->_conf->osd_pg_log_trim_min) {
       return;
     }
-    auto it = pg_log.get_log().log.begin(); // oldest log entry
-    auto rit = pg_log.get_log().log.rbegin();
+    // positions counted from the oldest entry, paged out ones included
+    size_t num_entries = pg_log.get_log().get_num_entries();
+    size_t keep_pos = num_entries > target ? num_entries - target - 1 : num_entries;
+    size_t trim_pos = num_to_trim ? num_to_trim - 1 : 0;
     eversion_t by_n_to_keep; // start from tail
     eversion_t by_n_to_trim = eversion_t::max(); // start from head
-    for (size_t i = 0; it != pg_log.get_log().log.end(); ++it, ++rit) {
-      i++;
-      if (i > target && by_n_to_keep == eversion_t()) {
-        by_n_to_keep = rit->version;
+    size_t i = 0;
+    pg_log.get_log().for_each_version([&](const eversion_t &v) {
+      if (i == keep_pos) {
+        by_n_to_keep = v;
       }
-      if (i >= num_to_trim && by_n_to_trim == eversion_t::max()) {
-        by_n_to_trim = it->version;
+      if (i == trim_pos) {
+        by_n_to_trim = v;
       }
-      if (by_n_to_keep != eversion_t() &&
-          by_n_to_trim != eversion_t::max()) {
-        break;
-      }
-    }
+      return ++i <= std::max(keep_pos, trim_pos);
+    });
 
     if (by_n_to_keep == eversion_t()) {
       return;
@@ -4505,6 +4521,15 @@ void PeeringState::calc_trim_to_aggressive()
   }
 }
 
+void PeeringState::page_out_log()
+{
+  auto keep = cct->_conf.get_val<uint64_t>("osd_pg_log_memory_entries");
+  if (keep && is_active()) {
+    // only what is known to be on disk
+    pg_log.page_out(keep, std::min(info.last_complete, last_complete_ondisk));
+  }
+}
+
 void PeeringState::apply_op_stats(
   const hobject_t &soid,
   const object_stat_sum_t &delta_stats)
@@ -5878,6 +5903,7 @@ PeeringState::Clean::Clean(my_context ctx)
 
 
   ps->try_mark_clean();
+  ps->page_out_log();
 
   context< PeeringMachine >().get_cur_transaction().register_on_commit(
     pl->on_clean());
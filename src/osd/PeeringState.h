@@ -1689,6 +1689,7 @@ public:
 
   void calc_trim_to();
   void calc_trim_to_aggressive();
+  void page_out_log();
 
 public:
   PeeringState(
@@ -2215,6 +2216,10 @@ public:
     return pg_log;
   }
 
+  void set_pg_log_reader(PGLog::LogReader &&reader) {
+    pg_log.set_log_reader(std::move(reader));
+  }
+
   bool state_test(uint64_t m) const { return (state & m) != 0; }
   void state_set(uint64_t m) { state |= m; }
   void state_clear(uint64_t m) { state &= ~m; }
@@ -125,6 +125,9 @@ PerfCounters *build_osd_logger(CephContext *cct) {
     "Latency of IO before calling queue(before really queue into ShardedOpWq)"); // client io before queue op_wq latency
   osd_plb.add_time_avg(l_osd_op_before_dequeue_op_lat, "op_before_dequeue_op_lat",
     "Latency of IO before calling dequeue_op(already dequeued and get PG lock)"); // client io before dequeue_op latency
+  osd_plb.add_time_avg(l_osd_op_queue_lat, "op_queue_lat",
+    "Latency of IO between being queued for its PG and dequeued by the op shard",
+    nullptr, PerfCountersBuilder::PRIO_USEFUL);
 
   osd_plb.add_u64_counter(
     l_osd_sop, "subop", "Suboperations");
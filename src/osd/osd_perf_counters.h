@@ -38,6 +38,7 @@ enum {
 
   l_osd_op_before_queue_op_lat,
   l_osd_op_before_dequeue_op_lat,
+  l_osd_op_queue_lat,
 
   l_osd_sop,
   l_osd_sop_inb,
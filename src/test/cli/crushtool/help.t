@@ -121,6 +121,8 @@
      --set-subtree-class <bucket-name> <class>
                            set class for all items beneath bucket-name
      --compare <otherfile> compare two maps using --test parameters
+     --benchmark           report mappings/sec, one at a time and
+                           batched, using --test parameters
   
   Options for the output stage
   
@@ -33,6 +33,7 @@
 #include "include/utime.h"
 #include "erasure-code/ErasureCodePlugin.h"
 #include "erasure-code/ErasureCode.h"
+#include "osd/ECUtil.h"
 #include "ceph_erasure_code_benchmark.h"
 
 namespace po = boost::program_options;
@@ -50,7 +51,8 @@ int ErasureCodeBench::setup(int argc, char** argv) {
     ("plugin,p", po::value<string>()->default_value("jerasure"),
      "erasure code plugin name")
     ("workload,w", po::value<string>()->default_value("encode"),
-     "run either encode or decode")
+     "run either encode, decode or overwrite (parity delta update of "
+     "the first data chunk)")
     ("erasures,e", po::value<int>()->default_value(1),
      "number of erasures when decoding")
     ("erased", po::value<vector<int> >(),
@@ -149,6 +151,8 @@ int ErasureCodeBench::run() {
 
   if (workload == "encode")
     return encode();
+  else if (workload == "overwrite")
+    return overwrite();
   else
     return decode();
 }
@@ -185,6 +189,57 @@ int ErasureCodeBench::encode()
   return 0;
 }
 
+int ErasureCodeBench::overwrite()
+{
+  ErasureCodePluginRegistry &instance = ErasureCodePluginRegistry::instance();
+  ErasureCodeInterfaceRef erasure_code;
+  stringstream messages;
+  int code = instance.factory(plugin,
+			      g_conf().get_val<std::string>("erasure_code_dir"),
+			      profile, &erasure_code, &messages);
+  if (code) {
+    cerr << messages.str() << endl;
+    return code;
+  }
+  if (!(erasure_code->get_supported_optimizations() &
+	ErasureCodeInterface::FLAG_EC_PLUGIN_PARITY_DELTA_OPTIMIZATION)) {
+    cerr << plugin << " does not support parity delta updates" << endl;
+    return -EOPNOTSUPP;
+  }
+
+  unsigned chunk_size = erasure_code->get_chunk_size(in_size);
+  ECUtil::stripe_info_t sinfo(k, k * chunk_size);
+  bufferlist in;
+  in.append(string(sinfo.get_stripe_width(), 'X'));
+  in.rebuild_aligned(ErasureCode::SIMD_ALIGN);
+  set<int> want_to_encode;
+  for (int i = 0; i < k + m; i++) {
+    want_to_encode.insert(i);
+  }
+  map<int,bufferlist> encoded;
+  code = erasure_code->encode(want_to_encode, in, &encoded);
+  if (code)
+    return code;
+
+  map<int,bufferlist> old_data, new_data, parity;
+  old_data[0] = encoded[0];
+  new_data[0].append(string(chunk_size, 'Y'));
+  for (int i = k; i < k + m; i++) {
+    parity[i] = encoded[i];
+  }
+  utime_t begin_time = ceph_clock_now();
+  for (int i = 0; i < max_iterations; i++) {
+    map<int,bufferlist> updated = parity;
+    code = ECUtil::encode_parity_delta(
+      sinfo, erasure_code, old_data, new_data, &updated);
+    if (code)
+      return code;
+  }
+  utime_t end_time = ceph_clock_now();
+  cout << (end_time - begin_time) << "\t" << (max_iterations * (in_size / 1024)) << endl;
+  return 0;
+}
+
 static void display_chunks(const map<int,bufferlist> &chunks,
 			   unsigned int chunk_count) {
   cout << "chunks ";
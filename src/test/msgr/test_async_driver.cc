@@ -272,6 +272,72 @@ TEST(EventCenterTest, FileEventExpansion) {
 }
 
 
+class ReadEvent : public EventCallback {
+ public:
+  unsigned count = 0;
+  void do_request(uint64_t fd) override {
+    char buf[16];
+    while (::read(fd, buf, sizeof(buf)) > 0) ;
+    count++;
+  }
+};
+
+TEST(EventCenterTest, BusyPoll) {
+  g_ceph_context->_conf.set_val_or_die("ms_async_busy_poll_us", "1000");
+  EventCenter center(g_ceph_context);
+  center.init(100, 0, "posix");
+  center.set_owner();
+  g_ceph_context->_conf.set_val_or_die("ms_async_busy_poll_us", "0");
+
+  int fds[2];
+  ASSERT_EQ(0, ::pipe(fds));
+  ASSERT_EQ(0, ::fcntl(fds[0], F_SETFL, O_NONBLOCK));
+  auto e = new ReadEvent();
+  EventCallbackRef ref(e);
+  ASSERT_EQ(0, center.create_file_event(fds[0], EVENT_READABLE, ref));
+
+  // an event which is already there is found by polling, no sleeping
+  ASSERT_EQ(1, ::write(fds[1], "x", 1));
+  ceph::timespan dur;
+  ceph::timespan spin_dur = ceph::timespan::zero();
+  ceph::timespan idle_dur = ceph::timespan::zero();
+  ASSERT_EQ(1, center.process_events(1000000, &dur, &spin_dur, &idle_dur));
+  ASSERT_EQ(1u, e->count);
+  ASSERT_EQ(1u, center.get_busy_polls());
+  ASSERT_EQ(1u, center.get_busy_poll_hits());
+  ASSERT_EQ(1000u, center.get_busy_poll_us());
+  ASSERT_EQ(ceph::timespan::zero(), idle_dur);
+
+  // nothing comes within the polling budget, sleep for the rest; the
+  // budget for the next round halves
+  ASSERT_EQ(0, center.process_events(20000, &dur, &spin_dur, &idle_dur));
+  ASSERT_EQ(2u, center.get_busy_polls());
+  ASSERT_EQ(1u, center.get_busy_poll_hits());
+  ASSERT_EQ(500u, center.get_busy_poll_us());
+
+  // the budget doesn't shrink below 1/16 of the maximum
+  for (int i = 0; i < 8; i++) {
+    ASSERT_EQ(0, center.process_events(1000, &dur, &spin_dur, &idle_dur));
+  }
+  ASSERT_EQ(10u, center.get_busy_polls());
+  ASSERT_EQ(62u, center.get_busy_poll_us());
+
+  // and grows back once polling finds events again
+  ASSERT_EQ(1, ::write(fds[1], "x", 1));
+  ASSERT_EQ(1, center.process_events(1000000, &dur, &spin_dur, &idle_dur));
+  ASSERT_EQ(2u, e->count);
+  ASSERT_EQ(2u, center.get_busy_poll_hits());
+  ASSERT_EQ(124u, center.get_busy_poll_us());
+
+  // a non-blocking round doesn't poll
+  ASSERT_EQ(0, center.process_events(0, &dur, &spin_dur, &idle_dur));
+  ASSERT_EQ(11u, center.get_busy_polls());
+
+  center.delete_file_event(fds[0], EVENT_READABLE);
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
 class Worker : public Thread {
   CephContext *cct;
   bool done;
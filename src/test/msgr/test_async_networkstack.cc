@@ -1045,6 +1045,109 @@ class StressFactory {
   }
 };
 
+static double thread_cpu_seconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/*
+ * Send 1 GiB in 4 MiB chunks over loopback and report throughput and CPU
+ * time with and without MSG_ZEROCOPY.  Note that the kernel copies data
+ * sent with MSG_ZEROCOPY over loopback anyway, run it between two hosts
+ * for meaningful numbers.
+ */
+TEST_P(NetworkWorkerTest, ZeroCopyThroughputBench) {
+  if (strcmp(GetParam(), "posix")) {
+    return;
+  }
+  entity_addr_t bind_addr;
+  ASSERT_TRUE(bind_addr.parse(get_addr().c_str()));
+  for (const char *zerocopy_min_size : {"0", "65536"}) {
+    g_ceph_context->_conf.set_val_or_die("ms_tcp_zerocopy_min_size",
+					 zerocopy_min_size);
+    exec_events([bind_addr, zerocopy_min_size](Worker *worker) mutable {
+      if (worker->id != 0) {
+	return;
+      }
+      EventCenter *center = &worker->center;
+      SocketOptions options;
+      ServerSocket bind_socket;
+      ConnectedSocket cli_socket, srv_socket;
+      entity_addr_t cli_addr;
+      ASSERT_EQ(0, worker->listen(bind_addr, 0, options, &bind_socket));
+      ASSERT_EQ(0, worker->connect(bind_addr, options, &cli_socket));
+      {
+	C_poll cb(center);
+	center->create_file_event(bind_socket.fd(), EVENT_READABLE, &cb);
+	ASSERT_TRUE(cb.poll(500));
+	center->delete_file_event(bind_socket.fd(), EVENT_READABLE);
+      }
+      ASSERT_EQ(0, bind_socket.accept(&srv_socket, options, &cli_addr, worker));
+      {
+	C_poll cb(center);
+	center->create_file_event(cli_socket.fd(), EVENT_READABLE, &cb);
+	int r = cli_socket.is_connected();
+	if (r == 0) {
+	  ASSERT_TRUE(cb.poll(500));
+	  r = cli_socket.is_connected();
+	}
+	ASSERT_EQ(1, r);
+	center->delete_file_event(cli_socket.fd(), EVENT_READABLE);
+      }
+
+      const size_t chunk = 4 << 20;
+      const uint64_t total = 1ull << 30;
+      bufferptr data = buffer::create_page_aligned(chunk);
+      memset(data.c_str(), 'z', chunk);
+      std::vector<char> buf(1 << 20);
+      bufferlist pending;
+      uint64_t sent = 0, received = 0;
+      PerfCounters *logger = worker->get_perf_counter();
+      uint64_t zc_bytes = logger->get(l_msgr_send_zerocopy_bytes);
+      uint64_t zc_copied = logger->get(l_msgr_send_zerocopy_copied_bytes);
+      uint64_t zc_fallback = logger->get(l_msgr_send_zerocopy_fallback_bytes);
+
+      auto start = ceph::mono_clock::now();
+      double cpu_start = thread_cpu_seconds();
+      while (received < total) {
+	if (pending.length() == 0 && sent < total) {
+	  pending.append(data);
+	}
+	if (pending.length()) {
+	  ssize_t r = cli_socket.send(pending, false);
+	  ASSERT_GE(r, 0);
+	  sent += r;
+	}
+	ssize_t r = srv_socket.read(buf.data(), buf.size());
+	if (r == -EAGAIN) {
+	  continue;
+	}
+	ASSERT_GT(r, 0);
+	ASSERT_EQ('z', buf[r - 1]);
+	received += r;
+      }
+      double cpu = thread_cpu_seconds() - cpu_start;
+      double secs = std::chrono::duration<double>(
+	ceph::mono_clock::now() - start).count();
+      std::cout << "ms_tcp_zerocopy_min_size " << zerocopy_min_size << ": "
+		<< (total >> 20) / secs << " MB/s, "
+		<< cpu / (total >> 30) << " cpu s/GB, "
+		<< (logger->get(l_msgr_send_zerocopy_bytes) - zc_bytes)
+		<< " bytes zerocopy, "
+		<< (logger->get(l_msgr_send_zerocopy_copied_bytes) - zc_copied)
+		<< " bytes copied by the kernel, "
+		<< (logger->get(l_msgr_send_zerocopy_fallback_bytes) - zc_fallback)
+		<< " bytes copied on ENOBUFS" << std::endl;
+      cli_socket.close();
+      srv_socket.close();
+      bind_socket.abort_accept();
+    });
+  }
+  g_ceph_context->_conf.set_val_or_die("ms_tcp_zerocopy_min_size", "0");
+}
+
 TEST_P(NetworkWorkerTest, StressTest) {
   StressFactory factory(stack, get_addr(), 16, 16, 10000, 1024);
   StressFactory *f = &factory;
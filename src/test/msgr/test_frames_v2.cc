@@ -21,6 +21,7 @@
 
 #include "auth/Auth.h"
 #include "common/ceph_argparse.h"
+#include "compressor/Compressor.h"
 #include "global/global_init.h"
 #include "global/global_context.h"
 #include "include/Context.h"
@@ -434,6 +435,142 @@ INSTANTIATE_TEST_SUITE_P(
         ::testing::ValuesIn(round_trip_perf_instances),
         ::testing::ValuesIn(modes)));
 
+class CompressionTest : public ::testing::TestWithParam<mode_t> {
+protected:
+  CompressionTest()
+      : m_tx_frame_asm(&m_tx_crypto, GetParam().is_rev1, &m_tx_compression),
+        m_rx_frame_asm(&m_rx_crypto, GetParam().is_rev1, &m_rx_compression) {
+    if (GetParam().is_secure) {
+      AuthConnectionMeta auth_meta;
+      auth_meta.con_mode = CEPH_CON_MODE_SECURE;
+      auth_meta.connection_secret.resize(64);
+      g_ceph_context->random()->get_bytes(auth_meta.connection_secret.data(),
+                                          auth_meta.connection_secret.size());
+      m_tx_crypto = ceph::crypto::onwire::rxtx_t::create_handler_pair(
+          g_ceph_context, auth_meta, GetParam().is_rev1, /*crossed=*/false);
+      m_rx_crypto = ceph::crypto::onwire::rxtx_t::create_handler_pair(
+          g_ceph_context, auth_meta, GetParam().is_rev1, /*crossed=*/true);
+    }
+  }
+
+  bool enable_compression() {
+    m_tx_compression = ceph::compression::onwire::rxtx_t::create_handler_pair(
+        g_ceph_context, Compressor::COMP_ALG_SNAPPY, 1024);
+    m_rx_compression = ceph::compression::onwire::rxtx_t::create_handler_pair(
+        g_ceph_context, Compressor::COMP_ALG_SNAPPY, 1024);
+    return m_tx_compression.tx && m_rx_compression.rx;
+  }
+
+  ceph::crypto::onwire::rxtx_t m_tx_crypto;
+  ceph::crypto::onwire::rxtx_t m_rx_crypto;
+  ceph::compression::onwire::rxtx_t m_tx_compression;
+  ceph::compression::onwire::rxtx_t m_rx_compression;
+  FrameAssembler m_tx_frame_asm;
+  FrameAssembler m_rx_frame_asm;
+};
+
+TEST_P(CompressionTest, RoundTrip) {
+  if (!enable_compression()) {
+    GTEST_SKIP() << "snappy compressor not available";
+  }
+  // small, incompressible, compressible
+  const auto header = make_bufferlist(41, 'H');
+  bufferlist front;
+  {
+    std::string s(4096, 0);
+    g_ceph_context->random()->get_bytes(s.data(), s.size());
+    front.append(s);
+  }
+  const auto data = make_bufferlist(65536, 'D');
+
+  for (int i = 0; i < 3; i++) {
+    auto tx_frame = TestFrame::Encode(header, front, {}, data);
+    auto onwire_bl = tx_frame.get_buffer(m_tx_frame_asm);
+    ASSERT_EQ(4, m_tx_frame_asm.get_num_segments());
+    EXPECT_FALSE(m_tx_frame_asm.is_segment_compressed(0));
+    EXPECT_FALSE(m_tx_frame_asm.is_segment_compressed(1));
+    EXPECT_FALSE(m_tx_frame_asm.is_segment_compressed(2));
+    EXPECT_TRUE(m_tx_frame_asm.is_segment_compressed(3));
+    EXPECT_GT(data.length(), m_tx_frame_asm.get_segment_logical_len(3));
+    EXPECT_GT(header.length() + front.length() + data.length(),
+              onwire_bl.length());
+
+    Tag rx_tag;
+    segment_bls_t rx_segment_bls;
+    EXPECT_TRUE(disassemble_frame(m_rx_frame_asm, onwire_bl, rx_tag,
+                                  rx_segment_bls));
+    EXPECT_EQ(TestFrame::tag, rx_tag);
+    auto rx_frame = TestFrame::Decode(rx_segment_bls);
+    EXPECT_TRUE(header.contents_equal(rx_frame.header()));
+    EXPECT_TRUE(front.contents_equal(rx_frame.front()));
+    EXPECT_EQ(0, rx_frame.middle().length());
+    EXPECT_TRUE(data.contents_equal(rx_frame.data()));
+  }
+}
+
+TEST_P(CompressionTest, NotNegotiated) {
+  if (!enable_compression()) {
+    GTEST_SKIP() << "snappy compressor not available";
+  }
+  m_rx_compression.rx.reset();
+  auto tx_frame = TestFrame::Encode({}, {}, {},
+                                    make_bufferlist(65536, 'D'));
+  auto onwire_bl = tx_frame.get_buffer(m_tx_frame_asm);
+  Tag rx_tag;
+  segment_bls_t rx_segment_bls;
+  EXPECT_THROW(disassemble_frame(m_rx_frame_asm, onwire_bl, rx_tag,
+                                 rx_segment_bls),
+               FrameError);
+}
+
+INSTANTIATE_TEST_SUITE_P(CompressionTests, CompressionTest,
+                         ::testing::ValuesIn(modes));
+
+TEST(CompressionHandlerTest, OriginalLength) {
+  auto handlers = ceph::compression::onwire::rxtx_t::create_handler_pair(
+      g_ceph_context, Compressor::COMP_ALG_SNAPPY, 1024);
+  if (!handlers.tx || !handlers.rx) {
+    GTEST_SKIP() << "snappy compressor not available";
+  }
+  const auto data = make_bufferlist(65536, 'D');
+  auto compressed = data;
+  ASSERT_TRUE(handlers.tx->compress(compressed));
+
+  auto with_length = [&compressed](uint32_t raw_len) {
+    bufferlist bl, rest;
+    encode(raw_len, bl);
+    rest.substr_of(compressed, sizeof(raw_len),
+                   compressed.length() - sizeof(raw_len));
+    bl.append(rest);
+    return bl;
+  };
+  {
+    auto bl = with_length(data.length());
+    ASSERT_TRUE(handlers.rx->decompress(bl));
+    EXPECT_TRUE(data.contents_equal(bl));
+  }
+  // the announced length has to match exactly
+  {
+    auto bl = with_length(data.length() - 1);
+    EXPECT_FALSE(handlers.rx->decompress(bl));
+  }
+  {
+    auto bl = with_length(data.length() + 1);
+    EXPECT_FALSE(handlers.rx->decompress(bl));
+  }
+  // nothing larger than ms_osd_decompress_max_size is even allocated
+  {
+    auto bl = with_length(
+        g_conf().get_val<Option::size_t>("ms_osd_decompress_max_size") + 1);
+    EXPECT_FALSE(handlers.rx->decompress(bl));
+  }
+  {
+    bufferlist bl;
+    bl.append("ab", 2);
+    EXPECT_FALSE(handlers.rx->decompress(bl));
+  }
+}
+
 }  // namespace ceph::msgr::v2
 
 int main(int argc, char* argv[]) {
@@ -1057,6 +1057,104 @@ TEST_P(MessengerTest, SimpleMsgr2Test) {
   server_msgr->wait();
 }
 
+class RxBufferDispatcher : public FakeDispatcher {
+ public:
+  bool supply = true;
+  std::vector<ceph::bufferptr> supplied;
+  ceph::bufferlist received;
+
+  RxBufferDispatcher() : FakeDispatcher(true) {}
+
+  bool ms_get_rx_data_buffer(Connection *con, int type, uint64_t tid,
+                             uint32_t data_off, uint32_t data_len,
+                             ceph::bufferlist *bl) override {
+    if (!supply || type != CEPH_MSG_PING) {
+      return false;
+    }
+    // scattered over unevenly sized buffers, more than needed in total
+    supplied.clear();
+    for (uint32_t len : {data_len / 3, data_len / 2, data_len}) {
+      supplied.push_back(ceph::buffer::create(len));
+      bl->append(supplied.back());
+    }
+    return true;
+  }
+  void ms_fast_dispatch(Message *m) override {
+    {
+      std::lock_guard l{lock};
+      received = m->get_data();
+    }
+    FakeDispatcher::ms_fast_dispatch(m);
+  }
+};
+
+TEST_P(MessengerTest, RxDataBufferTest) {
+  FakeDispatcher cli_dispatcher(false);
+  RxBufferDispatcher srv_dispatcher;
+  entity_addr_t bind_addr;
+  bind_addr.parse("v2:127.0.0.1");
+  server_msgr->bind(bind_addr);
+  server_msgr->add_dispatcher_head(&srv_dispatcher);
+  server_msgr->start();
+
+  client_msgr->add_dispatcher_head(&cli_dispatcher);
+  client_msgr->start();
+
+  ConnectionRef conn = client_msgr->connect_to(
+    server_msgr->get_mytype(),
+    server_msgr->get_myaddrs());
+
+  ceph::bufferlist data;
+  for (int i = 0; i < 3 * CEPH_PAGE_SIZE + 100; i++) {
+    data.append(static_cast<char>(i % 251));
+  }
+
+  // 1. data is received into the buffers supplied by the dispatcher
+  {
+    MPing *m = new MPing();
+    m->set_data(data);
+    ASSERT_EQ(conn->send_message(m), 0);
+    std::unique_lock l{cli_dispatcher.lock};
+    cli_dispatcher.cond.wait(l, [&] { return cli_dispatcher.got_new; });
+    cli_dispatcher.got_new = false;
+  }
+  {
+    std::lock_guard l{srv_dispatcher.lock};
+    ASSERT_TRUE(srv_dispatcher.received.contents_equal(data));
+    ASSERT_EQ(3u, srv_dispatcher.received.get_num_buffers());
+    auto& supplied = srv_dispatcher.supplied;
+    auto p = srv_dispatcher.received.buffers().begin();
+    for (size_t i = 0; i < supplied.size(); i++, ++p) {
+      ASSERT_EQ(supplied[i].c_str(), p->c_str());
+    }
+    ASSERT_EQ(data.length() - supplied[0].length() - supplied[1].length(),
+              srv_dispatcher.received.back().length());
+  }
+
+  // 2. otherwise the data is laid out according to data_off
+  srv_dispatcher.supply = false;
+  {
+    MPing *m = new MPing();
+    m->set_data(data);
+    m->get_header().data_off = 512;
+    ASSERT_EQ(conn->send_message(m), 0);
+    std::unique_lock l{cli_dispatcher.lock};
+    cli_dispatcher.cond.wait(l, [&] { return cli_dispatcher.got_new; });
+    cli_dispatcher.got_new = false;
+  }
+  {
+    std::lock_guard l{srv_dispatcher.lock};
+    ASSERT_TRUE(srv_dispatcher.received.contents_equal(data));
+    ASSERT_EQ(512u, reinterpret_cast<uintptr_t>(
+      srv_dispatcher.received.front().c_str()) % CEPH_PAGE_SIZE);
+  }
+
+  client_msgr->shutdown();
+  client_msgr->wait();
+  server_msgr->shutdown();
+  server_msgr->wait();
+}
+
 TEST_P(MessengerTest, FeatureTest) {
   FakeDispatcher cli_dispatcher(false), srv_dispatcher(true);
   entity_addr_t bind_addr;
@@ -15,6 +15,7 @@
 #include "include/stringify.h"
 #include "include/Context.h"
 #include "os/bluestore/Allocator.h"
+#include "os/bluestore/MagazineAllocator.h"
 
 #include <boost/random/uniform_int.hpp>
 
@@ -155,8 +156,19 @@ void AllocTest::init_alloc(const std::string& allocator_name, int64_t size, uint
   this->capacity = size;
   this->alloc_unit = min_alloc_size;
   rng.seed(0);
-  alloc.reset(Allocator::create(g_ceph_context, allocator_name, size,
-				min_alloc_size));
+  // "<type>+magazine" puts per-thread magazines in front of <type>
+  const std::string magazine_suffix = "+magazine";
+  auto pos = allocator_name.rfind(magazine_suffix);
+  if (pos != std::string::npos &&
+      pos + magazine_suffix.size() == allocator_name.size()) {
+    alloc.reset(new MagazineAllocator(g_ceph_context,
+      Allocator::create(g_ceph_context, allocator_name.substr(0, pos), size,
+			min_alloc_size),
+      4, 64, ""));
+  } else {
+    alloc.reset(Allocator::create(g_ceph_context, allocator_name, size,
+				  min_alloc_size));
+  }
   at.reset(new AllocTracker());
 }
 
@@ -434,5 +446,6 @@ TEST_P(AllocTest, test_bonus_empty_fragmented)
 INSTANTIATE_TEST_CASE_P(
   Allocator,
   AllocTest,
-  ::testing::Values("stupid", "bitmap", "avl"));
+  ::testing::Values("stupid", "bitmap", "avl",
+		    "bitmap+magazine", "avl+magazine"));
 
@@ -4,7 +4,10 @@
  * In memory space allocator benchmarks.
  * Author: Igor Fedotov, ifedotov@suse.com
  */
+#include <atomic>
+#include <deque>
 #include <iostream>
+#include <thread>
 #include <boost/scoped_ptr.hpp>
 #include <gtest/gtest.h>
 
@@ -37,6 +40,7 @@ public:
   }
   void doOverwriteTest(uint64_t capacity, uint64_t prefill,
     uint64_t overwrite);
+  void doConcurrentTest(unsigned writers, unsigned batch, bool batched);
 };
 
 const uint64_t _1m = 1024 * 1024;
@@ -326,6 +330,98 @@ TEST_P(AllocTest, test_alloc_bench_10_300)
   doOverwriteTest(capacity, prefill, overwrite);
 }
 
+// Every writer keeps a window of its recent allocations and, per step,
+// releases the oldest 'batch' of them and allocates 'batch' new ones.
+// Either via individual allocate/release calls or via a single
+// allocate_batch call.
+void AllocTest::doConcurrentTest(unsigned writers, unsigned batch,
+  bool batched)
+{
+  uint64_t capacity = uint64_t(64) * 1024 * 1024 * 1024;
+  uint64_t alloc_unit = 4096;
+  const unsigned steps = 20000;
+  const unsigned window = 64;
+
+  init_alloc(capacity, alloc_unit);
+  alloc->init_add_free(0, capacity);
+
+  std::atomic<uint64_t> ops = {0};
+  auto writer = [&](unsigned id) {
+    gen_type rng(id);
+    boost::uniform_int<> u1(0, 4); // 4K-64K
+    std::deque<PExtentVector> inflight;
+    std::vector<Allocator::alloc_request_t> requests;
+    std::vector<PExtentVector> results(batch);
+    uint64_t local_ops = 0;
+    for (unsigned i = 0; i < steps; i++) {
+      interval_set<uint64_t> release_set;
+      while (inflight.size() >= window) {
+	for (unsigned j = 0; j < batch && !inflight.empty(); j++) {
+	  if (batched) {
+	    for (auto& e : inflight.front()) {
+	      release_set.insert(e.offset, e.length);
+	    }
+	  } else {
+	    alloc->release(inflight.front());
+	  }
+	  inflight.pop_front();
+	  ++local_ops;
+	}
+      }
+      requests.clear();
+      for (unsigned j = 0; j < batch; j++) {
+	results[j].clear();
+	uint64_t want = alloc_unit << u1(rng);
+	if (batched) {
+	  requests.emplace_back(want, alloc_unit, 0, 0, &results[j]);
+	} else {
+	  ASSERT_EQ(static_cast<int64_t>(want),
+		    alloc->allocate(want, alloc_unit, 0, 0, &results[j]));
+	}
+      }
+      if (batched) {
+	alloc->allocate_batch(&release_set, requests);
+	for (auto& r : requests) {
+	  ASSERT_EQ(static_cast<int64_t>(r.want), r.result);
+	}
+      }
+      for (auto& r : results) {
+	inflight.emplace_back(std::move(r));
+	++local_ops;
+      }
+    }
+    for (auto& e : inflight) {
+      alloc->release(e);
+    }
+    ops += local_ops;
+  };
+
+  utime_t start = ceph_clock_now();
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < writers; i++) {
+    threads.emplace_back(writer, i);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  double elapsed = ceph_clock_now() - start;
+  std::cout << (batched ? "batched" : "per-call")
+	    << " writers " << writers
+	    << " batch " << batch
+	    << " executed in " << elapsed
+	    << " ops/sec " << (uint64_t)(ops / elapsed) << std::endl;
+  EXPECT_EQ(capacity, alloc->get_free());
+  init_close();
+}
+
+TEST_P(AllocTest, test_alloc_bench_concurrent)
+{
+  for (unsigned writers : {16, 32}) {
+    doConcurrentTest(writers, 8, false);
+    doConcurrentTest(writers, 8, true);
+  }
+}
+
 TEST_P(AllocTest, mempoolAccounting)
 {
   uint64_t bytes = mempool::bluestore_alloc::allocated_bytes();
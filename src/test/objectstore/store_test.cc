@@ -6815,6 +6815,97 @@ TEST_P(StoreTestSpecificAUSize, OnodeSizeTracking) {
   }
 }
 
+// memory held by cached onode metadata, extent maps and blobs
+uint64_t get_onode_meta_bytes()
+{
+  return mempool::bluestore_cache_meta::allocated_bytes() +
+    mempool::bluestore_cache_onode::allocated_bytes() +
+    mempool::bluestore_cache_other::allocated_bytes() +
+    mempool::bluestore_Extent::allocated_bytes() +
+    mempool::bluestore_Blob::allocated_bytes() +
+    mempool::bluestore_SharedBlob::allocated_bytes() +
+    mempool::bluestore_inline_bl::allocated_bytes();
+}
+
+TEST_P(StoreTestSpecificAUSize, OnodeSizeFragmented) {
+
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  size_t block_size = 4096;
+  StartDeferred(block_size);
+  SetVal(g_conf(), "bluestore_compression_mode", "none");
+  SetVal(g_conf(), "bluestore_cache_size_hdd", "400000000");
+  SetVal(g_conf(), "bluestore_cache_size_ssd", "400000000");
+  g_conf().apply_changes(nullptr);
+
+  int r;
+  coll_t cid;
+  ghobject_t hoid(hobject_t("test_fragmented", "", CEPH_NOSNAP, 0, -1, ""));
+  size_t obj_size = 4 * 1024 * 1024;
+  size_t overwrites = 0;
+
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  {
+    ObjectStore::Transaction t;
+    bufferlist bl;
+    bl.append(std::string(obj_size, 'a'));
+    t.write(cid, hoid, 0, bl.length(), bl);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // every other block overwritten separately, as small RBD writes do
+  for (size_t i = 0; i < obj_size; i += 2 * block_size) {
+    ObjectStore::Transaction t;
+    bufferlist bl;
+    bl.append(std::string(block_size, 'b'));
+    t.write(cid, hoid, i, bl.length(), bl);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+    ++overwrites;
+  }
+
+  // remount to get the onode decoded from disk rather than built up by
+  // the writes above
+  ch.reset();
+  EXPECT_EQ(store->umount(), 0);
+  EXPECT_EQ(store->mount(), 0);
+  ch = store->open_collection(cid);
+
+  uint64_t before = get_onode_meta_bytes();
+  uint64_t other_before = mempool::bluestore_cache_other::allocated_bytes();
+  {
+    bufferlist bl;
+    r = store->read(ch, hoid, 0, obj_size, bl);
+    ASSERT_EQ(r, (int)obj_size);
+  }
+  uint64_t after = get_onode_meta_bytes();
+  uint64_t other_after = mempool::bluestore_cache_other::allocated_bytes();
+  ASSERT_GT(after, before);
+  // the shard buffers blob checksums point into are accounted to
+  // bluestore_cache_other, once each
+  ASSERT_GT(other_after, other_before);
+  ASSERT_LT(other_after - other_before, after - before);
+  cout << "fragmented onode with " << overwrites << " overwrites: "
+       << (after - before) << " bytes, "
+       << (after - before) / overwrites << " bytes per overwrite"
+       << std::endl;
+
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
 TEST_P(StoreTestSpecificAUSize, BlobReuseOnOverwrite) {
 
   if (string(GetParam()) != "bluestore")
@@ -6988,6 +7079,141 @@ TEST_P(StoreTestSpecificAUSize, BlobReuseOnOverwrite) {
   }
 }
 
+TEST_P(StoreTestSpecificAUSize, ReadNoCopy) {
+
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  size_t block_size = 4096;
+  StartDeferred(block_size);
+  SetVal(g_conf(), "bluestore_compression_mode", "none");
+  g_conf().apply_changes(nullptr);
+
+  int r;
+  coll_t cid;
+  ghobject_t hoid(hobject_t("test", "", CEPH_NOSNAP, 0, -1, ""));
+  const PerfCounters* logger = store->get_perf_counters();
+  size_t obj_size = 1024 * 1024;
+
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  bufferlist expected;
+  expected.append(std::string(obj_size, 'a'));
+  {
+    ObjectStore::Transaction t;
+    bufferlist bl = expected;
+    t.write(cid, hoid, 0, bl.length(), bl, CEPH_OSD_OP_FLAG_FADVISE_NOCACHE);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  {
+    // a cached, unaligned buffer which the padded reads below overlap
+    size_t off = 15 * block_size + 100;
+    size_t len = 3 * block_size - 100;
+    ObjectStore::Transaction t;
+    bufferlist bl;
+    bl.append(std::string(len, 'b'));
+    t.write(cid, hoid, off, len, bl, CEPH_OSD_OP_FLAG_FADVISE_WILLNEED);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+    bufferlist e;
+    e.substr_of(expected, 0, off);
+    e.append(bl);
+    bufferlist tail;
+    tail.substr_of(expected, off + len, obj_size - off - len);
+    e.append(tail);
+    expected.swap(e);
+  }
+
+  uint64_t copied = logger->get(l_bluestore_read_copied_bytes);
+  {
+    bufferlist bl, e;
+    r = store->read(ch, hoid, 0, 16 * block_size, bl,
+		    CEPH_OSD_OP_FLAG_FADVISE_WILLNEED);
+    ASSERT_EQ(r, (int)(16 * block_size));
+    e.substr_of(expected, 0, 16 * block_size);
+    ASSERT_TRUE(bl_eq(e, bl));
+  }
+  {
+    bufferlist bl;
+    r = store->read(ch, hoid, 0, obj_size, bl,
+		    CEPH_OSD_OP_FLAG_FADVISE_WILLNEED);
+    ASSERT_EQ(r, (int)obj_size);
+    ASSERT_TRUE(bl_eq(expected, bl));
+  }
+  ASSERT_EQ(logger->get(l_bluestore_read_copied_bytes), copied);
+
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
+TEST_P(StoreTestSpecificAUSize, DeferredAdaptive) {
+
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  size_t block_size = 4096;
+  StartDeferred(block_size);
+  SetVal(g_conf(), "bluestore_prefer_deferred_size", "65536");
+  SetVal(g_conf(), "bluestore_deferred_adaptive_max_size", "131072");
+  SetVal(g_conf(), "bluestore_deferred_adaptive_interval", "0");
+  SetVal(g_conf(), "bluestore_deferred_adaptive", "true");
+  g_conf().apply_changes(nullptr);
+
+  int r;
+  coll_t cid;
+  ghobject_t hoid(hobject_t("test", "", CEPH_NOSNAP, 0, -1, ""));
+  const PerfCounters* logger = store->get_perf_counters();
+
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  for (unsigned i = 0; i < 32; ++i) {
+    ObjectStore::Transaction t;
+    bufferlist bl;
+    // alternate direct and small writes
+    size_t len = (i % 2) ? block_size : block_size * 64;
+    bl.append(std::string(len, 'a' + i % 26));
+    t.write(cid, hoid, i * block_size * 64, bl.length(), bl);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ASSERT_GT(logger->get(l_bluestore_deferred_tune_up) +
+	    logger->get(l_bluestore_deferred_tune_down) +
+	    logger->get(l_bluestore_deferred_tune_hold), 0u);
+  uint64_t size = logger->get(l_bluestore_prefer_deferred_size);
+  ASSERT_LE(size, 131072u);
+  ASSERT_EQ(size % block_size, 0u);
+  ASSERT_GT(logger->get(l_bluestore_deferred_batch_ops), 0u);
+
+  // back to the configured values once disabled
+  SetVal(g_conf(), "bluestore_deferred_adaptive", "false");
+  g_conf().apply_changes(nullptr);
+  ASSERT_EQ(logger->get(l_bluestore_prefer_deferred_size), 65536u);
+
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
 TEST_P(StoreTestSpecificAUSize, DeferredOnBigOverwrite) {
 
   if (string(GetParam()) != "bluestore")
@@ -7944,6 +8170,148 @@ TEST_P(StoreTest, KVDBStatsTest) {
 }
 
 #if defined(WITH_BLUESTORE)
+TEST_P(StoreTest, BluestoreAllocatorSnapshot) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  SetVal(g_conf(), "bluestore_allocator_snapshot", "true");
+  g_ceph_context->_conf.apply_changes(nullptr);
+
+  int NUM_OBJS = 200;
+  coll_t cid;
+  string base("testobj.");
+  bufferlist a;
+  bufferptr ap(0x10000);
+  memset(ap.c_str(), 'a', 0x10000);
+  a.append(ap);
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  for (int i = 0; i < NUM_OBJS; ++i) {
+    ObjectStore::Transaction t;
+    ghobject_t hoid(hobject_t(sobject_t(base + stringify(i), CEPH_NOSNAP)));
+    t.write(cid, hoid, 0, a.length(), a);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // punch some holes into allocated space
+  for (int i = 0; i < NUM_OBJS; i += 3) {
+    ObjectStore::Transaction t;
+    ghobject_t hoid(hobject_t(sobject_t(base + stringify(i), CEPH_NOSNAP)));
+    t.remove(cid, hoid);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  struct store_statfs_t statfs0;
+  ASSERT_EQ(store->statfs(&statfs0), 0);
+  ch.reset();
+
+  const PerfCounters* logger = store->get_perf_counters();
+  ASSERT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->fsck(false), 0);
+  ASSERT_EQ(store->mount(), 0);
+  ASSERT_EQ(logger->get(l_bluestore_alloc_init_from_snapshot), 1u);
+  struct store_statfs_t statfs1;
+  ASSERT_EQ(store->statfs(&statfs1), 0);
+  ASSERT_EQ(statfs0.available, statfs1.available);
+  ASSERT_EQ(statfs0.allocated, statfs1.allocated);
+
+  // snapshot is consumed by a writable mount, unclean shutdown
+  // has nothing to load from
+  SetVal(g_conf(), "bluestore_allocator_snapshot", "false");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  ASSERT_EQ(store->umount(), 0);
+  SetVal(g_conf(), "bluestore_allocator_snapshot", "true");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  ASSERT_EQ(store->mount(), 0);
+  ASSERT_EQ(logger->get(l_bluestore_alloc_init_from_snapshot), 0u);
+  struct store_statfs_t statfs2;
+  ASSERT_EQ(store->statfs(&statfs2), 0);
+  ASSERT_EQ(statfs0.available, statfs2.available);
+
+  // a snapshot taken at umount is stale once anything wrote to the kv
+  // store in between, e.g. a repair run
+  ASSERT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->repair(false), 0);
+  ASSERT_EQ(store->mount(), 0);
+  ASSERT_EQ(logger->get(l_bluestore_alloc_init_from_snapshot), 0u);
+  struct store_statfs_t statfs3;
+  ASSERT_EQ(store->statfs(&statfs3), 0);
+  ASSERT_EQ(statfs0.available, statfs3.available);
+
+  SetVal(g_conf(), "bluestore_allocator_snapshot", "false");
+  g_ceph_context->_conf.apply_changes(nullptr);
+}
+
+TEST_P(StoreTest, BluestoreAllocatorSnapshotAsyncDiscard) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  SetVal(g_conf(), "bluestore_allocator_snapshot", "true");
+  SetVal(g_conf(), "bdev_enable_discard", "true");
+  SetVal(g_conf(), "bdev_async_discard", "true");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  ASSERT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->mount(), 0);
+
+  int NUM_OBJS = 200;
+  coll_t cid;
+  string base("testobj.");
+  bufferlist a;
+  bufferptr ap(0x10000);
+  memset(ap.c_str(), 'a', 0x10000);
+  a.append(ap);
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  for (int i = 0; i < NUM_OBJS; ++i) {
+    ObjectStore::Transaction t;
+    ghobject_t hoid(hobject_t(sobject_t(base + stringify(i), CEPH_NOSNAP)));
+    t.write(cid, hoid, 0, a.length(), a);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // released extents go through the discard queue right before umount
+  for (int i = 0; i < NUM_OBJS; i += 2) {
+    ObjectStore::Transaction t;
+    ghobject_t hoid(hobject_t(sobject_t(base + stringify(i), CEPH_NOSNAP)));
+    t.remove(cid, hoid);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ch.reset();
+
+  const PerfCounters* logger = store->get_perf_counters();
+  ASSERT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->mount(), 0);
+  ASSERT_EQ(logger->get(l_bluestore_alloc_init_from_snapshot), 1u);
+  struct store_statfs_t statfs_snap;
+  ASSERT_EQ(store->statfs(&statfs_snap), 0);
+
+  // the freelist is the reference
+  SetVal(g_conf(), "bluestore_allocator_snapshot", "false");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  ASSERT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->mount(), 0);
+  ASSERT_EQ(logger->get(l_bluestore_alloc_init_from_snapshot), 0u);
+  struct store_statfs_t statfs_scan;
+  ASSERT_EQ(store->statfs(&statfs_scan), 0);
+  ASSERT_EQ(statfs_scan.available, statfs_snap.available);
+  ASSERT_EQ(statfs_scan.allocated, statfs_snap.allocated);
+
+  SetVal(g_conf(), "bdev_enable_discard", "false");
+  SetVal(g_conf(), "bdev_async_discard", "false");
+  g_ceph_context->_conf.apply_changes(nullptr);
+}
+
 TEST_P(StoreTestSpecificAUSize, garbageCollection) {
   int r;
   coll_t cid;
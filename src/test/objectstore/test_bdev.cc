@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <iostream>
+#include <random>
 #include <gtest/gtest.h>
 #include "global/global_init.h"
 #include "global/global_context.h"
@@ -13,6 +14,8 @@
 #include "common/errno.h"
 
 #include "blk/BlockDevice.h"
+#include "blk/kernel/io_uring.h"
+#include "blk/kernel/KernelDevice.h"
 
 class TempBdev {
 public:
@@ -89,6 +92,154 @@ TEST(KernelDevice, Ticket45337) {
   b->close();
 }
 
+static double bench_aio_read(const std::string& path, uint64_t size,
+			     unsigned io_size, unsigned iodepth,
+			     unsigned rounds)
+{
+  std::unique_ptr<BlockDevice> b(
+    BlockDevice::create(g_ceph_context, path, NULL, NULL,
+      [](void* handle, void* aio) {}, NULL));
+  int r = b->open(path);
+  if (r < 0) {
+    std::cerr << "open " << path << " failed" << std::endl;
+    return 0;
+  }
+  std::mt19937_64 rng(0);
+  uint64_t slots = size / io_size;
+  auto start = ceph::mono_clock::now();
+  for (unsigned i = 0; i < rounds; i++) {
+    IOContext ioc(g_ceph_context, NULL);
+    std::vector<bufferlist> bls(iodepth);
+    for (auto& bl : bls) {
+      r = b->aio_read((rng() % slots) * io_size, io_size, &bl, &ioc);
+      ceph_assert(r == 0);
+    }
+    if (ioc.has_pending_aios()) {
+      b->aio_submit(&ioc);
+      ioc.aio_wait();
+    }
+  }
+  double secs = std::chrono::duration<double>(
+    ceph::mono_clock::now() - start).count();
+  b->close();
+  return double(rounds) * iodepth / secs;
+}
+
+TEST(KernelDevice, ReadBench) {
+  // compares aio_read IOPS for libaio, io_uring and io_uring with
+  // registered (fixed) buffers
+  uint64_t size = 1048576ull * 256;
+  TempBdev bdev{ size };
+  const unsigned io_size = 65536;
+  const unsigned iodepth = 32;
+  const unsigned rounds = 500;
+
+  struct mode_t {
+    const char *name;
+    const char *ioring;
+    const char *fixed_buffers;
+  };
+  std::vector<mode_t> modes = {{"libaio", "false", "0"}};
+  if (ioring_queue_t::supported()) {
+    modes.push_back({"io_uring", "true", "0"});
+    modes.push_back({"io_uring fixed buffers", "true", "64"});
+  }
+  auto& conf = g_ceph_context->_conf;
+  for (auto& m : modes) {
+    conf.set_val("bdev_ioring", m.ioring);
+    conf.set_val("bdev_ioring_fixed_buffers", m.fixed_buffers);
+    conf.set_val("bdev_ioring_fixed_buffer_size", stringify(io_size));
+    conf.apply_changes(nullptr);
+    double iops = bench_aio_read(bdev.path, size, io_size, iodepth, rounds);
+    std::cout << m.name << ": " << iops << " IOPS ("
+	      << iops * io_size / 1048576 << " MB/s)" << std::endl;
+    ASSERT_GT(iops, 0);
+  }
+  conf.set_val("bdev_ioring", "false");
+  conf.set_val("bdev_ioring_fixed_buffers", "0");
+  conf.apply_changes(nullptr);
+}
+
+TEST(KernelDevice, ReadFixedBuffersReleased) {
+  // reads into registered buffers hand them to the caller as is; a slot
+  // is only reused once the last reference to it is gone
+  if (!ioring_queue_t::supported()) {
+    std::cout << "io_uring not supported, skipping" << std::endl;
+    return;
+  }
+  const unsigned io_size = 65536;
+  const unsigned num_buffers = 8;
+  const unsigned batches = 3;
+  const unsigned num_reads = num_buffers * batches;
+  TempBdev bdev{ 1048576ull * 16 };
+
+  auto& conf = g_ceph_context->_conf;
+  conf.set_val("bdev_ioring", "true");
+  conf.set_val("bdev_ioring_fixed_buffers", stringify(num_buffers));
+  conf.set_val("bdev_ioring_fixed_buffer_size", stringify(io_size));
+  conf.apply_changes(nullptr);
+
+  std::unique_ptr<BlockDevice> b(
+    BlockDevice::create(g_ceph_context, bdev.path, NULL, NULL,
+      [](void* handle, void* aio) {}, NULL));
+  ASSERT_EQ(0, b->open(bdev.path));
+
+  bufferlist data;
+  for (unsigned i = 0; i < num_reads; i++) {
+    data.append(string(io_size, 'a' + (i % 26)));
+  }
+  {
+    IOContext ioc(g_ceph_context, NULL);
+    ASSERT_EQ(0, b->aio_write(0, data, &ioc, false));
+    b->aio_submit(&ioc);
+    ioc.aio_wait();
+  }
+
+  auto read_batch = [&](unsigned batch, std::vector<bufferlist>& bls) {
+    IOContext ioc(g_ceph_context, NULL);
+    bls.resize(num_buffers);
+    for (unsigned i = 0; i < num_buffers; i++) {
+      ASSERT_EQ(0, b->aio_read((batch * num_buffers + i) * io_size, io_size,
+			       &bls[i], &ioc));
+    }
+    b->aio_submit(&ioc);
+    ioc.aio_wait();
+    ASSERT_EQ(0, ioc.get_return_value());
+    for (unsigned i = 0; i < num_buffers; i++) {
+      bufferlist expected;
+      expected.substr_of(data, (batch * num_buffers + i) * io_size, io_size);
+      ASSERT_TRUE(bls[i].contents_equal(expected));
+    }
+  };
+
+  // the first batch takes every slot
+  std::vector<bufferlist> first, second;
+  read_batch(0, first);
+  for (auto& bl : first) {
+    ASSERT_TRUE(b->is_io_buffer(bl));
+  }
+  // while those are held the next batch falls back to regular buffers
+  read_batch(1, second);
+  for (auto& bl : second) {
+    ASSERT_FALSE(b->is_io_buffer(bl));
+  }
+  // a copy releases the slot
+  first[0].rebuild();
+  ASSERT_FALSE(b->is_io_buffer(first[0]));
+  first.clear();
+  second.clear();
+  read_batch(2, second);
+  for (auto& bl : second) {
+    ASSERT_TRUE(b->is_io_buffer(bl));
+  }
+  second.clear();
+
+  b->close();
+  conf.set_val("bdev_ioring", "false");
+  conf.set_val("bdev_ioring_fixed_buffers", "0");
+  conf.apply_changes(nullptr);
+}
+
 int main(int argc, char **argv) {
   vector<const char*> args;
   argv_to_vec(argc, (const char **)argv, args);
@@ -681,6 +681,61 @@ TEST(BlueFS, test_compaction_async) {
   fs.umount();
 }
 
+void append_fsync_file(BlueFS &fs, const string& dir, int n,
+		       unsigned appends, unsigned append_len)
+{
+  BlueFS::FileWriter *h;
+  string file = "file." + to_string(n);
+  ASSERT_EQ(0, fs.open_for_write(dir, file, &h, false));
+  ASSERT_NE(nullptr, h);
+  auto sg = make_scope_guard([&fs, h] { fs.close_writer(h); });
+  std::unique_ptr<char[]> buf = gen_buffer(append_len);
+  for (unsigned i = 0; i < appends; i++) {
+    fs.append_try_flush(h, buf.get(), append_len);
+    if ((i % 4) == 3) {
+      ASSERT_EQ(0, fs.fsync(h));
+    }
+  }
+  ASSERT_EQ(0, fs.fsync(h));
+}
+
+TEST(BlueFS, test_concurrent_write_fsync) {
+  uint64_t size = 1048576 * 512;
+  TempBdev bdev{size};
+  ConfSaver conf(g_ceph_context->_conf);
+  conf.SetVal("bluefs_alloc_size", "65536");
+  conf.SetVal("bluefs_min_flush_size", "65536");
+  conf.ApplyChanges();
+
+  BlueFS fs(g_ceph_context);
+  ASSERT_EQ(0, fs.add_block_device(BlueFS::BDEV_DB, bdev.path, false, 1048576));
+  uuid_d fsid;
+  ASSERT_EQ(0, fs.mkfs(fsid, { BlueFS::BDEV_DB, false, false }));
+  ASSERT_EQ(0, fs.mount());
+  const unsigned appends = 128;
+  const unsigned append_len = 32768;
+  const string dir = "dir.concurrent";
+  ASSERT_EQ(0, fs.mkdir(dir));
+  // every writer has its own file, so data flushes only contend on the
+  // per-writer lock; compare MB/s across thread counts.
+  int n = 0;
+  for (unsigned threads : {1, 2, 4, 8}) {
+    std::vector<std::thread> writers;
+    auto start = ceph::mono_clock::now();
+    for (unsigned i = 0; i < threads; i++) {
+      writers.push_back(std::thread(append_fsync_file, std::ref(fs),
+				    std::cref(dir), n++, appends, append_len));
+    }
+    join_all(writers);
+    double secs = std::chrono::duration<double>(
+      ceph::mono_clock::now() - start).count();
+    double mb = double(threads) * appends * append_len / 1048576;
+    std::cout << "threads " << threads << ": " << mb << " MB in " << secs
+	      << " s, " << mb / secs << " MB/s" << std::endl;
+  }
+  fs.umount();
+}
+
 TEST(BlueFS, test_replay) {
   uint64_t size = 1048576 * 128;
   TempBdev bdev{size};
@@ -308,6 +308,40 @@ TEST(bluestore_blob_t, calc_csum)
   }
 }
 
+TEST(bluestore_blob_t, decode_shallow_csum)
+{
+  bluestore_blob_t b;
+  b.allocated_test(bluestore_pextent_t(0x10000, 0x4000));
+  b.init_csum(Checksummer::CSUM_CRC32C, 12, 0x4000);
+  bufferlist data;
+  data.append(string(0x4000, 'a'));
+  b.calc_csum(0, data);
+
+  bufferlist bl;
+  {
+    size_t bound = 0;
+    denc(b, bound, 2);
+    auto app = bl.get_contiguous_appender(bound);
+    denc(b, app, 2);
+  }
+  bl.rebuild();
+  bufferptr bp = bl.front();
+
+  // a shallow decode leaves csum_data in the source buffer, and that
+  // buffer in its mempool
+  auto other_before = mempool::bluestore_cache_other::allocated_bytes();
+  bluestore_blob_t d;
+  auto p = bp.cbegin();
+  denc(d, p, 2);
+  ASSERT_EQ(other_before, mempool::bluestore_cache_other::allocated_bytes());
+  ASSERT_GE(d.csum_data.c_str(), bp.c_str());
+  ASSERT_LE(d.csum_data.end_c_str(), bp.end_c_str());
+  int bad_off;
+  uint64_t bad_csum;
+  ASSERT_EQ(0, d.verify_csum(0, data, &bad_off, &bad_csum));
+  ASSERT_EQ(-1, bad_off);
+}
+
 TEST(bluestore_blob_t, csum_bench)
 {
   bufferlist bl;
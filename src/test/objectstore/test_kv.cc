@@ -17,8 +17,11 @@
 #include <iostream>
 #include <time.h>
 #include <sys/mount.h>
+#include <thread>
 #include "kv/KeyValueDB.h"
 #include "kv/RocksDBStore.h"
+#include "rocksdb/table.h"
+#include "rocksdb/utilities/options_util.h"
 #include "include/Context.h"
 #include "common/ceph_argparse.h"
 #include "global/global_init.h"
@@ -195,6 +198,109 @@ TEST_P(KVTest, BenchCommit) {
   fini();
 }
 
+TEST_P(KVTest, MultiGet) {
+  bool rocksdb = string(GetParam()) == "rocksdb";
+  ASSERT_EQ(0, db->create_and_open(cout, rocksdb ? "cf(3)" : ""));
+  std::vector<std::string> prefixes = {"prefix"};
+  if (rocksdb) {
+    prefixes.push_back("cf");
+  }
+  for (auto& prefix : prefixes) {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (int i = 0; i < 100; i += 2) {
+      bufferlist value;
+      value.append(prefix + stringify(i));
+      t->set(prefix, "key" + stringify(i), value);
+    }
+    t->set(prefix, "empty", bufferlist());
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+
+    std::vector<std::string> keys = {"empty"};
+    for (int i = 0; i < 100; i++) {
+      keys.push_back("key" + stringify(i));
+    }
+    auto check = [&](const std::vector<int>& rs,
+		     const std::vector<bufferlist>& values) {
+      ASSERT_EQ(keys.size(), rs.size());
+      ASSERT_EQ(keys.size(), values.size());
+      ASSERT_EQ(0, rs[0]);
+      ASSERT_EQ(0u, values[0].length());
+      for (int i = 0; i < 100; i++) {
+	if (i % 2) {
+	  ASSERT_EQ(-ENOENT, rs[i + 1]);
+	} else {
+	  ASSERT_EQ(0, rs[i + 1]);
+	  ASSERT_EQ(prefix + stringify(i), _bl_to_str(values[i + 1]));
+	}
+      }
+    };
+
+    std::vector<int> rs;
+    std::vector<bufferlist> values;
+    db->multi_get(prefix, keys, &rs, &values);
+    check(rs, values);
+
+    std::map<std::string, bufferlist> out;
+    ASSERT_EQ(0, db->get(prefix, std::set<std::string>(keys.begin(), keys.end()),
+			 &out));
+    ASSERT_EQ(51u, out.size());
+    ASSERT_EQ(prefix + "42", _bl_to_str(out["key42"]));
+  }
+  fini();
+}
+
+TEST_P(KVTest, BenchMultiGet) {
+  const int num_keys = 100000;
+  const int batch = 32;
+  const int rounds = 1000;
+  ASSERT_EQ(0, db->create_and_open(cout));
+  {
+    bufferlist value;
+    bufferptr bp(100);
+    bp.zero();
+    value.append(bp);
+    for (int i = 0; i < num_keys; i += 1000) {
+      KeyValueDB::Transaction t = db->get_transaction();
+      for (int j = i; j < i + 1000; ++j) {
+	t->set("prefix", "key" + stringify(j), value);
+      }
+      ASSERT_EQ(0, db->submit_transaction_sync(t));
+    }
+  }
+  db->compact();
+
+  std::vector<std::vector<std::string>> batches(rounds);
+  for (auto& keys : batches) {
+    for (int j = 0; j < batch; ++j) {
+      keys.push_back("key" + stringify(rand() % num_keys));
+    }
+  }
+
+  utime_t start = ceph_clock_now();
+  for (auto& keys : batches) {
+    for (auto& key : keys) {
+      bufferlist v;
+      ASSERT_EQ(0, db->get("prefix", key, &v));
+    }
+  }
+  utime_t serial = ceph_clock_now() - start;
+
+  start = ceph_clock_now();
+  for (auto& keys : batches) {
+    std::vector<int> rs;
+    std::vector<bufferlist> values;
+    db->multi_get("prefix", keys, &rs, &values);
+    ASSERT_EQ(0, rs.front());
+  }
+  utime_t batched = ceph_clock_now() - start;
+
+  cout << rounds << " batches of " << batch << " keys: get "
+       << serial << " (" << (serial / (double)rounds) << " per batch)"
+       << ", multi_get " << batched << " (" << (batched / (double)rounds)
+       << " per batch)" << std::endl;
+  fini();
+}
+
 struct AppendMOP : public KeyValueDB::MergeOperator {
   void merge_nonexistent(
     const char *rdata, size_t rlen, std::string *new_value) override {
@@ -312,6 +418,112 @@ TEST_P(KVTest, RMRange) {
   fini();
 }
 
+TEST_P(KVTest, SnapshotIterator) {
+  ASSERT_EQ(0, db->create_and_open(cout));
+  bufferlist value;
+  value.append("value");
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (int i = 0; i < 100; i++) {
+      t->set("prefix", stringify(1000 + i), value);
+    }
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  auto it = db->get_iterator("prefix");
+  it->seek_to_first();
+  ASSERT_TRUE(it->valid());
+  ASSERT_EQ("1000", it->key());
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rm_range_keys("prefix", "1010", "1090");
+    t->set("prefix", "1050x", value);
+    t->set("prefix", "2000", value);
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  // the iterator keeps seeing the store as of its creation
+  int n = 0;
+  for (; it->valid(); it->next()) {
+    ASSERT_EQ(stringify(1000 + n), it->key());
+    n++;
+  }
+  ASSERT_EQ(100, n);
+  it->seek_to_last();
+  ASSERT_TRUE(it->valid());
+  ASSERT_EQ("1099", it->key());
+
+  auto it2 = db->get_iterator("prefix");
+  n = 0;
+  for (it2->seek_to_first(); it2->valid(); it2->next()) {
+    n++;
+  }
+  ASSERT_EQ(22, n);
+  it2->lower_bound("1010");
+  ASSERT_TRUE(it2->valid());
+  ASSERT_EQ("1050x", it2->key());
+  it2->prev();
+  ASSERT_TRUE(it2->valid());
+  ASSERT_EQ("1009", it2->key());
+  fini();
+}
+
+TEST_P(KVTest, ConcurrentReadWrite) {
+  ASSERT_EQ(0, db->create_and_open(cout));
+  const int num_keys = 64;
+  const int rounds = 500;
+  // every transaction rewrites all keys with the same value, readers must
+  // never see a mix of two transactions
+  auto write = [&](int round) {
+    KeyValueDB::Transaction t = db->get_transaction();
+    bufferlist value;
+    value.append(stringify(round));
+    for (int i = 0; i < num_keys; i++) {
+      if ((i + round) % 7 == 0) {
+	t->rmkey("prefix", stringify(1000 + i));
+      } else {
+	t->set("prefix", stringify(1000 + i), value);
+      }
+    }
+    return db->submit_transaction(t);
+  };
+  ASSERT_EQ(0, write(0));
+
+  std::atomic<bool> stop = {false};
+  std::atomic<int> errors = {0};
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 4; r++) {
+    readers.emplace_back([&]() {
+      while (!stop) {
+	string round;
+	int n = 0;
+	auto it = db->get_iterator("prefix");
+	for (it->seek_to_first(); it->valid(); it->next()) {
+	  string v = _bl_to_str(it->value());
+	  if (round.empty()) {
+	    round = v;
+	  } else if (v != round) {
+	    errors++;
+	  }
+	  n++;
+	}
+	if (n != num_keys - num_keys / 7 && n != num_keys - num_keys / 7 - 1) {
+	  errors++;
+	}
+	bufferlist bl;
+	db->get("prefix", "1001", &bl);
+      }
+    });
+  }
+  for (int round = 1; round < rounds; round++) {
+    ASSERT_EQ(0, write(round));
+  }
+  stop = true;
+  for (auto& t : readers) {
+    t.join();
+  }
+  ASSERT_EQ(0, errors);
+  fini();
+}
+
 TEST_P(KVTest, ShardingRMRange) {
   if(string(GetParam()) != "rocksdb")
     return;
@@ -349,6 +561,85 @@ TEST_P(KVTest, ShardingRMRange) {
 }
 
 
+TEST_P(KVTest, RocksDBTombstoneCompact) {
+  if(string(GetParam()) != "rocksdb")
+    return;
+
+  g_ceph_context->_conf.set_val_or_die("rocksdb_delete_range_threshold", "500");
+  g_ceph_context->_conf.set_val_or_die("rocksdb_delete_range_compact_threshold", "100");
+  fini();
+  init();
+  ASSERT_EQ(0, db->create_and_open(cout, "O(3)"));
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    bufferlist value;
+    value.append("value");
+    for (int i = 0; i < 1000; i++) {
+      t->set("prefix", stringify(1000 + i), value);
+    }
+    for (int i = 0; i < 600; i++) {
+      t->set("O", stringify(1000 + i), value);
+    }
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  PerfCounters *logger = db->get_perf_counters();
+  auto compactions = [&]() {
+    return logger->get(l_rocksdb_tombstone_compact);
+  };
+  auto delete_ranges = [&]() {
+    return logger->get(l_rocksdb_delete_range);
+  };
+
+  // too few tombstones to bother
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rm_range_keys("prefix", "1000", "1050");
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  ASSERT_EQ(0u, compactions());
+  ASSERT_EQ(0u, delete_ranges());
+
+  // point deletes over the compact threshold
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rm_range_keys("prefix", "1100", "1400");
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  ASSERT_EQ(1u, compactions());
+  ASSERT_EQ(0u, delete_ranges());
+
+  // the sharded column family counts all shards together
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rmkeys_by_prefix("O");
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  ASSERT_EQ(2u, compactions());
+  ASSERT_EQ(0u, delete_ranges());
+
+  // falls back to DeleteRange
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rm_range_keys("prefix", "1400", "2000");
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  ASSERT_EQ(3u, compactions());
+  ASSERT_EQ(1u, delete_ranges());
+
+  bufferlist v;
+  for (int i = 0; i < 1000; i++) {
+    bool removed = i < 50 || (i >= 100 && i < 1000);
+    ASSERT_EQ(removed ? -ENOENT : 0, db->get("prefix", stringify(1000 + i), &v));
+  }
+  auto it = db->get_iterator("O");
+  it->seek_to_first();
+  ASSERT_FALSE(it->valid());
+  fini();
+
+  g_ceph_context->_conf.rm_val("rocksdb_delete_range_threshold");
+  g_ceph_context->_conf.rm_val("rocksdb_delete_range_compact_threshold");
+}
+
 TEST_P(KVTest, RocksDBColumnFamilyTest) {
   if(string(GetParam()) != "rocksdb")
     return;
@@ -403,6 +694,94 @@ TEST_P(KVTest, RocksDBColumnFamilyTest) {
   fini();
 }
 
+TEST_P(KVTest, RocksDBAccessHints) {
+  if(string(GetParam()) != "rocksdb")
+    return;
+
+  std::string cfs("point scan(3) once");
+  auto set_hints = [&]() {
+    ASSERT_EQ(0, db->set_prefix_access_hint(
+      "point", KeyValueDB::access_hint_t::POINT_LOOKUP));
+    ASSERT_EQ(0, db->set_prefix_access_hint(
+      "scan", KeyValueDB::access_hint_t::RANGE_SCAN));
+    ASSERT_EQ(0, db->set_prefix_access_hint(
+      "once", KeyValueDB::access_hint_t::WRITE_ONCE));
+    // not a column family, ignored
+    ASSERT_EQ(0, db->set_prefix_access_hint(
+      "prefix", KeyValueDB::access_hint_t::POINT_LOOKUP));
+  };
+  set_hints();
+  ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+  ASSERT_EQ(0, db->create_and_open(cout, cfs));
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    bufferlist value;
+    value.append("value");
+    for (auto prefix : {"point", "scan", "once", "prefix"}) {
+      for (int i = 0; i < 100; i++) {
+	t->set(prefix, stringify(1000 + i), value);
+      }
+    }
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  db->compact();
+  fini();
+
+  init();
+  set_hints();
+  ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+  ASSERT_EQ(0, db->open(cout, cfs));
+  for (auto prefix : {"point", "scan", "once", "prefix"}) {
+    bufferlist v;
+    ASSERT_EQ(0, db->get(prefix, "1050", &v));
+    ASSERT_EQ("value", _bl_to_str(v));
+    ASSERT_EQ(-ENOENT, db->get(prefix, "2000", &v));
+    int n = 0;
+    auto it = db->get_iterator(prefix);
+    for (it->lower_bound("1010"); it->valid(); it->next()) {
+      ASSERT_EQ(stringify(1010 + n), it->key());
+      n++;
+    }
+    ASSERT_EQ(90, n);
+  }
+  fini();
+
+  // check what ended up in the column family options
+  rocksdb::DBOptions db_opts;
+  std::vector<rocksdb::ColumnFamilyDescriptor> cf_descs;
+  ASSERT_TRUE(rocksdb::LoadLatestOptions("kv_test_temp_dir",
+					 rocksdb::Env::Default(),
+					 &db_opts, &cf_descs).ok());
+  std::map<std::string, rocksdb::ColumnFamilyOptions> cf_opts;
+  for (auto& d : cf_descs) {
+    cf_opts[d.name] = d.options;
+  }
+  auto table_opts = [&](const std::string& cf) {
+    return static_cast<rocksdb::BlockBasedTableOptions*>(
+      cf_opts.at(cf).table_factory->GetOptions());
+  };
+  uint64_t block_size = g_conf()->rocksdb_block_size;
+  auto def = table_opts(rocksdb::kDefaultColumnFamilyName);
+  ASSERT_EQ(block_size, def->block_size);
+
+  auto point = table_opts("point");
+  ASSERT_EQ(std::min<uint64_t>(block_size, 4096), point->block_size);
+  ASSERT_TRUE(point->filter_policy);
+  ASSERT_TRUE(point->whole_key_filtering);
+  ASSERT_TRUE(cf_opts["point"].memtable_whole_key_filtering);
+  ASSERT_GT(cf_opts["point"].memtable_prefix_bloom_size_ratio, 0);
+
+  for (int i = 0; i < 3; i++) {
+    auto scan = table_opts("scan-" + stringify(i));
+    ASSERT_EQ(std::max<uint64_t>(block_size, 16384), scan->block_size);
+    ASSERT_EQ(!!def->filter_policy, !!scan->filter_policy);
+  }
+
+  auto once = table_opts("once");
+  ASSERT_FALSE(once->filter_policy);
+  ASSERT_EQ(rocksdb::kOldestSmallestSeqFirst, cf_opts["once"].compaction_pri);
+}
+
 TEST_P(KVTest, RocksDBIteratorTest) {
   if(string(GetParam()) != "rocksdb")
     return;
@@ -58,3 +58,48 @@ TEST(ECUtil, stripe_info_t)
             make_pair((uint64_t)0, 2*swidth));
 }
 
+TEST(ECUtil, offset_len_to_chunk_bounds)
+{
+  const uint64_t swidth = 4096;
+  const uint64_t ssize = 4;
+  ECUtil::stripe_info_t s(ssize, swidth);
+  const uint64_t csize = s.get_chunk_size();
+
+  {
+    set<int> chunks;
+    ASSERT_EQ(s.offset_len_to_chunk_bounds(make_pair(10ul, 20ul), &chunks),
+	      make_pair(10ul, 20ul));
+    ASSERT_EQ(chunks, set<int>({0}));
+  }
+  {
+    // within a chunk of the second stripe
+    set<int> chunks;
+    ASSERT_EQ(s.offset_len_to_chunk_bounds(
+		make_pair(swidth + csize + 6, 10ul), &chunks),
+	      make_pair(csize + 6, 10ul));
+    ASSERT_EQ(chunks, set<int>({1}));
+  }
+  {
+    // the tail of chunk 0 and the head of chunk 1 cover all of the chunk
+    set<int> chunks;
+    ASSERT_EQ(s.offset_len_to_chunk_bounds(make_pair(csize - 24, 100ul),
+					   &chunks),
+	      make_pair(0ul, csize));
+    ASSERT_EQ(chunks, set<int>({0, 1}));
+  }
+  {
+    // across a stripe boundary
+    set<int> chunks;
+    ASSERT_EQ(s.offset_len_to_chunk_bounds(make_pair(swidth - 10, 20ul),
+					   &chunks),
+	      make_pair(csize - 10, 20ul));
+    ASSERT_EQ(chunks, set<int>({0, 3}));
+  }
+  {
+    set<int> chunks;
+    ASSERT_EQ(s.offset_len_to_chunk_bounds(make_pair(10ul, swidth), &chunks),
+	      make_pair(0ul, 2 * csize));
+    ASSERT_EQ(chunks, set<int>({0, 1, 2, 3}));
+  }
+}
+
@@ -297,6 +297,149 @@ TEST_F(OSDMapTest, MapFunctionsMatch) {
   EXPECT_EQ(acting_osds, acting_osds_two);
 }
 
+TEST_F(OSDMapTest, MapPGRange) {
+  set_up_map();
+  {
+    // a pg_temp on top of the batched CRUSH mapping
+    OSDMap::Incremental pgtemp_map(osdmap.get_epoch() + 1);
+    pgtemp_map.new_pg_temp[osdmap.raw_pg_to_pg(pg_t(3, my_rep_pool))] =
+      mempool::osdmap::vector<int>({0, 1, 2});
+    osdmap.apply_incremental(pgtemp_map);
+  }
+
+  for (auto pool : {my_rep_pool, my_ec_pool}) {
+    unsigned pg_num = osdmap.get_pg_pool(pool)->get_pg_num();
+    unsigned n = 0;
+    osdmap.pg_range_to_up_acting_osds(
+      pool, 0, pg_num,
+      [&](pg_t pgid, vector<int>&& raw, vector<int>&& up, int up_primary,
+	  vector<int>&& acting, int acting_primary) {
+	ASSERT_EQ(n++, pgid.ps());
+	vector<int> crush_raw, raw2, up2, acting2;
+	int up_primary2, acting_primary2;
+	osdmap.pg_to_raw_upmap(pgid, &crush_raw, &raw2);
+	osdmap.pg_to_up_acting_osds(pgid, &up2, &up_primary2,
+				    &acting2, &acting_primary2);
+	EXPECT_EQ(raw2, raw);
+	EXPECT_EQ(up2, up);
+	EXPECT_EQ(up_primary2, up_primary);
+	EXPECT_EQ(acting2, acting);
+	EXPECT_EQ(acting_primary2, acting_primary);
+      });
+    EXPECT_EQ(pg_num, n);
+  }
+}
+
+TEST_F(OSDMapTest, MappingIncremental) {
+  set_up_map();
+  mapping.update(osdmap);
+
+  auto check = [&]() {
+    OSDMapMapping full;
+    full.update(osdmap);
+    for (auto pool : {my_rep_pool, my_ec_pool}) {
+      unsigned pg_num = osdmap.get_pg_pool(pool)->get_pg_num();
+      for (unsigned ps = 0; ps < pg_num; ++ps) {
+	pg_t pgid(ps, pool);
+	vector<int> up, acting, up2, acting2;
+	int up_primary, acting_primary, up_primary2, acting_primary2;
+	mapping.get(pgid, &up, &up_primary, &acting, &acting_primary);
+	full.get(pgid, &up2, &up_primary2, &acting2, &acting_primary2);
+	EXPECT_EQ(up2, up) << pgid;
+	EXPECT_EQ(up_primary2, up_primary) << pgid;
+	EXPECT_EQ(acting2, acting) << pgid;
+	EXPECT_EQ(acting_primary2, acting_primary) << pgid;
+      }
+    }
+    for (int osd = 0; osd < osdmap.get_max_osd(); ++osd) {
+      EXPECT_EQ(full.get_osd_acting_pgs(osd), mapping.get_osd_acting_pgs(osd));
+    }
+    EXPECT_EQ(osdmap.get_epoch(), mapping.get_epoch());
+  };
+
+  pg_t pgid = osdmap.raw_pg_to_pg(pg_t(7, my_rep_pool));
+  vector<int> up;
+  osdmap.pg_to_raw_up(pgid, &up, nullptr);
+  ASSERT_EQ(3u, up.size());
+  int down_osd = up[1];
+  int unused_osd = -1;
+  for (int osd = 0; osd < (int)get_num_osds(); ++osd) {
+    if (std::find(up.begin(), up.end(), osd) == up.end()) {
+      unused_osd = osd;
+      break;
+    }
+  }
+  ASSERT_NE(-1, unused_osd);
+
+  {
+    // mark an osd down
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_state[down_osd] = CEPH_OSD_UP;
+    osdmap.apply_incremental(inc);
+    mapping.update(osdmap, {inc});
+    check();
+  }
+  {
+    // and out, together with an upmap and a pg_temp in the next epoch
+    vector<OSDMap::Incremental> incs;
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_weight[down_osd] = CEPH_OSD_OUT;
+    osdmap.apply_incremental(inc);
+    incs.push_back(inc);
+    OSDMap::Incremental inc2(osdmap.get_epoch() + 1);
+    osdmap.pg_to_raw_up(pgid, &up, nullptr);
+    inc2.new_pg_upmap_items[pgid] =
+      mempool::osdmap::vector<pair<int32_t,int32_t>>({{up[0], down_osd}});
+    inc2.new_pg_temp[osdmap.raw_pg_to_pg(pg_t(3, my_ec_pool))] =
+      mempool::osdmap::vector<int>({0, 1, 2});
+    osdmap.apply_incremental(inc2);
+    incs.push_back(inc2);
+    mapping.update(osdmap, incs);
+    check();
+  }
+  {
+    // back up and in, which makes the upmap valid again
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_state[down_osd] = CEPH_OSD_UP;
+    inc.new_up_client[down_osd] = osdmap.get_addrs(unused_osd);
+    inc.new_weight[down_osd] = CEPH_OSD_IN;
+    osdmap.apply_incremental(inc);
+    mapping.update(osdmap, {inc});
+    check();
+  }
+  {
+    // reweight below in, and a primary affinity change
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_weight[unused_osd] = CEPH_OSD_IN / 2;
+    inc.new_primary_affinity[up[0]] = 0;
+    osdmap.apply_incremental(inc);
+    mapping.update(osdmap, {inc});
+    check();
+  }
+  {
+    // pool changes are remapped as a whole
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    pg_pool_t *p = inc.get_new_pool(my_rep_pool,
+				    osdmap.get_pg_pool(my_rep_pool));
+    p->set_pg_num(128);
+    p->set_pgp_num(128);
+    osdmap.apply_incremental(inc);
+    mapping.update(osdmap, {inc});
+    check();
+  }
+  {
+    // a gap in the incrementals falls back to a full update
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.old_pg_upmap_items.insert(pgid);
+    osdmap.apply_incremental(inc);
+    OSDMap::Incremental inc2(osdmap.get_epoch() + 1);
+    inc2.new_weight[unused_osd] = CEPH_OSD_IN;
+    osdmap.apply_incremental(inc2);
+    mapping.update(osdmap, {inc2});
+    check();
+  }
+}
+
 /** This test must be removed or modified appropriately when we allow
  * other ways to specify a primary. */
 TEST_F(OSDMapTest, PrimaryIsFirst) {
@@ -1395,6 +1538,120 @@ TEST_F(OSDMapTest, BUG_40104) {
   }
 }
 
+TEST_F(OSDMapTest, CalcPgUpmapsLarge) {
+  int big_osd_num = 2000;
+  int big_pg_num = 32768;
+  set_up_map(big_osd_num, true);
+  int pool_id;
+  {
+    OSDMap::Incremental pending_inc(osdmap.get_epoch() + 1);
+    pending_inc.new_pool_max = osdmap.get_pool_max();
+    pool_id = ++pending_inc.new_pool_max;
+    pg_pool_t empty;
+    auto p = pending_inc.get_new_pool(pool_id, &empty);
+    p->size = 3;
+    p->min_size = 1;
+    p->set_pg_num(big_pg_num);
+    p->set_pgp_num(big_pg_num);
+    p->type = pg_pool_t::TYPE_REPLICATED;
+    p->crush_rule = 0;
+    p->set_flag(pg_pool_t::FLAG_HASHPSPOOL);
+    pending_inc.new_pool_names[pool_id] = "big_pool";
+    osdmap.apply_incremental(pending_inc);
+  }
+  set<int64_t> only_pools = {pool_id};
+  {
+    OSDMap::Incremental pending_inc(osdmap.get_epoch() + 1);
+    auto start = mono_clock::now();
+    int num_changed = osdmap.calc_pg_upmaps(g_ceph_context, 1, 100,
+					    only_pools, &pending_inc);
+    auto latency = mono_clock::now() - start;
+    std::cout << "calc_pg_upmaps (" << big_osd_num << " osds, " << big_pg_num
+	      << " pgs) " << num_changed << " changes, latency: "
+	      << timespan_str(latency) << std::endl;
+    ASSERT_GT(num_changed, 0);
+  }
+  {
+    // give up (almost) right away
+    g_ceph_context->_conf.set_val("osd_calc_pg_upmaps_max_time", "0.000001");
+    OSDMap::Incremental pending_inc(osdmap.get_epoch() + 1);
+    int num_changed = osdmap.calc_pg_upmaps(g_ceph_context, 1, 100,
+					    only_pools, &pending_inc);
+    g_ceph_context->_conf.rm_val("osd_calc_pg_upmaps_max_time");
+    ASSERT_EQ(0, num_changed);
+  }
+}
+
+TEST_F(OSDMapTest, CalcPgUpmapsParallel) {
+  set_up_map(60, true);
+  int pool_id;
+  {
+    OSDMap::Incremental pending_inc(osdmap.get_epoch() + 1);
+    pending_inc.new_pool_max = osdmap.get_pool_max();
+    pool_id = ++pending_inc.new_pool_max;
+    pg_pool_t empty;
+    auto p = pending_inc.get_new_pool(pool_id, &empty);
+    p->size = 3;
+    p->min_size = 1;
+    p->set_pg_num(1024);
+    p->set_pgp_num(1024);
+    p->type = pg_pool_t::TYPE_REPLICATED;
+    p->crush_rule = 0;
+    p->set_flag(pg_pool_t::FLAG_HASHPSPOOL);
+    pending_inc.new_pool_names[pool_id] = "pool";
+    osdmap.apply_incremental(pending_inc);
+  }
+  set<int64_t> only_pools = {pool_id};
+  const uint32_t max_deviation = 2;
+
+  ThreadPool tp(g_ceph_context, "CalcPgUpmapsParallel::tp", "upmap_tp", 4);
+  tp.start();
+  ParallelPGMapper mapper(g_ceph_context, &tp);
+
+  // without the random pg order both give the very same changes
+  g_ceph_context->_conf.set_val("osd_calc_pg_upmaps_aggressively", "false");
+  {
+    OSDMap::Incremental serial_inc(osdmap.get_epoch() + 1);
+    int serial = osdmap.calc_pg_upmaps(g_ceph_context, max_deviation, 100,
+				       only_pools, &serial_inc);
+    OSDMap::Incremental parallel_inc(osdmap.get_epoch() + 1);
+    int parallel = osdmap.calc_pg_upmaps(g_ceph_context, max_deviation, 100,
+					 only_pools, &parallel_inc, &mapper);
+    ASSERT_GT(serial, 0);
+    ASSERT_EQ(serial, parallel);
+    ASSERT_EQ(serial_inc.new_pg_upmap_items, parallel_inc.new_pg_upmap_items);
+    ASSERT_EQ(serial_inc.old_pg_upmap_items, parallel_inc.old_pg_upmap_items);
+  }
+  g_ceph_context->_conf.rm_val("osd_calc_pg_upmaps_aggressively");
+
+  // and the map gets balanced as well as before: to within max_deviation
+  // of the target on every osd
+  for (int round = 0; round < 100; ++round) {
+    OSDMap::Incremental pending_inc(osdmap.get_epoch() + 1);
+    if (osdmap.calc_pg_upmaps(g_ceph_context, max_deviation, 100,
+			      only_pools, &pending_inc, &mapper) == 0) {
+      break;
+    }
+    osdmap.apply_incremental(pending_inc);
+  }
+  tp.stop();
+
+  map<int,int> pgs_by_osd;
+  for (unsigned ps = 0; ps < 1024; ++ps) {
+    vector<int> up;
+    int primary;
+    osdmap.pg_to_raw_up(pg_t(ps, pool_id), &up, &primary);
+    for (auto osd : up) {
+      pgs_by_osd[osd]++;
+    }
+  }
+  double target = 1024.0 * 3 / get_num_osds();
+  for (unsigned osd = 0; osd < get_num_osds(); ++osd) {
+    ASSERT_LE(std::abs(pgs_by_osd[osd] - target), max_deviation + 1)
+      << "osd." << osd << " pgs " << pgs_by_osd[osd] << " target " << target;
+  }
+}
+
 TEST_F(OSDMapTest, BUG_42052) {
   // https://tracker.ceph.com/issues/42052
   set_up_map(6, true);
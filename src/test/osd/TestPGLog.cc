@@ -2911,6 +2911,96 @@ TEST_F(PGLogTrimTest, TestGetRequest) {
   EXPECT_FALSE(result);
 }
 
+TEST_F(PGLogTrimTest, TestPageOutIn) {
+  SetUp(20);
+  PGLog::IndexedLog log;
+  log.head = mk_evt(20, 0);
+  log.skip_can_rollback_to_to_head();
+  log.head = mk_evt(9, 0);
+
+  entity_name_t client = entity_name_t::CLIENT(777);
+
+  log.add(mk_ple_mod(mk_obj(1), mk_evt(10, 100), mk_evt(8, 70),
+		     osd_reqid_t(client, 8, 1)));
+  log.add(mk_ple_dt(mk_obj(2), mk_evt(15, 150), mk_evt(10, 100),
+		    osd_reqid_t(client, 8, 2)));
+  log.add(mk_ple_mod_rb(mk_obj(3), mk_evt(15, 155), mk_evt(15, 150),
+			osd_reqid_t(client, 8, 3)));
+  log.add(mk_ple_mod(mk_obj(1), mk_evt(20, 160), mk_evt(25, 152),
+		     osd_reqid_t(client, 8, 4)));
+
+  mempool::osd_pglog::list<pg_log_entry_t> on_disk(
+    log.log.begin(), std::next(log.log.begin(), 3));
+
+  // keeps at least one entry, stops at the first one pred rejects
+  EXPECT_EQ(3u, log.page_out(1, [](const pg_log_entry_t &e) {
+    return e.version <= mk_evt(15, 155);
+  }));
+  EXPECT_EQ(1u, log.log.size());
+  EXPECT_EQ(3u, log.paged.size());
+  EXPECT_EQ(4u, log.get_num_entries());
+  EXPECT_FALSE(log.logged_object(mk_obj(2)));
+
+  std::vector<eversion_t> versions;
+  log.for_each_version([&](const eversion_t &v) {
+    versions.push_back(v);
+    return true;
+  });
+  EXPECT_EQ(4u, versions.size());
+  EXPECT_EQ(mk_evt(10, 100), versions.front());
+  EXPECT_EQ(mk_evt(20, 160), versions.back());
+
+  // paged out requests are still detected as dups
+  eversion_t version;
+  version_t user_version;
+  int return_code;
+  vector<pg_log_op_return_item_t> op_returns;
+  EXPECT_TRUE(log.get_request(osd_reqid_t(client, 8, 2), &version,
+			      &user_version, &return_code, &op_returns));
+  EXPECT_EQ(mk_evt(15, 150), version);
+
+  log.page_in(std::move(on_disk));
+  EXPECT_EQ(4u, log.log.size());
+  EXPECT_EQ(0u, log.paged.size());
+  EXPECT_EQ(4u, log.get_num_entries());
+  EXPECT_TRUE(log.logged_object(mk_obj(2)));
+  EXPECT_TRUE(log.logged_req(osd_reqid_t(client, 8, 2)));
+}
+
+TEST_F(PGLogTrimTest, TestTrimPaged) {
+  SetUp(20);
+  PGLog::IndexedLog log;
+  log.head = mk_evt(20, 0);
+  log.skip_can_rollback_to_to_head();
+  log.head = mk_evt(9, 0);
+
+  log.add(mk_ple_mod(mk_obj(1), mk_evt(10, 100), mk_evt(8, 70)));
+  log.add(mk_ple_dt(mk_obj(2), mk_evt(15, 150), mk_evt(10, 100)));
+  log.add(mk_ple_mod_rb(mk_obj(3), mk_evt(15, 155), mk_evt(15, 150)));
+  log.add(mk_ple_mod(mk_obj(1), mk_evt(20, 160), mk_evt(25, 152)));
+  log.add(mk_ple_mod(mk_obj(4), mk_evt(21, 165), mk_evt(26, 160)));
+  log.add(mk_ple_dt_rb(mk_obj(5), mk_evt(21, 167), mk_evt(31, 166)));
+
+  EXPECT_EQ(3u, log.page_out(3, [](const pg_log_entry_t &e) {
+    return true;
+  }));
+
+  std::set<eversion_t> trimmed;
+  std::set<std::string> trimmed_dups;
+  eversion_t write_from_dups = eversion_t::max();
+
+  // the same as trimming the entries in memory, see TestPartialTrim
+  log.trim(cct, mk_evt(19, 157), &trimmed, &trimmed_dups, &write_from_dups);
+
+  EXPECT_EQ(eversion_t(15, 150), write_from_dups);
+  EXPECT_EQ(3u, log.log.size());
+  EXPECT_EQ(0u, log.paged.size());
+  EXPECT_EQ(3u, log.get_num_entries());
+  EXPECT_EQ(3u, trimmed.size());
+  EXPECT_EQ(2u, log.dups.size());
+  EXPECT_EQ(0u, trimmed_dups.size());
+}
+
 TEST_F(PGLogTest, _merge_object_divergent_entries) {
   {
     // Test for issue 20843
@@ -12,7 +12,10 @@
  *
  */
 
+#include <random>
 #include <gtest/gtest.h>
+#include "erasure-code/ErasureCode.h"
+#include "erasure-code/ErasureCodePlugin.h"
 #include "osd/PGTransaction.h"
 #include "osd/ECTransaction.h"
 
@@ -122,3 +125,442 @@ TEST(ectransaction, many_writes)
   ASSERT_EQ(0u, plan.to_read.size());
   ASSERT_EQ(1u, plan.will_write.size());
 }
+
+// a linear code with k=3 and m=2: p = d0 ^ d1 ^ d2, q = d0 ^ d2
+class ErasureCodeXor final : public ceph::ErasureCode {
+public:
+  unsigned int get_chunk_count() const override {
+    return 5;
+  }
+  unsigned int get_data_chunk_count() const override {
+    return 3;
+  }
+  unsigned int get_chunk_size(unsigned int object_size) const override {
+    return object_size / 3;
+  }
+  uint64_t get_supported_optimizations() const override {
+    return FLAG_EC_PLUGIN_PARITY_DELTA_OPTIMIZATION;
+  }
+  int encode_chunks(const std::set<int> &want_to_encode,
+		    std::map<int, bufferlist> *encoded) override {
+    const char *d0 = (*encoded)[0].c_str();
+    const char *d1 = (*encoded)[1].c_str();
+    const char *d2 = (*encoded)[2].c_str();
+    char *p = (*encoded)[3].c_str();
+    char *q = (*encoded)[4].c_str();
+    for (unsigned i = 0; i < (*encoded)[0].length(); ++i) {
+      p[i] = d0[i] ^ d1[i] ^ d2[i];
+      q[i] = d0[i] ^ d2[i];
+    }
+    return 0;
+  }
+  int decode_chunks(const std::set<int> &want_to_read,
+		    const std::map<int, bufferlist> &chunks,
+		    std::map<int, bufferlist> *decoded) override {
+    // a single missing data chunk, from p and the other two
+    std::vector<int> missing;
+    for (int i = 0; i < 3; ++i) {
+      if (!chunks.count(i)) {
+	missing.push_back(i);
+      }
+    }
+    if (missing.empty()) {
+      return 0;
+    }
+    if (missing.size() > 1 || !chunks.count(3)) {
+      return -EIO;
+    }
+    const int i = missing[0];
+    char *d = (*decoded)[i].c_str();
+    const char *p = (*decoded)[3].c_str();
+    const char *a = (*decoded)[(i + 1) % 3].c_str();
+    const char *b = (*decoded)[(i + 2) % 3].c_str();
+    for (unsigned j = 0; j < (*decoded)[i].length(); ++j) {
+      d[j] = p[j] ^ a[j] ^ b[j];
+    }
+    return 0;
+  }
+};
+
+static bufferlist random_bl(std::mt19937 &rng, unsigned len)
+{
+  bufferptr bp(len);
+  for (unsigned i = 0; i < len; ++i) {
+    bp.c_str()[i] = rng();
+  }
+  bufferlist bl;
+  bl.push_back(std::move(bp));
+  return bl;
+}
+
+TEST(ectransaction, parity_delta_plan)
+{
+  ceph::ErasureCodeInterfaceRef ec(new ErasureCodeXor);
+  ECUtil::stripe_info_t sinfo(3, 3 * 4096);
+  const uint64_t sw = sinfo.get_stripe_width();
+  hobject_t h;
+  auto get_hinfo = [&](const hobject_t &i) {
+    ECUtil::HashInfoRef ref(new ECUtil::HashInfo(5));
+    ref->set_projected_total_logical_size(sinfo, 4 * sw);
+    return ref;
+  };
+  bufferlist a;
+  a.append_zero(200);
+
+  // within the first data chunk of the second stripe
+  {
+    PGTransactionUPtr t(new PGTransaction);
+    t->write(h, sw + 10, a.length(), a, 0);
+    auto plan = ECTransaction::get_write_plan(
+      sinfo, std::move(t), get_hinfo, &dpp);
+    ECTransaction::plan_parity_delta(sinfo, ec, &plan);
+    ASSERT_EQ(1u, plan.parity_delta.size());
+    ASSERT_EQ(std::set<int>{0}, plan.parity_delta[h]);
+  }
+  // across two data chunks, a delta would move as much as an rmw
+  {
+    PGTransactionUPtr t(new PGTransaction);
+    t->write(h, sw + 4000, a.length(), a, 0);
+    auto plan = ECTransaction::get_write_plan(
+      sinfo, std::move(t), get_hinfo, &dpp);
+    ECTransaction::plan_parity_delta(sinfo, ec, &plan);
+    ASSERT_TRUE(plan.parity_delta.empty());
+  }
+  // appends have nothing to read
+  {
+    PGTransactionUPtr t(new PGTransaction);
+    t->write(h, 4 * sw + 10, a.length(), a, 0);
+    auto plan = ECTransaction::get_write_plan(
+      sinfo, std::move(t), get_hinfo, &dpp);
+    ECTransaction::plan_parity_delta(sinfo, ec, &plan);
+    ASSERT_TRUE(plan.parity_delta.empty());
+  }
+  // as do fresh objects
+  {
+    PGTransactionUPtr t(new PGTransaction);
+    t->create(h);
+    t->write(h, sw + 10, a.length(), a, 0);
+    auto plan = ECTransaction::get_write_plan(
+      sinfo, std::move(t), get_hinfo, &dpp);
+    ECTransaction::plan_parity_delta(sinfo, ec, &plan);
+    ASSERT_TRUE(plan.parity_delta.empty());
+  }
+}
+
+TEST(ectransaction, parity_delta_write)
+{
+  ceph::ErasureCodeInterfaceRef ec(new ErasureCodeXor);
+  ECUtil::stripe_info_t sinfo(3, 3 * 4096);
+  const uint64_t sw = sinfo.get_stripe_width();
+  const uint64_t cs = sinfo.get_chunk_size();
+  std::mt19937 rng(1);
+  hobject_t h = hobject_t(object_t("foo"), "", CEPH_NOSNAP, 0, 1, "")
+    .make_temp_hobject("foo");
+
+  std::set<int> all = {0, 1, 2, 3, 4};
+  bufferlist old_bl = random_bl(rng, 2 * sw);
+  std::map<int, bufferlist> old_chunks;
+  ASSERT_EQ(0, ECUtil::encode(sinfo, ec, old_bl, all, &old_chunks));
+  ECUtil::HashInfoRef hinfo(new ECUtil::HashInfo(5));
+  hinfo->append(0, old_chunks);
+  hinfo->set_projected_total_logical_size(sinfo, 2 * sw);
+
+  // overwrite part of the second data chunk of the second stripe
+  const uint64_t off = sw + cs + 1000;
+  bufferlist update = random_bl(rng, 1000);
+  PGTransactionUPtr t(new PGTransaction);
+  t->write(h, off, update.length(), update, 0);
+  auto plan = ECTransaction::get_write_plan(
+    sinfo,
+    std::move(t),
+    [&](const hobject_t &i) {
+      return hinfo;
+    },
+    &dpp);
+  ECTransaction::plan_parity_delta(sinfo, ec, &plan);
+  ASSERT_EQ(std::set<int>{1}, plan.parity_delta[h]);
+
+  std::map<hobject_t, std::map<int, extent_map>> delta_extents;
+  for (int shard : {1, 3, 4}) {
+    bufferlist bl;
+    bl.substr_of(old_chunks[shard], cs, cs);
+    delta_extents[h][shard].insert(cs, cs, bl);
+  }
+  std::map<shard_id_t, ObjectStore::Transaction> trans;
+  for (int shard : all) {
+    trans[shard_id_t(shard)];
+  }
+  std::vector<pg_log_entry_t> entries;
+  std::map<hobject_t, extent_map> written;
+  std::set<hobject_t> temp_added, temp_removed;
+  ECTransaction::generate_transactions(
+    plan, ec, pg_t(0, 1), sinfo, {}, delta_extents, entries,
+    &written, &trans, &temp_added, &temp_removed, &dpp);
+  ASSERT_TRUE(written[h].empty());
+
+  // what a full stripe rewrite would have written
+  bufferlist new_bl;
+  new_bl.substr_of(old_bl, 0, off);
+  new_bl.append(update);
+  bufferlist tail;
+  tail.substr_of(old_bl, off + update.length(),
+		 old_bl.length() - off - update.length());
+  new_bl.append(tail);
+  std::map<int, bufferlist> new_chunks;
+  ASSERT_EQ(0, ECUtil::encode(sinfo, ec, new_bl, all, &new_chunks));
+
+  for (int shard : all) {
+    std::vector<bufferlist> writes;
+    for (auto i = trans[shard_id_t(shard)].begin(); i.have_op(); ) {
+      auto op = i.decode_op();
+      if (op->op == ObjectStore::Transaction::OP_WRITE) {
+	ASSERT_EQ(cs, (uint64_t)op->off);
+	ASSERT_EQ(cs, (uint64_t)op->len);
+	writes.emplace_back();
+	i.decode_bl(writes.back());
+      } else {
+	// only the hinfo is set on all of them
+	ASSERT_EQ(ObjectStore::Transaction::OP_SETATTR, (int)op->op);
+	ASSERT_EQ(ECUtil::get_hinfo_key(), i.decode_string());
+	bufferlist bl;
+	i.decode_bl(bl);
+      }
+    }
+    if (shard == 0 || shard == 2) {
+      ASSERT_TRUE(writes.empty());
+    } else {
+      ASSERT_EQ(1u, writes.size());
+      bufferlist expected;
+      expected.substr_of(new_chunks[shard], cs, cs);
+      ASSERT_TRUE(expected.contents_equal(writes[0]));
+    }
+  }
+}
+
+// apply the writes of t to the chunk of a shard
+static void apply_writes(ObjectStore::Transaction &t, bufferlist *chunk)
+{
+  for (auto i = t.begin(); i.have_op(); ) {
+    auto op = i.decode_op();
+    if (op->op == ObjectStore::Transaction::OP_WRITE) {
+      bufferlist bl;
+      i.decode_bl(bl);
+      ASSERT_LE(op->off + op->len, chunk->length());
+      bufferlist head, tail;
+      head.substr_of(*chunk, 0, op->off);
+      tail.substr_of(*chunk, op->off + op->len,
+		     chunk->length() - op->off - op->len);
+      head.append(bl);
+      head.append(tail);
+      chunk->swap(head);
+    } else if (op->op == ObjectStore::Transaction::OP_SETATTR) {
+      i.decode_string();
+      bufferlist bl;
+      i.decode_bl(bl);
+    }
+  }
+}
+
+TEST(ectransaction, parity_delta_jerasure)
+{
+  const uint64_t cs = 4096;
+  ECUtil::stripe_info_t sinfo(3, 3 * cs);
+  const uint64_t sw = sinfo.get_stripe_width();
+  std::set<int> all = {0, 1, 2, 3, 4};
+  auto &registry = ceph::ErasureCodePluginRegistry::instance();
+  hobject_t h = hobject_t(object_t("foo"), "", CEPH_NOSNAP, 0, 1, "")
+    .make_temp_hobject("foo");
+
+  for (const char *technique : {"reed_sol_van", "reed_sol_r6_op"}) {
+    SCOPED_TRACE(technique);
+    ceph::ErasureCodeProfile profile;
+    profile["technique"] = technique;
+    profile["k"] = "3";
+    profile["m"] = "2";
+    ceph::ErasureCodeInterfaceRef ec;
+    ASSERT_EQ(0, registry.factory(
+		"jerasure", g_conf().get_val<std::string>("erasure_code_dir"),
+		profile, &ec, &cerr));
+    std::mt19937 rng(3);
+
+    bufferlist old_bl = random_bl(rng, 2 * sw);
+    std::map<int, bufferlist> chunks;
+    ASSERT_EQ(0, ECUtil::encode(sinfo, ec, old_bl, all, &chunks));
+    ECUtil::HashInfoRef hinfo(new ECUtil::HashInfo(5));
+    hinfo->append(0, chunks);
+    hinfo->set_projected_total_logical_size(sinfo, 2 * sw);
+
+    // overwrite part of the second data chunk of the second stripe
+    const uint64_t off = sw + cs + 1000;
+    bufferlist update = random_bl(rng, 1000);
+    PGTransactionUPtr t(new PGTransaction);
+    t->write(h, off, update.length(), update, 0);
+    auto plan = ECTransaction::get_write_plan(
+      sinfo,
+      std::move(t),
+      [&](const hobject_t &i) {
+	return hinfo;
+      },
+      &dpp);
+    ECTransaction::plan_parity_delta(sinfo, ec, &plan);
+    ASSERT_EQ(std::set<int>{1}, plan.parity_delta[h]);
+
+    std::map<hobject_t, std::map<int, extent_map>> delta_extents;
+    for (int shard : {1, 3, 4}) {
+      bufferlist bl;
+      bl.substr_of(chunks[shard], cs, cs);
+      delta_extents[h][shard].insert(cs, cs, bl);
+    }
+    std::map<shard_id_t, ObjectStore::Transaction> trans;
+    for (int shard : all) {
+      trans[shard_id_t(shard)];
+    }
+    std::vector<pg_log_entry_t> entries;
+    std::map<hobject_t, extent_map> written;
+    std::set<hobject_t> temp_added, temp_removed;
+    ECTransaction::generate_transactions(
+      plan, ec, pg_t(0, 1), sinfo, {}, delta_extents, entries,
+      &written, &trans, &temp_added, &temp_removed, &dpp);
+    for (int shard : all) {
+      apply_writes(trans[shard_id_t(shard)], &chunks[shard]);
+    }
+
+    bufferlist new_bl;
+    new_bl.substr_of(old_bl, 0, off);
+    new_bl.append(update);
+    bufferlist tail;
+    tail.substr_of(old_bl, off + update.length(),
+		   old_bl.length() - off - update.length());
+    new_bl.append(tail);
+
+    // the updated coding chunks rebuild the touched data chunk as well
+    // as an untouched one
+    for (int missing : {1, 0}) {
+      std::map<int, bufferlist> to_decode = chunks;
+      to_decode.erase(missing);
+      bufferlist decoded;
+      ASSERT_EQ(0, ECUtil::decode(sinfo, ec, to_decode, &decoded));
+      ASSERT_TRUE(new_bl.contents_equal(decoded)) << "missing " << missing;
+    }
+  }
+
+  // the plugins encode by position, a remapped layout keeps the rmw
+  {
+    ceph::ErasureCodeProfile profile;
+    profile["technique"] = "reed_sol_van";
+    profile["k"] = "3";
+    profile["m"] = "2";
+    profile["mapping"] = "_DD_D";
+    ceph::ErasureCodeInterfaceRef ec;
+    ASSERT_EQ(0, registry.factory(
+		"jerasure", g_conf().get_val<std::string>("erasure_code_dir"),
+		profile, &ec, &cerr));
+    ASSERT_FALSE(ec->get_chunk_mapping().empty());
+    ECUtil::HashInfoRef hinfo(new ECUtil::HashInfo(5));
+    hinfo->set_projected_total_logical_size(sinfo, 2 * sw);
+    bufferlist a;
+    a.append_zero(200);
+    PGTransactionUPtr t(new PGTransaction);
+    t->write(h, sw + 10, a.length(), a, 0);
+    auto plan = ECTransaction::get_write_plan(
+      sinfo,
+      std::move(t),
+      [&](const hobject_t &i) {
+	return hinfo;
+      },
+      &dpp);
+    ECTransaction::plan_parity_delta(sinfo, ec, &plan);
+    ASSERT_TRUE(plan.parity_delta.empty());
+  }
+}
+
+TEST(ECUtil, assemble_extent)
+{
+  ceph::ErasureCodeInterfaceRef ec(new ErasureCodeXor);
+  ECUtil::stripe_info_t sinfo(3, 3 * 4096);
+  const uint64_t sw = sinfo.get_stripe_width();
+  const uint64_t cs = sinfo.get_chunk_size();
+  std::mt19937 rng(2);
+
+  std::set<int> all = {0, 1, 2, 3, 4};
+  bufferlist data = random_bl(rng, 3 * sw);
+  std::map<int, bufferlist> shards;
+  ASSERT_EQ(0, ECUtil::encode(sinfo, ec, data, all, &shards));
+
+  const std::vector<std::pair<uint64_t, uint64_t>> extents = {
+    {sw + 10, 100},		// within a chunk
+    {cs - 100, 300},		// across a chunk boundary
+    {sw - 50, 100},		// across a stripe boundary
+    {2 * sw - 10, sw - 20},	// over all the chunks of a stripe
+  };
+  for (auto &in : extents) {
+    std::set<int> touched;
+    auto bounds = sinfo.offset_len_to_chunk_bounds(in, &touched);
+    std::map<int, bufferlist> chunks;
+    for (int i : touched) {
+      chunks[i].substr_of(shards[i], bounds.first, bounds.second);
+    }
+    bufferlist out;
+    ECUtil::assemble_extent(sinfo, ec, chunks, bounds.first, in, &out);
+    bufferlist expected;
+    expected.substr_of(data, in.first, in.second);
+    ASSERT_TRUE(expected.contents_equal(out))
+      << in.first << "~" << in.second;
+  }
+
+  // chunks cut short at the end of the shards cut the extent short
+  {
+    std::pair<uint64_t, uint64_t> in(3 * sw - cs - 100, 200);
+    std::set<int> touched;
+    auto bounds = sinfo.offset_len_to_chunk_bounds(in, &touched);
+    ASSERT_EQ(std::set<int>({1, 2}), touched);
+    std::map<int, bufferlist> chunks;
+    for (int i : touched) {
+      chunks[i].substr_of(shards[i], bounds.first,
+			  shards[i].length() - bounds.first - 50);
+    }
+    bufferlist out;
+    ECUtil::assemble_extent(sinfo, ec, chunks, bounds.first, in, &out);
+    bufferlist expected;
+    // chunk 1 is short by 50 bytes of the 100 asked from it
+    expected.substr_of(data, in.first, 50);
+    ASSERT_TRUE(expected.contents_equal(out));
+  }
+}
+
+TEST(ECUtil, decode_extent)
+{
+  ceph::ErasureCodeInterfaceRef ec(new ErasureCodeXor);
+  ECUtil::stripe_info_t sinfo(3, 3 * 4096);
+  const uint64_t sw = sinfo.get_stripe_width();
+  const uint64_t cs = sinfo.get_chunk_size();
+  std::mt19937 rng(3);
+
+  std::set<int> all = {0, 1, 2, 3, 4};
+  bufferlist data = random_bl(rng, 3 * sw);
+  std::map<int, bufferlist> shards;
+  ASSERT_EQ(0, ECUtil::encode(sinfo, ec, data, all, &shards));
+
+  const std::vector<std::pair<uint64_t, uint64_t>> extents = {
+    {sw + cs + 10, 100},	// within the missing chunk
+    {sw + cs - 100, 300},	// half of it missing
+    {sw - 50, 100},		// across a stripe boundary
+  };
+  for (auto &in : extents) {
+    std::set<int> want;
+    sinfo.offset_len_to_chunk_bounds(in, &want);
+    auto bounds = sinfo.aligned_offset_len_to_chunk(
+      sinfo.offset_len_to_stripe_bounds(in));
+    // shard 1 is missing, read the decode set
+    std::map<int, bufferlist> to_decode;
+    for (int i : {0, 2, 3}) {
+      to_decode[i].substr_of(shards[i], bounds.first, bounds.second);
+    }
+    bufferlist out;
+    ASSERT_EQ(0, ECUtil::decode_extent(sinfo, ec, to_decode, want, in, &out));
+    bufferlist expected;
+    expected.substr_of(data, in.first, in.second);
+    ASSERT_TRUE(expected.contents_equal(out))
+      << in.first << "~" << in.second;
+  }
+}
@@ -229,6 +229,8 @@ void usage()
   cout << "   --set-subtree-class <bucket-name> <class>\n";
   cout << "                         set class for all items beneath bucket-name\n";
   cout << "   --compare <otherfile> compare two maps using --test parameters\n";
+  cout << "   --benchmark           report mappings/sec, one at a time and\n";
+  cout << "                         batched, using --test parameters\n";
   cout << "\n";
   cout << "Options for the output stage\n";
   cout << "\n";
@@ -430,6 +432,7 @@ int main(int argc, const char **argv)
   map<string,string> set_subtree_class;     // bucket -> class
 
   string compare;
+  bool benchmark = false;
 
   CrushWrapper crush;
 
@@ -534,6 +537,8 @@ int main(int argc, const char **argv)
       check = true;
     } else if (ceph_argparse_flag(args, i, "-t", "--test", (char*)NULL)) {
       test = true;
+    } else if (ceph_argparse_flag(args, i, "--benchmark", (char*)NULL)) {
+      benchmark = true;
     } else if (ceph_argparse_witharg(args, i, &full_location, err, "--show-location", (char*)NULL)) {
     } else if (ceph_argparse_flag(args, i, "-s", "--simulate", (char*)NULL)) {
       tester.set_random_placement();
@@ -838,7 +843,7 @@ int main(int argc, const char **argv)
       add_item < 0 && !add_bucket && !move_item && !add_rule && !del_rule && full_location < 0 &&
       !bucket_tree &&
       !reclassify && !rebuild_class_roots &&
-      compare.empty() &&
+      compare.empty() && !benchmark &&
 
       remove_name.empty() && reweight_name.empty()) {
     cerr << "no action specified; -h for help" << std::endl;
@@ -1300,6 +1305,12 @@ int main(int argc, const char **argv)
       return EXIT_FAILURE;
   }
 
+  if (benchmark) {
+    int r = tester.benchmark();
+    if (r < 0)
+      return EXIT_FAILURE;
+  }
+
   // output ---
   if (modified) {
     crush.finalize();
@@ -24,7 +24,9 @@
 #include <algorithm>
 
 #include "global/global_init.h"
+#include "common/WorkQueue.h"
 #include "osd/OSDMap.h"
+#include "osd/OSDMapMapping.h"
 
 
 void usage()
@@ -61,6 +63,7 @@ void usage()
   cout << "                           max deviation from target [default: 5]" << std::endl;
   cout << "   --upmap-pool <poolname> restrict upmap balancing to 1 or more pools" << std::endl;
   cout << "   --upmap-active          Act like an active balancer, keep applying changes until balanced" << std::endl;
+  cout << "   --upmap-threads <num>   threads to map pgs with [default: 1]" << std::endl;
   cout << "   --dump <format>         displays the map in plain text when <format> is 'plain', 'json' if specified format is not supported" << std::endl;
   cout << "   --tree                  displays a tree of the map" << std::endl;
   cout << "   --test-crush [--range-first <first> --range-last <last>] map pgs to acting osds" << std::endl;
@@ -154,6 +157,7 @@ int main(int argc, const char **argv)
   int upmap_max = 10;
   int upmap_deviation = 5;
   bool upmap_active = false;
+  int upmap_threads = 1;
   std::set<std::string> upmap_pools;
   int64_t pg_num = -1;
   bool test_map_pgs_dump_all = false;
@@ -185,6 +189,7 @@ int main(int argc, const char **argv)
       upmap = true;
     } else if (ceph_argparse_witharg(args, i, &upmap_max, err, "--upmap-max", (char*)NULL)) {
     } else if (ceph_argparse_witharg(args, i, &upmap_deviation, err, "--upmap-deviation", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &upmap_threads, err, "--upmap-threads", (char*)NULL)) {
     } else if (ceph_argparse_witharg(args, i, &val, "--upmap-pool", (char*)NULL)) {
       upmap_pools.insert(val);
     } else if (ceph_argparse_witharg(args, i, &num_osd, err, "--createsimple", (char*)NULL)) {
@@ -273,6 +278,10 @@ int main(int argc, const char **argv)
     cerr << me << ": too many arguments" << std::endl;
     usage();
   }
+  if (upmap_threads < 1) {
+    cerr << me << ": upmap-threads must be >= 1" << std::endl;
+    usage();
+  }
   if (upmap_deviation < 1) {
     cerr << me << ": upmap-deviation must be >= 1" << std::endl;
     usage();
@@ -467,6 +476,14 @@ int main(int argc, const char **argv)
       cout << "No pools available" << std::endl;
       goto skip_upmap;
     }
+    std::unique_ptr<ThreadPool> tp;
+    std::unique_ptr<ParallelPGMapper> mapper;
+    if (upmap_threads > 1) {
+      tp.reset(new ThreadPool(g_ceph_context, "osdmaptool::upmap_tp",
+			      "upmap_tp", upmap_threads));
+      tp->start();
+      mapper.reset(new ParallelPGMapper(g_ceph_context, tp.get()));
+    }
     int rounds = 0;
     struct timespec round_start;
     int r = clock_gettime(CLOCK_MONOTONIC, &round_start);
@@ -491,7 +508,7 @@ int main(int argc, const char **argv)
         int did = osdmap.calc_pg_upmaps(
           g_ceph_context, upmap_deviation,
           left, one_pool,
-          &pending_inc);
+          &pending_inc, mapper.get());
         total_did += did;
         left -= did;
         if (left <= 0)
@@ -540,6 +557,9 @@ int main(int argc, const char **argv)
       }
       ++rounds;
     } while(upmap_active);
+    if (tp) {
+      tp->stop();
+    }
   }
 skip_upmap:
   if (upmap_file != "-") {